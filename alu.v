@@ -0,0 +1,101 @@
+/*
+ * ALU of the CPU. It is purely combinational and has no state of its own, so
+ * besides being part of cpu.v it can be verilated on its own to test it against
+ * the emulator (see test_instructions/alu_lanes.v).
+ */
+module alu (
+    input [4:0] op,
+    input is_16bit,
+    input [15:0] in1,
+    input [15:0] in2,
+    input [3:0] flags_in, // {Z, N, H, C}
+
+    output [15:0] out,
+    output [3:0] flags_out
+);
+
+/* Operations the ALU can perform, same as in cpu.v. */
+localparam ALU_NOP  = 0,
+           ALU_ADD  = 1,
+           ALU_ADC  = 2,
+           ALU_SUB  = 3,
+           ALU_SBC  = 4,
+           ALU_AND  = 5,
+           ALU_XOR  = 6,
+           ALU_OR   = 7,
+           ALU_RLC  = 8,
+           ALU_RRC  = 9,
+           ALU_RL   = 10,
+           ALU_RR   = 11,
+           ALU_SLA  = 12,
+           ALU_SRA  = 13,
+           ALU_SWAP = 14,
+           ALU_SRL  = 15,
+           ALU_DAA  = 16;
+
+/* verilator lint_off UNUSED */
+wire Z = flags_in[3];
+/* verilator lint_on UNUSED */
+wire N = flags_in[2];
+wire H = flags_in[1];
+wire C = flags_in[0];
+
+reg [16:0] alu_out; // 16 bit + 1 bit for capturing carry
+wire alu_out_Z, alu_out_N, alu_out_H;
+reg alu_out_C;
+wire [7:0] alu_daa_add;
+
+always @(*)
+    case (op)
+        ALU_NOP:  begin alu_out = {1'b0, in1}; end
+        ALU_ADD:  begin alu_out = {1'b0, in1} + {1'b0, in2}; end
+        ALU_ADC:  begin alu_out = {1'b0, in1} + {1'b0, in2} + {16'b0, C}; end
+        ALU_SUB:  begin alu_out = {1'b0, in1} - {1'b0, in2}; end
+        ALU_SBC:  begin alu_out = {1'b0, in1} - {1'b0, in2} - {16'b0, C}; end
+        ALU_AND:  begin alu_out = {1'b0, in1} & {1'b0, in2}; end
+        ALU_XOR:  begin alu_out = {1'b0, in1} ^ {1'b0, in2}; end
+        ALU_OR:   begin alu_out = {1'b0, in1} | {1'b0, in2}; end
+        ALU_RLC:  begin alu_out = {9'b0, in1[6:0], in1[7]}; end
+        ALU_RRC:  begin alu_out = {9'b0, in1[0], in1[7:1]}; end
+        ALU_RL:   begin alu_out = {9'b0, in1[6:0], C}; end
+        ALU_RR:   begin alu_out = {9'b0, C, in1[7:1]}; end
+        ALU_SLA:  begin alu_out = {9'b0, in1[6:0], 1'b0}; end
+        ALU_SRA:  begin alu_out = {9'b0, in1[7], in1[7:1]}; end
+        ALU_SWAP: begin alu_out = {9'b0, in1[3:0], in1[7:4]}; end
+        ALU_SRL:  begin alu_out = {9'b0, 1'b0, in1[7:1]}; end
+        ALU_DAA:  begin alu_out = {9'b0, in1[7:0] + (N ? -alu_daa_add : alu_daa_add)}; end
+        default:  alu_out = 17'hFFFF;
+    endcase
+
+assign alu_daa_add = ((H || (!N && (in1 & 'h0f) > 'h09)) ? 8'h06 : 0) |
+                     ((C || (!N && (in1 & 'hff) > 'h99)) ? 8'h60 : 0);
+
+assign alu_out_Z = is_16bit ? (alu_out[15:0] == 16'h0000) :
+                              (alu_out[7:0] == 8'h00);
+assign alu_out_N = op == ALU_SUB || op == ALU_SBC;
+assign alu_out_H = op == ALU_AND ||
+                   ((op == ALU_ADD || op == ALU_ADC ||
+                     op == ALU_SUB || op == ALU_SBC) &&
+                    (is_16bit ? in1[12] ^ in2[12] ^ alu_out[12]
+                              : in1[4] ^ in2[4] ^ alu_out[4]));
+always @(*)
+    case (op)
+        ALU_ADD, ALU_ADC, ALU_SUB, ALU_SBC:
+            alu_out_C = is_16bit ? alu_out[16] :
+                            (in1[8] ^ in2[8] ^ alu_out[8]);
+        ALU_RLC, ALU_RL,
+        ALU_SLA:
+            alu_out_C = in1[7];
+        ALU_RRC, ALU_RR,
+        ALU_SRA, ALU_SRL:
+            alu_out_C = in1[0];
+        ALU_DAA:
+            alu_out_C = C || (!N && (in1 & 'hff) > 'h99);
+        default:
+            alu_out_C = 0;
+    endcase
+
+assign out = alu_out[15:0];
+assign flags_out = {alu_out_Z, alu_out_N, alu_out_H, alu_out_C};
+
+endmodule
@@ -0,0 +1,463 @@
+/*
+ * Simulation of the whole board (syn_top.v, built by `make board`): the FPGA
+ * design as it is synthesized, with a model of the ILI9341 display
+ * (ili9341.h) on the TFT pins, to see how the PPU output gets to the panel
+ * without the hardware. It measures:
+ *
+ *  - the bandwidth used on the display bus;
+ *  - per PPU frame, how long writing it to GRAM takes and how long after the
+ *    PPU put out its last pixel it is complete there;
+ *  - per panel refresh, whether it shows more than one PPU frame (tearing),
+ *    from which panel row, and where the PPU was in its frame relative to
+ *    vblank when the refresh started.
+ *
+ * Every pixel written to GRAM is checked against the one the PPU put out
+ * (lcd_x/lcd_y/lcd_col of main.v), in color and place.
+ *
+ * The ROM is the one cart.v has (roms/build/obj.hex), as on the board. The
+ * PLL is passed through (ice40_sim.v), so device_clk is driven at its output
+ * frequency.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <vector>
+
+#include <unistd.h>
+
+#include "Vsyn_top.h"
+#include "verilated.h"
+#include "ili9341.h"
+
+/* Output of the PLL (see pll.v), the clock of tft.v. The PPU runs at a
+ * quarter of it. */
+#define BOARD_CLK_HZ 16875000.0
+
+#define PPU_CLKS_PER_LINE (456 * 4)
+#define PPU_LINES 154
+#define PPU_VBLANK_LINE 144
+
+/* tft.v writes a byte every other clock at most. */
+#define CLKS_PER_WRITE 2
+
+#define TEAR_ROW_BUCKET 32
+#define PPU_LINE_BUCKET 14
+
+#define BAR_WIDTH 40
+
+/* RGB565 colors tft.v sends for the 2-bit PPU colors. */
+static const uint16_t tft_colors[4] = { 0xffff, 0xad55, 0x632c, 0x1082 };
+
+class Board
+{
+public:
+    Vsyn_top *top;
+    Ili9341 ili;
+    uint64_t t;
+
+    /* Save the panel after every refresh as <prefix>-NNNNN.ppm. */
+    const char *ppm_prefix;
+
+    Board();
+    ~Board();
+
+    /* A clock cycle of the board. */
+    void step();
+
+    /* PPU frames that ended. */
+    size_t frames_done() const { return frames.size() - 1; }
+
+    /* Totals and histograms, then (if details) a line per frame and per
+     * refresh. */
+    void write(FILE *fp, bool details) const;
+
+private:
+    /* A pixel the PPU put out, on its way to GRAM. */
+    struct Pixel {
+        uint64_t t;
+        size_t frame;
+        uint8_t x, y, col;
+    };
+
+    /* A frame of the PPU, ended by vblank. */
+    struct Frame {
+        uint64_t vblank;                  // Start of the vblank ending it
+        uint64_t last_pixel;              // Last pixel put out by the PPU
+        uint64_t first_write, last_write; // First and last pixel in GRAM
+        uint64_t max_latency;             // Longest a pixel took to GRAM
+        uint64_t pixels, written, wrong_color, misplaced;
+        uint64_t bus_writes;              // Display bus writes while drawn
+    };
+
+    /* A refresh of the panel. */
+    struct Refresh {
+        uint64_t start, end;
+        int ppu_line;                     // At the start, -1 if unknown
+        int32_t frame_min, frame_max;     // PPU frames shown (tags of ili)
+        int tear_row;
+    };
+
+    std::deque<Pixel> pending;
+    std::vector<Frame> frames;
+    std::vector<Refresh> refreshes;
+    uint64_t other_pixels;
+    uint64_t frame_writes;
+    bool clk4_old, vblank_old;
+
+    uint64_t bus_writes() const;
+    void ppu_cycle();
+    void gram_pixel();
+    void panel_refresh();
+};
+
+Board::Board()
+    : ili(BOARD_CLK_HZ), t(0), ppm_prefix(NULL), other_pixels(0),
+      frame_writes(0), clk4_old(0), vblank_old(0)
+{
+    top = new Vsyn_top;
+    frames.push_back(Frame());
+}
+
+Board::~Board()
+{
+    top->final();
+    delete top;
+}
+
+uint64_t Board::bus_writes() const
+{
+    return ili.writes_cmd + ili.writes_param + ili.writes_pixel;
+}
+
+void Board::step()
+{
+    top->device_clk = 1;
+    top->eval();
+    t++;
+
+    bool clk4 = top->syn_top__DOT__clk_4mhz;
+    if (clk4 && !clk4_old)
+        ppu_cycle();
+    clk4_old = clk4;
+
+    uint8_t data = top->P1B1 | top->P1B2 << 1 | top->P1B3 << 2 |
+                   top->P1B4 << 3 | top->P1B7 << 4 | top->P1B8 << 5 |
+                   top->P1B9 << 6 | top->P1B10 << 7;
+    int ev = ili.edge(t, top->P1A7, top->P1A1, top->P1A2, top->P1A3,
+                      top->P1A4, data);
+    if (ev & ILI9341_EV_PIXEL)
+        gram_pixel();
+    if (ev & ILI9341_EV_REFRESH)
+        panel_refresh();
+
+    top->device_clk = 0;
+    top->eval();
+}
+
+/* After a rising edge of the PPU's clock. */
+void Board::ppu_cycle()
+{
+    if (top->syn_top__DOT__lcd_write) {
+        Frame &f = frames.back();
+        f.pixels++;
+        f.last_pixel = t;
+        pending.push_back({ t, frames.size() - 1, top->syn_top__DOT__lcd_x,
+                            top->syn_top__DOT__lcd_y,
+                            top->syn_top__DOT__lcd_col });
+    }
+
+    bool vblank = top->syn_top__DOT__lcd_vblank;
+    if (vblank && !vblank_old && frames.back().pixels) {
+        /* Frames without pixels (LCD off) are left out. */
+        Frame &f = frames.back();
+        f.vblank = t;
+        f.bus_writes = bus_writes() - frame_writes;
+        frame_writes = bus_writes();
+        frames.push_back(Frame());
+    }
+    vblank_old = vblank;
+}
+
+/* Matches a pixel written to GRAM with the oldest one the PPU put out. */
+void Board::gram_pixel()
+{
+    if (pending.empty()) {
+        /* Not from the PPU, e.g. clearing the display. */
+        other_pixels++;
+        ili.tag[ili.pixel_y][ili.pixel_x] = -1;
+        return;
+    }
+
+    Pixel p = pending.front();
+    pending.pop_front();
+
+    Frame &f = frames[p.frame];
+    if (!f.written)
+        f.first_write = t;
+    f.written++;
+    f.last_write = t;
+    if (t - p.t > f.max_latency)
+        f.max_latency = t - p.t;
+    if (ili.pixel_color != tft_colors[p.col])
+        f.wrong_color++;
+    if (ili.pixel_col != ili.col_start + p.x ||
+        ili.pixel_page != ili.page_start + p.y)
+        f.misplaced++;
+    ili.tag[ili.pixel_y][ili.pixel_x] = p.frame;
+}
+
+void Board::panel_refresh()
+{
+    Refresh r;
+
+    r.start = ili.refresh.start;
+    r.end = ili.refresh.end;
+    r.frame_min = ili.refresh.tag_min;
+    r.frame_max = ili.refresh.tag_max;
+    r.tear_row = ili.refresh.tear_row;
+
+    /* Lines since the last vblank before it. */
+    r.ppu_line = -1;
+    for (size_t n = frames_done(); n-- > 0; ) {
+        if (frames[n].vblank <= r.start) {
+            r.ppu_line = (PPU_VBLANK_LINE + (r.start - frames[n].vblank) /
+                          PPU_CLKS_PER_LINE) % PPU_LINES;
+            break;
+        }
+    }
+    refreshes.push_back(r);
+
+    if (ppm_prefix) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s-%05zu.ppm", ppm_prefix,
+                 refreshes.size() - 1);
+        ili.save_panel(path);
+    }
+}
+
+static double us(uint64_t clks)
+{
+    return clks * 1e6 / BOARD_CLK_HZ;
+}
+
+static void print_bar(FILE *fp, unsigned n, unsigned max)
+{
+    int len = max ? (n * BAR_WIDTH + max - 1) / max : 0;
+    fprintf(fp, "%10u  %.*s\n", n, len,
+            "########################################");
+}
+
+static void print_hist(FILE *fp, const std::vector<unsigned> &hist,
+                       unsigned bucket)
+{
+    unsigned max = 0;
+
+    for (unsigned n : hist)
+        max = n > max ? n : max;
+    for (size_t i = 0; i < hist.size(); i++) {
+        if (!hist[i])
+            continue;
+        fprintf(fp, "%3zu-%-3zu", i * bucket, (i + 1) * bucket - 1);
+        print_bar(fp, hist[i], max);
+    }
+}
+
+void Board::write(FILE *fp, bool details) const
+{
+    double secs = t / BOARD_CLK_HZ;
+    uint64_t writes = bus_writes();
+
+    fprintf(fp, "%.3f s of board time, %zu PPU frames, %zu panel refreshes "
+            "(%.2f Hz)\n", secs, frames_done(), refreshes.size(),
+            ili.refresh_rate());
+
+    fprintf(fp, "\ndisplay bus: %llu writes (%llu commands, %llu parameters, "
+            "%llu pixel data), %llu too fast, %llu commands < 5 ms after "
+            "sleep out\n",
+            (unsigned long long)writes, (unsigned long long)ili.writes_cmd,
+            (unsigned long long)ili.writes_param,
+            (unsigned long long)ili.writes_pixel,
+            (unsigned long long)ili.timing_violations,
+            (unsigned long long)ili.early_cmds);
+
+    /* Bandwidth while frames were drawn, the first one (starting with the
+     * display initialization) left out. */
+    uint64_t frame_clks = 0, frame_bus = 0;
+    for (size_t n = 1; n < frames_done(); n++) {
+        frame_clks += frames[n].vblank - frames[n - 1].vblank;
+        frame_bus += frames[n].bus_writes;
+    }
+    double max_rate = BOARD_CLK_HZ / CLKS_PER_WRITE;
+    if (frame_clks) {
+        double rate = frame_bus * BOARD_CLK_HZ / frame_clks;
+        fprintf(fp, "  %.0f bytes per frame, %.3f MB/s, %.1f%% of the "
+                "%.3f MB/s of tft.v\n",
+                (double)frame_bus / (frames_done() - 1), rate / 1e6,
+                rate * 100 / max_rate, max_rate / 1e6);
+    }
+
+    uint64_t pixels = 0, written = 0, wrong = 0, misplaced = 0;
+    uint64_t span_min = UINT64_MAX, span_max = 0, span_sum = 0;
+    uint64_t lat_min = UINT64_MAX, lat_max = 0, lat_sum = 0, pix_lat = 0;
+    size_t complete = 0;
+    for (size_t n = 0; n < frames_done(); n++) {
+        const Frame &f = frames[n];
+        pixels += f.pixels;
+        written += f.written;
+        wrong += f.wrong_color;
+        misplaced += f.misplaced;
+        pix_lat = f.max_latency > pix_lat ? f.max_latency : pix_lat;
+        if (f.written != f.pixels)
+            continue;
+        uint64_t span = f.last_write - f.first_write;
+        uint64_t lat = f.last_write - f.last_pixel;
+        span_min = span < span_min ? span : span_min;
+        span_max = span > span_max ? span : span_max;
+        span_sum += span;
+        lat_min = lat < lat_min ? lat : lat_min;
+        lat_max = lat > lat_max ? lat : lat_max;
+        lat_sum += lat;
+        complete++;
+    }
+
+    fprintf(fp, "\nPPU pixels: %llu put out, %llu written to GRAM (%llu wrong "
+            "color, %llu misplaced), %zu pending; %llu other pixels written\n",
+            (unsigned long long)pixels, (unsigned long long)written,
+            (unsigned long long)wrong, (unsigned long long)misplaced,
+            pending.size(), (unsigned long long)other_pixels);
+    if (complete) {
+        fprintf(fp, "frame writes: %.2f-%.2f ms, %.2f on average; complete "
+                "%.2f-%.2f us after the PPU's last pixel\n"
+                "pixel latency: %.2f us at most\n",
+                us(span_min) / 1e3, us(span_max) / 1e3,
+                us(span_sum) / 1e3 / complete, us(lat_min), us(lat_max),
+                us(pix_lat));
+    }
+
+    std::vector<unsigned> tear_hist((ILI9341_HEIGHT + TEAR_ROW_BUCKET - 1) /
+                                    TEAR_ROW_BUCKET);
+    std::vector<unsigned> line_hist((PPU_LINES + PPU_LINE_BUCKET - 1) /
+                                    PPU_LINE_BUCKET);
+    size_t shown = 0, torn = 0;
+    for (const Refresh &r : refreshes) {
+        if (r.frame_min > r.frame_max)
+            continue;
+        shown++;
+        if (r.ppu_line >= 0)
+            line_hist[r.ppu_line / PPU_LINE_BUCKET]++;
+        if (r.tear_row >= 0) {
+            torn++;
+            tear_hist[r.tear_row / TEAR_ROW_BUCKET]++;
+        }
+    }
+    fprintf(fp, "\nrefreshes showing PPU frames: %zu, %zu torn (%.1f%%)\n",
+            shown, torn, shown ? torn * 100.0 / shown : 0);
+    if (torn) {
+        fprintf(fp, "\ntear row           refreshes\n");
+        print_hist(fp, tear_hist, TEAR_ROW_BUCKET);
+    }
+    if (shown) {
+        fprintf(fp, "\nPPU line at start  refreshes (vblank from %d)\n",
+                PPU_VBLANK_LINE);
+        print_hist(fp, line_hist, PPU_LINE_BUCKET);
+    }
+
+    if (!details)
+        return;
+
+    fprintf(fp, "\nframe        vblank  pixels  written  wrong  misplaced  "
+            "write ms  latency us  max pixel us  bus writes\n");
+    for (size_t n = 0; n < frames_done(); n++) {
+        const Frame &f = frames[n];
+        fprintf(fp, "%5zu  %12llu  %6llu  %7llu  %5llu  %9llu  %8.3f  "
+                "%10.2f  %12.2f  %10llu\n",
+                n, (unsigned long long)f.vblank,
+                (unsigned long long)f.pixels, (unsigned long long)f.written,
+                (unsigned long long)f.wrong_color,
+                (unsigned long long)f.misplaced,
+                f.written ? us(f.last_write - f.first_write) / 1e3 : 0,
+                f.written ? us(f.last_write) - us(f.last_pixel) : 0,
+                us(f.max_latency), (unsigned long long)f.bus_writes);
+    }
+
+    fprintf(fp, "\nrefresh         start  PPU line  frames  tear row\n");
+    for (size_t n = 0; n < refreshes.size(); n++) {
+        const Refresh &r = refreshes[n];
+        fprintf(fp, "%7zu  %12llu  %8d  ", n, (unsigned long long)r.start,
+                r.ppu_line);
+        if (r.frame_min > r.frame_max)
+            fprintf(fp, "%6s", "-");
+        else if (r.frame_min == r.frame_max)
+            fprintf(fp, "%6d", r.frame_min);
+        else
+            fprintf(fp, "%3d-%-2d", r.frame_min, r.frame_max);
+        fprintf(fp, "  %8d\n", r.tear_row);
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-n frames] [-c clocks] [-F prefix] [-r file]\n"
+            "  -n   Run until the PPU finished this many frames (default 60)\n"
+            "  -c   Stop after this many board clocks at most\n"
+            "  -F   Save the panel after every refresh as "
+            "prefix-NNNNN.ppm\n"
+            "  -r   Write the measurements with a line per frame and per "
+            "refresh to file\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned frames = 60;
+    uint64_t max_clks = 0;
+    const char *ppm_prefix = NULL;
+    const char *report_file = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:c:F:r:h")) != -1) {
+        switch (opt) {
+        case 'n': frames = strtoul(optarg, NULL, 0); break;
+        case 'c': max_clks = strtoull(optarg, NULL, 0); break;
+        case 'F': ppm_prefix = optarg; break;
+        case 'r': report_file = optarg; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    /* Initializing the display takes some 0.2 s, then the frames with some
+     * slack. */
+    if (!max_clks)
+        max_clks = (uint64_t)((0.5 + (frames + 10) / 59.7) * BOARD_CLK_HZ);
+
+    Board *board = new Board;
+    board->ppm_prefix = ppm_prefix;
+
+    while (board->frames_done() < frames && board->t < max_clks &&
+           !Verilated::gotFinish())
+        board->step();
+    if (board->frames_done() < frames)
+        printf("Stopped after %llu clocks with %zu of %u frames\n",
+               (unsigned long long)board->t, board->frames_done(), frames);
+
+    board->write(stdout, 0);
+    if (report_file) {
+        FILE *fp = fopen(report_file, "w");
+        if (!fp) {
+            perror(report_file);
+            delete board;
+            return 1;
+        }
+        board->write(fp, 1);
+        fclose(fp);
+    }
+
+    delete board;
+    return 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * CPU accesses to VRAM and OAM, see contention.h.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "contention.h"
+
+/* Lines summed up per heatmap column. */
+#define HEAT_LINES_PER_COL 2
+#define HEAT_COLS ((HEAT_LINES + HEAT_LINES_PER_COL - 1) / HEAT_LINES_PER_COL)
+
+/* Blocked accesses listed by code. */
+#define MAX_BLOCKED_LOCS 20
+
+static const char *const mode_names[5] = {
+    "hblank", "vblank", "oam", "pixel", "lcd off"
+};
+
+static const char *const region_names[Contention::NUM_REGIONS] = {
+    "VRAM", "OAM", "other"
+};
+
+Contention::Contention()
+    : enabled(0)
+{
+    clear();
+}
+
+void Contention::clear()
+{
+    frames.clear();
+    memset(&cur, 0, sizeof(cur));
+    memset(heat, 0, sizeof(heat));
+    memset(heat_blocked, 0, sizeof(heat_blocked));
+    blocked_by_loc.clear();
+}
+
+void Contention::frame_end(uint64_t cycle)
+{
+    cur.cycle = cycle;
+    frames.push_back(cur);
+    memset(&cur, 0, sizeof(cur));
+}
+
+void Contention::add(Frame &sum, const Frame &f)
+{
+    for (int r = 0; r < NUM_REGIONS; r++)
+        for (int w = 0; w < 2; w++)
+            for (int m = 0; m < 5; m++) {
+                sum.accesses[r][w][m] += f.accesses[r][w][m];
+                sum.blocked[r][w][m] += f.blocked[r][w][m];
+            }
+    sum.dma_cycles += f.dma_cycles;
+    sum.dma_blocked += f.dma_blocked;
+}
+
+/* Sum over the modes of counts[region][write][mode]. */
+static unsigned sum_modes(const uint32_t counts[][2][5], int region, int write)
+{
+    unsigned n = 0;
+    for (int m = 0; m < 5; m++)
+        n += counts[region][write][m];
+    return n;
+}
+
+static void write_table(FILE *fp, const char *what, const uint32_t counts[][2][5])
+{
+    fprintf(fp, "%-12s", what);
+    for (int m = 0; m < 5; m++)
+        fprintf(fp, "  %9s", mode_names[m]);
+    fprintf(fp, "\n");
+    for (int r = 0; r < Contention::NUM_REGIONS; r++)
+        for (int w = 0; w < 2; w++) {
+            if (!sum_modes(counts, r, w))
+                continue;
+            fprintf(fp, "%-5s %-6s", region_names[r], w ? "writes" : "reads");
+            for (int m = 0; m < 5; m++)
+                fprintf(fp, "  %9u", counts[r][w][m]);
+            fprintf(fp, "\n");
+        }
+}
+
+/* One character per HEAT_LINES_PER_COL lines, from ' ' for none up to '@'
+ * for the most of the map. */
+void Contention::write_heatmap(FILE *fp, const uint32_t map[][HEAT_LINES])
+{
+    static const char ramp[] = " .:-=+*#%@";
+    uint32_t cols[HEAT_PAGES][HEAT_COLS];
+    uint32_t max = 0;
+    char ruler[HEAT_COLS + 8];
+
+    memset(cols, 0, sizeof(cols));
+    for (int p = 0; p < HEAT_PAGES; p++)
+        for (int y = 0; y < HEAT_LINES; y++) {
+            uint32_t &c = cols[p][y / HEAT_LINES_PER_COL];
+            c += map[p][y];
+            max = c > max ? c : max;
+        }
+
+    /* Line numbers every 20 lines. */
+    memset(ruler, ' ', sizeof(ruler));
+    for (int y = 0; y < HEAT_LINES; y += 20) {
+        char num[4];
+        int len = snprintf(num, sizeof(num), "%d", y);
+        memcpy(ruler + y / HEAT_LINES_PER_COL, num, len);
+    }
+    ruler[HEAT_COLS] = 0;
+    fprintf(fp, "line  %s\n", ruler);
+
+    for (int p = 0; p < HEAT_PAGES; p++) {
+        fprintf(fp, "%04x |", p == HEAT_PAGES - 1 ? 0xfe00 : 0x8000 + p * 0x100);
+        for (int i = 0; i < HEAT_COLS; i++)
+            fputc(cols[p][i] ? ramp[1 + (uint64_t)(cols[p][i] - 1) *
+                                        (sizeof(ramp) - 2) / max]
+                             : ' ', fp);
+        fprintf(fp, "|\n");
+    }
+    fprintf(fp, "(%d lines per column, '@' = %u accesses)\n",
+            HEAT_LINES_PER_COL, max);
+}
+
+void Contention::write(FILE *fp, const Symbols &syms) const
+{
+    Frame total;
+    unsigned accesses = 0, blocked = 0;
+
+    memset(&total, 0, sizeof(total));
+    for (const Frame &f : frames)
+        add(total, f);
+    add(total, cur);
+    for (int r = 0; r < NUM_REGIONS; r++)
+        for (int w = 0; w < 2; w++) {
+            if (r != OTHER)
+                accesses += sum_modes(total.accesses, r, w);
+            blocked += sum_modes(total.blocked, r, w);
+        }
+
+    fprintf(fp, "%zu frames, %u CPU accesses to VRAM/OAM, %u accesses "
+            "blocked\n", frames.size(), accesses, blocked);
+    fprintf(fp, "OAM DMA: %u cycles owning the bus", total.dma_cycles);
+    if (!frames.empty())
+        fprintf(fp, " (%.1f per frame)",
+                (double)total.dma_cycles / frames.size());
+    fprintf(fp, ", %u CPU accesses blocked\n\n", total.dma_blocked);
+
+    write_table(fp, "accesses", total.accesses);
+    if (blocked) {
+        fprintf(fp, "\n");
+        write_table(fp, "blocked", total.blocked);
+    }
+
+    fprintf(fp, "\nframe         cycle  vram r/w       oam r/w    blocked  "
+            "dma cycles  dma blocked\n");
+    for (size_t n = 0; n < frames.size(); n++) {
+        const Frame &f = frames[n];
+        unsigned fb = 0;
+        for (int r = 0; r < NUM_REGIONS; r++)
+            fb += sum_modes(f.blocked, r, 0) + sum_modes(f.blocked, r, 1);
+        fprintf(fp, "%5zu  %12llu  %5u/%-5u  %5u/%-5u  %9u  %10u  %11u\n",
+                n, (unsigned long long)f.cycle,
+                sum_modes(f.accesses, VRAM, 0), sum_modes(f.accesses, VRAM, 1),
+                sum_modes(f.accesses, OAM, 0), sum_modes(f.accesses, OAM, 1),
+                fb, f.dma_cycles, f.dma_blocked);
+    }
+
+    if (!accesses)
+        return;
+    fprintf(fp, "\nAccesses by page and line:\n");
+    write_heatmap(fp, heat);
+    if (blocked != total.dma_blocked) {
+        fprintf(fp, "\nBlocked accesses by page and line:\n");
+        write_heatmap(fp, heat_blocked);
+    }
+
+    if (!blocked)
+        return;
+    std::vector<std::pair<uint32_t, uint64_t>> locs(blocked_by_loc.begin(),
+                                                     blocked_by_loc.end());
+    std::stable_sort(locs.begin(), locs.end(),
+                     [](const std::pair<uint32_t, uint64_t> &a,
+                        const std::pair<uint32_t, uint64_t> &b) {
+                         return a.second > b.second ||
+                                (a.second == b.second && a.first < b.first);
+                     });
+    fprintf(fp, "\n   blocked  address  symbol\n");
+    for (size_t i = 0; i < locs.size() && i < MAX_BLOCKED_LOCS; i++)
+        fprintf(fp, "%10llu  %02x:%04x  %s\n",
+                (unsigned long long)locs[i].second, LOC_BANK(locs[i].first),
+                LOC_ADDR(locs[i].first), syms.name(locs[i].first, 1).c_str());
+    if (locs.size() > MAX_BLOCKED_LOCS)
+        fprintf(fp, "... and %zu more\n", locs.size() - MAX_BLOCKED_LOCS);
+}
@@ -0,0 +1,97 @@
+/*
+ * CPU accesses to VRAM and OAM for gbsim.cpp (see gbsim_contention_enable):
+ * how many happen in which LCD mode, how many of them ppu.v or OAM DMA
+ * blocked, where in memory and in the frame they happen, and which guest code
+ * does them.
+ *
+ * An access is blocked when the CPU does not get the bus it is after: VRAM
+ * while the PPU fetches pixels or objects (reads return garbage, writes are
+ * dropped), OAM during OAM search or object fetches, and anything but HRAM
+ * while OAM DMA owns the bus.
+ */
+
+#ifndef CONTENTION_H
+#define CONTENTION_H
+
+#include <cstdint>
+#include <cstdio>
+#include <unordered_map>
+#include <vector>
+
+#include "symbols.h"
+
+/* Heatmap rows: the 32 pages of VRAM, then OAM. */
+#define HEAT_PAGES 33
+#define HEAT_LINES 154
+
+class Contention
+{
+public:
+    enum Region { VRAM, OAM, OTHER, NUM_REGIONS };
+    enum Block { NOT_BLOCKED, BLOCKED_PPU, BLOCKED_DMA };
+
+    bool enabled;
+
+    Contention();
+
+    void clear();
+
+    /* The CPU read or wrote addr in LCD mode (4 if off) on line ly, from the
+     * code at loc. */
+    inline void access(uint16_t addr, bool write, uint8_t mode, uint8_t ly,
+                       Block block, uint32_t loc)
+    {
+        Region region = addr >= 0x8000 && addr < 0xa000 ? VRAM :
+                        addr >= 0xfe00 && addr < 0xfea0 ? OAM : OTHER;
+
+        if (region == OTHER && block == NOT_BLOCKED)
+            return;
+        cur.accesses[region][write][mode]++;
+        if (block) {
+            cur.blocked[region][write][mode]++;
+            if (block == BLOCKED_DMA)
+                cur.dma_blocked++;
+            blocked_by_loc[loc]++;
+        }
+        if (region != OTHER && ly < HEAT_LINES) {
+            int page = region == VRAM ? (addr - 0x8000) >> 8 : HEAT_PAGES - 1;
+            heat[page][ly]++;
+            if (block)
+                heat_blocked[page][ly]++;
+        }
+    }
+
+    /* OAM DMA owned the bus for a cycle. */
+    inline void dma_cycle()
+    {
+        cur.dma_cycles++;
+    }
+
+    /* The LCD entered vblank at the given cycle, ending the frame. */
+    void frame_end(uint64_t cycle);
+
+    /* Accesses by region and LCD mode, OAM DMA, a line per frame, heatmaps
+     * of all and of blocked accesses by page and line, and the code doing
+     * blocked accesses. */
+    void write(FILE *fp, const Symbols &syms) const;
+
+private:
+    struct Frame {
+        uint64_t cycle;
+        uint32_t accesses[NUM_REGIONS][2][5];   // [region][write][mode]
+        uint32_t blocked[NUM_REGIONS][2][5];
+        uint32_t dma_cycles, dma_blocked;
+    };
+
+    std::vector<Frame> frames;
+    Frame cur;
+
+    uint32_t heat[HEAT_PAGES][HEAT_LINES];
+    uint32_t heat_blocked[HEAT_PAGES][HEAT_LINES];
+    std::unordered_map<uint32_t, uint64_t> blocked_by_loc;
+
+    static void add(Frame &sum, const Frame &f);
+    static void write_heatmap(FILE *fp, const uint32_t map[][HEAT_LINES]);
+};
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ * Guest code coverage, see coverage.h.
+ */
+
+#include "coverage.h"
+
+extern "C" {
+#include "disassembler.h"
+}
+
+Coverage::Coverage()
+    : enabled(0), rom_size(0)
+{
+    for (int op = 0; op < 256; op++) {
+        u8 inst[2] = { (u8)op, 0 };
+        length[op] = disassemble_length(inst);
+    }
+    clear(0);
+}
+
+void Coverage::clear(size_t size)
+{
+    rom_size = size;
+    rom.assign((size + 7) / 8, 0);
+    ram.assign(0x8000 / 8, 0);
+    restart(0, 0, 0);
+}
+
+void Coverage::restart(uint16_t pc, uint8_t bank, bool bootrom)
+{
+    cur_pc = pc;
+    cur_bank = bank;
+    cur_bootrom = bootrom && pc < 0x100;
+}
+
+bool Coverage::executed(uint32_t loc) const
+{
+    uint16_t addr = LOC_ADDR(loc);
+
+    if (addr >= 0x8000)
+        return (ram[(addr - 0x8000) >> 3] >> (addr & 7)) & 1;
+    size_t offset = addr < 0x4000 ? addr :
+                    (size_t)LOC_BANK(loc) * 0x4000 + addr - 0x4000;
+    return offset < rom_size && ((rom[offset >> 3] >> (offset & 7)) & 1);
+}
+
+size_t Coverage::count(uint32_t start, uint32_t end) const
+{
+    size_t n = 0;
+    for (uint32_t loc = start; loc < end; loc++)
+        n += executed(loc);
+    return n;
+}
+
+/* Location of a byte of the ROM image. */
+static uint32_t rom_loc(size_t offset)
+{
+    if (offset < 0x4000)
+        return offset;
+    return LOC(offset / 0x4000, 0x4000 + offset % 0x4000);
+}
+
+static void print_row(FILE *fp, size_t executed, size_t size)
+{
+    fprintf(fp, "%9zu  %9zu  %5.1f%%  ", executed, size,
+            size ? 100.0 * executed / size : 0.0);
+}
+
+void Coverage::write(FILE *fp, const Symbols &syms) const
+{
+    size_t rom_executed = 0, ram_executed = 0;
+
+    for (size_t i = 0; i < rom_size; i++)
+        rom_executed += executed(rom_loc(i));
+    ram_executed = count(0x8000, 0x10000);
+
+    fprintf(fp, "%zu of %zu ROM bytes executed", rom_executed, rom_size);
+    if (rom_size)
+        fprintf(fp, " (%.1f%%)", 100.0 * rom_executed / rom_size);
+    fprintf(fp, ", %zu bytes in RAM\n", ram_executed);
+
+    if (!syms.sections.empty()) {
+        fprintf(fp, "\n executed       size       %%  section\n");
+        for (const Symbols::Section &sec : syms.sections) {
+            size_t n = count(sec.start, sec.end + 1);
+            if (LOC_ADDR(sec.start) >= 0x8000 && !n)
+                continue;
+            print_row(fp, n, sec.end + 1 - sec.start);
+            fprintf(fp, "%02x:%04x-%04x  %s\n", LOC_BANK(sec.start),
+                    LOC_ADDR(sec.start), LOC_ADDR(sec.end), sec.name.c_str());
+        }
+    }
+
+    /* Labels, each followed by what of it was not executed (if any was). */
+    if (!syms.symbols.empty()) {
+        fprintf(fp, "\n executed       size       %%  label\n");
+        for (const Symbols::Symbol &sym : syms.symbols) {
+            uint32_t end = syms.end(&sym);
+            size_t n = count(sym.loc, end);
+            if (end == sym.loc || (LOC_ADDR(sym.loc) >= 0x8000 && !n))
+                continue;
+            print_row(fp, n, end - sym.loc);
+            fprintf(fp, "%02x:%04x  %s\n", LOC_BANK(sym.loc),
+                    LOC_ADDR(sym.loc), sym.name.c_str());
+            if (!n || n == end - sym.loc)
+                continue;
+            for (uint32_t loc = sym.loc; loc < end; loc++) {
+                uint32_t start = loc;
+                if (executed(loc))
+                    continue;
+                while (loc + 1 < end && !executed(loc + 1))
+                    loc++;
+                fprintf(fp, "%30snot executed: +0x%x", "", start - sym.loc);
+                if (loc != start)
+                    fprintf(fp, "-0x%x", loc - sym.loc);
+                fprintf(fp, "\n");
+            }
+        }
+    }
+
+    /* The executed bytes themselves, bank by bank and then RAM. */
+    fprintf(fp, "\nexecuted\n");
+    for (size_t offset = 0; offset < rom_size; offset += 0x4000) {
+        size_t size = rom_size - offset < 0x4000 ? rom_size - offset : 0x4000;
+        write_ranges(fp, syms, rom_loc(offset), rom_loc(offset) + size);
+    }
+    write_ranges(fp, syms, 0x8000, 0x10000);
+}
+
+void Coverage::write_ranges(FILE *fp, const Symbols &syms, uint32_t start,
+                            uint32_t end) const
+{
+    for (uint32_t loc = start; loc < end; loc++) {
+        uint32_t first = loc;
+        if (!executed(loc))
+            continue;
+        while (loc + 1 < end && executed(loc + 1))
+            loc++;
+        fprintf(fp, "%02x:%04x-%04x  %s\n", LOC_BANK(first), LOC_ADDR(first),
+                LOC_ADDR(loc), syms.name(first, 1).c_str());
+    }
+}
@@ -0,0 +1,77 @@
+/*
+ * Code coverage of the guest program for gbsim.cpp (see
+ * gbsim_coverage_enable): a bit per executed byte, for every byte of the ROM
+ * image (so for every bank) and of 0x8000-0xffff for code run from RAM.
+ *
+ * Each retired instruction marks its opcode and operand bytes, which costs a
+ * table lookup for its length and setting up to three bits.
+ */
+
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "symbols.h"
+
+class Coverage
+{
+public:
+    bool enabled;
+
+    Coverage();
+
+    /* Sizes the map for a ROM image of rom_size bytes and clears it. */
+    void clear(size_t rom_size);
+
+    /* Continues at pc, e.g. after the CPU state was changed behind our back;
+     * bootrom is whether the boot ROM is mapped at 0x0000-0x00ff. */
+    void restart(uint16_t pc, uint8_t bank, bool bootrom);
+
+    /* An instruction with the given opcode (or an interrupt dispatch if
+     * intack) retired; pc, bank and bootrom are the state it left behind. */
+    inline void retire(uint16_t pc, uint8_t bank, bool bootrom,
+                       uint8_t opcode, bool intack)
+    {
+        if (!intack && !cur_bootrom)
+            for (int i = 0; i < length[opcode]; i++)
+                mark((uint16_t)(cur_pc + i), cur_bank);
+        restart(pc, bank, bootrom);
+    }
+
+    bool executed(uint32_t loc) const;
+
+    /* Executed bytes per section and label, the parts of every label that
+     * were not executed and the executed address ranges. */
+    void write(FILE *fp, const Symbols &syms) const;
+
+private:
+    std::vector<uint8_t> rom, ram;
+    size_t rom_size;
+    uint8_t length[256];
+
+    uint16_t cur_pc;
+    uint8_t cur_bank;
+    bool cur_bootrom;
+
+    inline void mark(uint16_t addr, uint8_t bank)
+    {
+        if (addr >= 0x8000) {
+            addr -= 0x8000;
+            ram[addr >> 3] |= 1 << (addr & 7);
+            return;
+        }
+        size_t offset = addr < 0x4000 ? addr :
+                        (size_t)bank * 0x4000 + addr - 0x4000;
+        if (offset < rom_size)
+            rom[offset >> 3] |= 1 << (offset & 7);
+    }
+
+    size_t count(uint32_t start, uint32_t end) const;
+    void write_ranges(FILE *fp, const Symbols &syms, uint32_t start,
+                      uint32_t end) const;
+};
+
+#endif
@@ -1,3 +1,5 @@
+`include "alu.v"
+
 module cpu (
     input clk,
     input reset,
@@ -21,7 +23,10 @@ module cpu (
     output [15:0] dbg_HL,
     output dbg_instruction_retired,
     output reg [7:0] dbg_last_opcode,
-    output [5:0] dbg_stage
+    output [5:0] dbg_stage,
+
+    input [3:0] dbg_perf_sel,
+    output reg [31:0] dbg_perf_count
 );
 
 /*
@@ -73,7 +78,23 @@ localparam RESET       = 0,
            STALL8      = 40,
            WRITEBACK   = 41;
 
-/* Operations the ALU can perform. */
+/* Performance counters, selected by dbg_perf_sel (see the end of this file;
+ * cpuperf.h has the same numbers for the host side).
+ * Apart from the first two, these count the cycles spent per class of stages;
+ * RESET counts as fetch. */
+localparam PERF_RETIRED    = 0, // Instructions and interrupt dispatches
+           PERF_INTERRUPTS = 1, // Interrupt dispatches
+           PERF_FETCH      = 2, // FETCH, DECODE
+           PERF_DECODE_CB  = 3, // DECODE_CB*
+           PERF_DECODE_IMM = 4, // DECODE_IMM*
+           PERF_LOAD_MEM   = 5, // LOAD_MEM*
+           PERF_EXECUTE    = 6, // EXECUTE
+           PERF_STORE_MEM  = 7, // STORE_MEM*
+           PERF_STALL      = 8, // STALL*
+           PERF_WRITEBACK  = 9, // WRITEBACK
+           PERF_HALTED     = 10; // HALTED
+
+/* Operations the ALU (alu.v) can perform. */
 localparam ALU_NOP  = 0,
            ALU_ADD  = 1,
            ALU_ADC  = 2,
@@ -188,10 +209,8 @@ reg store_mem_execout;
 reg alu_16bit;
 reg [4:0] alu_op;
 reg [15:0] exec_oper1, exec_oper2;
-reg [16:0] alu_out; // 16 bit + 1 bit for capturing carry
-wire alu_out_Z, alu_out_N, alu_out_H;
-reg alu_out_C;
-wire [7:0] alu_daa_add;
+wire [15:0] alu_out;
+wire [3:0] alu_out_flags;
 
 // Add pad cycles to mimic cycle count of original hardware
 reg do_stall, do_stall8;
@@ -838,55 +857,15 @@ endfunction
 /*
  * Execution - ALU
  */
-always @(*)
-    case (alu_op)
-        ALU_NOP:  begin alu_out = {1'b0, exec_oper1}; end
-        ALU_ADD:  begin alu_out = {1'b0, exec_oper1} + {1'b0, exec_oper2}; end
-        ALU_ADC:  begin alu_out = {1'b0, exec_oper1} + {1'b0, exec_oper2} + {16'b0, C}; end
-        ALU_SUB:  begin alu_out = {1'b0, exec_oper1} - {1'b0, exec_oper2}; end
-        ALU_SBC:  begin alu_out = {1'b0, exec_oper1} - {1'b0, exec_oper2} - {16'b0, C}; end
-        ALU_AND:  begin alu_out = {1'b0, exec_oper1} & {1'b0, exec_oper2}; end
-        ALU_XOR:  begin alu_out = {1'b0, exec_oper1} ^ {1'b0, exec_oper2}; end
-        ALU_OR:   begin alu_out = {1'b0, exec_oper1} | {1'b0, exec_oper2}; end
-        ALU_RLC:  begin alu_out = {9'b0, exec_oper1[6:0], exec_oper1[7]}; end
-        ALU_RRC:  begin alu_out = {9'b0, exec_oper1[0], exec_oper1[7:1]}; end
-        ALU_RL:   begin alu_out = {9'b0, exec_oper1[6:0], C}; end
-        ALU_RR:   begin alu_out = {9'b0, C, exec_oper1[7:1]}; end
-        ALU_SLA:  begin alu_out = {9'b0, exec_oper1[6:0], 1'b0}; end
-        ALU_SRA:  begin alu_out = {9'b0, exec_oper1[7], exec_oper1[7:1]}; end
-        ALU_SWAP: begin alu_out = {9'b0, exec_oper1[3:0], exec_oper1[7:4]}; end
-        ALU_SRL:  begin alu_out = {9'b0, 1'b0, exec_oper1[7:1]}; end
-        ALU_DAA:  begin alu_out = {9'b0, exec_oper1[7:0] + (N ? -alu_daa_add : alu_daa_add)}; end
-        default:  alu_out = 17'hFFFF;
-    endcase
-
-assign alu_daa_add = ((H || (!N && (exec_oper1 & 'h0f) > 'h09)) ? 8'h06 : 0) |
-                     ((C || (!N && (exec_oper1 & 'hff) > 'h99)) ? 8'h60 : 0);
-
-assign alu_out_Z = alu_16bit ? (alu_out[15:0] == 16'h0000) :
-                               (alu_out[7:0] == 8'h00);
-assign alu_out_N = alu_op == ALU_SUB || alu_op == ALU_SBC;
-assign alu_out_H = alu_op == ALU_AND ||
-                   ((alu_op == ALU_ADD || alu_op == ALU_ADC ||
-                     alu_op == ALU_SUB || alu_op == ALU_SBC) &&
-                    (alu_16bit ? exec_oper1[12] ^ exec_oper2[12] ^ alu_out[12]
-                               : exec_oper1[4] ^ exec_oper2[4] ^ alu_out[4]));
-always @(*)
-    case (alu_op)
-        ALU_ADD, ALU_ADC, ALU_SUB, ALU_SBC:
-            alu_out_C = alu_16bit ? alu_out[16] :
-                            (exec_oper1[8] ^ exec_oper2[8] ^ alu_out[8]);
-        ALU_RLC, ALU_RL,
-        ALU_SLA:
-            alu_out_C = exec_oper1[7];
-        ALU_RRC, ALU_RR,
-        ALU_SRA, ALU_SRL:
-            alu_out_C = exec_oper1[0];
-        ALU_DAA:
-            alu_out_C = C || (!N && (exec_oper1 & 'hff) > 'h99);
-        default:
-            alu_out_C = 0;
-    endcase
+alu alu (
+    .op(alu_op),
+    .is_16bit(alu_16bit),
+    .in1(exec_oper1),
+    .in2(exec_oper2),
+    .flags_in(reg_Fh),
+    .out(alu_out),
+    .flags_out(alu_out_flags)
+);
 
 /*
  * Datapath between stages (propagate on clock).
@@ -1103,12 +1082,12 @@ always @(posedge clk) begin
 
         EXECUTE: begin
             `ifdef DEBUG_CPU
-                $display("[CPU] Execute ALU op %x  in1: %04x  in2: %04x  out: %04x  F %d%d%d%d", alu_op, exec_oper1, exec_oper2, alu_out[15:0], alu_out_Z, alu_out_N, alu_out_H, alu_out_C);
+                $display("[CPU] Execute ALU op %x  in1: %04x  in2: %04x  out: %04x  F %b", alu_op, exec_oper1, exec_oper2, alu_out, alu_out_flags);
             `endif
-            wb_data <= alu_out[15:0];
-            wb_flags <= {alu_out_Z, alu_out_N, alu_out_H, alu_out_C};
+            wb_data <= alu_out;
+            wb_flags <= alu_out_flags;
             if (store_mem_execout)
-                store_mem_data <= alu_out[15:0];
+                store_mem_data <= alu_out;
         end
 
         STORE_MEM1: begin
@@ -1184,4 +1163,81 @@ always @(posedge clk) begin
         stage <= next_stage;
     end
 end
+
+/*
+ * Performance counters (with PERF_COUNTERS defined, reading as 0 otherwise):
+ * 32-bit counts since reset of the events and stage classes of PERF_*, one of
+ * which is shown on dbg_perf_count. They wrap around after 2^32 cycles (about
+ * 17 minutes at 4 MHz), so readers should take differences.
+ */
+`ifdef PERF_COUNTERS
+reg [31:0] perf_retired, perf_interrupts;
+reg [31:0] perf_fetch, perf_decode_cb, perf_decode_imm, perf_load_mem;
+reg [31:0] perf_execute, perf_store_mem, perf_stall, perf_writeback;
+reg [31:0] perf_halted;
+
+always @(posedge clk) begin
+    if (reset) begin
+        {perf_retired, perf_interrupts} <= 0;
+        {perf_fetch, perf_decode_cb, perf_decode_imm, perf_load_mem} <= 0;
+        {perf_execute, perf_store_mem, perf_stall, perf_writeback} <= 0;
+        perf_halted <= 0;
+    end else begin
+        if (stage == WRITEBACK) begin
+            perf_retired <= perf_retired + 1;
+            if (|wb_intack)
+                perf_interrupts <= perf_interrupts + 1;
+        end
+
+        case (stage)
+            RESET, FETCH, DECODE:
+                perf_fetch <= perf_fetch + 1;
+            DECODE_CB1, DECODE_CB2, DECODE_CB3, DECODE_CB4:
+                perf_decode_cb <= perf_decode_cb + 1;
+            DECODE_IMM1, DECODE_IMM2, DECODE_IMM3, DECODE_IMM4,
+            DECODE_IMM5, DECODE_IMM6, DECODE_IMM7, DECODE_IMM8:
+                perf_decode_imm <= perf_decode_imm + 1;
+            LOAD_MEM1, LOAD_MEM2, LOAD_MEM3, LOAD_MEM4,
+            LOAD_MEM5, LOAD_MEM6, LOAD_MEM7, LOAD_MEM8:
+                perf_load_mem <= perf_load_mem + 1;
+            EXECUTE:
+                perf_execute <= perf_execute + 1;
+            STORE_MEM1, STORE_MEM2, STORE_MEM3, STORE_MEM4,
+            STORE_MEM5, STORE_MEM6, STORE_MEM7, STORE_MEM8:
+                perf_store_mem <= perf_store_mem + 1;
+            STALL1, STALL2, STALL3, STALL4,
+            STALL5, STALL6, STALL7, STALL8:
+                perf_stall <= perf_stall + 1;
+            WRITEBACK:
+                perf_writeback <= perf_writeback + 1;
+            HALTED:
+                perf_halted <= perf_halted + 1;
+            default: ;
+        endcase
+    end
+end
+
+always @(*)
+    case (dbg_perf_sel)
+        PERF_RETIRED:    dbg_perf_count = perf_retired;
+        PERF_INTERRUPTS: dbg_perf_count = perf_interrupts;
+        PERF_FETCH:      dbg_perf_count = perf_fetch;
+        PERF_DECODE_CB:  dbg_perf_count = perf_decode_cb;
+        PERF_DECODE_IMM: dbg_perf_count = perf_decode_imm;
+        PERF_LOAD_MEM:   dbg_perf_count = perf_load_mem;
+        PERF_EXECUTE:    dbg_perf_count = perf_execute;
+        PERF_STORE_MEM:  dbg_perf_count = perf_store_mem;
+        PERF_STALL:      dbg_perf_count = perf_stall;
+        PERF_WRITEBACK:  dbg_perf_count = perf_writeback;
+        PERF_HALTED:     dbg_perf_count = perf_halted;
+        default:         dbg_perf_count = 0;
+    endcase
+`else
+/* verilator lint_off UNUSED */
+wire [3:0] perf_sel_unused = dbg_perf_sel;
+/* verilator lint_on UNUSED */
+always @(*)
+    dbg_perf_count = 0;
+`endif
+
 endmodule
@@ -0,0 +1,359 @@
+/*
+ * Behavioural model of cpu.v, see cpu_model.h. The DPI functions at the end
+ * are what cpu_model.v calls.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "Vmain__Dpi.h"
+#include "cpu_model.h"
+
+extern "C" {
+#include "emu_cpu.h"
+}
+
+CpuModel::CpuModel(uint16_t reset_pc)
+    : reset_pc(reset_pc)
+{
+    cpu = ecpu_create();
+    ecpu_set_mmu(cpu, this, spec_read, spec_write);
+    ecpu_set_quirks(cpu, ECPU_QUIRKS_CPU_V);
+    check_timing();
+    intack = 0;
+    cycle(1, 0, 0, 0);
+}
+
+CpuModel::~CpuModel()
+{
+    ecpu_destroy(cpu);
+}
+
+void CpuModel::set_state(const struct state *state)
+{
+    st = *state;
+    busy = 0;
+}
+
+/*
+ * Reads return the data of the instruction's earlier reads in order. The first
+ * one beyond those is the access the bus has to do next; from there on the
+ * data is made up and nothing is recorded anymore.
+ */
+u8 CpuModel::spec_read(void *ctx, u16 addr)
+{
+    CpuModel *m = (CpuModel *)ctx;
+
+    if (m->spec_missing || m->num_ops == CPU_MODEL_MAX_OPS)
+        return 0xff;
+    m->ops[m->num_ops++] = { 0, addr, 0 };
+    if (m->spec_reads < m->num_reads)
+        return m->reads[m->spec_reads++];
+    m->spec_missing = 1;
+    return 0xff;
+}
+
+void CpuModel::spec_write(void *ctx, u16 addr, u8 val)
+{
+    CpuModel *m = (CpuModel *)ctx;
+
+    if (m->spec_missing || m->num_ops == CPU_MODEL_MAX_OPS)
+        return;
+    m->ops[m->num_ops++] = { 1, addr, val };
+}
+
+/* Executes the current instruction from the start with the reads so far. */
+void CpuModel::speculate()
+{
+    ecpu_reset(cpu, &st);
+    spec_reads = 0;
+    spec_missing = 0;
+    num_ops = 0;
+    cycles = vector >= 0 ? ecpu_interrupt(cpu, 0x40 + vector * 8)
+                         : ecpu_step(cpu);
+    if (cycles < 0) {
+        /* Unknown opcode; with made-up data it might be any. */
+        if (!spec_missing)
+            error = 1;
+        cycles = 0;
+    }
+    ecpu_get_state(cpu, &next);
+
+    /* The cycles cover the accesses (see check_timing), except while the
+     * data and so the instruction are still partly made up. */
+    length = cycles > 4 * (int)num_ops ? cycles : 4 * num_ops;
+    if (length < 4)
+        length = 4;
+}
+
+/*
+ * The bus accesses and stall M-cycles of an instruction in cpu.v, as its
+ * decoder sets them up: the fetch, the CB opcode and immediates (DECODE_CB*,
+ * DECODE_IMM*), loads (load_mem, load_mem16), stores (store_mem, store_mem16)
+ * and then one stall (do_stall) or two (do_stall8). taken is whether the
+ * condition of a conditional jump, call or return holds. Returns false for
+ * opcodes cpu.v does not implement.
+ */
+static bool cpu_v_timing(uint8_t op, uint8_t cb_op, bool taken,
+                         unsigned *bus_ops, unsigned *stalls)
+{
+    bool src_hl = (op & 7) == 6, dest_hl = (op >> 3 & 7) == 6;
+    unsigned imm = 0, load = 0, store = 0, stall = 0;
+
+    if (op == 0xcd || op == 0xc3 || op == 0x18)
+        taken = 1;
+
+    if (op == 0xcb) {
+        imm = 1;
+        load = (cb_op & 7) == 6;
+        store = load && (cb_op & 0xc0) != 0x40;
+    } else if (op == 0x00 || op == 0x76 || op == 0xf3 || op == 0xfb ||
+               op == 0x37 || op == 0x3f || op == 0xe9 ||
+               ((op & 0xe7) == 0x07) || op == 0x27 || op == 0x2f) {
+        ;
+    } else if ((op & 0xcf) == 0x01) {               // LD r16, imm16
+        imm = 2;
+    } else if ((op & 0xc7) == 0x06) {               // LD r8, imm8
+        imm = 1;
+        store = dest_hl;
+    } else if ((op & 0xc0) == 0x40) {               // LD r8, r8
+        load = src_hl;
+        store = dest_hl;
+    } else if (op == 0xf9) {                        // LD SP, HL
+        stall = 1;
+    } else if ((op & 0xef) == 0x0a || op == 0x2a || op == 0x3a ||
+               op == 0xf2) {                        // LD A, (r16/C)
+        load = 1;
+    } else if (op == 0xf0 || op == 0xfa) {          // LD A, (imm)
+        imm = op == 0xfa ? 2 : 1;
+        load = 1;
+    } else if ((op & 0xef) == 0x02 || op == 0x22 || op == 0x32 ||
+               op == 0xe2) {                        // LD (r16/C), A
+        store = 1;
+    } else if (op == 0xe0 || op == 0xea) {          // LD (imm), A
+        imm = op == 0xea ? 2 : 1;
+        store = 1;
+    } else if (op == 0x08) {                        // LD (imm16), SP
+        imm = 2;
+        store = 2;
+    } else if ((op & 0xcf) == 0xc5 ||
+               (op & 0xc7) == 0xc7) {               // PUSH r16, RST vec
+        store = 2;
+        stall = 1;
+    } else if ((op & 0xcf) == 0xc1) {               // POP r16
+        load = 2;
+    } else if (op == 0xcd || (op & 0xe7) == 0xc4) { // CALL (cc,) imm16
+        imm = 2;
+        store = taken ? 2 : 0;
+        stall = taken;
+    } else if (op == 0xc9 || op == 0xd9) {          // RET, RETI
+        load = 2;
+        stall = 1;
+    } else if ((op & 0xe7) == 0xc0) {               // RET cc
+        load = taken ? 2 : 0;
+        stall = taken ? 2 : 1;
+    } else if (op == 0xc3 || (op & 0xe7) == 0xc2) { // JP (cc,) imm16
+        imm = 2;
+        stall = taken;
+    } else if (op == 0x18 || (op & 0xe7) == 0x20) { // JR (cc,) off8
+        imm = 1;
+        stall = taken;
+    } else if ((op & 0xc6) == 0x04) {               // INC/DEC r8
+        load = store = dest_hl;
+    } else if ((op & 0xc0) == 0x80) {               // ALU r8
+        load = src_hl;
+    } else if ((op & 0xc7) == 0xc6) {               // ALU imm8
+        imm = 1;
+    } else if ((op & 0xc7) == 0x03 ||
+               (op & 0xcf) == 0x09) {               // INC/DEC r16, ADD HL
+        stall = 1;
+    } else if (op == 0xe8 || op == 0xf8) {          // ADD SP/LD HL, SP+imm8
+        imm = 1;
+        stall = op == 0xe8 ? 2 : 1;
+    } else {
+        return false;
+    }
+
+    *bus_ops = 1 + imm + load + store;
+    *stalls = stall;
+    return true;
+}
+
+/*
+ * Runs every opcode (with its condition true and false) and an interrupt
+ * dispatch on the emulator and compares their bus accesses and cycles with
+ * those of cpu.v. Lists all that differ, then aborts.
+ */
+void CpuModel::check_timing()
+{
+    int mismatches = 0;
+
+    for (int i = -1; i < 3 * 256; i++) {
+        uint8_t op = i < 512 ? i & 0xff : 0xcb;
+        uint8_t cb_op = i < 512 ? 0 : i & 0xff;
+        bool flags_set = i >= 256 && i < 512;
+        unsigned bus_ops, stalls;
+        bool taken;
+
+        if (i < 0) {
+            bus_ops = 3;            // the fetch and two stores
+            stalls = 0;
+        } else {
+            /* NZ/NC hold with the flags clear, Z/C with them set. */
+            taken = !(op & 0x08) != flags_set;
+            if (!cpu_v_timing(op, cb_op, taken, &bus_ops, &stalls))
+                continue;
+        }
+
+        memset(&st, 0, sizeof(st));
+        st.PC = 0xc000;
+        st.SP = 0xd000;
+        st.reg8.F = flags_set ? 0xf0 : 0x00;
+        vector = i < 0 ? 0 : -1;
+        memset(reads, 0, sizeof(reads));
+        reads[0] = op;
+        reads[1] = cb_op;
+        num_reads = CPU_MODEL_MAX_OPS;
+        error = 0;
+        speculate();
+
+        if (error || num_ops != bus_ops ||
+            cycles != 4 * (int)(bus_ops + stalls)) {
+            if (i < 0)
+                fprintf(stderr, "CPU model: interrupt dispatch");
+            else if (op == 0xcb)
+                fprintf(stderr, "CPU model: opcode cb %02x", cb_op);
+            else
+                fprintf(stderr, "CPU model: opcode %02x (flags %02x)", op,
+                        st.reg8.F);
+            fprintf(stderr, " takes %d cycles with %u bus accesses in the "
+                    "emulator, %u with %u in cpu.v\n", error ? -1 : cycles,
+                    num_ops, 4 * (bus_ops + stalls), bus_ops);
+            mismatches++;
+        }
+    }
+
+    if (mismatches) {
+        fprintf(stderr, "%d instruction timing(s) of the emulator differ from "
+                "cpu.v\n", mismatches);
+        abort();
+    }
+}
+
+/* Bus and stage outputs for cycle cyc of the instruction. */
+void CpuModel::drive()
+{
+    unsigned k = cyc / 4;
+
+    do_write = 0;
+    if (k >= num_ops) {
+        stage = CPU_MODEL_EXECUTE;
+        return;
+    }
+    addr = ops[k].addr;
+    if (ops[k].write) {
+        data_w = ops[k].val;
+        do_write = cyc % 4 == 0;
+    }
+    stage = k == 0 ? CPU_MODEL_FETCH :
+            !ops[k].write && cyc % 4 == 2 ? CPU_MODEL_LOAD_MEM2 :
+            CPU_MODEL_EXECUTE;
+}
+
+/* Starts the next instruction, or an interrupt as emu_sys.c does. */
+void CpuModel::start(uint8_t ie, uint8_t if_)
+{
+    uint8_t pending = ie & if_ & 0x1f;
+
+    do_write = 0;
+    if (st.interrupts_master_enabled && pending) {
+        vector = __builtin_ctz(pending);
+    } else if (st.halted) {
+        /* Without IME, cpu.v never leaves HALT. */
+        stage = CPU_MODEL_HALTED;
+        return;
+    } else {
+        vector = -1;
+    }
+
+    busy = 1;
+    cyc = 0;
+    num_reads = 0;
+    speculate();
+    drive();
+}
+
+void CpuModel::cycle(bool rst, uint8_t data_r, uint8_t ie, uint8_t if_)
+{
+    /* main.v clears IF on the edge after the acknowledge. */
+    uint8_t acked = intack;
+
+    intack = 0;
+    if (rst) {
+        memset(&st, 0, sizeof(st));
+        st.PC = reset_pc;
+        busy = 0;
+        addr = 0;
+        data_w = 0;
+        do_write = 0;
+        stage = CPU_MODEL_RESET;
+        last_opcode = 0;
+        error = 0;
+        return;
+    }
+
+    if (busy) {
+        if (cyc % 4 == 1 && spec_missing && cyc / 4 == num_ops - 1) {
+            reads[num_reads++] = data_r;
+            if (vector < 0 && num_reads == 1)
+                last_opcode = data_r;
+            speculate();
+        }
+
+        cyc++;
+        if (cyc == length - 1) {
+            st = next;
+            do_write = 0;
+            stage = CPU_MODEL_WRITEBACK;
+            if (vector >= 0)
+                intack = 1 << vector;
+            return;
+        }
+        if (cyc < length) {
+            drive();
+            return;
+        }
+        busy = 0;
+    }
+
+    start(ie, if_ & ~acked);
+}
+
+/* DPI functions of cpu_model.v. */
+
+void *cpu_model_create(unsigned int reset_pc)
+{
+    return new CpuModel(reset_pc);
+}
+
+void cpu_model_destroy(void *model)
+{
+    delete (CpuModel *)model;
+}
+
+void cpu_model_cycle(void *model, svBit reset, unsigned int data_r,
+                     unsigned int ie, unsigned int if_, unsigned int *bus,
+                     unsigned int *status, unsigned int *pc_sp,
+                     unsigned int *af_bc, unsigned int *de_hl)
+{
+    CpuModel *m = (CpuModel *)model;
+
+    m->cycle(reset, data_r, ie, if_);
+    *bus = (unsigned)m->do_write << 24 | m->data_w << 16 | m->addr;
+    *status = (unsigned)m->error << 20 | m->last_opcode << 12 |
+              m->st.halted << 11 | m->stage << 5 | m->intack;
+    *pc_sp = (unsigned)m->st.PC << 16 | m->st.SP;
+    *af_bc = (unsigned)m->st.reg16.AF << 16 | m->st.reg16.BC;
+    *de_hl = (unsigned)m->st.reg16.DE << 16 | m->st.reg16.HL;
+}
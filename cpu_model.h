@@ -0,0 +1,109 @@
+/*
+ * Behavioural model of cpu.v for hybrid simulation builds (HYBRID=cpu, see the
+ * Makefile): cpu_model.v puts it behind the ports of cpu.v, calling into it
+ * once per clock cycle.
+ *
+ * Instructions are executed by the reference emulator of
+ * test_instructions/emu_cpu.c, which already takes as many cycles per
+ * instruction as cpu.v does. Its memory accesses have to go over the bus of
+ * main.v one at a time though, with the read data only known a cycle after
+ * the address went out. So an instruction is executed again from its start
+ * whenever a read completes, with the data read so far, up to the first read
+ * that has not happened yet; that read is the next bus access. Writes only
+ * reach the bus when their turn comes.
+ *
+ * Every access takes four cycles (an M-cycle), the address going out on the
+ * first and the data read on the second, as with the synchronous memories of
+ * main.v. The instruction is retired (stage WRITEBACK) on its last cycle.
+ * Interrupts are dispatched in place of an instruction as emu_sys.c does.
+ *
+ * This only holds as long as the emulator's bus accesses and cycles per
+ * instruction are those of cpu.v, so the constructor checks them for every
+ * opcode against what the decoder of cpu.v sets up, and aborts if any differ.
+ */
+
+#ifndef CPU_MODEL_H
+#define CPU_MODEL_H
+
+#include <cstdint>
+
+#include "common.h"
+
+struct ecpu;
+
+/* Stages of cpu.v that the model goes through. */
+#define CPU_MODEL_RESET     0
+#define CPU_MODEL_HALTED    1
+#define CPU_MODEL_FETCH     2
+#define CPU_MODEL_LOAD_MEM2 17
+#define CPU_MODEL_EXECUTE   24
+#define CPU_MODEL_WRITEBACK 41
+
+#define CPU_MODEL_MAX_OPS 8
+
+class CpuModel
+{
+public:
+    /* Registers as of the last instruction retired. */
+    struct state st;
+
+    /* Bus outputs, as cpu.v has them for the cycle after the last edge. */
+    uint16_t addr;
+    uint8_t data_w;
+    bool do_write;
+    uint8_t stage;
+    uint8_t intack;
+    uint8_t last_opcode;
+
+    /* An instruction cpu.v does not implement was fetched. */
+    bool error;
+
+    explicit CpuModel(uint16_t reset_pc);
+    ~CpuModel();
+
+    /* Continues after the instruction at st.PC, as gbsim_fast_forward does
+     * with cpu.v. */
+    void set_state(const struct state *state);
+
+    /* A rising clock edge, with data_r what the bus returned in the cycle
+     * before it. */
+    void cycle(bool rst, uint8_t data_r, uint8_t ie, uint8_t if_);
+
+private:
+    struct Op {
+        bool write;
+        uint16_t addr;
+        uint8_t val;
+    };
+
+    struct ecpu *cpu;
+    uint16_t reset_pc;
+
+    /* The instruction under way: whether there is one, the interrupt it
+     * dispatches (or -1), cycles since it started, the data read so far and
+     * what executing it with them gave. */
+    bool busy;
+    int vector;
+    unsigned cyc;
+    uint8_t reads[CPU_MODEL_MAX_OPS];
+    unsigned num_reads;
+    Op ops[CPU_MODEL_MAX_OPS];
+    unsigned num_ops;
+    unsigned length;
+    int cycles;
+    struct state next;
+
+    /* Speculative execution, see the callbacks. */
+    unsigned spec_reads;
+    bool spec_missing;
+
+    void start(uint8_t ie, uint8_t if_);
+    void speculate();
+    void drive();
+    void check_timing();
+
+    static u8 spec_read(void *ctx, u16 addr);
+    static void spec_write(void *ctx, u16 addr, u8 val);
+};
+
+#endif
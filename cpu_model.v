@@ -0,0 +1,98 @@
+/*
+ * Behavioural model of the CPU (cpu_model.cpp) behind the ports of cpu.v, for
+ * hybrid simulation builds (CPU_MODEL, see main.v). Verilator only: the model
+ * is called through DPI once per clock cycle, with the inputs before the
+ * edge, and returns the outputs after it packed into words:
+ *
+ *   bus:    [24] mem_do_write, [23:16] mem_data_write, [15:0] mem_addr
+ *   status: [20] opcode not implemented, [19:12] dbg_last_opcode,
+ *           [11] cpu_is_halted, [10:5] dbg_stage, [4:0] interrupts_ack
+ *   pc_sp, af_bc, de_hl: the registers, high half first
+ *
+ * There are no performance counters.
+ */
+
+module cpu_model (
+    input clk,
+    input reset,
+
+    output reg [15:0] mem_addr,
+    output reg [7:0] mem_data_write,
+    input [7:0] mem_data_read,
+    output reg mem_do_write,
+
+    input [4:0] interrupts_enabled,
+    input [4:0] interrupts_request,
+    output reg [4:0] interrupts_ack,
+
+    output reg cpu_is_halted,
+
+    output reg [15:0] dbg_pc,
+    output reg [15:0] dbg_sp,
+    output reg [15:0] dbg_AF,
+    output reg [15:0] dbg_BC,
+    output reg [15:0] dbg_DE,
+    output reg [15:0] dbg_HL,
+    output dbg_instruction_retired,
+    output reg [7:0] dbg_last_opcode,
+    output reg [5:0] dbg_stage,
+
+    /* verilator lint_off UNUSED */
+    input [3:0] dbg_perf_sel,
+    /* verilator lint_on UNUSED */
+    output [31:0] dbg_perf_count
+);
+
+localparam WRITEBACK = 41;
+
+`ifdef SKIP_BOOTROM
+localparam RESET_PC = 'h00fc;
+`else
+localparam RESET_PC = 'h0000;
+`endif
+
+import "DPI-C" function chandle cpu_model_create(input int unsigned reset_pc);
+import "DPI-C" function void cpu_model_destroy(input chandle model);
+import "DPI-C" function void cpu_model_cycle(
+    input chandle model,
+    input bit reset,
+    input int unsigned data_r,
+    input int unsigned ie,
+    input int unsigned if_,
+    output int unsigned bus,
+    output int unsigned status,
+    output int unsigned pc_sp,
+    output int unsigned af_bc,
+    output int unsigned de_hl);
+
+chandle model;
+initial model = cpu_model_create(RESET_PC);
+final cpu_model_destroy(model);
+
+/* verilator lint_off UNUSED */
+int unsigned bus, status;
+/* verilator lint_on UNUSED */
+int unsigned pc_sp, af_bc, de_hl;
+
+always @(posedge clk) begin
+    cpu_model_cycle(model, reset, {24'b0, mem_data_read},
+                    {27'b0, interrupts_enabled}, {27'b0, interrupts_request},
+                    bus, status, pc_sp, af_bc, de_hl);
+    {mem_do_write, mem_data_write, mem_addr} <= bus[24:0];
+    {dbg_last_opcode, cpu_is_halted, dbg_stage, interrupts_ack} <= status[19:0];
+    {dbg_pc, dbg_sp} <= pc_sp;
+    {dbg_AF, dbg_BC} <= af_bc;
+    {dbg_DE, dbg_HL} <= de_hl;
+
+    `ifndef SYNTHESIS
+    if (status[20]) begin
+        $display("Opcode not implemented: %02x", status[19:12]);
+        $finish;
+    end
+    `endif
+end
+
+assign dbg_instruction_retired = dbg_stage == WRITEBACK;
+assign dbg_perf_count = 0;
+
+endmodule
@@ -0,0 +1,59 @@
+/*
+ * Performance counters of cpu.v (PERF_COUNTERS): their numbers as selected by
+ * dbg_perf_sel (PERF_* in cpu.v) and a CPI breakdown of their values, shared
+ * by the simulator (gbsim_perf_dump) and the debug UART decoder (readserial).
+ */
+
+#ifndef CPUPERF_H
+#define CPUPERF_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define PERF_RETIRED    0   // Instructions and interrupt dispatches
+#define PERF_INTERRUPTS 1   // Interrupt dispatches
+#define PERF_FETCH      2   // Cycles per class of stages from here on
+#define PERF_DECODE_CB  3
+#define PERF_DECODE_IMM 4
+#define PERF_LOAD_MEM   5
+#define PERF_EXECUTE    6
+#define PERF_STORE_MEM  7
+#define PERF_STALL      8
+#define PERF_WRITEBACK  9
+#define PERF_HALTED     10
+#define PERF_NUM        11
+
+static const char *const perf_stage_names[PERF_NUM] = {
+    NULL, NULL, "fetch/decode", "CB prefix", "immediates", "memory loads",
+    "execute", "memory stores", "stalls", "writeback", "halted"
+};
+
+/* Prints the cycles per stage class of counts[PERF_NUM], in total and per
+ * retired instruction (halted cycles left out). */
+static inline void perf_print(FILE *fp, const uint32_t *counts)
+{
+    uint64_t cycles = 0;
+    uint32_t retired = counts[PERF_RETIRED];
+
+    for (int i = PERF_FETCH; i < PERF_NUM; i++)
+        cycles += counts[i];
+
+    fprintf(fp, "%llu cycles, %u instructions retired (%u interrupt "
+            "dispatches)", (unsigned long long)cycles,
+            retired - counts[PERF_INTERRUPTS], counts[PERF_INTERRUPTS]);
+    if (retired)
+        fprintf(fp, ", CPI %.2f when not halted",
+                (double)(cycles - counts[PERF_HALTED]) / retired);
+    fprintf(fp, "\n");
+    if (!cycles)
+        return;
+
+    fprintf(fp, "      cycles       %%  per inst  stages\n");
+    for (int i = PERF_FETCH; i < PERF_NUM; i++)
+        fprintf(fp, "%12u  %5.1f%%  %8.2f  %s\n", counts[i],
+                100.0 * counts[i] / cycles,
+                i != PERF_HALTED && retired ? (double)counts[i] / retired : 0.0,
+                perf_stage_names[i]);
+}
+
+#endif
@@ -0,0 +1,167 @@
+/*
+ * The CXXRTL model of main.v behind the interface of the verilated one, see
+ * cxxrtl_top.h.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "cxxrtl_top.h"
+
+/* Names that did not resolve while binding, all reported before giving up. */
+static int unbound;
+
+static cxxrtl::debug_item *find_item(cxxrtl::debug_items &items,
+                                     const char *name, bool memory)
+{
+    auto it = items.table.find(name);
+
+    if (it == items.table.end() || it->second.size() != 1) {
+        fprintf(stderr, "CXXRTL model has no signal '%s'\n", name);
+        unbound++;
+        return NULL;
+    }
+
+    cxxrtl::debug_item *item = &it->second[0];
+    if ((item->type == cxxrtl::debug_item::MEMORY) != memory ||
+        item->width > 32) {
+        fprintf(stderr, "CXXRTL signal '%s' is not a %s of at most 32 bits\n",
+                name, memory ? "memory" : "signal");
+        unbound++;
+        return NULL;
+    }
+    return item;
+}
+
+void CxxrtlSignal::bind(cxxrtl::debug_items &items, const char *name)
+{
+    item = find_item(items, name, 0);
+    if (!item)
+        return;
+    mask = item->width == 32 ? ~0u : (1u << item->width) - 1;
+    input = item->flags & cxxrtl::debug_item::INPUT;
+}
+
+void CxxrtlMemory::bind(cxxrtl::debug_items &items, const char *name)
+{
+    item = find_item(items, name, 1);
+    if (!item)
+        return;
+    mask = item->width == 32 ? ~0u : (1u << item->width) - 1;
+}
+
+SimTop::SimTop()
+{
+    design.debug_info(&items, NULL, "");
+    unbound = 0;
+
+    clk.bind(items, "clk");
+    reset.bind(items, "reset");
+    joy_btn_a.bind(items, "joy_btn_a");
+    joy_btn_b.bind(items, "joy_btn_b");
+    joy_btn_start.bind(items, "joy_btn_start");
+    joy_btn_select.bind(items, "joy_btn_select");
+    joy_btn_up.bind(items, "joy_btn_up");
+    joy_btn_down.bind(items, "joy_btn_down");
+    joy_btn_left.bind(items, "joy_btn_left");
+    joy_btn_right.bind(items, "joy_btn_right");
+    extbus_addr.bind(items, "extbus_addr");
+    extbus_data_w.bind(items, "extbus_data_w");
+    extbus_data_r.bind(items, "extbus_data_r");
+    extbus_do_write.bind(items, "extbus_do_write");
+    vram_addr.bind(items, "vram_addr");
+    vram_data_w.bind(items, "vram_data_w");
+    vram_data_r.bind(items, "vram_data_r");
+    vram_do_write.bind(items, "vram_do_write");
+    lcd_hblank.bind(items, "lcd_hblank");
+    lcd_vblank.bind(items, "lcd_vblank");
+    lcd_write.bind(items, "lcd_write");
+    lcd_col.bind(items, "lcd_col");
+    lcd_x.bind(items, "lcd_x");
+    lcd_y.bind(items, "lcd_y");
+    dbg_pc.bind(items, "dbg_pc");
+    dbg_sp.bind(items, "dbg_sp");
+    dbg_AF.bind(items, "dbg_AF");
+    dbg_BC.bind(items, "dbg_BC");
+    dbg_DE.bind(items, "dbg_DE");
+    dbg_HL.bind(items, "dbg_HL");
+    dbg_instruction_retired.bind(items, "dbg_instruction_retired");
+    dbg_halted.bind(items, "dbg_halted");
+    dbg_last_opcode.bind(items, "dbg_last_opcode");
+    dbg_stage.bind(items, "dbg_stage");
+    dbg_perf_sel.bind(items, "dbg_perf_sel");
+    dbg_perf_count.bind(items, "dbg_perf_count");
+    dbg_line_done.bind(items, "dbg_line_done");
+    dbg_line_mode3_cycles.bind(items, "dbg_line_mode3_cycles");
+    dbg_line_obj_fetches.bind(items, "dbg_line_obj_fetches");
+    dbg_line_obj_stall_cycles.bind(items, "dbg_line_obj_stall_cycles");
+    dbg_line_fetch_restarts.bind(items, "dbg_line_fetch_restarts");
+
+    main.bootrom_enabled.bind(items, "bootrom_enabled");
+    main.interrupts_enabled.bind(items, "interrupts_enabled");
+    main.interrupts_request.bind(items, "interrupts_request");
+    main.joypad_select.bind(items, "joypad_select");
+    main.oamdma_active.bind(items, "oamdma_active");
+    main.cpu_addr.bind(items, "cpu_addr");
+    main.cpu_do_write.bind(items, "cpu_do_write");
+    main.hram__DOT__mem.bind(items, "hram mem");
+    main.bootrom__DOT__mem.bind(items, "bootrom mem");
+
+    cpu.pc.bind(items, "cpu pc");
+    cpu.sp.bind(items, "cpu sp");
+    cpu.reg_A.bind(items, "cpu reg_A");
+    cpu.reg_B.bind(items, "cpu reg_B");
+    cpu.reg_C.bind(items, "cpu reg_C");
+    cpu.reg_D.bind(items, "cpu reg_D");
+    cpu.reg_E.bind(items, "cpu reg_E");
+    cpu.reg_H.bind(items, "cpu reg_H");
+    cpu.reg_L.bind(items, "cpu reg_L");
+    cpu.Z.bind(items, "cpu Z");
+    cpu.N.bind(items, "cpu N");
+    cpu.H.bind(items, "cpu H");
+    cpu.C.bind(items, "cpu C");
+    cpu.halted.bind(items, "cpu halted");
+    cpu.interrupts_master_enabled.bind(items, "cpu interrupts_master_enabled");
+    cpu.interrupts_ack.bind(items, "cpu interrupts_ack");
+    cpu.mem_addr.bind(items, "cpu mem_addr");
+    cpu.mem_do_write.bind(items, "cpu mem_do_write");
+    cpu.stage.bind(items, "cpu stage");
+
+    ppu.display_enabled.bind(items, "ppu display_enabled");
+    ppu.win_tilemap_select.bind(items, "ppu win_tilemap_select");
+    ppu.win_enabled.bind(items, "ppu win_enabled");
+    ppu.bgwin_tiledata_select.bind(items, "ppu bgwin_tiledata_select");
+    ppu.bg_tilemap_select.bind(items, "ppu bg_tilemap_select");
+    ppu.obj_size_select.bind(items, "ppu obj_size_select");
+    ppu.obj_enabled.bind(items, "ppu obj_enabled");
+    ppu.bg_enabled.bind(items, "ppu bg_enabled");
+    ppu.int_y_coincidence.bind(items, "ppu int_y_coincidence");
+    ppu.int_oam.bind(items, "ppu int_oam");
+    ppu.int_vblank.bind(items, "ppu int_vblank");
+    ppu.int_hblank.bind(items, "ppu int_hblank");
+    ppu.bg_y.bind(items, "ppu bg_y");
+    ppu.bg_x.bind(items, "ppu bg_x");
+    ppu.y_compare.bind(items, "ppu y_compare");
+    ppu.bg_pal.bind(items, "ppu bg_pal");
+    ppu.obj_pal0.bind(items, "ppu obj_pal0");
+    ppu.obj_pal1.bind(items, "ppu obj_pal1");
+    ppu.win_x.bind(items, "ppu win_x");
+    ppu.win_y.bind(items, "ppu win_y");
+    ppu.cur_x_clk.bind(items, "ppu cur_x_clk");
+    ppu.cur_y.bind(items, "ppu cur_y");
+    ppu.cur_x_px.bind(items, "ppu cur_x_px");
+    ppu.pixfetch_stage.bind(items, "ppu pixfetch_stage");
+    ppu.objfetch_active.bind(items, "ppu objfetch_active");
+    ppu.oam.bind(items, "ppu oam");
+
+    if (unbound) {
+        fprintf(stderr, "%d signal(s) of main.v not found in the CXXRTL model\n",
+                unbound);
+        abort();
+    }
+
+    /* lram.v only fills its memory with 0xff in simulation, which yosys does
+     * not see (it defines SYNTHESIS). */
+    for (size_t i = 0; i < main.hram__DOT__mem.size(); i++)
+        main.hram__DOT__mem[i] = 0xff;
+}
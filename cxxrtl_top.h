@@ -0,0 +1,144 @@
+/*
+ * main.v compiled by yosys' CXXRTL backend (BACKEND=cxxrtl, see the Makefile)
+ * behind the interface of the verilated model that gbsim.cpp uses (see
+ * sim_top.h).
+ *
+ * The ports and the internals gbsim.cpp needs are found by their hierarchical
+ * names in the debug information of the design when it is created, so the
+ * generated code can optimize everything else. Signals are at most 32 bits
+ * wide; reading one that CXXRTL computes on demand (outlined) evaluates it.
+ * Assigning to a register takes effect immediately, to an input port on the
+ * next eval().
+ */
+
+#ifndef CXXRTL_TOP_H
+#define CXXRTL_TOP_H
+
+#include <cstdint>
+
+#include "main_cxxrtl.h"
+
+class CxxrtlSignal
+{
+public:
+    CxxrtlSignal() : item(NULL) {}
+
+    void bind(cxxrtl::debug_items &items, const char *name);
+
+    operator uint32_t() const
+    {
+        if (item->type == cxxrtl::debug_item::OUTLINE)
+            item->outline->eval();
+        return item->curr[0];
+    }
+
+    CxxrtlSignal &operator=(uint32_t val)
+    {
+        val &= mask;
+        if (item->next)
+            item->next[0] = val;
+        if (!item->next || !input)
+            item->curr[0] = val;
+        return *this;
+    }
+
+    CxxrtlSignal &operator=(const CxxrtlSignal &other)
+    {
+        return *this = (uint32_t)other;
+    }
+
+private:
+    cxxrtl::debug_item *item;
+    uint32_t mask;
+    bool input;
+};
+
+/* A memory, indexed like an array of its words. */
+class CxxrtlMemory
+{
+public:
+    class Word
+    {
+    public:
+        Word(uint32_t *chunk, uint32_t mask) : chunk(chunk), mask(mask) {}
+
+        operator uint32_t() const { return *chunk; }
+
+        Word &operator=(uint32_t val)
+        {
+            *chunk = val & mask;
+            return *this;
+        }
+
+    private:
+        uint32_t *chunk;
+        uint32_t mask;
+    };
+
+    CxxrtlMemory() : item(NULL) {}
+
+    void bind(cxxrtl::debug_items &items, const char *name);
+
+    size_t size() const { return item->depth; }
+
+    Word operator[](size_t i) const
+    {
+        return Word(&item->curr[i], mask);
+    }
+
+private:
+    cxxrtl::debug_item *item;
+    uint32_t mask;
+};
+
+class SimTop
+{
+public:
+    CxxrtlSignal clk, reset;
+    CxxrtlSignal joy_btn_a, joy_btn_b, joy_btn_start, joy_btn_select;
+    CxxrtlSignal joy_btn_up, joy_btn_down, joy_btn_left, joy_btn_right;
+    CxxrtlSignal extbus_addr, extbus_data_w, extbus_data_r, extbus_do_write;
+    CxxrtlSignal vram_addr, vram_data_w, vram_data_r, vram_do_write;
+    CxxrtlSignal lcd_hblank, lcd_vblank, lcd_write, lcd_col, lcd_x, lcd_y;
+    CxxrtlSignal dbg_pc, dbg_sp, dbg_AF, dbg_BC, dbg_DE, dbg_HL;
+    CxxrtlSignal dbg_instruction_retired, dbg_halted, dbg_last_opcode;
+    CxxrtlSignal dbg_stage, dbg_perf_sel, dbg_perf_count;
+    CxxrtlSignal dbg_line_done, dbg_line_mode3_cycles, dbg_line_obj_fetches;
+    CxxrtlSignal dbg_line_obj_stall_cycles, dbg_line_fetch_restarts;
+
+    /* Internals of main.v, cpu.v and ppu.v (MAIN/CPU/PPU of sim_top.h). */
+    struct {
+        CxxrtlSignal bootrom_enabled, interrupts_enabled, interrupts_request;
+        CxxrtlSignal joypad_select, oamdma_active, cpu_addr, cpu_do_write;
+        CxxrtlMemory hram__DOT__mem, bootrom__DOT__mem;
+    } main;
+
+    struct {
+        CxxrtlSignal pc, sp, reg_A, reg_B, reg_C, reg_D, reg_E, reg_H, reg_L;
+        CxxrtlSignal Z, N, H, C, halted, interrupts_master_enabled;
+        CxxrtlSignal interrupts_ack, mem_addr, mem_do_write, stage;
+    } cpu;
+
+    struct {
+        CxxrtlSignal display_enabled, win_tilemap_select, win_enabled;
+        CxxrtlSignal bgwin_tiledata_select, bg_tilemap_select, obj_size_select;
+        CxxrtlSignal obj_enabled, bg_enabled;
+        CxxrtlSignal int_y_coincidence, int_oam, int_vblank, int_hblank;
+        CxxrtlSignal bg_y, bg_x, y_compare, bg_pal, obj_pal0, obj_pal1;
+        CxxrtlSignal win_x, win_y;
+        CxxrtlSignal cur_x_clk, cur_y, cur_x_px, pixfetch_stage;
+        CxxrtlSignal objfetch_active;
+        CxxrtlMemory oam;
+    } ppu;
+
+    SimTop();
+
+    void eval() { design.step(); }
+    void final() {}
+
+private:
+    cxxrtl_design::p_main design;
+    cxxrtl::debug_items items;
+};
+
+#endif
@@ -0,0 +1,134 @@
+/*
+ * Streams snapshots of the CPU debug ports over a UART.
+ *
+ * Whenever the transmitter is free, the state of the next retired instruction
+ * (or the halted CPU) is captured and sent as one fixed-size frame. Frames in
+ * between are dropped, so the host sees a sampled trace rather than every
+ * instruction. The frame layout (multi-byte fields big-endian) is:
+ *
+ *   0     1     2    3       4-5 6-7 8-9 10-11 12-13 14-15 16      17   18-21
+ *   0xA5  0x5A  seq  status  PC  SP  AF  BC    DE    HL    opcode  sel  count
+ *   22
+ *   cksum
+ *
+ * status is {halted, 1'b0, stage[5:0]} and seq increments per frame so lost
+ * frames can be detected. Every frame also carries one of the performance
+ * counters of cpu.v (count of counter sel, see PERF_* there), going round all
+ * perf_num of them in turn. cksum is chosen such that bytes 2..22 sum to zero
+ * (mod 256). See readserial.cpp for the host side.
+ */
+
+`include "uart.v"
+
+module dbgserial (
+    input clk,
+    input reset,
+
+    input [15:0] dbg_pc,
+    input [15:0] dbg_sp,
+    input [15:0] dbg_AF,
+    input [15:0] dbg_BC,
+    input [15:0] dbg_DE,
+    input [15:0] dbg_HL,
+    input dbg_instruction_retired,
+    input dbg_halted,
+    input [7:0] dbg_last_opcode,
+    input [5:0] dbg_stage,
+    output reg [3:0] dbg_perf_sel,
+    input [31:0] dbg_perf_count,
+
+    output tx
+);
+
+parameter clks_per_bit = 37;
+parameter perf_num = 11;
+
+localparam FRAME_LEN = 23;
+localparam SYNC0 = 8'hA5, SYNC1 = 8'h5A;
+
+reg frame_active;
+reg [4:0] frame_idx;
+reg [7:0] frame_seq;
+reg [7:0] frame_cksum;
+reg [7:0] snap_status, snap_opcode;
+reg [15:0] snap_pc, snap_sp, snap_AF, snap_BC, snap_DE, snap_HL;
+reg [3:0] snap_perf_sel;
+reg [31:0] snap_perf_count;
+
+reg tx_start;
+reg [7:0] tx_data;
+wire tx_busy;
+
+uart_tx #(.clks_per_bit(clks_per_bit))
+    uart_tx (clk, reset, tx_start, tx_data, tx_busy, tx);
+
+function [7:0] frame_byte(input [4:0] idx);
+    case (idx)
+        0:  frame_byte = SYNC0;
+        1:  frame_byte = SYNC1;
+        2:  frame_byte = frame_seq;
+        3:  frame_byte = snap_status;
+        4:  frame_byte = snap_pc[15:8];
+        5:  frame_byte = snap_pc[7:0];
+        6:  frame_byte = snap_sp[15:8];
+        7:  frame_byte = snap_sp[7:0];
+        8:  frame_byte = snap_AF[15:8];
+        9:  frame_byte = snap_AF[7:0];
+        10: frame_byte = snap_BC[15:8];
+        11: frame_byte = snap_BC[7:0];
+        12: frame_byte = snap_DE[15:8];
+        13: frame_byte = snap_DE[7:0];
+        14: frame_byte = snap_HL[15:8];
+        15: frame_byte = snap_HL[7:0];
+        16: frame_byte = snap_opcode;
+        17: frame_byte = {4'h0, snap_perf_sel};
+        18: frame_byte = snap_perf_count[31:24];
+        19: frame_byte = snap_perf_count[23:16];
+        20: frame_byte = snap_perf_count[15:8];
+        21: frame_byte = snap_perf_count[7:0];
+        22: frame_byte = 8'h00 - frame_cksum;
+        default: frame_byte = 8'h00;
+    endcase
+endfunction
+
+always @(posedge clk) begin
+    tx_start <= 0;
+
+    if (reset) begin
+        frame_active <= 0;
+        frame_idx <= 0;
+        frame_seq <= 0;
+        frame_cksum <= 0;
+        dbg_perf_sel <= 0;
+    end else if (!frame_active) begin
+        if (dbg_instruction_retired || dbg_halted) begin
+            snap_status <= {dbg_halted, 1'b0, dbg_stage};
+            snap_opcode <= dbg_last_opcode;
+            snap_pc <= dbg_pc;
+            snap_sp <= dbg_sp;
+            snap_AF <= dbg_AF;
+            snap_BC <= dbg_BC;
+            snap_DE <= dbg_DE;
+            snap_HL <= dbg_HL;
+            snap_perf_sel <= dbg_perf_sel;
+            snap_perf_count <= dbg_perf_count;
+            dbg_perf_sel <= dbg_perf_sel == perf_num - 1 ? 0 :
+                                                           dbg_perf_sel + 1;
+            frame_active <= 1;
+            frame_idx <= 0;
+            frame_cksum <= 0;
+        end
+    end else if (!tx_start && !tx_busy) begin
+        tx_data <= frame_byte(frame_idx);
+        tx_start <= 1;
+        if (frame_idx >= 2)
+            frame_cksum <= frame_cksum + frame_byte(frame_idx);
+        if (frame_idx == FRAME_LEN - 1) begin
+            frame_active <= 0;
+            frame_seq <= frame_seq + 1;
+        end else
+            frame_idx <= frame_idx + 1;
+    end
+end
+
+endmodule
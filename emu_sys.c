@@ -0,0 +1,220 @@
+/*
+ * Behavioural model of main.v/ppu.v around emu_cpu.c, see emu_sys.h.
+ *
+ * Time is only advanced between instructions (by the number of cycles the
+ * instruction takes in cpu.v), so PPU state observed by the CPU may be off by
+ * a few cycles compared to the RTL. This is fine for getting through boot and
+ * initialization code, which only polls LY/STAT in loops.
+ */
+
+#include "emu_sys.h"
+#include "emu_cpu.h"
+#include "gbsim.h"
+
+#define CYCLES_X 456
+#define CYCLES_Y 154
+#define OAM_CYCLES 80
+#define PIX_Y 144
+
+/* ppu.v draws a line in 160 cycles plus fetcher and object stalls. Treat the
+ * line as drawing up to PIX_END for reads of STAT and VRAM, and only hand off
+ * after HANDOFF_X, which leaves room for ten objects per line. */
+#define PIX_END (OAM_CYCLES + 172)
+#define HANDOFF_X 400
+
+#define LCDC_DISPLAY_ENABLE 0x80
+
+#define REG_P1   0xff00
+#define REG_IF   0xff0f
+#define REG_LCDC 0xff40
+#define REG_STAT 0xff41
+#define REG_LY   0xff44
+#define REG_DMA  0xff46
+#define REG_WY   0xff4b
+#define REG_BOOT 0xff50
+#define REG_IE   0xffff
+
+static u8 *ppu_reg(struct emu_sys *sys, u16 addr)
+{
+    switch (addr) {
+    case 0xff40: return &sys->lcdc;
+    case 0xff41: return &sys->stat;
+    case 0xff42: return &sys->scy;
+    case 0xff43: return &sys->scx;
+    case 0xff45: return &sys->lyc;
+    case 0xff47: return &sys->bgp;
+    case 0xff48: return &sys->obp0;
+    case 0xff49: return &sys->obp1;
+    case 0xff4a: return &sys->wx;
+    case 0xff4b: return &sys->wy;
+    default:     return NULL;
+    }
+}
+
+static u8 ppu_mode(const struct emu_sys *sys)
+{
+    if (sys->ppu_y >= PIX_Y)
+        return 1;
+    if (sys->ppu_x_clk < OAM_CYCLES)
+        return 2;
+    return sys->ppu_x_clk < PIX_END ? 3 : 0;
+}
+
+static u8 sys_read(void *ctx, u16 addr)
+{
+    struct emu_sys *sys = ctx;
+
+    if (sys->bootrom_enabled && addr < 0x100)
+        return sys->bootrom[addr];
+    if (addr < 0x8000 || (addr >= 0xa000 && addr < 0xc000))
+        return sys->cart_read(sys->cart_ctx, addr);
+    if (addr >= 0xc000 && addr < 0xfe00)
+        return sys->wram[(addr - 0xc000) & 0x1fff];
+    if (addr >= 0xff80 && addr < 0xffff)
+        return sys->hram[addr - 0xff80];
+    if (addr >= 0x8000 && addr < 0xa000)
+        return ppu_mode(sys) == 3 ? 0xff : sys->vram[addr - 0x8000];
+    if (addr >= 0xfe00 && addr < 0xfe00 + EMU_SYS_OAM_SIZE)
+        return sys->oam[addr - 0xfe00];
+    if (addr == REG_STAT)
+        return (sys->stat & 0x78) | (sys->ppu_y == sys->lyc ? 0x04 : 0) |
+               ppu_mode(sys);
+    if (addr == REG_LY)
+        return sys->ppu_y;
+    if (addr >= REG_LCDC && addr <= REG_WY) {
+        u8 *reg = ppu_reg(sys, addr);
+        return reg ? *reg : 0xff;
+    }
+    if (addr == REG_P1) {
+        u8 pressed = 0;
+        if (sys->joypad_select & 1)
+            pressed |= ((sys->buttons & GBSIM_BTN_START) ? 8 : 0) |
+                       ((sys->buttons & GBSIM_BTN_SELECT) ? 4 : 0) |
+                       ((sys->buttons & GBSIM_BTN_A) ? 2 : 0) |
+                       ((sys->buttons & GBSIM_BTN_B) ? 1 : 0);
+        if (sys->joypad_select & 2)
+            pressed |= ((sys->buttons & GBSIM_BTN_DOWN) ? 8 : 0) |
+                       ((sys->buttons & GBSIM_BTN_UP) ? 4 : 0) |
+                       ((sys->buttons & GBSIM_BTN_LEFT) ? 2 : 0) |
+                       ((sys->buttons & GBSIM_BTN_RIGHT) ? 1 : 0);
+        return 0xc0 | (sys->joypad_select << 4) | (~pressed & 0xf);
+    }
+    if (addr == REG_IF)
+        return 0xe0 | sys->if_;
+    if (addr == REG_IE)
+        return sys->ie;
+    return 0xff;
+}
+
+static void sys_write(void *ctx, u16 addr, u8 val)
+{
+    struct emu_sys *sys = ctx;
+
+    if (addr < 0x8000 || (addr >= 0xa000 && addr < 0xc000)) {
+        sys->cart_write(sys->cart_ctx, addr, val);
+    } else if (addr >= 0xc000 && addr < 0xe000) {
+        sys->wram[addr - 0xc000] = val;
+    } else if (addr >= 0xff80 && addr < 0xffff) {
+        sys->hram[addr - 0xff80] = val;
+    } else if (addr >= 0x8000 && addr < 0xa000) {
+        if (ppu_mode(sys) != 3)
+            sys->vram[addr - 0x8000] = val;
+    } else if (addr >= 0xfe00 && addr < 0xfe00 + EMU_SYS_OAM_SIZE) {
+        sys->oam[addr - 0xfe00] = val;
+    } else if (addr == REG_LY) {
+        sys->ppu_y = 0;
+    } else if (addr == REG_STAT) {
+        sys->stat = val & 0x78;
+    } else if (addr == REG_DMA) {
+        /* The RTL takes ~640 cycles during which the CPU keeps running (and
+         * reads HRAM); code waits for it in HRAM, so copying at once is
+         * indistinguishable. */
+        for (int i = 0; i < EMU_SYS_OAM_SIZE; i++)
+            sys->oam[i] = sys_read(sys, (val << 8) | i);
+    } else if (addr >= REG_LCDC && addr <= REG_WY) {
+        u8 *reg = ppu_reg(sys, addr);
+        if (reg)
+            *reg = val;
+    } else if (addr == REG_P1) {
+        sys->joypad_select = (val >> 4) & 3;
+    } else if (addr == REG_BOOT) {
+        sys->bootrom_enabled = 0;
+    } else if (addr == REG_IF) {
+        sys->if_ = val & 0x1f;
+    } else if (addr == REG_IE) {
+        sys->ie = val;
+    }
+}
+
+static void ppu_tick(struct emu_sys *sys, int cycles)
+{
+    sys->cycles += cycles;
+    if (!(sys->lcdc & LCDC_DISPLAY_ENABLE))
+        return;
+
+    sys->ppu_x_clk += cycles;
+    while (sys->ppu_x_clk >= CYCLES_X) {
+        sys->ppu_x_clk -= CYCLES_X;
+        sys->ppu_y = sys->ppu_y == CYCLES_Y - 1 ? 0 : sys->ppu_y + 1;
+        if (sys->ppu_y == PIX_Y)
+            sys->if_ |= 0x01;
+    }
+}
+
+bool emu_sys_handoff_safe(const struct emu_sys *sys)
+{
+    return !(sys->lcdc & LCDC_DISPLAY_ENABLE) || sys->ppu_y >= PIX_Y ||
+           sys->ppu_x_clk >= HANDOFF_X;
+}
+
+int emu_sys_run(struct emu_sys *sys, int stop_mask, u64 max_cycles, u16 pc)
+{
+    u64 end_cycle = sys->cycles + max_cycles;
+    struct ecpu *cpu;
+    int stop = 0;
+
+    cpu = ecpu_create();
+    if (!cpu)
+        return -1;
+    ecpu_set_mmu(cpu, sys, sys_read, sys_write);
+    ecpu_set_quirks(cpu, sys->match_cpu_v ? ECPU_QUIRKS_CPU_V : 0);
+    ecpu_reset(cpu, &sys->cpu);
+
+    while (!stop) {
+        u8 pending = sys->ie & sys->if_ & 0x1f;
+        bool ime = sys->cpu.interrupts_master_enabled;
+
+        if (ime && pending) {
+            int num = __builtin_ctz(pending);
+            sys->if_ &= ~(1 << num);
+            ppu_tick(sys, ecpu_interrupt(cpu, 0x40 + num * 8));
+        } else if (sys->cpu.halted) {
+            /* Without IME, cpu.v never leaves HALT. */
+            ppu_tick(sys, 1);
+            if (sys->cycles >= end_cycle)
+                stop |= GBSIM_STOP_CYCLES;
+            stop &= stop_mask;
+            continue;
+        } else {
+            int cycles = ecpu_step(cpu);
+            if (cycles < 0) {
+                stop = -1;
+                break;
+            }
+            ppu_tick(sys, cycles);
+        }
+
+        ecpu_get_state(cpu, &sys->cpu);
+        if (sys->cpu.PC == pc)
+            stop |= GBSIM_STOP_PC;
+        if (sys->cpu.halted)
+            stop |= GBSIM_STOP_HALT;
+        if (sys->cycles >= end_cycle)
+            stop |= GBSIM_STOP_CYCLES;
+        stop &= stop_mask;
+    }
+
+    ecpu_get_state(cpu, &sys->cpu);
+    ecpu_destroy(cpu);
+    return stop;
+}
@@ -0,0 +1,78 @@
+/*
+ * Behavioural model of the full system (main.v) around the reference CPU
+ * emulator of test_instructions/emu_cpu.c.
+ *
+ * This is not a general Game Boy emulator: it models the system as main.v and
+ * ppu.v implement it (including their deviations from real hardware), so its
+ * state can be transferred into the verilated model at any instruction
+ * boundary. It is used to fast-forward through boot and initialization code
+ * before continuing in RTL, see gbsim_fast_forward().
+ */
+
+#ifndef EMU_SYS_H
+#define EMU_SYS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EMU_SYS_HRAM_SIZE 0x7f
+#define EMU_SYS_OAM_SIZE  0xa0
+
+struct emu_sys {
+    /* CPU registers, loaded into emu_cpu.c for the duration of emu_sys_run. */
+    struct state cpu;
+
+    /* Whether the CPU reproduces cpu.v's deviations from the SM83
+     * (ECPU_QUIRKS_CPU_V), as it has to for handing off to the RTL. */
+    bool match_cpu_v;
+
+    /* Cartridge (ROM/RAM at 0000-7FFF and A000-BFFF). */
+    void *cart_ctx;
+    u8 (*cart_read)(void *ctx, u16 addr);
+    void (*cart_write)(void *ctx, u16 addr, u8 val);
+
+    /* Memories, usually shared with the simulation this state came from. */
+    const u8 *bootrom;  // 0x100 bytes
+    u8 *vram;           // 0x2000 bytes
+    u8 *wram;           // 0x2000 bytes
+    u8 hram[EMU_SYS_HRAM_SIZE];
+    u8 oam[EMU_SYS_OAM_SIZE];
+
+    /* main.v */
+    bool bootrom_enabled;
+    u8 ie, if_;
+    u8 joypad_select;   // P1 bits 5:4
+    u8 buttons;         // GBSIM_BTN_* mask
+
+    /* ppu.v registers, in the order of the FF40-FF4B address space. */
+    u8 lcdc, stat, scy, scx, lyc, bgp, obp0, obp1, wx, wy;
+    u16 ppu_x_clk;      // 0..455
+    u8 ppu_y;           // LY
+
+    u64 cycles;
+};
+
+/*
+ * Runs the system until any of the conditions in stop_mask is met
+ * (GBSIM_STOP_CYCLES, GBSIM_STOP_PC and GBSIM_STOP_HALT are supported), with
+ * the same meaning as for gbsim_run_until(). Conditions are checked after
+ * every instruction. Returns the mask of conditions that caused it to stop,
+ * or -1 if the CPU hit an opcode emu_cpu.c does not implement.
+ */
+int emu_sys_run(struct emu_sys *sys, int stop_mask, u64 max_cycles, u16 pc);
+
+/* Whether the state can be transferred into the RTL model: the PPU must not be
+ * drawing, as its pixel pipeline is not modeled. */
+bool emu_sys_handoff_safe(const struct emu_sys *sys);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
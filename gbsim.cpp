@@ -0,0 +1,1405 @@
+/*
+ * Simulation of the full system (main.v) around the verilated model: provides
+ * the cartridge, WRAM and VRAM memories on the external buses and captures
+ * the LCD output. See gbsim.h for the API.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "gbsim.h"
+#include "cpuperf.h"
+#include "emu_sys.h"
+#include "contention.h"
+#include "coverage.h"
+#include "profile.h"
+#include "scanlines.h"
+#include "sim_top.h"
+#include "symbols.h"
+#include "vcoverage.h"
+#if defined(PPU_MODEL) || defined(PPU_LOCKSTEP)
+#include "ppu_model.h"
+#endif
+#ifdef CPU_MODEL
+#include "cpu_model.h"
+#endif
+
+#define RES_X GBSIM_LCD_WIDTH
+#define RES_Y GBSIM_LCD_HEIGHT
+
+#define CPU_STAGE_RESET     0
+#define CPU_STAGE_HALTED    1
+#define CPU_STAGE_LOAD_MEM2 17
+#define CPU_STAGE_LOAD_MEM6 21
+#define CPU_STAGE_WRITEBACK 41
+
+class MemRegion
+{
+protected:
+    uint8_t *mem;
+    uint16_t base, end;
+public:
+    MemRegion(uint16_t base, uint16_t end)
+        : base(base), end(end)
+    {
+        mem = (uint8_t *)calloc(end - base, 1);
+    }
+
+    ~MemRegion()
+    {
+        free(mem);
+    }
+
+    uint8_t *data(size_t *size)
+    {
+        *size = end - base;
+        return mem;
+    }
+
+    void update(uint16_t addr, bool do_write, uint8_t val, uint8_t *rv)
+    {
+        if (addr >= base && addr < end) {
+            if (do_write)
+                mem[addr - base] = val;
+            else
+                *rv = mem[addr - base];
+        }
+    }
+};
+
+/*
+ * Ring buffer of the most recent events (see gbsim_events_enable). Recording
+ * an event is only a mask test and a few stores.
+ */
+#define EVENT_LOG_SIZE 4096 // Must be a power of two
+
+struct EventLog
+{
+    unsigned mask;
+    uint64_t head, tail; // Number of events written and read in total
+
+    /* Source of the timestamps of events. */
+    const uint64_t *cycles;
+    const SimTop *top;
+
+    struct gbsim_event buf[EVENT_LOG_SIZE];
+
+    inline bool enabled(uint8_t type)
+    {
+        return mask & (1u << type);
+    }
+
+    inline void log(uint8_t type, uint8_t val, uint16_t arg = 0)
+    {
+        if (!enabled(type))
+            return;
+        struct gbsim_event *ev = &buf[head++ & (EVENT_LOG_SIZE - 1)];
+        ev->cycle = *cycles;
+        ev->pc = top->dbg_pc;
+        ev->arg = arg;
+        ev->type = type;
+        ev->val = val;
+    }
+};
+
+/*
+ * PPU_LOCKSTEP builds run ppu_model.v next to ppu.v (see main.v); whenever
+ * ppu.v moves on to the next line, the line it drew, its registers, OAM and
+ * position are compared with the model's (gbsim::lockstep_line).
+ */
+#define LOCKSTEP_MAX_REPORTS 10
+
+struct Lockstep
+{
+    uint8_t y_old;
+    uint64_t lines, lines_mismatched, mismatches;
+    bool line_ok;
+};
+
+#define ROMHDR_CART_TYPE 0x0147
+#define ROMHDR_RAM_SIZE 0x0149
+
+#define CART_TYPE_ROMONLY 0x00
+#define CART_TYPE_MBC3_RAM_BAT 0x13
+
+#define ROMBANK_SIZE 0x4000
+#define RAMBANK_SIZE 0x2000
+
+class Cartridge
+{
+protected:
+    size_t rom_size;
+    uint8_t *rom;
+    Cartridge(size_t rom_size, uint8_t *rom_data)
+            : rom_size(rom_size), rom(rom_data), events(NULL)
+    {
+    }
+public:
+    EventLog *events;
+
+    virtual ~Cartridge()
+    {
+        free(rom);
+    }
+
+    virtual uint8_t read(uint16_t addr) = 0;
+    virtual void write(uint16_t addr, uint8_t data) = 0;
+
+    uint8_t *rom_data(size_t *size)
+    {
+        *size = rom_size;
+        return rom;
+    }
+
+    virtual uint8_t *ram_data(size_t *size)
+    {
+        *size = 0;
+        return NULL;
+    }
+
+    /* ROM bank currently mapped at 0x4000-0x7fff. */
+    virtual uint8_t cur_rom_bank()
+    {
+        return 1;
+    }
+
+    void update(uint16_t addr, bool do_write, uint8_t val, uint8_t *rv)
+    {
+        if (addr < 0x8000 || (addr >= 0xA000 && addr < 0xC000)) {
+            if (do_write)
+                write(addr, val);
+            else
+                *rv = read(addr);
+        }
+    }
+};
+
+class CartRomOnly : public Cartridge
+{
+public:
+    CartRomOnly(size_t rom_size, uint8_t *rom_data)
+        : Cartridge(rom_size, rom_data)
+    {
+    }
+
+    virtual uint8_t read(uint16_t addr)
+    {
+        if (addr >= 0x8000 || addr > rom_size)
+            return 0xaa;
+        return rom[addr];
+    }
+
+    virtual void write(uint16_t addr, uint8_t data)
+    {
+    }
+};
+
+class CartMBC3 : public Cartridge
+{
+    // TODO: RTC, disabling extram
+protected:
+    uint8_t rom_bank, ram_bank;
+    size_t ram_size;
+    uint8_t *ram;
+public:
+    CartMBC3(size_t rom_size, uint8_t *rom_data, size_t ram_size)
+        : Cartridge(rom_size, rom_data),
+          rom_bank(1), ram_bank(0), ram_size(ram_size)
+    {
+        ram = NULL;
+        if (ram_size)
+            ram = (uint8_t *)calloc(ram_size, 1);
+    }
+
+    virtual ~CartMBC3()
+    {
+        free(ram);
+    }
+
+    virtual uint8_t *ram_data(size_t *size)
+    {
+        *size = ram_size;
+        return ram;
+    }
+
+    virtual uint8_t cur_rom_bank()
+    {
+        return rom_bank;
+    }
+
+    virtual uint8_t read(uint16_t addr)
+    {
+        if (addr < 0x4000)
+            return rom[addr];
+        else if (addr < 0x8000)
+            return rom[addr - 0x4000 + rom_bank * ROMBANK_SIZE];
+        else if (addr >= 0xA000 && addr < 0xC000)
+            return ram[addr - 0xA000 + ram_bank * RAMBANK_SIZE];
+        return 0xaa;
+    }
+
+    virtual void write(uint16_t addr, uint8_t data)
+    {
+        // Writes are seen on both clock edges, so only log actual switches.
+        if (addr >= 0x2000 && addr < 0x4000) {
+            uint8_t old_bank = rom_bank;
+            rom_bank = data & 0x7f;
+            // TODO truncate
+            if (rom_bank == 0)
+                rom_bank = 1;
+            if (events && rom_bank != old_bank)
+                events->log(GBSIM_EV_ROM_BANK, rom_bank);
+        } else if (addr >= 0x4000 && addr < 0x6000) {
+            if (data <= 3 && data != ram_bank) {
+                ram_bank = data;
+                if (events)
+                    events->log(GBSIM_EV_RAM_BANK, ram_bank);
+            }
+            // TODO RTC
+        }
+    }
+};
+
+static int read_file(const char *filename, uint8_t **buf, size_t *size)
+{
+    FILE *fp;
+
+    fp = fopen(filename, "rb");
+    if (!fp) {
+        fprintf(stderr, "Failed to load file (\"%s\").\n", filename);
+        return 1;
+    }
+
+    /* Get the file size */
+    fseek(fp, 0L, SEEK_END);
+    size_t allocsize = ftell(fp) * sizeof(uint8_t);
+    rewind(fp);
+
+    *buf = (uint8_t *)malloc(allocsize);
+    if (*buf == NULL) {
+        fprintf(stderr,
+                "Error allocating mem for file (file=%s, size=%zu byte).",
+                filename, allocsize);
+        fclose(fp);
+        return 1;
+    }
+    *size = fread(*buf, sizeof(uint8_t), allocsize, fp);
+    fclose(fp);
+    return 0;
+}
+
+/* Creates a cartridge taking ownership of rom (malloc'ed). Returns NULL for
+ * unsupported cartridges. */
+static Cartridge *create_cart(uint8_t *rom, size_t rom_size)
+{
+    if (rom_size < 0x150) {
+        fprintf(stderr, "ROM too small (%zu bytes)\n", rom_size);
+        free(rom);
+        return NULL;
+    }
+
+    uint8_t cart_type = rom[ROMHDR_CART_TYPE];
+    switch (cart_type) {
+    case CART_TYPE_ROMONLY:
+        return new CartRomOnly(rom_size, rom);
+    case CART_TYPE_MBC3_RAM_BAT: {
+        uint8_t cart_ram_size = rom[ROMHDR_RAM_SIZE];
+        size_t ram_size;
+        switch (cart_ram_size) {
+        case 0: ram_size =   0 * 1024; break;
+        case 1: ram_size =   2 * 1024; break;
+        case 2: ram_size =   8 * 1024; break;
+        case 3: ram_size =  32 * 1024; break;
+        case 4: ram_size = 128 * 1024; break;
+        case 5: ram_size =  64 * 1024; break;
+        default:
+            fprintf(stderr, "Unsupported RAM size %#02x\n", cart_ram_size);
+            free(rom);
+            return NULL;
+        }
+        return new CartMBC3(rom_size, rom, ram_size);
+    }
+    default:
+        fprintf(stderr, "Unsupported cart type %#02x\n", cart_type);
+        free(rom);
+        return NULL;
+    }
+}
+
+struct gbsim {
+    SimTop *top;
+    MemRegion vram, wram;
+    Cartridge *cart;
+
+    uint64_t cycles;
+    bool vblank_old;
+    unsigned buttons;
+
+    EventLog events;
+    uint8_t lcd_mode_old;
+
+    Symbols symbols;
+    Profiler profile;
+    Coverage coverage;
+    Scanlines scanlines;
+    Contention contention;
+#ifdef PPU_LOCKSTEP
+    Lockstep lockstep;
+#endif
+
+    uint8_t pixbuf[RES_X * RES_Y];
+    /* Copy of the boot ROM for the reference emulator. */
+    uint8_t bootrom[0x100];
+
+    gbsim()
+        : vram(0x8000, 0xA000), wram(0xC000, 0xE000), cart(NULL),
+          cycles(0), vblank_old(0), buttons(0), lcd_mode_old(0)
+    {
+        top = new SimTop;
+        vcoverage_model_created();
+        memset(pixbuf, 0, sizeof(pixbuf));
+        memset(&events, 0, sizeof(events));
+        events.cycles = &cycles;
+        events.top = top;
+    }
+
+    ~gbsim()
+    {
+        vcoverage_save();
+        top->final();
+        delete top;
+        delete cart;
+    }
+
+    /* Connects the external memories to the buses and advances the model by
+     * half a clock cycle. */
+    inline void half_cycle()
+    {
+        uint8_t extbus_data_r = top->extbus_data_r;
+        uint8_t vram_data_r = top->vram_data_r;
+
+        if (cart)
+            cart->update(top->extbus_addr, top->extbus_do_write,
+                         top->extbus_data_w, &extbus_data_r);
+        wram.update(top->extbus_addr, top->extbus_do_write, top->extbus_data_w,
+                    &extbus_data_r);
+        vram.update(top->vram_addr, top->vram_do_write, top->vram_data_w,
+                    &vram_data_r);
+        top->extbus_data_r = extbus_data_r;
+        top->vram_data_r = vram_data_r;
+
+        top->clk = !top->clk;
+        top->eval();
+    }
+
+    /* Records events visible on the ports/internals of main.v after a full
+     * clock cycle. Only called if any of these event types is enabled. */
+    void log_events()
+    {
+        /* CPU writes are on the bus for exactly one cycle. */
+        if (top->extbus_do_write) {
+            switch (top->extbus_addr) {
+            case 0xFF46: events.log(GBSIM_EV_DMA, top->extbus_data_w); break;
+            case 0xFFFF: events.log(GBSIM_EV_IE, top->extbus_data_w); break;
+            case 0xFF0F: events.log(GBSIM_EV_IF, top->extbus_data_w); break;
+            }
+        }
+
+        if (events.enabled(GBSIM_EV_LCD_MODE)) {
+            uint8_t mode = lcd_mode();
+            if (mode != lcd_mode_old)
+                events.log(GBSIM_EV_LCD_MODE, mode, ly());
+            lcd_mode_old = mode;
+        }
+    }
+
+    /* Records a CPU data access after a full clock cycle, and whether ppu.v
+     * or OAM DMA blocks it. Loads are seen the cycle before they latch the
+     * data (LOAD_MEM2/6), stores while they are on the bus. Instruction
+     * fetches are not counted. */
+    void record_access()
+    {
+        bool dma = MAIN(oamdma_active);
+        bool write = MAIN(cpu_do_write);
+        uint16_t addr = MAIN(cpu_addr);
+        Contention::Block block = Contention::NOT_BLOCKED;
+
+        if (dma)
+            contention.dma_cycle();
+        if (!write && top->dbg_stage != CPU_STAGE_LOAD_MEM2 &&
+                top->dbg_stage != CPU_STAGE_LOAD_MEM6)
+            return;
+
+        uint8_t mode = lcd_mode();
+        if (dma && (addr < 0xFF80 || addr == 0xFFFF)) {
+            block = Contention::BLOCKED_DMA;
+        } else if (addr >= 0x8000 && addr < 0xA000) {
+            /* Reads get the fetcher's data, writes are dropped. */
+            if (ppu_vram_busy())
+                block = Contention::BLOCKED_PPU;
+        } else if (addr >= 0xFE00 && addr < 0xFEA0 && !write) {
+            /* The OAM address is the PPU's during OAM search (mode 2) and
+             * object fetches. Writes still land. */
+            if (mode == 2 || ppu_obj_fetch())
+                block = Contention::BLOCKED_PPU;
+        }
+        contention.access(addr, write, mode, ly(), block,
+                          loc_of(top->dbg_pc, rom_bank(top->dbg_pc)));
+    }
+
+    /* Bank of the ROM at addr, for the profiler and coverage: 0 outside of
+     * the switchable area. */
+    uint8_t rom_bank(uint16_t addr)
+    {
+        return cart && addr >= 0x4000 && addr < 0x8000 ? cart->cur_rom_bank()
+                                                        : 0;
+    }
+
+    /*
+     * What the rest of the simulation needs to know about the PPU and CPU, in
+     * hybrid builds from the C++ model in their place (see the Makefile).
+     */
+#ifdef PPU_MODEL
+    PpuModel *ppu_model()
+    {
+        return (PpuModel *)VL_CVT_Q_VP(PPU(model));
+    }
+
+    uint8_t ly()
+    {
+        return ppu_model()->y;
+    }
+
+    uint8_t lcd_mode()
+    {
+        PpuModel *ppu = ppu_model();
+        return ppu->enabled() ? ppu->mode() : 4;
+    }
+
+    bool ppu_vram_busy()
+    {
+        return ppu_model()->drawing();
+    }
+
+    bool ppu_obj_fetch()
+    {
+        return 0;
+    }
+#else
+    uint8_t ly()
+    {
+        return PPU(cur_y);
+    }
+
+    /* STAT mode as computed by ppu.v, or 4 if the LCD is off. */
+    uint8_t lcd_mode()
+    {
+        if (!PPU(display_enabled))
+            return 4;
+        if (PPU(cur_y) >= RES_Y)
+            return 1;
+        if (PPU(cur_x_clk) < 80)
+            return 2;
+        return PPU(cur_x_px) < RES_X ? 3 : 0;
+    }
+
+    /* Whether ppu.v is fetching pixels or objects, which takes the VRAM (and
+     * for objects the OAM) address away from the CPU. */
+    bool ppu_vram_busy()
+    {
+        return PPU(pixfetch_stage) ||
+               PPU(objfetch_active);
+    }
+
+    bool ppu_obj_fetch()
+    {
+        return PPU(objfetch_active);
+    }
+#endif
+
+#ifdef PPU_LOCKSTEP
+    PpuModel *ppu_ref()
+    {
+        return (PpuModel *)VL_CVT_Q_VP(MAIN(ppu_ref__DOT__model));
+    }
+
+    void lockstep_line();
+    void lockstep_mismatch(uint8_t y, const char *what, unsigned rtl,
+                           unsigned model);
+#endif
+
+#ifdef CPU_MODEL
+    CpuModel *cpu_model()
+    {
+        return (CpuModel *)VL_CVT_Q_VP(CPU(model));
+    }
+
+    /* Interrupts acknowledged by the instruction being retired. */
+    uint8_t cpu_intack()
+    {
+        return cpu_model()->intack;
+    }
+#else
+    uint8_t cpu_intack()
+    {
+        return CPU(interrupts_ack);
+    }
+#endif
+};
+
+/* Event types recorded by gbsim::log_events(). */
+#define EVENTS_RTL ((1u << GBSIM_EV_DMA) | (1u << GBSIM_EV_IE) | \
+                    (1u << GBSIM_EV_IF) | (1u << GBSIM_EV_LCD_MODE))
+
+extern "C" {
+
+struct gbsim *gbsim_create(void)
+{
+    struct gbsim *sim = new gbsim;
+    gbsim_reset(sim);
+    return sim;
+}
+
+void gbsim_destroy(struct gbsim *sim)
+{
+    delete sim;
+}
+
+void gbsim_reset(struct gbsim *sim)
+{
+    SimTop *top = sim->top;
+
+    top->reset = 1;
+    top->clk = 0;
+    top->eval();
+    top->clk = 1;
+    top->eval();
+    top->reset = 0;
+    top->clk = 0;
+    top->eval();
+
+    /* The PPU models draw from VRAM directly. */
+#ifdef PPU_MODEL
+    size_t vram_size;
+    sim->ppu_model()->set_vram(sim->vram.data(&vram_size));
+#endif
+#ifdef PPU_LOCKSTEP
+    size_t vram_size;
+    sim->ppu_ref()->set_vram(sim->vram.data(&vram_size));
+    memset(&sim->lockstep, 0, sizeof(sim->lockstep));
+    sim->lockstep.y_old = sim->ly();
+#endif
+
+    sim->cycles = 0;
+    sim->vblank_old = 0;
+    sim->events.head = sim->events.tail = 0;
+    sim->lcd_mode_old = sim->lcd_mode();
+    sim->profile.clear(top->dbg_pc, top->dbg_sp, sim->rom_bank(top->dbg_pc));
+
+    size_t rom_size = 0;
+    if (sim->cart)
+        sim->cart->rom_data(&rom_size);
+    sim->coverage.clear(rom_size);
+    sim->coverage.restart(top->dbg_pc, sim->rom_bank(top->dbg_pc),
+                          MAIN(bootrom_enabled));
+    sim->scanlines.clear();
+    sim->contention.clear();
+}
+
+static int set_cart(struct gbsim *sim, Cartridge *cart)
+{
+    if (!cart)
+        return 1;
+    delete sim->cart;
+    sim->cart = cart;
+    cart->events = &sim->events;
+    gbsim_reset(sim);
+    return 0;
+}
+
+int gbsim_load_rom(struct gbsim *sim, const char *filename)
+{
+    uint8_t *rom;
+    size_t rom_size;
+    if (read_file(filename, &rom, &rom_size))
+        return 1;
+    return set_cart(sim, create_cart(rom, rom_size));
+}
+
+int gbsim_load_rom_mem(struct gbsim *sim, const uint8_t *data, size_t size)
+{
+    uint8_t *rom = (uint8_t *)malloc(size);
+    if (!rom)
+        return 1;
+    memcpy(rom, data, size);
+    return set_cart(sim, create_cart(rom, size));
+}
+
+int gbsim_run_until(struct gbsim *sim, int stop_mask, uint64_t max_cycles,
+                    uint16_t pc)
+{
+    SimTop *top = sim->top;
+    uint64_t end_cycle = sim->cycles + max_cycles;
+    bool log_events = sim->events.mask & EVENTS_RTL;
+    bool profile = sim->profile.enabled;
+    bool coverage = sim->coverage.enabled;
+    bool scanlines = sim->scanlines.enabled;
+    bool contention = sim->contention.enabled;
+    int stop = 0;
+
+    while (!stop) {
+        if (sim_top_finished())
+            return GBSIM_STOP_FINISH;
+
+        /* One full clock cycle: rising edge, then falling edge. */
+        sim->half_cycle();
+        sim->half_cycle();
+        sim->cycles++;
+
+        if (top->lcd_write)
+            sim->pixbuf[top->lcd_x + top->lcd_y * RES_X] = top->lcd_col;
+
+        if (top->lcd_vblank && !sim->vblank_old) {
+            stop |= GBSIM_STOP_VBLANK;
+            if (scanlines)
+                sim->scanlines.frame_end(sim->cycles);
+            if (contention)
+                sim->contention.frame_end(sim->cycles);
+        }
+        sim->vblank_old = top->lcd_vblank;
+
+        if (scanlines && top->dbg_line_done)
+            sim->scanlines.line(top->dbg_line_mode3_cycles,
+                                top->dbg_line_obj_fetches,
+                                top->dbg_line_obj_stall_cycles,
+                                top->dbg_line_fetch_restarts);
+
+        if (contention)
+            sim->record_access();
+
+#ifdef PPU_LOCKSTEP
+        if (sim->ly() != sim->lockstep.y_old)
+            sim->lockstep_line();
+#endif
+
+        if (log_events)
+            sim->log_events();
+
+        if (profile)
+            sim->profile.cycle(top->dbg_stage == CPU_STAGE_HALTED);
+
+        if (top->dbg_instruction_retired) {
+            sim->events.log(GBSIM_EV_RETIRE, top->dbg_last_opcode);
+            if (profile || coverage) {
+                uint8_t bank = sim->rom_bank(top->dbg_pc);
+                bool intack = sim->cpu_intack();
+                if (profile)
+                    sim->profile.retire(top->dbg_pc, top->dbg_sp, bank,
+                                        top->dbg_last_opcode, intack);
+                if (coverage)
+                    sim->coverage.retire(top->dbg_pc, bank,
+                                         MAIN(bootrom_enabled),
+                                         top->dbg_last_opcode, intack);
+            }
+            stop |= GBSIM_STOP_RETIRE;
+            if (top->dbg_pc == pc)
+                stop |= GBSIM_STOP_PC;
+            if (top->dbg_halted)
+                stop |= GBSIM_STOP_HALT;
+        }
+
+        if (sim->cycles >= end_cycle)
+            stop |= GBSIM_STOP_CYCLES;
+
+        stop &= stop_mask;
+    }
+    return stop;
+}
+
+/*
+ * State transfer between the RTL and emu_sys.c for gbsim_fast_forward(). The
+ * RTL must be at an instruction boundary; in the other direction the PPU must
+ * not be drawing, so its pixel pipeline can simply be put in the stopped
+ * state it would be in during hblank/vblank.
+ */
+
+static uint8_t cart_read(void *ctx, uint16_t addr)
+{
+    return ((Cartridge *)ctx)->read(addr);
+}
+
+static void cart_write(void *ctx, uint16_t addr, uint8_t val)
+{
+    ((Cartridge *)ctx)->write(addr, val);
+}
+
+static bool rtl_at_boundary(SimTop *top)
+{
+    return (top->dbg_stage == CPU_STAGE_RESET ||
+            top->dbg_stage == CPU_STAGE_HALTED ||
+            top->dbg_stage == CPU_STAGE_WRITEBACK) && !MAIN(oamdma_active);
+}
+
+#ifdef CPU_MODEL
+static void cpu_to_sys(struct gbsim *sim, struct emu_sys *sys)
+{
+    const struct state *st = &sim->cpu_model()->st;
+
+    sys->cpu.PC = st->PC;
+    sys->cpu.SP = st->SP;
+    sys->cpu.reg16.AF = st->reg16.AF;
+    sys->cpu.reg16.BC = st->reg16.BC;
+    sys->cpu.reg16.DE = st->reg16.DE;
+    sys->cpu.reg16.HL = st->reg16.HL;
+    sys->cpu.halted = st->halted;
+    sys->cpu.interrupts_master_enabled = st->interrupts_master_enabled;
+}
+
+static void sys_to_cpu(struct gbsim *sim, const struct emu_sys *sys)
+{
+    sim->cpu_model()->set_state(&sys->cpu);
+}
+#else
+static void cpu_to_sys(struct gbsim *sim, struct emu_sys *sys)
+{
+    SimTop *top = sim->top;
+
+    sys->cpu.PC = CPU(pc);
+    sys->cpu.SP = CPU(sp);
+    sys->cpu.reg8.A = CPU(reg_A);
+    sys->cpu.reg8.B = CPU(reg_B);
+    sys->cpu.reg8.C = CPU(reg_C);
+    sys->cpu.reg8.D = CPU(reg_D);
+    sys->cpu.reg8.E = CPU(reg_E);
+    sys->cpu.reg8.H = CPU(reg_H);
+    sys->cpu.reg8.L = CPU(reg_L);
+    sys->cpu.reg8.F = CPU(Z) << 7 | CPU(N) << 6 | CPU(H) << 5 | CPU(C) << 4;
+    sys->cpu.halted = CPU(halted);
+    sys->cpu.interrupts_master_enabled = CPU(interrupts_master_enabled);
+}
+
+static void sys_to_cpu(struct gbsim *sim, const struct emu_sys *sys)
+{
+    SimTop *top = sim->top;
+
+    CPU(pc) = sys->cpu.PC;
+    CPU(sp) = sys->cpu.SP;
+    CPU(reg_A) = sys->cpu.reg8.A;
+    CPU(reg_B) = sys->cpu.reg8.B;
+    CPU(reg_C) = sys->cpu.reg8.C;
+    CPU(reg_D) = sys->cpu.reg8.D;
+    CPU(reg_E) = sys->cpu.reg8.E;
+    CPU(reg_H) = sys->cpu.reg8.H;
+    CPU(reg_L) = sys->cpu.reg8.L;
+    CPU(Z) = BIT(sys->cpu.reg8.F, 7);
+    CPU(N) = BIT(sys->cpu.reg8.F, 6);
+    CPU(H) = BIT(sys->cpu.reg8.F, 5);
+    CPU(C) = BIT(sys->cpu.reg8.F, 4);
+    CPU(halted) = sys->cpu.halted;
+    CPU(interrupts_master_enabled) = sys->cpu.interrupts_master_enabled;
+    CPU(interrupts_ack) = 0;
+    CPU(mem_do_write) = 0;
+    CPU(mem_addr) = sys->cpu.PC;
+    /* Like test_instructions/vcpu.cpp: restart with a fetch at PC. */
+    CPU(stage) = sys->cpu.halted ? CPU_STAGE_HALTED : CPU_STAGE_RESET;
+}
+#endif
+
+#if defined(PPU_MODEL) || defined(PPU_LOCKSTEP)
+static void ppu_model_to_sys(const PpuModel *ppu, struct emu_sys *sys)
+{
+    memcpy(sys->oam, ppu->oam, EMU_SYS_OAM_SIZE);
+    sys->lcdc = ppu->lcdc;
+    sys->stat = ppu->stat;
+    sys->scy = ppu->scy;
+    sys->scx = ppu->scx;
+    sys->lyc = ppu->lyc;
+    sys->bgp = ppu->bgp;
+    sys->obp0 = ppu->obp0;
+    sys->obp1 = ppu->obp1;
+    sys->wx = ppu->wx;
+    sys->wy = ppu->wy;
+    sys->ppu_x_clk = ppu->x_clk;
+    sys->ppu_y = ppu->y;
+}
+
+static void sys_to_ppu_model(const struct emu_sys *sys, PpuModel *ppu)
+{
+    memcpy(ppu->oam, sys->oam, EMU_SYS_OAM_SIZE);
+    ppu->lcdc = sys->lcdc;
+    ppu->stat = sys->stat;
+    ppu->scy = sys->scy;
+    ppu->scx = sys->scx;
+    ppu->lyc = sys->lyc;
+    ppu->bgp = sys->bgp;
+    ppu->obp0 = sys->obp0;
+    ppu->obp1 = sys->obp1;
+    ppu->wx = sys->wx;
+    ppu->wy = sys->wy;
+    ppu->set_position(sys->ppu_x_clk, sys->ppu_y);
+}
+#endif
+
+#ifdef PPU_MODEL
+static void ppu_to_sys(struct gbsim *sim, struct emu_sys *sys)
+{
+    ppu_model_to_sys(sim->ppu_model(), sys);
+}
+
+static void sys_to_ppu(struct gbsim *sim, const struct emu_sys *sys)
+{
+    sys_to_ppu_model(sys, sim->ppu_model());
+}
+#else
+static void ppu_to_sys(struct gbsim *sim, struct emu_sys *sys)
+{
+    SimTop *top = sim->top;
+
+    for (int i = 0; i < EMU_SYS_OAM_SIZE / 2; i++) {
+        sys->oam[i * 2] = PPU(oam)[i] & 0xff;
+        sys->oam[i * 2 + 1] = PPU(oam)[i] >> 8;
+    }
+
+    sys->lcdc = PPU(display_enabled) << 7 | PPU(win_tilemap_select) << 6 |
+                PPU(win_enabled) << 5 | PPU(bgwin_tiledata_select) << 4 |
+                PPU(bg_tilemap_select) << 3 | PPU(obj_size_select) << 2 |
+                PPU(obj_enabled) << 1 | PPU(bg_enabled);
+    sys->stat = PPU(int_y_coincidence) << 6 | PPU(int_oam) << 5 |
+                PPU(int_vblank) << 4 | PPU(int_hblank) << 3;
+    sys->scy = PPU(bg_y);
+    sys->scx = PPU(bg_x);
+    sys->lyc = PPU(y_compare);
+    sys->bgp = PPU(bg_pal);
+    sys->obp0 = PPU(obj_pal0);
+    sys->obp1 = PPU(obj_pal1);
+    sys->wx = PPU(win_x);
+    sys->wy = PPU(win_y);
+    sys->ppu_x_clk = PPU(cur_x_clk);
+    sys->ppu_y = PPU(cur_y);
+}
+
+static void sys_to_ppu(struct gbsim *sim, const struct emu_sys *sys)
+{
+    SimTop *top = sim->top;
+
+    for (int i = 0; i < EMU_SYS_OAM_SIZE / 2; i++)
+        PPU(oam)[i] = sys->oam[i * 2] | sys->oam[i * 2 + 1] << 8;
+
+    PPU(display_enabled) = BIT(sys->lcdc, 7);
+    PPU(win_tilemap_select) = BIT(sys->lcdc, 6);
+    PPU(win_enabled) = BIT(sys->lcdc, 5);
+    PPU(bgwin_tiledata_select) = BIT(sys->lcdc, 4);
+    PPU(bg_tilemap_select) = BIT(sys->lcdc, 3);
+    PPU(obj_size_select) = BIT(sys->lcdc, 2);
+    PPU(obj_enabled) = BIT(sys->lcdc, 1);
+    PPU(bg_enabled) = BIT(sys->lcdc, 0);
+    PPU(int_y_coincidence) = BIT(sys->stat, 6);
+    PPU(int_oam) = BIT(sys->stat, 5);
+    PPU(int_vblank) = BIT(sys->stat, 4);
+    PPU(int_hblank) = BIT(sys->stat, 3);
+    PPU(bg_y) = sys->scy;
+    PPU(bg_x) = sys->scx;
+    PPU(y_compare) = sys->lyc;
+    PPU(bg_pal) = sys->bgp;
+    PPU(obj_pal0) = sys->obp0;
+    PPU(obj_pal1) = sys->obp1;
+    PPU(win_x) = sys->wx;
+    PPU(win_y) = sys->wy;
+    PPU(cur_x_clk) = sys->ppu_x_clk;
+    PPU(cur_y) = sys->ppu_y;
+    PPU(cur_x_px) = RES_X;
+    PPU(pixfetch_stage) = 0; // PF_STOPPED
+    PPU(objfetch_active) = 0;
+
+#ifdef PPU_LOCKSTEP
+    sys_to_ppu_model(sys, sim->ppu_ref());
+    sim->lockstep.y_old = sys->ppu_y;
+#endif
+}
+#endif
+
+static void rtl_to_sys(struct gbsim *sim, struct emu_sys *sys)
+{
+    SimTop *top = sim->top;
+    size_t size;
+
+    memset(sys, 0, sizeof(*sys));
+
+    sys->match_cpu_v = 1;
+    cpu_to_sys(sim, sys);
+
+    sys->cart_ctx = sim->cart;
+    sys->cart_read = cart_read;
+    sys->cart_write = cart_write;
+
+    for (int i = 0; i < 0x100; i++)
+        sim->bootrom[i] = MAIN(bootrom__DOT__mem)[i];
+    sys->bootrom = sim->bootrom;
+    sys->vram = sim->vram.data(&size);
+    sys->wram = sim->wram.data(&size);
+    for (int i = 0; i < EMU_SYS_HRAM_SIZE; i++)
+        sys->hram[i] = MAIN(hram__DOT__mem)[i];
+
+    /* An interrupt acknowledged in writeback only clears IF a cycle later. */
+    sys->bootrom_enabled = MAIN(bootrom_enabled);
+    sys->ie = MAIN(interrupts_enabled);
+    sys->if_ = MAIN(interrupts_request) & ~sim->cpu_intack();
+    sys->joypad_select = MAIN(joypad_select);
+    sys->buttons = sim->buttons;
+
+    ppu_to_sys(sim, sys);
+
+    sys->cycles = sim->cycles;
+}
+
+static void sys_to_rtl(struct gbsim *sim, const struct emu_sys *sys)
+{
+    SimTop *top = sim->top;
+
+    sys_to_cpu(sim, sys);
+
+    for (int i = 0; i < EMU_SYS_HRAM_SIZE; i++)
+        MAIN(hram__DOT__mem)[i] = sys->hram[i];
+
+    MAIN(bootrom_enabled) = sys->bootrom_enabled;
+    MAIN(interrupts_enabled) = sys->ie;
+    MAIN(interrupts_request) = sys->if_;
+    MAIN(joypad_select) = sys->joypad_select;
+    MAIN(oamdma_active) = 0;
+
+    sys_to_ppu(sim, sys);
+
+    bool vblank = BIT(sys->lcdc, 7) && sys->ppu_y >= RES_Y;
+    top->lcd_vblank = vblank;
+    top->lcd_write = 0;
+    sim->vblank_old = vblank;
+    sim->cycles = sys->cycles;
+
+    top->eval();
+}
+
+#ifdef PPU_LOCKSTEP
+void gbsim::lockstep_mismatch(uint8_t y, const char *what, unsigned rtl,
+                              unsigned model)
+{
+    if (lockstep.mismatches++ < LOCKSTEP_MAX_REPORTS)
+        fprintf(stderr, "lockstep: line %d, cycle %llu: %s is %#x in ppu.v, "
+                "%#x in the model\n", y, (unsigned long long)cycles, what,
+                rtl, model);
+    lockstep.line_ok = 0;
+}
+
+/* ppu.v just left line y_old: compare it with the model. */
+void gbsim::lockstep_line()
+{
+    PpuModel *ref = ppu_ref();
+    uint8_t y = lockstep.y_old;
+    struct emu_sys rtl, model;
+
+    lockstep.y_old = ly();
+    lockstep.lines++;
+    lockstep.line_ok = 1;
+
+    ppu_to_sys(this, &rtl);
+    ppu_model_to_sys(ref, &model);
+
+#define LOCKSTEP_CHECK(field) \
+    if (rtl.field != model.field) \
+        lockstep_mismatch(y, #field, rtl.field, model.field)
+    LOCKSTEP_CHECK(ppu_x_clk);
+    LOCKSTEP_CHECK(ppu_y);
+    LOCKSTEP_CHECK(lcdc);
+    LOCKSTEP_CHECK(stat);
+    LOCKSTEP_CHECK(scy);
+    LOCKSTEP_CHECK(scx);
+    LOCKSTEP_CHECK(lyc);
+    LOCKSTEP_CHECK(bgp);
+    LOCKSTEP_CHECK(obp0);
+    LOCKSTEP_CHECK(obp1);
+    LOCKSTEP_CHECK(wx);
+    LOCKSTEP_CHECK(wy);
+#undef LOCKSTEP_CHECK
+
+    char what[32];
+    for (int i = 0; i < EMU_SYS_OAM_SIZE; i++)
+        if (rtl.oam[i] != model.oam[i]) {
+            snprintf(what, sizeof(what), "OAM byte %02x", i);
+            lockstep_mismatch(y, what, rtl.oam[i], model.oam[i]);
+            break;
+        }
+
+    /* The pixels only if both drew the line; the first differing one. */
+    if (BIT(rtl.lcdc, 7) && y < RES_Y && ref->line_y == y) {
+        const uint8_t *row = &pixbuf[y * RES_X];
+        for (int x = 0; x < RES_X; x++)
+            if (row[x] != ref->line_col[x]) {
+                snprintf(what, sizeof(what), "pixel %d", x);
+                lockstep_mismatch(y, what, row[x], ref->line_col[x]);
+                break;
+            }
+    }
+
+    if (!lockstep.line_ok)
+        lockstep.lines_mismatched++;
+}
+#endif
+
+int gbsim_fast_forward(struct gbsim *sim, int stop_mask, uint64_t max_cycles,
+                       uint16_t pc)
+{
+    struct emu_sys sys;
+
+    if (!sim->cart)
+        return -1;
+
+    while (!rtl_at_boundary(sim->top))
+        if (gbsim_run_until(sim, GBSIM_STOP_CYCLES, 1, 0) & GBSIM_STOP_FINISH)
+            return -1;
+
+    rtl_to_sys(sim, &sys);
+
+    /* Cartridge writes would be logged with stale timestamps. */
+    unsigned event_mask = sim->events.mask;
+    sim->events.mask = 0;
+
+    int stop = emu_sys_run(&sys, stop_mask, max_cycles, pc);
+    while (stop >= 0 && !emu_sys_handoff_safe(&sys))
+        if (emu_sys_run(&sys, GBSIM_STOP_CYCLES, 1, 0) < 0)
+            stop = -1;
+
+    sim->events.mask = event_mask;
+    if (stop < 0)
+        return -1;
+
+    sys_to_rtl(sim, &sys);
+    sim->lcd_mode_old = sim->lcd_mode();
+    sim->profile.restart(sys.cpu.PC, sys.cpu.SP, sim->rom_bank(sys.cpu.PC));
+    sim->coverage.restart(sys.cpu.PC, sim->rom_bank(sys.cpu.PC),
+                          sys.bootrom_enabled);
+    return stop;
+}
+
+void gbsim_set_input(struct gbsim *sim, unsigned buttons)
+{
+    SimTop *top = sim->top;
+    sim->buttons = buttons;
+    top->joy_btn_a = !!(buttons & GBSIM_BTN_A);
+    top->joy_btn_b = !!(buttons & GBSIM_BTN_B);
+    top->joy_btn_select = !!(buttons & GBSIM_BTN_SELECT);
+    top->joy_btn_start = !!(buttons & GBSIM_BTN_START);
+    top->joy_btn_right = !!(buttons & GBSIM_BTN_RIGHT);
+    top->joy_btn_left = !!(buttons & GBSIM_BTN_LEFT);
+    top->joy_btn_up = !!(buttons & GBSIM_BTN_UP);
+    top->joy_btn_down = !!(buttons & GBSIM_BTN_DOWN);
+}
+
+const uint8_t *gbsim_framebuffer(struct gbsim *sim)
+{
+    return sim->pixbuf;
+}
+
+void gbsim_get_regs(struct gbsim *sim, struct gbsim_regs *regs)
+{
+    SimTop *top = sim->top;
+    regs->pc = top->dbg_pc;
+    regs->sp = top->dbg_sp;
+    regs->AF = top->dbg_AF;
+    regs->BC = top->dbg_BC;
+    regs->DE = top->dbg_DE;
+    regs->HL = top->dbg_HL;
+    regs->halted = top->dbg_halted;
+    regs->last_opcode = top->dbg_last_opcode;
+    regs->stage = top->dbg_stage;
+}
+
+void gbsim_events_enable(struct gbsim *sim, unsigned categories)
+{
+    sim->events.mask = categories;
+    sim->lcd_mode_old = sim->lcd_mode();
+}
+
+size_t gbsim_events_read(struct gbsim *sim, struct gbsim_event *events,
+                         size_t max, uint64_t *lost)
+{
+    EventLog *log = &sim->events;
+
+    if (log->head - log->tail > EVENT_LOG_SIZE) {
+        if (lost)
+            *lost += log->head - log->tail - EVENT_LOG_SIZE;
+        log->tail = log->head - EVENT_LOG_SIZE;
+    }
+
+    size_t n = 0;
+    while (n < max && log->tail != log->head)
+        events[n++] = log->buf[log->tail++ & (EVENT_LOG_SIZE - 1)];
+    return n;
+}
+
+void gbsim_events_dump(struct gbsim *sim, FILE *fp)
+{
+    struct gbsim_event evs[256];
+    uint64_t lost = 0;
+    size_t n;
+
+    gbsim_events_read(sim, NULL, 0, &lost);
+    if (lost)
+        fprintf(fp, "(%llu older events lost)\n", (unsigned long long)lost);
+
+    while ((n = gbsim_events_read(sim, evs, 256, NULL))) {
+        for (size_t i = 0; i < n; i++) {
+            struct gbsim_event *ev = &evs[i];
+            fprintf(fp, "%12llu %04x  ", (unsigned long long)ev->cycle,
+                    ev->pc);
+            switch (ev->type) {
+            case GBSIM_EV_ROM_BANK:
+                fprintf(fp, "rom bank %#02x\n", ev->val);
+                break;
+            case GBSIM_EV_RAM_BANK:
+                fprintf(fp, "ram bank %#02x\n", ev->val);
+                break;
+            case GBSIM_EV_DMA:
+                fprintf(fp, "oam dma from %02x00\n", ev->val);
+                break;
+            case GBSIM_EV_IE:
+                fprintf(fp, "IE = %02x\n", ev->val);
+                break;
+            case GBSIM_EV_IF:
+                fprintf(fp, "IF = %02x\n", ev->val);
+                break;
+            case GBSIM_EV_LCD_MODE:
+                if (ev->val == 4)
+                    fprintf(fp, "lcd off\n");
+                else
+                    fprintf(fp, "lcd mode %d (LY %d)\n", ev->val, ev->arg);
+                break;
+            case GBSIM_EV_RETIRE:
+                fprintf(fp, "retire %02x\n", ev->val);
+                break;
+            default:
+                fprintf(fp, "event %d %02x %04x\n", ev->type, ev->val,
+                        ev->arg);
+            }
+        }
+    }
+}
+
+uint64_t gbsim_cycles(struct gbsim *sim)
+{
+    return sim->cycles;
+}
+
+void gbsim_perf_read(struct gbsim *sim, uint32_t *counts)
+{
+    SimTop *top = sim->top;
+
+    /* dbg_perf_count is combinational, so this does not advance the clock. */
+    for (int i = 0; i < PERF_NUM; i++) {
+        top->dbg_perf_sel = i;
+        top->eval();
+        counts[i] = top->dbg_perf_count;
+    }
+    top->dbg_perf_sel = 0;
+    top->eval();
+}
+
+void gbsim_perf_dump(struct gbsim *sim, FILE *fp)
+{
+    uint32_t counts[PERF_NUM];
+
+    gbsim_perf_read(sim, counts);
+    perf_print(fp, counts);
+}
+
+void gbsim_profile_enable(struct gbsim *sim, int enable)
+{
+    SimTop *top = sim->top;
+
+    if (enable && !sim->profile.enabled)
+        sim->profile.restart(top->dbg_pc, top->dbg_sp,
+                             sim->rom_bank(top->dbg_pc));
+    sim->profile.enabled = enable;
+}
+
+void gbsim_coverage_enable(struct gbsim *sim, int enable)
+{
+    SimTop *top = sim->top;
+
+    if (enable && !sim->coverage.enabled)
+        sim->coverage.restart(top->dbg_pc, sim->rom_bank(top->dbg_pc),
+                              MAIN(bootrom_enabled));
+    sim->coverage.enabled = enable;
+}
+
+int gbsim_load_symbols(struct gbsim *sim, const char *sym_file,
+                       const char *map_file)
+{
+    int ret = 0;
+
+    if (sym_file)
+        ret |= sim->symbols.load_sym(sym_file);
+    if (map_file)
+        ret |= sim->symbols.load_map(map_file);
+    return ret;
+}
+
+static int close_output(FILE *fp, const char *filename)
+{
+    if (fclose(fp)) {
+        perror(filename);
+        return 1;
+    }
+    return 0;
+}
+
+int gbsim_profile_save(struct gbsim *sim, const char *flat_file,
+                       const char *collapsed_file)
+{
+    FILE *fp;
+    int ret = 0;
+
+    if (flat_file) {
+        if (!(fp = fopen(flat_file, "w"))) {
+            perror(flat_file);
+            return 1;
+        }
+        sim->profile.write_flat(fp, sim->symbols);
+        ret |= close_output(fp, flat_file);
+    }
+    if (collapsed_file) {
+        if (!(fp = fopen(collapsed_file, "w"))) {
+            perror(collapsed_file);
+            return 1;
+        }
+        sim->profile.write_collapsed(fp, sim->symbols);
+        ret |= close_output(fp, collapsed_file);
+    }
+    return ret;
+}
+
+int gbsim_coverage_save(struct gbsim *sim, const char *filename)
+{
+    FILE *fp = fopen(filename, "w");
+
+    if (!fp) {
+        perror(filename);
+        return 1;
+    }
+    sim->coverage.write(fp, sim->symbols);
+    return close_output(fp, filename);
+}
+
+void gbsim_scanlines_enable(struct gbsim *sim, int enable)
+{
+    sim->scanlines.enabled = enable;
+}
+
+int gbsim_scanlines_save(struct gbsim *sim, const char *filename)
+{
+    FILE *fp = fopen(filename, "w");
+
+    if (!fp) {
+        perror(filename);
+        return 1;
+    }
+    sim->scanlines.write(fp);
+    return close_output(fp, filename);
+}
+
+void gbsim_contention_enable(struct gbsim *sim, int enable)
+{
+    sim->contention.enabled = enable;
+}
+
+int gbsim_contention_save(struct gbsim *sim, const char *filename)
+{
+    FILE *fp = fopen(filename, "w");
+
+    if (!fp) {
+        perror(filename);
+        return 1;
+    }
+    sim->contention.write(fp, sim->symbols);
+    return close_output(fp, filename);
+}
+
+int gbsim_lockstep_dump(struct gbsim *sim, FILE *fp)
+{
+#ifdef PPU_LOCKSTEP
+    Lockstep *ls = &sim->lockstep;
+
+    fprintf(fp, "PPU lockstep: %llu lines compared, %llu mismatched "
+            "(%llu mismatches)\n", (unsigned long long)ls->lines,
+            (unsigned long long)ls->lines_mismatched,
+            (unsigned long long)ls->mismatches);
+    return ls->mismatches != 0;
+#else
+    return 0;
+#endif
+}
+
+uint8_t *gbsim_mem(struct gbsim *sim, int region, size_t *size)
+{
+    SimTop *top = sim->top;
+
+    *size = 0;
+    switch (region) {
+    case GBSIM_MEM_ROM:
+        return sim->cart ? sim->cart->rom_data(size) : NULL;
+    case GBSIM_MEM_CART_RAM:
+        return sim->cart ? sim->cart->ram_data(size) : NULL;
+    case GBSIM_MEM_VRAM:
+        return sim->vram.data(size);
+    case GBSIM_MEM_WRAM:
+        return sim->wram.data(size);
+#ifdef CXXRTL
+    /* CXXRTL keeps memories as arrays of value chunks, not bytes. */
+    case GBSIM_MEM_OAM:
+    case GBSIM_MEM_HRAM:
+        return NULL;
+#else
+    case GBSIM_MEM_OAM:
+#ifdef PPU_MODEL
+        *size = PPU_MODEL_OAM_SIZE;
+        return sim->ppu_model()->oam;
+#else
+        /* Stored as 16-bit words, low byte at the even address. */
+        *size = sizeof(PPU(oam));
+        return (uint8_t *)PPU(oam);
+#endif
+    case GBSIM_MEM_HRAM:
+        *size = sizeof(MAIN(hram__DOT__mem));
+        return (uint8_t *)MAIN(hram__DOT__mem);
+#endif
+    default:
+        return NULL;
+    }
+}
+
+uint64_t gbsim_frame_hash(struct gbsim *sim)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < sizeof(sim->pixbuf); i++) {
+        hash ^= sim->pixbuf[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+unsigned gbsim_run_frames(struct gbsim *sim, unsigned num_frames,
+                          uint64_t max_cycles_per_frame, uint64_t *hashes)
+{
+    int stop_mask = GBSIM_STOP_VBLANK;
+    if (max_cycles_per_frame)
+        stop_mask |= GBSIM_STOP_CYCLES;
+
+    for (unsigned i = 0; i < num_frames; i++) {
+        int stop = gbsim_run_until(sim, stop_mask, max_cycles_per_frame, 0);
+        if (!(stop & GBSIM_STOP_VBLANK))
+            return i;
+        hashes[i] = gbsim_frame_hash(sim);
+    }
+    return num_frames;
+}
+
+}
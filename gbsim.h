@@ -0,0 +1,268 @@
+/*
+ * Embeddable simulator of the full system (main.v) with a C API.
+ *
+ * A simulation instance owns the verilated model and everything main.v
+ * expects to find outside of it (cartridge, WRAM, VRAM) and keeps track of the
+ * LCD output in a framebuffer. The simulation is advanced in batches with
+ * gbsim_run_until(), so callers only pay for a function call once per batch.
+ */
+
+#ifndef GBSIM_H
+#define GBSIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GBSIM_LCD_WIDTH 160
+#define GBSIM_LCD_HEIGHT 144
+
+/* Stop conditions for gbsim_run_until(), also used as its return value. */
+#define GBSIM_STOP_CYCLES  0x01 // Given number of clock cycles have passed
+#define GBSIM_STOP_VBLANK  0x02 // LCD entered vblank (framebuffer complete)
+#define GBSIM_STOP_PC      0x04 // Instruction retired and next PC matches
+#define GBSIM_STOP_RETIRE  0x08 // Any instruction retired
+#define GBSIM_STOP_HALT    0x10 // CPU entered halted state
+#define GBSIM_STOP_FINISH  0x80 // Verilog $finish (always enabled)
+
+/* Joypad buttons for gbsim_set_input(). */
+#define GBSIM_BTN_A      0x01
+#define GBSIM_BTN_B      0x02
+#define GBSIM_BTN_SELECT 0x04
+#define GBSIM_BTN_START  0x08
+#define GBSIM_BTN_RIGHT  0x10
+#define GBSIM_BTN_LEFT   0x20
+#define GBSIM_BTN_UP     0x40
+#define GBSIM_BTN_DOWN   0x80
+
+/* Memory regions for gbsim_mem(). */
+#define GBSIM_MEM_ROM      0
+#define GBSIM_MEM_CART_RAM 1
+#define GBSIM_MEM_VRAM     2
+#define GBSIM_MEM_WRAM     3
+#define GBSIM_MEM_OAM      4
+#define GBSIM_MEM_HRAM     5
+
+/* Event types for the event log (see gbsim_events_enable). */
+#define GBSIM_EV_ROM_BANK  0 // Cartridge ROM bank switch (val = bank)
+#define GBSIM_EV_RAM_BANK  1 // Cartridge RAM bank switch (val = bank)
+#define GBSIM_EV_DMA       2 // OAM DMA started (val = source page)
+#define GBSIM_EV_IE        3 // Write to IE (val = value)
+#define GBSIM_EV_IF        4 // Write to IF (val = value)
+#define GBSIM_EV_LCD_MODE  5 // PPU mode change (val = mode, 4 if off; arg = LY)
+#define GBSIM_EV_RETIRE    6 // Instruction retired (val = opcode)
+
+/* Event categories: masks of the event types above. */
+#define GBSIM_EVCAT_BANK   0x03
+#define GBSIM_EVCAT_DMA    0x04
+#define GBSIM_EVCAT_INT    0x18
+#define GBSIM_EVCAT_LCD    0x20
+#define GBSIM_EVCAT_TRACE  0x40
+#define GBSIM_EVCAT_ALL    0x7f
+
+struct gbsim_event {
+    uint64_t cycle;     // Clock cycle the event happened in
+    uint16_t pc;        // dbg_pc at that time
+    uint16_t arg;
+    uint8_t type;       // GBSIM_EV_*
+    uint8_t val;
+};
+
+/* CPU state, as seen through the dbg_* ports of main.v. */
+struct gbsim_regs {
+    uint16_t pc, sp;
+    uint16_t AF, BC, DE, HL;
+    uint8_t halted;
+    uint8_t last_opcode;
+    uint8_t stage;
+};
+
+struct gbsim;
+
+struct gbsim *gbsim_create(void);
+
+/* In RTL coverage builds (COVERAGE=1), destroying the first instance writes
+ * the coverage, see test_instructions/vcoverage.h. */
+void gbsim_destroy(struct gbsim *sim);
+
+/* Puts the system back in its power-on state (keeping the loaded ROM). */
+void gbsim_reset(struct gbsim *sim);
+
+/* Returns non-zero if the ROM could not be loaded or is not supported. The
+ * system is reset after successfully loading a ROM. */
+int gbsim_load_rom(struct gbsim *sim, const char *filename);
+int gbsim_load_rom_mem(struct gbsim *sim, const uint8_t *data, size_t size);
+
+/*
+ * Runs the simulation until any of the conditions in stop_mask (GBSIM_STOP_*)
+ * is met, checked after every clock cycle (so at least one cycle is always
+ * simulated). max_cycles is only used for GBSIM_STOP_CYCLES and counts from
+ * the start of this call, pc is only used for GBSIM_STOP_PC. Returns the mask
+ * of conditions that caused the simulation to stop.
+ */
+int gbsim_run_until(struct gbsim *sim, int stop_mask, uint64_t max_cycles,
+                    uint16_t pc);
+
+/*
+ * Fast-forwards using the behavioural model of emu_sys.c instead of the RTL.
+ * The RTL is first run up to the next instruction boundary, after which the
+ * complete system state is transferred into the model. The model runs until
+ * any of the conditions in stop_mask (GBSIM_STOP_CYCLES, _PC or _HALT, with
+ * the same meaning as for gbsim_run_until) is met, and then on until the PPU
+ * is not drawing a line. Its state is then transferred back, so simulation
+ * continues in RTL with gbsim_run_until(). The framebuffer is not updated
+ * while fast-forwarding. Returns the mask of conditions that were met, or -1
+ * if the model hit an unimplemented opcode (leaving the system in an undefined
+ * state) or the RTL called $finish.
+ */
+int gbsim_fast_forward(struct gbsim *sim, int stop_mask, uint64_t max_cycles,
+                       uint16_t pc);
+
+/* Sets the state of all joypad buttons at once (GBSIM_BTN_* mask). */
+void gbsim_set_input(struct gbsim *sim, unsigned buttons);
+
+/* Returns the LCD framebuffer: GBSIM_LCD_WIDTH x GBSIM_LCD_HEIGHT bytes of
+ * 2-bit color (after palette translation), row-major. The pointer stays valid
+ * for the lifetime of sim and is updated in place while running. */
+const uint8_t *gbsim_framebuffer(struct gbsim *sim);
+
+void gbsim_get_regs(struct gbsim *sim, struct gbsim_regs *regs);
+
+/*
+ * Returns the backing storage of a memory region (GBSIM_MEM_*) and stores its
+ * size in *size, or returns NULL if the region does not exist (e.g., no ROM
+ * loaded). This is the memory the simulation itself uses, so writes through
+ * the pointer are visible to the running system. OAM and HRAM live inside the
+ * verilated model; OAM is only byte addressable this way on little-endian
+ * hosts. CXXRTL builds return NULL for those two.
+ */
+uint8_t *gbsim_mem(struct gbsim *sim, int region, size_t *size);
+
+/* 64-bit FNV-1a hash of the current framebuffer contents. */
+uint64_t gbsim_frame_hash(struct gbsim *sim);
+
+/*
+ * Runs num_frames frames (up to each vblank) and stores the hash of every
+ * completed frame in hashes[]. Running a frame is aborted if it takes more
+ * than max_cycles_per_frame cycles (0 for no limit), e.g. because the LCD is
+ * disabled. Returns the number of frames completed.
+ */
+unsigned gbsim_run_frames(struct gbsim *sim, unsigned num_frames,
+                          uint64_t max_cycles_per_frame, uint64_t *hashes);
+
+/*
+ * Event log: a fixed-size ring buffer of the most recent events of the enabled
+ * categories (GBSIM_EVCAT_* mask, none by default). Recording an event costs a
+ * few stores; when the buffer is full the oldest events are overwritten.
+ * Events are recorded while running RTL only (not during gbsim_fast_forward),
+ * and the log is cleared on reset.
+ */
+void gbsim_events_enable(struct gbsim *sim, unsigned categories);
+
+/* Moves up to max of the oldest events out of the log into events[] and
+ * returns how many. If lost is not NULL, the number of events overwritten
+ * before they could be read is added to it. */
+size_t gbsim_events_read(struct gbsim *sim, struct gbsim_event *events,
+                         size_t max, uint64_t *lost);
+
+/* Reads all events from the log and prints them, one per line, to fp. */
+void gbsim_events_dump(struct gbsim *sim, FILE *fp);
+
+/* Total number of clock cycles simulated since the last reset. */
+uint64_t gbsim_cycles(struct gbsim *sim);
+
+/*
+ * Reads the performance counters of cpu.v into counts[], PERF_NUM of them
+ * indexed by PERF_* (see cpuperf.h): retired instructions, interrupt
+ * dispatches and cycles per class of CPU stages, since the last reset. They
+ * only count RTL cycles (not gbsim_fast_forward), wrap around at 2^32 and are
+ * all 0 in builds without them (NO_PERF_COUNTERS=1).
+ */
+void gbsim_perf_read(struct gbsim *sim, uint32_t *counts);
+
+/* Prints the performance counters as a CPI breakdown per stage class. */
+void gbsim_perf_dump(struct gbsim *sim, FILE *fp);
+
+/*
+ * Profiler of the guest program (disabled by default): every clock cycle is
+ * charged to the instruction it belongs to (by ROM bank and address) and to
+ * the call stack, as followed through CALL/RST/RET and interrupts. Costs an
+ * increment per cycle and a hash table update per retired instruction. Only
+ * RTL cycles are counted (not gbsim_fast_forward), and counts are cleared on
+ * reset.
+ */
+void gbsim_profile_enable(struct gbsim *sim, int enable);
+
+/*
+ * Writes the profile so far to the given files (either may be NULL): a flat
+ * profile of cycles and instructions per ROM bank, symbol and address, and
+ * one line of "frame;frame;leaf cycles" per call stack (the collapsed-stack
+ * format of flame graph tools). Returns non-zero on errors.
+ */
+int gbsim_profile_save(struct gbsim *sim, const char *flat_file,
+                       const char *collapsed_file);
+
+/*
+ * Code coverage of the guest program (disabled by default): a bitmap of the
+ * bytes of every ROM bank (and of RAM) executed, updated per retired
+ * instruction. Like the profile, only RTL cycles count and the map is cleared
+ * on reset.
+ */
+void gbsim_coverage_enable(struct gbsim *sim, int enable);
+
+/* Writes the executed bytes per section and label (with the parts of labels
+ * not executed) and the executed address ranges to filename. Returns non-zero
+ * on errors. */
+int gbsim_coverage_save(struct gbsim *sim, const char *filename);
+
+/*
+ * PPU timing per scanline (disabled by default): the mode-3 length, object
+ * fetches and stall cycles and background fetcher restarts that ppu.v reports
+ * for every line, collected into histograms per frame (up to each vblank).
+ * Cleared on reset; nothing is recorded while fast-forwarding.
+ */
+void gbsim_scanlines_enable(struct gbsim *sim, int enable);
+
+/* Writes totals and histograms over all frames and a line per frame to
+ * filename. Returns non-zero on errors. */
+int gbsim_scanlines_save(struct gbsim *sim, const char *filename);
+
+/*
+ * CPU accesses to VRAM and OAM (disabled by default): data loads and stores
+ * counted by LCD mode per frame (up to each vblank) and by page and line, and
+ * the ones that get nothing because ppu.v fetches from VRAM/OAM or OAM DMA
+ * owns the bus, with the code doing them. Also counts the cycles of OAM DMA.
+ * Cleared on reset; nothing is recorded while fast-forwarding.
+ */
+void gbsim_contention_enable(struct gbsim *sim, int enable);
+
+/* Writes totals by mode, a line per frame, heatmaps by page and line and the
+ * code doing blocked accesses to filename. Returns non-zero on errors. */
+int gbsim_contention_save(struct gbsim *sim, const char *filename);
+
+/*
+ * Hybrid builds (HYBRID=ppu-lockstep, see the Makefile) run the C++ model of
+ * the PPU (ppu_model.h) next to ppu.v and compare them whenever ppu.v
+ * finishes a line: the pixels it drew, the registers, OAM and the position.
+ * The first mismatches are printed to stderr as they happen. This prints how
+ * many lines were compared and how many differed, and returns non-zero if
+ * any did. In other builds it prints nothing and returns 0.
+ */
+int gbsim_lockstep_dump(struct gbsim *sim, FILE *fp);
+
+/* Loads the labels of an rgblink symbol file (-n) and/or the sections of its
+ * map file (-m), to name code in the profile, coverage map and VRAM/OAM
+ * accesses with. Either may be NULL. Returns non-zero if a file could not be
+ * read. */
+int gbsim_load_symbols(struct gbsim *sim, const char *sym_file,
+                       const char *map_file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,371 @@
+"""
+Python bindings (ctypes) for the simulator library, see gbsim.h.
+
+Build the library first with `make lib`. The framebuffer and memory regions
+are returned as memoryviews directly on the simulator's own storage, so they
+are never copied and always reflect the current state of the simulation.
+The views keep that storage alive: after close() the simulator itself is only
+freed once the last view of it is gone, and any other use of a closed GBSim
+raises ValueError. Loading a ROM replaces the cartridge, so load_rom() refuses
+to while views of the ROM or cartridge RAM are still around.
+
+Example:
+
+    import gbsim
+    sim = gbsim.GBSim()
+    sim.load_rom("roms/build/obj.gb")
+    hashes = sim.run_frames(60)
+    fb = sim.framebuffer        # memoryview, shape (144, 160)
+    print(fb[72, 80], sim.regs())
+"""
+
+import ctypes
+import os
+import weakref
+
+LCD_WIDTH = 160
+LCD_HEIGHT = 144
+
+STOP_CYCLES = 0x01
+STOP_VBLANK = 0x02
+STOP_PC = 0x04
+STOP_RETIRE = 0x08
+STOP_HALT = 0x10
+STOP_FINISH = 0x80
+
+BTN_A = 0x01
+BTN_B = 0x02
+BTN_SELECT = 0x04
+BTN_START = 0x08
+BTN_RIGHT = 0x10
+BTN_LEFT = 0x20
+BTN_UP = 0x40
+BTN_DOWN = 0x80
+
+EV_ROM_BANK = 0
+EV_RAM_BANK = 1
+EV_DMA = 2
+EV_IE = 3
+EV_IF = 4
+EV_LCD_MODE = 5
+EV_RETIRE = 6
+
+EVCAT_BANK = 0x03
+EVCAT_DMA = 0x04
+EVCAT_INT = 0x18
+EVCAT_LCD = 0x20
+EVCAT_TRACE = 0x40
+EVCAT_ALL = 0x7f
+
+MEM_ROM = 0
+MEM_CART_RAM = 1
+MEM_VRAM = 2
+MEM_WRAM = 3
+MEM_OAM = 4
+MEM_HRAM = 5
+
+# Performance counters of cpu.v, see cpuperf.h
+PERF_NAMES = ["retired", "interrupts", "fetch", "decode_cb", "decode_imm",
+              "load_mem", "execute", "store_mem", "stall", "writeback",
+              "halted"]
+
+DEFAULT_LIB = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                           "build", "sim", "libgbsim.so")
+
+
+class Regs(ctypes.Structure):
+    _fields_ = [
+        ("pc", ctypes.c_uint16),
+        ("sp", ctypes.c_uint16),
+        ("AF", ctypes.c_uint16),
+        ("BC", ctypes.c_uint16),
+        ("DE", ctypes.c_uint16),
+        ("HL", ctypes.c_uint16),
+        ("halted", ctypes.c_uint8),
+        ("last_opcode", ctypes.c_uint8),
+        ("stage", ctypes.c_uint8),
+    ]
+
+    def __repr__(self):
+        return ("Regs(pc=%04x sp=%04x AF=%04x BC=%04x DE=%04x HL=%04x "
+                "halted=%d)" % (self.pc, self.sp, self.AF, self.BC, self.DE,
+                                self.HL, self.halted))
+
+
+class Event(ctypes.Structure):
+    _fields_ = [
+        ("cycle", ctypes.c_uint64),
+        ("pc", ctypes.c_uint16),
+        ("arg", ctypes.c_uint16),
+        ("type", ctypes.c_uint8),
+        ("val", ctypes.c_uint8),
+    ]
+
+    def __repr__(self):
+        return "Event(cycle=%d pc=%04x type=%d val=%02x arg=%04x)" % (
+            self.cycle, self.pc, self.type, self.val, self.arg)
+
+
+def _load_lib(path):
+    lib = ctypes.CDLL(path)
+    p = ctypes.c_void_p
+
+    lib.gbsim_create.restype = p
+    lib.gbsim_create.argtypes = []
+    lib.gbsim_destroy.restype = None
+    lib.gbsim_destroy.argtypes = [p]
+    lib.gbsim_reset.restype = None
+    lib.gbsim_reset.argtypes = [p]
+    lib.gbsim_load_rom.restype = ctypes.c_int
+    lib.gbsim_load_rom.argtypes = [p, ctypes.c_char_p]
+    lib.gbsim_load_rom_mem.restype = ctypes.c_int
+    lib.gbsim_load_rom_mem.argtypes = [p, ctypes.c_char_p, ctypes.c_size_t]
+    lib.gbsim_run_until.restype = ctypes.c_int
+    lib.gbsim_run_until.argtypes = [p, ctypes.c_int, ctypes.c_uint64,
+                                    ctypes.c_uint16]
+    lib.gbsim_fast_forward.restype = ctypes.c_int
+    lib.gbsim_fast_forward.argtypes = [p, ctypes.c_int, ctypes.c_uint64,
+                                       ctypes.c_uint16]
+    lib.gbsim_set_input.restype = None
+    lib.gbsim_set_input.argtypes = [p, ctypes.c_uint]
+    lib.gbsim_framebuffer.restype = p
+    lib.gbsim_framebuffer.argtypes = [p]
+    lib.gbsim_get_regs.restype = None
+    lib.gbsim_get_regs.argtypes = [p, ctypes.POINTER(Regs)]
+    lib.gbsim_cycles.restype = ctypes.c_uint64
+    lib.gbsim_cycles.argtypes = [p]
+    lib.gbsim_mem.restype = p
+    lib.gbsim_mem.argtypes = [p, ctypes.c_int, ctypes.POINTER(ctypes.c_size_t)]
+    lib.gbsim_frame_hash.restype = ctypes.c_uint64
+    lib.gbsim_frame_hash.argtypes = [p]
+    lib.gbsim_run_frames.restype = ctypes.c_uint
+    lib.gbsim_run_frames.argtypes = [p, ctypes.c_uint, ctypes.c_uint64,
+                                     ctypes.POINTER(ctypes.c_uint64)]
+    lib.gbsim_events_enable.restype = None
+    lib.gbsim_events_enable.argtypes = [p, ctypes.c_uint]
+    lib.gbsim_events_read.restype = ctypes.c_size_t
+    lib.gbsim_events_read.argtypes = [p, ctypes.POINTER(Event),
+                                      ctypes.c_size_t,
+                                      ctypes.POINTER(ctypes.c_uint64)]
+    lib.gbsim_profile_enable.restype = None
+    lib.gbsim_profile_enable.argtypes = [p, ctypes.c_int]
+    lib.gbsim_profile_save.restype = ctypes.c_int
+    lib.gbsim_profile_save.argtypes = [p, ctypes.c_char_p, ctypes.c_char_p]
+    lib.gbsim_coverage_enable.restype = None
+    lib.gbsim_coverage_enable.argtypes = [p, ctypes.c_int]
+    lib.gbsim_coverage_save.restype = ctypes.c_int
+    lib.gbsim_coverage_save.argtypes = [p, ctypes.c_char_p]
+    lib.gbsim_perf_read.restype = None
+    lib.gbsim_perf_read.argtypes = [p, ctypes.POINTER(ctypes.c_uint32)]
+    lib.gbsim_scanlines_enable.restype = None
+    lib.gbsim_scanlines_enable.argtypes = [p, ctypes.c_int]
+    lib.gbsim_scanlines_save.restype = ctypes.c_int
+    lib.gbsim_scanlines_save.argtypes = [p, ctypes.c_char_p]
+    lib.gbsim_contention_enable.restype = None
+    lib.gbsim_contention_enable.argtypes = [p, ctypes.c_int]
+    lib.gbsim_contention_save.restype = ctypes.c_int
+    lib.gbsim_contention_save.argtypes = [p, ctypes.c_char_p]
+    lib.gbsim_load_symbols.restype = ctypes.c_int
+    lib.gbsim_load_symbols.argtypes = [p, ctypes.c_char_p, ctypes.c_char_p]
+    return lib
+
+
+class _Handle:
+    """Owns a simulator instance of the library; it is destroyed with the
+    last reference, i.e. once its GBSim is closed and no view is left."""
+
+    def __init__(self, lib):
+        self.lib = lib
+        self.sim = lib.gbsim_create()
+        if not self.sim:
+            raise MemoryError("Failed to create simulator")
+
+    def __del__(self):
+        if getattr(self, "sim", None):
+            self.lib.gbsim_destroy(self.sim)
+            self.sim = None
+
+
+def _view(array, shape=None):
+    """Zero-copy byte memoryview on a ctypes array."""
+    raw = memoryview(array).cast("B")
+    return raw.cast("B", shape) if shape else raw
+
+
+def _array(addr, size, owner):
+    """ctypes array of size bytes at addr, holding a reference to owner."""
+    array = (ctypes.c_uint8 * size).from_address(addr)
+    array._owner = owner
+    return array
+
+
+class GBSim:
+    _lib = None
+
+    def __init__(self, lib_path=None):
+        if GBSim._lib is None:
+            GBSim._lib = _load_lib(lib_path or
+                                   os.environ.get("GBSIM_LIB", DEFAULT_LIB))
+        self._handle = _Handle(self._lib)
+        # Arrays behind the views of the current cartridge (see load_rom).
+        self._cart_arrays = []
+        self.framebuffer = _view(
+            _array(self._lib.gbsim_framebuffer(self._sim),
+                   LCD_WIDTH * LCD_HEIGHT, self._handle),
+            [LCD_HEIGHT, LCD_WIDTH])
+
+    @property
+    def _sim(self):
+        if self._handle is None:
+            raise ValueError("GBSim is closed")
+        return self._handle.sim
+
+    def close(self):
+        """Releases the simulator. Views of its memory stay valid, and it is
+        freed when the last of them is gone."""
+        self._handle = None
+        self.framebuffer = None
+        self._cart_arrays = []
+
+    def __del__(self):
+        if hasattr(self, "_handle"):
+            self.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def load_rom(self, rom):
+        """Loads a ROM from a filename or bytes-like object. Raises
+        RuntimeError if views of the current ROM or cartridge RAM (mem()) are
+        still referenced, as the cartridge they point into is freed."""
+        if any(ref() is not None for ref in self._cart_arrays):
+            raise RuntimeError("Views of the ROM or cartridge RAM are still "
+                               "in use, delete them before loading a ROM")
+        self._cart_arrays = []
+        if isinstance(rom, (bytes, bytearray, memoryview)):
+            data = bytes(rom)
+            ret = self._lib.gbsim_load_rom_mem(self._sim, data, len(data))
+        else:
+            ret = self._lib.gbsim_load_rom(self._sim, os.fsencode(rom))
+        if ret:
+            raise ValueError("Failed to load ROM %r" % (rom,))
+
+    def reset(self):
+        self._lib.gbsim_reset(self._sim)
+
+    def run_until(self, stop_mask, cycles=0, pc=0):
+        """Runs until any STOP_* condition in stop_mask; returns the mask of
+        conditions that were hit."""
+        return self._lib.gbsim_run_until(self._sim, stop_mask, cycles, pc)
+
+    def fast_forward(self, stop_mask, cycles=0, pc=0):
+        """Like run_until, but runs in the C reference model and hands off to
+        the RTL afterwards (see gbsim_fast_forward)."""
+        ret = self._lib.gbsim_fast_forward(self._sim, stop_mask, cycles, pc)
+        if ret < 0:
+            raise RuntimeError("Fast-forward failed")
+        return ret
+
+    def run_cycles(self, cycles):
+        return self.run_until(STOP_CYCLES, cycles)
+
+    def run_frames(self, num_frames, max_cycles_per_frame=0):
+        """Runs num_frames frames entirely inside the library and returns a
+        memoryview of the 64-bit hash of every completed frame."""
+        hashes = (ctypes.c_uint64 * num_frames)()
+        done = self._lib.gbsim_run_frames(self._sim, num_frames,
+                                          max_cycles_per_frame, hashes)
+        return memoryview(hashes).cast("B").cast("Q")[:done]
+
+    def frame_hash(self):
+        return self._lib.gbsim_frame_hash(self._sim)
+
+    def set_input(self, buttons):
+        self._lib.gbsim_set_input(self._sim, buttons)
+
+    def regs(self):
+        regs = Regs()
+        self._lib.gbsim_get_regs(self._sim, ctypes.byref(regs))
+        return regs
+
+    @property
+    def cycles(self):
+        return self._lib.gbsim_cycles(self._sim)
+
+    def perf_counters(self):
+        """Performance counters of cpu.v since reset, as a dict by the names
+        of PERF_NAMES (all 0 without PERF_COUNTERS)."""
+        counts = (ctypes.c_uint32 * len(PERF_NAMES))()
+        self._lib.gbsim_perf_read(self._sim, counts)
+        return dict(zip(PERF_NAMES, counts))
+
+    def enable_events(self, categories):
+        """Records events of the given EVCAT_* categories in the log."""
+        self._lib.gbsim_events_enable(self._sim, categories)
+
+    def events(self, max_events=4096):
+        """Moves the oldest events out of the log; returns (events, lost)."""
+        buf = (Event * max_events)()
+        lost = ctypes.c_uint64()
+        n = self._lib.gbsim_events_read(self._sim, buf, max_events,
+                                        ctypes.byref(lost))
+        return buf[:n], lost.value
+
+    def load_symbols(self, sym_file=None, map_file=None):
+        """Names code in the profile and coverage map with the labels of an
+        rgblink .sym file and the sections of its .map file."""
+        if self._lib.gbsim_load_symbols(
+                self._sim, os.fsencode(sym_file) if sym_file else None,
+                os.fsencode(map_file) if map_file else None):
+            raise ValueError("Failed to load symbols")
+
+    def enable_profile(self, enable=True):
+        """Profiles the guest program (see gbsim_profile_enable)."""
+        self._lib.gbsim_profile_enable(self._sim, int(enable))
+
+    def save_profile(self, flat=None, collapsed=None):
+        """Writes the flat profile and/or the collapsed stacks (for flame
+        graphs) to the given files."""
+        if self._lib.gbsim_profile_save(
+                self._sim, os.fsencode(flat) if flat else None,
+                os.fsencode(collapsed) if collapsed else None):
+            raise OSError("Failed to write profile")
+
+    def enable_coverage(self, enable=True):
+        """Records which bytes of guest code are executed."""
+        self._lib.gbsim_coverage_enable(self._sim, int(enable))
+
+    def save_coverage(self, filename):
+        if self._lib.gbsim_coverage_save(self._sim, os.fsencode(filename)):
+            raise OSError("Failed to write coverage map")
+
+    def enable_scanlines(self, enable=True):
+        """Records PPU timing per scanline (see gbsim_scanlines_enable)."""
+        self._lib.gbsim_scanlines_enable(self._sim, int(enable))
+
+    def save_scanlines(self, filename):
+        if self._lib.gbsim_scanlines_save(self._sim, os.fsencode(filename)):
+            raise OSError("Failed to write scanline timing")
+
+    def enable_contention(self, enable=True):
+        """Records CPU accesses to VRAM/OAM (see gbsim_contention_enable)."""
+        self._lib.gbsim_contention_enable(self._sim, int(enable))
+
+    def save_contention(self, filename):
+        if self._lib.gbsim_contention_save(self._sim, os.fsencode(filename)):
+            raise OSError("Failed to write VRAM/OAM accesses")
+
+    def mem(self, region):
+        """Zero-copy memoryview of a memory region (MEM_*), or None."""
+        size = ctypes.c_size_t()
+        addr = self._lib.gbsim_mem(self._sim, region, ctypes.byref(size))
+        if not addr:
+            return None
+        array = _array(addr, size.value, self._handle)
+        if region in (MEM_ROM, MEM_CART_RAM):
+            self._cart_arrays = [ref for ref in self._cart_arrays if ref()]
+            self._cart_arrays.append(weakref.ref(array))
+        return _view(array)
@@ -49,7 +49,7 @@ int gui_init(int width, int height, int zoom, const char *wintitle) {
     return 0;
 }
 
-void gui_render_frame(uint8_t *pixbuf) {
+void gui_render_frame(const uint8_t *pixbuf) {
     uint32_t *pixels = NULL;
     int pitch;
     if (SDL_LockTexture(texture, NULL, (void*)&pixels, &pitch)) {
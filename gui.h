@@ -19,7 +19,7 @@ struct gui_input {
 };
 
 int gui_init(int width, int height, int zoom, const char *wintitle);
-void gui_render_frame(uint8_t *pixbuf);
+void gui_render_frame(const uint8_t *pixbuf);
 int gui_input_poll(struct gui_input *input);
 
 #endif
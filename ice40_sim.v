@@ -0,0 +1,60 @@
+/*
+ * Behavioural models of the ice40 primitives that syn_top.v uses, for the
+ * board simulation (see board_main.cpp). Not for synthesis, yosys has the
+ * real ones.
+ *
+ * The PLL passes its input clock through and is always locked: the simulation
+ * drives device_clk at the PLL's output frequency directly.
+ */
+
+/* verilator lint_off UNUSED */
+module SB_PLL40_PAD #(
+    parameter FEEDBACK_PATH = "SIMPLE",
+    parameter [3:0] DIVR = 0,
+    parameter [6:0] DIVF = 0,
+    parameter [2:0] DIVQ = 0,
+    parameter [2:0] FILTER_RANGE = 0
+) (
+    input PACKAGEPIN,
+    input RESETB,
+    input BYPASS,
+    output PLLOUTCORE,
+    output LOCK
+);
+/* verilator lint_on UNUSED */
+
+assign PLLOUTCORE = PACKAGEPIN;
+assign LOCK = RESETB;
+
+endmodule
+
+/* 16K x 16-bit single-port RAM, with a nibble write mask. */
+module SB_SPRAM256KA (
+    input CLOCK,
+    input [13:0] ADDRESS,
+    input [15:0] DATAIN,
+    output reg [15:0] DATAOUT,
+    input WREN,
+    input [3:0] MASKWREN,
+    input CHIPSELECT,
+    input STANDBY,
+    input SLEEP,
+    input POWEROFF
+);
+
+reg [15:0] mem [0:16383];
+
+always @(posedge CLOCK) begin
+    if (CHIPSELECT && !STANDBY && !SLEEP && POWEROFF) begin
+        if (WREN) begin
+            if (MASKWREN[0]) mem[ADDRESS][3:0] <= DATAIN[3:0];
+            if (MASKWREN[1]) mem[ADDRESS][7:4] <= DATAIN[7:4];
+            if (MASKWREN[2]) mem[ADDRESS][11:8] <= DATAIN[11:8];
+            if (MASKWREN[3]) mem[ADDRESS][15:12] <= DATAIN[15:12];
+        end else begin
+            DATAOUT <= mem[ADDRESS];
+        end
+    end
+end
+
+endmodule
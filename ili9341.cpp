@@ -0,0 +1,325 @@
+/*
+ * ILI9341 display controller model, see ili9341.h.
+ */
+
+#include <cstring>
+
+#include "ili9341.h"
+
+/* Internal oscillator, that the frame rate is derived from. */
+#define FOSC_HZ 615000.0
+
+/* Write timing of the 8080-I interface, in ns. */
+#define T_WC  66 // Write cycle
+#define T_WRL 15 // WR low
+#define T_WRH 15 // WR high
+
+/* Commands with an effect on the model. */
+#define CMD_SWRESET 0x01
+#define CMD_SLPIN   0x10
+#define CMD_SLPOUT  0x11
+#define CMD_DISPOFF 0x28
+#define CMD_DISPON  0x29
+#define CMD_CASET   0x2A
+#define CMD_PASET   0x2B
+#define CMD_RAMWR   0x2C
+#define CMD_MADCTL  0x36
+#define CMD_PIXSET  0x3A
+#define CMD_RAMWRC  0x3C
+#define CMD_FRMCTR1 0xB1
+#define CMD_PRCTR   0xB5
+
+/* Memory access control (MADCTL). */
+#define MADCTL_MY 0x80 // Row address order
+#define MADCTL_MX 0x40 // Column address order
+#define MADCTL_MV 0x20 // Row/column exchange
+
+Ili9341::Ili9341(double clk_hz)
+    : clk_hz(clk_hz)
+{
+    memset(gram, 0, sizeof(gram));
+    memset(panel, 0, sizeof(panel));
+    for (int y = 0; y < ILI9341_HEIGHT; y++)
+        for (int x = 0; x < ILI9341_WIDTH; x++)
+            tag[y][x] = -1;
+    pixel_col = pixel_page = pixel_x = pixel_y = 0;
+    pixel_color = 0;
+    writes_cmd = writes_param = writes_pixel = 0;
+    timing_violations = early_cmds = 0;
+    wr_n_old = rst_n_old = 1;
+    wr_fall = wr_rise = 0;
+    reset();
+}
+
+void Ili9341::reset()
+{
+    cmd = 0;
+    nparam = 0;
+    sleep = 1;
+    display_on = 0;
+    madctl = 0;
+    colmod = 0x66;
+    diva = 0;
+    rtna = 0x1b;
+    vfp = vbp = 2;
+    sleep_out = 0;
+    col_start = page_start = 0;
+    col_end = ILI9341_WIDTH - 1;
+    page_end = ILI9341_HEIGHT - 1;
+    col = page = 0;
+    nbytes = 0;
+    scan_line = 0;
+    scan_next = 0;
+    memset(&refresh, 0, sizeof(refresh));
+    refresh.tear_row = -1;
+}
+
+int Ili9341::edge(uint64_t t, bool rst_n, bool cs_n, bool dc, bool wr_n,
+                  bool rd_n, uint8_t data)
+{
+    int ev = 0;
+
+    (void)rd_n;
+    if (!rst_n) {
+        if (rst_n_old)
+            reset();
+        rst_n_old = 0;
+        wr_n_old = wr_n;
+        return 0;
+    }
+    rst_n_old = 1;
+
+    if (!cs_n && wr_n != wr_n_old) {
+        if (!wr_n) {
+            wr_fall = t;
+        } else {
+            double ns = 1e9 / clk_hz;
+            if (writes_cmd + writes_param + writes_pixel &&
+                ((t - wr_rise) * ns < T_WC || (t - wr_fall) * ns < T_WRL ||
+                 (wr_fall - wr_rise) * ns < T_WRH))
+                timing_violations++;
+            wr_rise = t;
+
+            if (!dc) {
+                command(t, data);
+            } else if (cmd == CMD_RAMWR || cmd == CMD_RAMWRC) {
+                writes_pixel++;
+                if (pixel_byte(data))
+                    ev |= ILI9341_EV_PIXEL;
+            } else {
+                writes_param++;
+                parameter(data);
+            }
+        }
+    }
+    wr_n_old = wr_n;
+
+    return ev | scan(t);
+}
+
+void Ili9341::command(uint64_t t, uint8_t data)
+{
+    writes_cmd++;
+    if (sleep_out && t < sleep_out + clk_hz * 5e-3)
+        early_cmds++;
+
+    cmd = data;
+    nparam = 0;
+    switch (cmd) {
+    case CMD_SWRESET:
+        reset();
+        break;
+    case CMD_SLPIN:
+        sleep = 1;
+        break;
+    case CMD_SLPOUT:
+        if (sleep) {
+            sleep = 0;
+            sleep_out = t;
+            scan_line = 0;
+            scan_next = t;
+        }
+        break;
+    case CMD_DISPOFF:
+        display_on = 0;
+        break;
+    case CMD_DISPON:
+        display_on = 1;
+        break;
+    case CMD_RAMWR:
+        col = col_start;
+        page = page_start;
+        nbytes = 0;
+        break;
+    case CMD_RAMWRC:
+        nbytes = 0;
+        break;
+    }
+}
+
+void Ili9341::parameter(uint8_t data)
+{
+    if (nparam < sizeof(params))
+        params[nparam] = data;
+    nparam++;
+
+    switch (cmd) {
+    case CMD_CASET:
+        if (nparam == 4) {
+            col_start = params[0] << 8 | params[1];
+            col_end = params[2] << 8 | params[3];
+        }
+        break;
+    case CMD_PASET:
+        if (nparam == 4) {
+            page_start = params[0] << 8 | params[1];
+            page_end = params[2] << 8 | params[3];
+        }
+        break;
+    case CMD_MADCTL:
+        madctl = data;
+        break;
+    case CMD_PIXSET:
+        colmod = data;
+        break;
+    case CMD_FRMCTR1:
+        if (nparam == 1)
+            diva = data & 0x03;
+        else if (nparam == 2)
+            rtna = data & 0x1f;
+        break;
+    case CMD_PRCTR:
+        if (nparam == 1)
+            vfp = data & 0x7f;
+        else if (nparam == 2)
+            vbp = data & 0x7f;
+        break;
+    }
+}
+
+/* Collects a byte of pixel data, returns whether it completed a pixel that
+ * went to GRAM. */
+bool Ili9341::pixel_byte(uint8_t data)
+{
+    /* 18 bits per pixel are sent as 6 bits in each of 3 bytes, else 16. */
+    bool rgb666 = (colmod & 0x07) == 0x06;
+
+    bytes[nbytes++] = data;
+    if (nbytes < (rgb666 ? 3u : 2u))
+        return 0;
+    nbytes = 0;
+
+    pixel_color = rgb666 ? (bytes[0] >> 3) << 11 | (bytes[1] >> 2) << 5 |
+                           bytes[2] >> 3
+                         : bytes[0] << 8 | bytes[1];
+    pixel_col = col;
+    pixel_page = page;
+    pixel_x = madctl & MADCTL_MV ? page : col;
+    pixel_y = madctl & MADCTL_MV ? col : page;
+
+    if (col >= col_end) {
+        col = col_start;
+        page = page >= page_end ? page_start : page + 1;
+    } else {
+        col++;
+    }
+
+    if (pixel_x >= ILI9341_WIDTH || pixel_y >= ILI9341_HEIGHT)
+        return 0;
+    if (madctl & MADCTL_MX)
+        pixel_x = ILI9341_WIDTH - 1 - pixel_x;
+    if (madctl & MADCTL_MY)
+        pixel_y = ILI9341_HEIGHT - 1 - pixel_y;
+    gram[pixel_y][pixel_x] = pixel_color;
+    return 1;
+}
+
+/* Clocks per line (RTNA, 16 at least) times the division ratio (DIVA). */
+static double line_clocks(uint8_t diva, uint8_t rtna)
+{
+    return (rtna < 0x10 ? 0x10 : rtna) * (1 << diva);
+}
+
+double Ili9341::refresh_rate() const
+{
+    return FOSC_HZ /
+           (line_clocks(diva, rtna) * (vbp + ILI9341_HEIGHT + vfp));
+}
+
+/* Scans out the lines due at time t, returns ILI9341_EV_REFRESH when that
+ * finished a refresh. */
+int Ili9341::scan(uint64_t t)
+{
+    unsigned lines = vbp + ILI9341_HEIGHT + vfp;
+    int ev = 0;
+
+    if (sleep)
+        return 0;
+
+    while (t >= scan_next) {
+        if (scan_line == 0) {
+            refresh.start = t;
+            refresh.tag_min = INT32_MAX;
+            refresh.tag_max = INT32_MIN;
+            refresh.tear_row = -1;
+        }
+        if (scan_line >= vbp && scan_line < vbp + (unsigned)ILI9341_HEIGHT)
+            scan_row(scan_line - vbp);
+
+        scan_next += line_clocks(diva, rtna) * clk_hz / FOSC_HZ;
+        if (++scan_line == lines) {
+            scan_line = 0;
+            refresh.end = t;
+            if (display_on)
+                ev |= ILI9341_EV_REFRESH;
+        }
+    }
+    return ev;
+}
+
+void Ili9341::scan_row(unsigned y)
+{
+    int32_t lo = INT32_MAX, hi = INT32_MIN;
+
+    memcpy(panel[y], gram[y], sizeof(panel[y]));
+
+    for (int x = 0; x < ILI9341_WIDTH; x++) {
+        if (tag[y][x] < 0)
+            continue;
+        lo = tag[y][x] < lo ? tag[y][x] : lo;
+        hi = tag[y][x] > hi ? tag[y][x] : hi;
+    }
+    if (lo > hi)
+        return;
+
+    /* Until the first tear, all rows before have the same tag. */
+    bool first = refresh.tag_min > refresh.tag_max;
+    if (refresh.tear_row < 0 && (lo != hi || (!first && lo != refresh.tag_min)))
+        refresh.tear_row = y;
+    refresh.tag_min = lo < refresh.tag_min ? lo : refresh.tag_min;
+    refresh.tag_max = hi > refresh.tag_max ? hi : refresh.tag_max;
+}
+
+int Ili9341::save_panel(const char *path) const
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+
+    fprintf(fp, "P6\n%d %d\n255\n", ILI9341_WIDTH, ILI9341_HEIGHT);
+    for (int y = 0; y < ILI9341_HEIGHT; y++) {
+        for (int x = 0; x < ILI9341_WIDTH; x++) {
+            uint16_t c = panel[y][x];
+            uint8_t rgb[3] = {
+                (uint8_t)(((c >> 11) & 0x1f) * 255 / 31),
+                (uint8_t)(((c >> 5) & 0x3f) * 255 / 63),
+                (uint8_t)((c & 0x1f) * 255 / 31),
+            };
+            fwrite(rgb, 1, 3, fp);
+        }
+    }
+    fclose(fp);
+    return 0;
+}
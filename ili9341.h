@@ -0,0 +1,119 @@
+/*
+ * Model of the ILI9341 display controller on the 8-bit 8080-I parallel
+ * interface, as driven by tft.v, for the board simulation (board_main.cpp).
+ *
+ * It decodes what is written on the bus (rising edge of WR with CS low), keeps
+ * the frame memory (GRAM) as the controller does with the commands that
+ * matter for it (address window, memory access control, pixel format, sleep,
+ * display on/off and frame rate) and scans it out to the panel line by line
+ * at the frame rate the registers give. Other commands and their parameters
+ * are accepted and ignored. Reads are not modelled.
+ *
+ * Times are in clocks of the board, counted by the caller.
+ */
+
+#ifndef ILI9341_H
+#define ILI9341_H
+
+#include <cstdint>
+#include <cstdio>
+
+/* GRAM and panel size, in the panel's own orientation. */
+#define ILI9341_WIDTH  240
+#define ILI9341_HEIGHT 320
+
+/* Events returned by Ili9341::edge(). */
+#define ILI9341_EV_PIXEL   0x01 // A pixel went to GRAM (pixel_*)
+#define ILI9341_EV_REFRESH 0x02 // The panel was refreshed (refresh)
+
+class Ili9341
+{
+public:
+    /* Frame memory, row 0 at the top of the panel. */
+    uint16_t gram[ILI9341_HEIGHT][ILI9341_WIDTH];
+
+    /* A value the caller keeps per GRAM pixel, e.g. the frame it belongs to,
+     * or -1. Scanning out compares them to find tearing. */
+    int32_t tag[ILI9341_HEIGHT][ILI9341_WIDTH];
+
+    /* What the panel shows: every row as GRAM had it when the scan passed. */
+    uint16_t panel[ILI9341_HEIGHT][ILI9341_WIDTH];
+
+    /* The last pixel written: its address in the window as the host sees it
+     * (column, page), where that is in GRAM, and its RGB565 color. */
+    unsigned pixel_col, pixel_page;
+    unsigned pixel_x, pixel_y;
+    uint16_t pixel_color;
+
+    /* The address window (CASET/PASET). */
+    unsigned col_start, col_end, page_start, page_end;
+
+    /* The last refresh of the panel. Tags are those of the rows scanned
+     * (tag_min > tag_max if none was tagged); tear_row is the first row
+     * showing tags other than the rows before, or -1. */
+    struct Refresh {
+        uint64_t start, end;
+        int32_t tag_min, tag_max;
+        int tear_row;
+    } refresh;
+
+    /* Write strobes on the bus: commands, their parameters and pixel data. */
+    uint64_t writes_cmd, writes_param, writes_pixel;
+
+    /* Writes faster than the datasheet allows (write cycle, WR low or high
+     * too short) and commands sooner than 5 ms after sleep out. */
+    uint64_t timing_violations, early_cmds;
+
+    /* clk_hz is the frequency of the clock edge() is called with. */
+    explicit Ili9341(double clk_hz);
+
+    /* Hardware or software reset: registers to their defaults. GRAM keeps
+     * its contents. */
+    void reset();
+
+    /* Samples the pins (active-low ones as on the bus) at time t. Returns
+     * ILI9341_EV_* for what happened. */
+    int edge(uint64_t t, bool rst_n, bool cs_n, bool dc, bool wr_n, bool rd_n,
+             uint8_t data);
+
+    /* Refresh rate the registers give, in Hz. */
+    double refresh_rate() const;
+
+    /* Writes the panel as a binary PPM image. */
+    int save_panel(const char *path) const;
+
+private:
+    double clk_hz;
+
+    /* Bus state. */
+    bool wr_n_old, rst_n_old;
+    uint64_t wr_fall, wr_rise;
+
+    /* Command being executed and its parameters so far. */
+    uint8_t cmd;
+    unsigned nparam;
+    uint8_t params[4];
+
+    /* Registers. */
+    bool sleep, display_on;
+    uint8_t madctl, colmod;
+    uint8_t diva, rtna, vfp, vbp;
+    uint64_t sleep_out;
+
+    /* Memory write: current address and the bytes of the pixel so far. */
+    unsigned col, page;
+    unsigned nbytes;
+    uint8_t bytes[3];
+
+    /* Scanning: the next line (vertical back porch first) and when. */
+    unsigned scan_line;
+    double scan_next;
+
+    void command(uint64_t t, uint8_t data);
+    void parameter(uint8_t data);
+    bool pixel_byte(uint8_t data);
+    int scan(uint64_t t);
+    void scan_row(unsigned y);
+};
+
+#endif
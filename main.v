@@ -2,6 +2,14 @@
 `include "lram.v"
 `include "bootrom.v"
 `include "ppu.v"
+`ifdef PPU_MODEL
+`include "ppu_model.v"
+`elsif PPU_LOCKSTEP
+`include "ppu_model.v"
+`endif
+`ifdef CPU_MODEL
+`include "cpu_model.v"
+`endif
 
 module main (
     input clk,
@@ -42,7 +50,16 @@ module main (
     output dbg_instruction_retired,
     output dbg_halted,
     output [7:0] dbg_last_opcode,
-    output [5:0] dbg_stage
+    output [5:0] dbg_stage,
+
+    input [3:0] dbg_perf_sel,       // Performance counter of cpu.v (PERF_*)
+    output [31:0] dbg_perf_count,
+
+    output dbg_line_done,           // Per-line timing of ppu.v
+    output [8:0] dbg_line_mode3_cycles,
+    output [3:0] dbg_line_obj_fetches,
+    output [8:0] dbg_line_obj_stall_cycles,
+    output [3:0] dbg_line_fetch_restarts
 );
 
 wire [15:0] bus_addr;
@@ -116,7 +133,13 @@ bootrom bootrom (clk, bootrom_enabled, bus_addr, bootrom_data_r, bootrom_data_ac
 lram #(.base(HRAM_BASE), .size(HRAM_SIZE), .addrbits(7))
     hram (clk, cpu_addr, hram_data_r, cpu_data_w, cpu_do_write, hram_data_active);
 
+/* Hybrid simulation builds (see the Makefile) swap in the C++ models of the
+ * PPU or CPU, or run the PPU model next to ppu.v to check it against. */
+`ifdef PPU_MODEL
+ppu_model ppu(
+`else
 ppu ppu(
+`endif
     clk,
     reset,
 
@@ -139,10 +162,56 @@ ppu ppu(
     lcd_write,
     lcd_col,
     lcd_x,
-    lcd_y
+    lcd_y,
+
+    dbg_line_done,
+    dbg_line_mode3_cycles,
+    dbg_line_obj_fetches,
+    dbg_line_obj_stall_cycles,
+    dbg_line_fetch_restarts
 );
 
+`ifdef PPU_LOCKSTEP
+/* verilator lint_off PINCONNECTEMPTY */
+ppu_model ppu_ref(
+    .clk(clk),
+    .reset(reset),
+
+    .mem_addr(bus_addr),
+    .mem_data_write(bus_data_w),
+    .mem_data_read(),
+    .mem_do_write(bus_do_write),
+    .mem_data_active(),
+
+    .vram_addr(),
+    .vram_data_w(),
+    .vram_data_r(vram_data_r),
+    .vram_do_write(),
+
+    .intreq_vblank(),
+    .intreq_stat(),
+
+    .lcd_hblank(),
+    .lcd_vblank(),
+    .lcd_write(),
+    .lcd_col(),
+    .lcd_x(),
+    .lcd_y(),
+
+    .dbg_line_done(),
+    .dbg_line_mode3_cycles(),
+    .dbg_line_obj_fetches(),
+    .dbg_line_obj_stall_cycles(),
+    .dbg_line_fetch_restarts()
+);
+/* verilator lint_on PINCONNECTEMPTY */
+`endif
+
+`ifdef CPU_MODEL
+cpu_model cpu(
+`else
 cpu cpu(
+`endif
     clk,
     reset,
 
@@ -165,7 +234,10 @@ cpu cpu(
     dbg_HL,
     dbg_instruction_retired,
     dbg_last_opcode,
-    dbg_stage
+    dbg_stage,
+
+    dbg_perf_sel,
+    dbg_perf_count
 );
 
 assign intreq_timer = 0;
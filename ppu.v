@@ -23,7 +23,15 @@ module ppu (
     output reg lcd_write,
     output reg [1:0] lcd_col,
     output reg [7:0] lcd_x,
-    output reg [7:0] lcd_y
+    output reg [7:0] lcd_y,
+
+    /* Timing of the line just drawn (lcd_y), valid in the cycle that
+     * dbg_line_done is set, right after mode 3 ended. */
+    output reg dbg_line_done,
+    output reg [8:0] dbg_line_mode3_cycles,
+    output reg [3:0] dbg_line_obj_fetches,
+    output reg [8:0] dbg_line_obj_stall_cycles,
+    output reg [3:0] dbg_line_fetch_restarts
 );
 
 localparam VRAM_BASE = 'h8000, VRAM_SIZE = 'h2000;
@@ -527,6 +535,51 @@ always @(posedge clk) begin
     end
 end
 
+/*
+ * Per-line timing for the host: cycles in mode 3, object fetches and the
+ * cycles the pixel pipeline stalled on them, and how many of these hit the
+ * background fetcher in the middle of a fetch (which then restarts its VRAM
+ * read when resuming).
+ *
+ * A fetch stalls the pixels from the cycle of the OAM cache hit (the one
+ * before objfetch_start) up to and including the objfetch_done cycle. The
+ * background fetcher freezes in the stage it enters along with
+ * objfetch_start.
+ */
+reg [1:0] line_mode_old;
+reg [8:0] line_mode3_cycles, line_obj_stall_cycles;
+reg [3:0] line_obj_fetches, line_fetch_restarts;
+always @(posedge clk) begin
+    dbg_line_done <= 0;
+    line_mode_old <= mode;
+
+    if (reset || !display_enabled || mode == MODE_OAM) begin
+        line_mode3_cycles <= 0;
+        line_obj_stall_cycles <= 0;
+        line_obj_fetches <= 0;
+        line_fetch_restarts <= 0;
+    end else if (mode == MODE_PIX) begin
+        line_mode3_cycles <= line_mode3_cycles + 1;
+        if (objfetch_start)
+            line_obj_stall_cycles <= line_obj_stall_cycles + 2;
+        else if (objfetch_active || objfetch_done)
+            line_obj_stall_cycles <= line_obj_stall_cycles + 1;
+        if (objfetch_start) begin
+            line_obj_fetches <= line_obj_fetches + 1;
+            if (pixfetch_stage_next != PF_STOPPED &&
+                    pixfetch_stage_next != PF_START &&
+                    pixfetch_stage_next != PF_WAIT_FIFO)
+                line_fetch_restarts <= line_fetch_restarts + 1;
+        end
+    end else if (line_mode_old == MODE_PIX) begin
+        dbg_line_done <= 1;
+        dbg_line_mode3_cycles <= line_mode3_cycles;
+        dbg_line_obj_fetches <= line_obj_fetches;
+        dbg_line_obj_stall_cycles <= line_obj_stall_cycles;
+        dbg_line_fetch_restarts <= line_fetch_restarts;
+    end
+end
+
 /* Request interrupts on vblank and STAT conditions */
 always @(posedge clk) begin
     intreq_vblank <= 0;
@@ -0,0 +1,271 @@
+/*
+ * Behavioural model of ppu.v, see ppu_model.h. The DPI functions at the end
+ * are what ppu_model.v calls.
+ */
+
+#include <cstring>
+
+#include "Vmain__Dpi.h"
+#include "ppu_model.h"
+
+#define CYCLES_X 456
+#define CYCLES_Y 154
+#define OAM_CYCLES 80
+#define PIX_X 160
+#define PIX_Y 144
+
+/* Cycles from the start of mode 3 until ppu.v pushes out its first pixel:
+ * fetching two tiles into the FIFO. */
+#define FETCH_DELAY 15
+
+#define OAM_CACHESIZE 10
+
+#define REG_LCDC 0xff40
+#define REG_STAT 0xff41
+#define REG_SCY  0xff42
+#define REG_SCX  0xff43
+#define REG_LY   0xff44
+#define REG_LYC  0xff45
+#define REG_BGP  0xff47
+#define REG_OBP0 0xff48
+#define REG_OBP1 0xff49
+#define REG_WY   0xff4a
+#define REG_WX   0xff4b
+
+PpuModel::PpuModel()
+    : vram(NULL)
+{
+    reset();
+}
+
+void PpuModel::reset()
+{
+    lcdc = stat = scy = scx = lyc = bgp = obp0 = obp1 = wx = wy = 0;
+    x_clk = 0;
+    y = 0;
+    x_px = PIX_X;
+    line_y = 0;
+    memset(line_idx, 0, sizeof(line_idx));
+    memset(line_col, 0, sizeof(line_col));
+    pix_wait = 0;
+    lcd_col = lcd_x = lcd_y = 0;
+    mode_old = 0;
+    mode3_cycles = line_objs = 0;
+    line_out_old = 0;
+}
+
+void PpuModel::set_position(uint16_t x_clk, uint8_t y)
+{
+    this->x_clk = x_clk;
+    this->y = y;
+    x_px = PIX_X;
+    pix_wait = 0;
+    mode_old = mode();
+    mode3_cycles = 0;
+}
+
+/*
+ * Renders line y as ppu.v draws it: a stream of background pixels starting at
+ * SCX, of which the first SCX % 8 are discarded. Whenever the pixel about to
+ * be pushed is at the X of an object in the OAM cache (x - 8, where lower
+ * cache entries than the last one fetched are skipped), that object's row
+ * replaces the next eight pixels of the stream. Colours are looked up in BGP
+ * when the pixels are pushed out.
+ */
+void PpuModel::render_line()
+{
+    uint8_t stream[PIX_X + 8 + 16];
+    uint8_t cache_oamidx[OAM_CACHESIZE];
+    int cache_x[OAM_CACHESIZE];
+    unsigned cache_size = 0, next_possible = 0;
+    uint8_t row = y + scy;
+    uint16_t map = lcdc & 0x08 ? 0x9c00 : 0x9800;
+    uint16_t data = lcdc & 0x10 ? 0x8000 : 0x9000;
+    unsigned discard = scx & 7;
+    unsigned len = PIX_X + discard;
+
+    /* Unsigned tile indices in both areas, as in ppu.v. */
+    for (unsigned s = 0; s < len + 8; s += 8) {
+        unsigned tile_x = ((scx >> 3) + s / 8) & 31;
+        uint8_t idx = vram_read(map + (row >> 3) * 32 + tile_x);
+        uint16_t addr = data + idx * 16 + (row & 7) * 2;
+        uint8_t lo = vram_read(addr), hi = vram_read(addr + 1);
+        for (int i = 0; i < 8; i++)
+            stream[s + i] = ((hi >> (7 - i)) & 1) << 1 | ((lo >> (7 - i)) & 1);
+    }
+
+    /* OAM search: the first ten objects on the line, 8 pixels high
+     * whatever LCDC says, with X > 0. */
+    for (int i = 0; i < PPU_MODEL_OAM_SIZE / 4 && cache_size < OAM_CACHESIZE;
+         i++) {
+        int oy = oam[i * 4], ox = oam[i * 4 + 1];
+        if (oy <= y + 16 && y + 16 < oy + 8 && ox > 0) {
+            cache_oamidx[cache_size] = i;
+            cache_x[cache_size++] = ox;
+        }
+    }
+
+    line_objs = 0;
+    for (unsigned s = 0; s < len; s++) {
+        int x = s < discard ? 0 : s - discard;
+        for (unsigned c = next_possible; c < cache_size; c++) {
+            if (cache_x[c] - 8 != x)
+                continue;
+            const uint8_t *obj = &oam[cache_oamidx[c] * 4];
+            uint16_t addr = 0x8000 + obj[2] * 16 + ((y + 16 - obj[0]) & 7) * 2;
+            uint8_t lo = vram_read(addr), hi = vram_read(addr + 1);
+            for (int i = 0; i < 8; i++)
+                stream[s + i] = ((hi >> (7 - i)) & 1) << 1 |
+                                ((lo >> (7 - i)) & 1);
+            next_possible = c + 1;
+            line_objs++;
+        }
+    }
+
+    line_y = y;
+    memcpy(line_idx, stream + discard, PIX_X);
+    memset(line_col, 0, sizeof(line_col));
+    pix_wait = FETCH_DELAY + discard;
+}
+
+void PpuModel::write(uint16_t addr, uint8_t val)
+{
+    if (addr >= 0xfe00 && addr < 0xfe00 + PPU_MODEL_OAM_SIZE) {
+        oam[addr - 0xfe00] = val;
+        return;
+    }
+    switch (addr) {
+    case REG_LCDC: lcdc = val; break;
+    case REG_STAT: stat = val & 0x78; break;
+    case REG_SCY:  scy = val; break;
+    case REG_SCX:  scx = val; break;
+    case REG_LYC:  lyc = val; break;
+    case REG_BGP:  bgp = val; break;
+    case REG_OBP0: obp0 = val; break;
+    case REG_OBP1: obp1 = val; break;
+    case REG_WY:   wy = val; break;
+    case REG_WX:   wx = val; break;
+    }
+}
+
+uint8_t PpuModel::read(uint16_t addr) const
+{
+    if (addr >= 0xfe00 && addr < 0xfe00 + PPU_MODEL_OAM_SIZE)
+        return oam[addr - 0xfe00];
+    switch (addr) {
+    case REG_LCDC: return lcdc;
+    case REG_STAT: return stat | (y == lyc ? 0x04 : 0) | mode();
+    case REG_SCY:  return scy;
+    case REG_SCX:  return scx;
+    case REG_LY:   return y;
+    case REG_LYC:  return lyc;
+    case REG_BGP:  return bgp;
+    case REG_OBP0: return obp0;
+    case REG_OBP1: return obp1;
+    case REG_WY:   return wy;
+    case REG_WX:   return wx;
+    default:       return 0xff;
+    }
+}
+
+/*
+ * Everything is computed from the state before the edge, like the always
+ * blocks of ppu.v: pixel output, line timing, register writes and at last
+ * the position.
+ */
+void PpuModel::cycle(bool rst, uint16_t addr, uint8_t data_w, bool do_write,
+                     uint32_t *lcd_out, uint32_t *line_out)
+{
+    bool lcd_write = 0, lcd_hblank = 0, lcd_vblank = 0, intreq_vblank = 0;
+    bool on = enabled();
+    uint8_t cur_mode = mode();
+
+    if (rst) {
+        reset();
+        *lcd_out = 0;
+        *line_out = 0;
+        return;
+    }
+
+    bool reset_y = do_write && addr == REG_LY;
+    uint16_t next_x = x_clk == CYCLES_X - 1 ? 0 : x_clk + 1;
+    uint8_t next_y = reset_y ? 0 :
+                     x_clk < CYCLES_X - 1 ? y :
+                     y == CYCLES_Y - 1 ? 0 : y + 1;
+
+    if (on) {
+        if (next_y != y && next_y == PIX_Y)
+            intreq_vblank = 1;
+
+        if (y >= PIX_Y) {
+            lcd_vblank = 1;
+        } else if (x_clk == OAM_CYCLES) {
+            render_line();
+            x_px = 0;
+        } else if (x_px == PIX_X) {
+            lcd_hblank = 1;
+        } else if (pix_wait) {
+            pix_wait--;
+        } else {
+            lcd_col = (bgp >> (line_idx[x_px] * 2)) & 3;
+            lcd_x = x_px;
+            lcd_y = y;
+            line_col[x_px] = lcd_col;
+            lcd_write = 1;
+            x_px++;
+        }
+    }
+
+    /* Line timing as ppu.v reports it; objects never stall here. */
+    uint32_t line = line_out_old & ~(1u << 26);
+    if (!on || cur_mode == 2) {
+        mode3_cycles = 0;
+    } else if (cur_mode == 3) {
+        mode3_cycles++;
+    } else if (mode_old == 3) {
+        line = 1u << 26 | (line_objs & 0xf) << 9 | (mode3_cycles & 0x1ff);
+        line_out_old = line & ~(1u << 26);
+    }
+    mode_old = cur_mode;
+
+    if (do_write)
+        write(addr, data_w);
+
+    if (on) {
+        x_clk = next_x;
+        y = next_y;
+    }
+
+    *lcd_out = (uint32_t)drawing() << 23 | intreq_vblank << 21 |
+               lcd_hblank << 20 | lcd_vblank << 19 | lcd_write << 18 |
+               lcd_col << 16 | lcd_x << 8 | lcd_y;
+    *line_out = line;
+}
+
+/* DPI functions of ppu_model.v. */
+
+void *ppu_model_create()
+{
+    return new PpuModel;
+}
+
+void ppu_model_destroy(void *model)
+{
+    delete (PpuModel *)model;
+}
+
+void ppu_model_cycle(void *model, svBit reset, unsigned int addr,
+                     unsigned int data_w, svBit do_write,
+                     unsigned int *lcd_out, unsigned int *line_out)
+{
+    uint32_t lcd, line;
+    ((PpuModel *)model)->cycle(reset, addr, data_w, do_write, &lcd, &line);
+    *lcd_out = lcd;
+    *line_out = line;
+}
+
+unsigned int ppu_model_read(void *model, unsigned int addr, unsigned int tick)
+{
+    (void)tick;
+    return ((PpuModel *)model)->read(addr);
+}
@@ -0,0 +1,108 @@
+/*
+ * Behavioural model of ppu.v for hybrid simulation builds (HYBRID=ppu and
+ * HYBRID=ppu-lockstep, see the Makefile): ppu_model.v puts it behind the ports
+ * of ppu.v, calling into it once per clock cycle.
+ *
+ * Like emu_sys.c, it models ppu.v rather than the real hardware, deviations
+ * included: the background without the window, objects replacing the next
+ * eight pixels of the FIFO when they are reached (in OAM order, ten per line,
+ * drawn with BGP), VRAM blocked for the CPU while drawing. It does not model
+ * the pixel pipeline though: a line is rendered all at once when mode 3
+ * starts, and pushed out a pixel per cycle after a fixed fetch delay, so mode
+ * 3 is as long as ppu.v takes without objects. It reads VRAM straight from
+ * the simulation's memory (set_vram) rather than over vram_addr.
+ */
+
+#ifndef PPU_MODEL_H
+#define PPU_MODEL_H
+
+#include <cstdint>
+
+#define PPU_MODEL_OAM_SIZE 0xa0
+
+class PpuModel
+{
+public:
+    /* Registers of ppu.v, as in struct emu_sys, and its position (cur_x_clk,
+     * cur_y and cur_x_px). */
+    uint8_t lcdc, stat, scy, scx, lyc, bgp, obp0, obp1, wx, wy;
+    uint16_t x_clk;
+    uint8_t y;
+    uint8_t x_px;
+
+    uint8_t oam[PPU_MODEL_OAM_SIZE];
+
+    /* The line last drawn (or being drawn): the colour indices rendered at
+     * the start of mode 3 and the colours pushed out so far. */
+    uint8_t line_y;
+    uint8_t line_idx[160];
+    uint8_t line_col[160];
+
+    PpuModel();
+
+    void reset();
+
+    /* VRAM (0x2000 bytes) to draw from, the same memory that vram_addr and
+     * vram_do_write go to. Until set, lines are drawn blank. */
+    void set_vram(const uint8_t *mem)
+    {
+        vram = mem;
+    }
+
+    /* Continues at the given position outside of mode 3, as
+     * gbsim_fast_forward does with ppu.v. */
+    void set_position(uint16_t x_clk, uint8_t y);
+
+    /* A rising clock edge with the given inputs. Returns the outputs of
+     * ppu.v for the next cycle, packed as described in ppu_model.v. */
+    void cycle(bool rst, uint16_t addr, uint8_t data_w, bool do_write,
+               uint32_t *lcd_out, uint32_t *line_out);
+
+    /* Value read from OAM or the registers at addr (VRAM reads are handled
+     * by ppu_model.v). */
+    uint8_t read(uint16_t addr) const;
+
+    bool enabled() const
+    {
+        return lcdc & 0x80;
+    }
+
+    /* STAT mode, computed like ppu.v does. */
+    uint8_t mode() const
+    {
+        if (y >= 144)
+            return 1;
+        if (x_clk < 80)
+            return 2;
+        return x_px < 160 ? 3 : 0;
+    }
+
+    /* Whether VRAM belongs to the PPU (mode 3 of a drawn line). */
+    bool drawing() const
+    {
+        return enabled() && mode() == 3;
+    }
+
+private:
+    const uint8_t *vram;
+
+    /* Cycles until the next pixel is pushed out (fetches and discarded
+     * pixels at the start of the line). */
+    unsigned pix_wait;
+
+    /* Last outputs, ppu.v keeps these in registers. */
+    uint8_t lcd_col, lcd_x, lcd_y;
+    uint8_t mode_old;
+    unsigned mode3_cycles, line_objs;
+    uint32_t line_out_old;
+
+    uint8_t vram_read(uint16_t addr) const
+    {
+        return vram ? vram[(addr - 0x8000) & 0x1fff] : 0;
+    }
+
+    void render_line();
+    void write(uint16_t addr, uint8_t val);
+};
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ * Behavioural model of the PPU (ppu_model.cpp) behind the ports of ppu.v, for
+ * hybrid simulation builds (PPU_MODEL/PPU_LOCKSTEP, see main.v). Verilator
+ * only: the model is called through DPI once per clock cycle, with the inputs
+ * before the edge, and returns the outputs after it packed into two words:
+ *
+ *   lcd:  [23] drawing (mode 3, VRAM is the PPU's), [22] intreq_stat,
+ *         [21] intreq_vblank, [20] lcd_hblank, [19] lcd_vblank,
+ *         [18] lcd_write, [17:16] lcd_col, [15:8] lcd_x, [7:0] lcd_y
+ *   line: [26] dbg_line_done, [25:22] dbg_line_fetch_restarts,
+ *         [21:13] dbg_line_obj_stall_cycles, [12:9] dbg_line_obj_fetches,
+ *         [8:0] dbg_line_mode3_cycles
+ *
+ * Reads of OAM and the registers are combinational, as in ppu.v; VRAM goes
+ * over the same port as there.
+ */
+
+module ppu_model (
+    input clk,
+    input reset,
+
+    input [15:0] mem_addr,
+    input [7:0] mem_data_write,
+    output [7:0] mem_data_read,
+    input mem_do_write,
+    output mem_data_active,
+
+    output [15:0] vram_addr,
+    output [7:0] vram_data_w,
+    input [7:0] vram_data_r,
+    output vram_do_write,
+
+    output reg intreq_vblank,
+    output reg intreq_stat,
+
+    output reg lcd_hblank,
+    output reg lcd_vblank,
+    output reg lcd_write,
+    output reg [1:0] lcd_col,
+    output reg [7:0] lcd_x,
+    output reg [7:0] lcd_y,
+
+    output reg dbg_line_done,
+    output reg [8:0] dbg_line_mode3_cycles,
+    output reg [3:0] dbg_line_obj_fetches,
+    output reg [8:0] dbg_line_obj_stall_cycles,
+    output reg [3:0] dbg_line_fetch_restarts
+);
+
+localparam VRAM_BASE = 'h8000, VRAM_SIZE = 'h2000;
+localparam  OAM_BASE = 'hFE00,  OAM_SIZE = 'hA0;
+localparam IO_START = 'hFF40, IO_END = 'hFF4B;
+
+import "DPI-C" function chandle ppu_model_create();
+import "DPI-C" function void ppu_model_destroy(input chandle model);
+import "DPI-C" function void ppu_model_cycle(
+    input chandle model,
+    input bit reset,
+    input int unsigned addr,
+    input int unsigned data_w,
+    input bit do_write,
+    output int unsigned lcd,
+    output int unsigned line);
+/* tick only makes reads depend on something that changes every cycle, so
+ * they are evaluated again when the model did. */
+import "DPI-C" function int unsigned ppu_model_read(
+    input chandle model,
+    input int unsigned addr,
+    input int unsigned tick);
+
+chandle model;
+initial model = ppu_model_create();
+final ppu_model_destroy(model);
+
+reg [31:0] tick;
+reg drawing;
+wire vram_selected;
+/* verilator lint_off UNUSED */
+int unsigned lcd_out, line_out, read_data;
+/* verilator lint_on UNUSED */
+
+always @(posedge clk) begin
+    ppu_model_cycle(model, reset, {16'b0, mem_addr}, {24'b0, mem_data_write},
+                    mem_do_write, lcd_out, line_out);
+    {drawing, intreq_stat, intreq_vblank, lcd_hblank, lcd_vblank, lcd_write,
+     lcd_col, lcd_x, lcd_y} <= lcd_out[23:0];
+    {dbg_line_done, dbg_line_fetch_restarts, dbg_line_obj_stall_cycles,
+     dbg_line_obj_fetches, dbg_line_mode3_cycles} <= line_out[26:0];
+    tick <= tick + 1;
+end
+
+assign vram_addr = drawing ? 0 : mem_addr;
+assign vram_data_w = drawing ? 0 : mem_data_write;
+assign vram_do_write = drawing ? 0 : mem_do_write;
+
+assign vram_selected = mem_addr >= VRAM_BASE && mem_addr < VRAM_BASE + VRAM_SIZE;
+assign read_data = ppu_model_read(model, {16'b0, mem_addr}, tick);
+assign mem_data_read = vram_selected ? (drawing ? 'hff : vram_data_r)
+                                     : read_data[7:0];
+
+assign mem_data_active = !mem_do_write && (vram_selected ||
+    (mem_addr >= OAM_BASE && mem_addr < OAM_BASE + OAM_SIZE) ||
+    (mem_addr >= IO_START && mem_addr <= IO_END));
+
+endmodule
@@ -0,0 +1,253 @@
+/*
+ * Guest program profiler, see profile.h.
+ */
+
+#include <algorithm>
+#include <map>
+
+#include "profile.h"
+
+/* Cycles the CPU spent halted, charged to the stack it halted in. */
+#define LOC_HALTED 0xffffff
+
+/* Deeper calls are charged to the deepest frame. */
+#define MAX_STACK_DEPTH 256
+
+static bool is_call(uint8_t opcode)
+{
+    return opcode == 0xcd ||            // CALL nn
+           (opcode & 0xe7) == 0xc4 ||   // CALL cc, nn
+           (opcode & 0xc7) == 0xc7;     // RST n
+}
+
+static bool is_ret(uint8_t opcode)
+{
+    return opcode == 0xc9 ||            // RET
+           opcode == 0xd9 ||            // RETI
+           (opcode & 0xe7) == 0xc0;     // RET cc
+}
+
+Profiler::Profiler()
+    : enabled(0)
+{
+    clear(0, 0, 0);
+}
+
+void Profiler::clear(uint16_t pc, uint16_t sp, uint8_t bank)
+{
+    nodes.clear();
+    nodes.push_back({ 0, 0 });
+    children.clear();
+    samples.clear();
+    restart(pc, sp, bank);
+}
+
+void Profiler::restart(uint16_t pc, uint16_t sp, uint8_t bank)
+{
+    stack.clear();
+    cur_loc = loc_of(pc, bank);
+    cur_sp = sp;
+    cycles = halted_cycles = 0;
+}
+
+uint32_t Profiler::push(uint32_t entry, uint16_t sp)
+{
+    uint32_t parent = stack.empty() ? 0 : stack.back().node;
+
+    if (stack.size() >= MAX_STACK_DEPTH)
+        return parent;
+
+    uint64_t key = (uint64_t)parent << 24 | entry;
+    auto it = children.find(key);
+    uint32_t node;
+    if (it != children.end()) {
+        node = it->second;
+    } else {
+        node = nodes.size();
+        nodes.push_back({ parent, entry });
+        children[key] = node;
+    }
+    stack.push_back({ node, sp });
+    return node;
+}
+
+void Profiler::add(uint32_t node, uint32_t loc, uint64_t cycles,
+                   uint64_t count)
+{
+    Sample &s = samples[(uint64_t)node << 24 | loc];
+    s.cycles += cycles;
+    s.count += count;
+}
+
+void Profiler::retire(uint16_t pc, uint16_t sp, uint8_t bank, uint8_t opcode,
+                      bool intack)
+{
+    uint32_t loc = loc_of(pc, bank);
+    uint32_t node = stack.empty() ? 0 : stack.back().node;
+
+    if (halted_cycles) {
+        add(node, LOC_HALTED, halted_cycles, 0);
+        halted_cycles = 0;
+    }
+
+    if (intack) {
+        /* The dispatch itself is charged to the handler. */
+        node = push(loc, sp);
+        add(node, loc, cycles, 1);
+    } else {
+        add(node, cur_loc, cycles, 1);
+        if (is_call(opcode) && sp != cur_sp)
+            push(loc, sp);
+        else if (is_ret(opcode))
+            while (!stack.empty() && stack.back().sp < sp)
+                stack.pop_back();
+    }
+
+    cycles = 0;
+    cur_loc = loc;
+    cur_sp = sp;
+}
+
+/* Label of loc, see Symbols::name(). */
+std::string Profiler::loc_name(uint32_t loc, bool offset, const Symbols &syms)
+{
+    if (loc == LOC_HALTED)
+        return "[halted]";
+    return syms.name(loc, offset);
+}
+
+/* Name of the function called by the frame of node. */
+std::string Profiler::frame_name(uint32_t node, const Symbols &syms)
+{
+    char buf[16];
+    uint32_t entry = nodes[node].entry;
+    std::string name = syms.name(entry, 0);
+
+    if (!name.empty())
+        return name;
+    snprintf(buf, sizeof(buf), "%02x:%04x", LOC_BANK(entry), LOC_ADDR(entry));
+    return buf;
+}
+
+/* Frames from the root to node, separated by ';'. */
+std::string Profiler::stack_name(uint32_t node, const Symbols &syms)
+{
+    if (!node)
+        return "";
+    std::string parent = stack_name(nodes[node].parent, syms);
+    return parent.empty() ? frame_name(node, syms) :
+                            parent + ";" + frame_name(node, syms);
+}
+
+/* Entries of a map of Samples, most cycles first. */
+template <typename M>
+static std::vector<typename M::const_iterator> by_cycles(const M &map)
+{
+    std::vector<typename M::const_iterator> v;
+    for (auto it = map.begin(); it != map.end(); ++it)
+        v.push_back(it);
+    std::stable_sort(v.begin(), v.end(),
+                     [](typename M::const_iterator a,
+                        typename M::const_iterator b) {
+                         return a->second.cycles > b->second.cycles;
+                     });
+    return v;
+}
+
+void Profiler::write_flat(FILE *fp, const Symbols &syms)
+{
+    std::map<uint32_t, Sample> by_loc;
+    std::map<int, Sample> by_bank;
+    std::map<std::string, Sample> by_sym;
+    uint64_t total = 0, count = 0, halted = 0;
+
+    for (auto &it : samples) {
+        uint32_t loc = it.first & 0xffffff;
+        Sample &s = by_loc[loc];
+        s.cycles += it.second.cycles;
+        s.count += it.second.count;
+        total += it.second.cycles;
+        count += it.second.count;
+        if (loc == LOC_HALTED)
+            halted += it.second.cycles;
+    }
+    for (auto &it : by_loc) {
+        uint32_t loc = it.first;
+        int bank = loc == LOC_HALTED ? -2 :
+                   LOC_ADDR(loc) < 0x8000 ? (int)LOC_BANK(loc) : -1;
+        std::string name = loc_name(loc, 0, syms);
+        Sample &b = by_bank[bank], &s = by_sym[name.empty() ? "??" : name];
+        b.cycles += it.second.cycles;
+        b.count += it.second.count;
+        s.cycles += it.second.cycles;
+        s.count += it.second.count;
+    }
+
+    fprintf(fp, "%llu cycles, %llu instructions", (unsigned long long)total,
+            (unsigned long long)count);
+    if (count)
+        fprintf(fp, " (%.2f cycles per instruction when not halted)",
+                (double)(total - halted) / count);
+    fprintf(fp, "\n");
+    if (!total)
+        return;
+
+    fprintf(fp, "\n      cycles       %%        insts  bank\n");
+    for (auto &it : by_cycles(by_bank)) {
+        fprintf(fp, "%12llu  %5.1f%%  %11llu  ",
+                (unsigned long long)it->second.cycles,
+                100.0 * it->second.cycles / total,
+                (unsigned long long)it->second.count);
+        if (it->first == -2)
+            fprintf(fp, "[halted]\n");
+        else if (it->first == -1)
+            fprintf(fp, "ram\n");
+        else
+            fprintf(fp, "%02x\n", it->first);
+    }
+
+    fprintf(fp, "\n      cycles       %%        insts  symbol\n");
+    for (auto &it : by_cycles(by_sym))
+        fprintf(fp, "%12llu  %5.1f%%  %11llu  %s\n",
+                (unsigned long long)it->second.cycles,
+                100.0 * it->second.cycles / total,
+                (unsigned long long)it->second.count, it->first.c_str());
+
+    fprintf(fp, "\n      cycles       %%        insts  address  symbol\n");
+    for (auto &it : by_cycles(by_loc)) {
+        if (it->first == LOC_HALTED)
+            continue;
+        fprintf(fp, "%12llu  %5.1f%%  %11llu  %02x:%04x  %s\n",
+                (unsigned long long)it->second.cycles,
+                100.0 * it->second.cycles / total,
+                (unsigned long long)it->second.count,
+                LOC_BANK(it->first), LOC_ADDR(it->first),
+                loc_name(it->first, 1, syms).c_str());
+    }
+}
+
+void Profiler::write_collapsed(FILE *fp, const Symbols &syms)
+{
+    std::map<std::string, uint64_t> stacks;
+
+    for (auto &it : samples) {
+        uint32_t node = it.first >> 24, loc = it.first & 0xffffff;
+        std::string frames = stack_name(node, syms);
+        std::string leaf = loc_name(loc, 0, syms);
+
+        /* Code in the function of the innermost frame is not a frame of
+         * its own, neither is code without a symbol. */
+        if (node && leaf == frame_name(node, syms))
+            leaf = "";
+        if (!leaf.empty())
+            frames = frames.empty() ? leaf : frames + ";" + leaf;
+        else if (frames.empty())
+            frames = "[unknown]";
+        stacks[frames] += it.second.cycles;
+    }
+
+    for (auto &it : stacks)
+        if (it.second)
+            fprintf(fp, "%s %llu\n", it.first.c_str(),
+                    (unsigned long long)it.second);
+}
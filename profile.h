@@ -0,0 +1,90 @@
+/*
+ * Profiler of the guest program for gbsim.cpp (see gbsim_profile_enable).
+ *
+ * Every clock cycle is attributed to the instruction it belongs to, by ROM
+ * bank and address, and to the call stack that instruction ran in. The stack
+ * is followed through the retired instructions: CALL, RST and interrupt
+ * dispatch that decrement SP push a frame, RET/RETI pop all frames whose
+ * return address is now above SP (so code that drops return addresses itself
+ * does not confuse it for long). Cycles are only summed up per instruction, so
+ * the per-cycle cost is a single increment.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "symbols.h"
+
+class Profiler
+{
+public:
+    bool enabled;
+
+    Profiler();
+
+    /* Drops all counts, then restart(). */
+    void clear(uint16_t pc, uint16_t sp, uint8_t bank);
+
+    /* Continues at pc with an empty call stack, e.g. after the CPU state was
+     * changed behind our back. Counts are kept. */
+    void restart(uint16_t pc, uint16_t sp, uint8_t bank);
+
+    inline void cycle(bool halted)
+    {
+        if (halted)
+            halted_cycles++;
+        else
+            cycles++;
+    }
+
+    /* An instruction (or interrupt dispatch if intack) retired; pc, sp and
+     * bank are the state it left behind. */
+    void retire(uint16_t pc, uint16_t sp, uint8_t bank, uint8_t opcode,
+                bool intack);
+
+    /* Cycles and instructions per ROM bank, per label and per address. */
+    void write_flat(FILE *fp, const Symbols &syms);
+
+    /* One "frame;frame;leaf cycles" line per call stack, the format of
+     * flamegraph.pl and similar tools. */
+    void write_collapsed(FILE *fp, const Symbols &syms);
+
+private:
+    struct Sample {
+        uint64_t cycles, count;
+    };
+    struct Node {
+        uint32_t parent;
+        uint32_t entry;         // Location called, 0 for the root
+    };
+    struct Frame {
+        uint32_t node;
+        uint16_t sp;            // Where the return address is
+    };
+
+    /* Call tree, node 0 is the root. */
+    std::vector<Node> nodes;
+    std::unordered_map<uint64_t, uint32_t> children;
+    std::vector<Frame> stack;
+
+    /* Keyed by node << 24 | location (see symbols.h). */
+    std::unordered_map<uint64_t, Sample> samples;
+
+    uint32_t cur_loc;
+    uint16_t cur_sp;
+    uint64_t cycles, halted_cycles;
+
+    uint32_t push(uint32_t entry, uint16_t sp);
+    void add(uint32_t node, uint32_t loc, uint64_t cycles, uint64_t count);
+    std::string loc_name(uint32_t loc, bool offset, const Symbols &syms);
+    std::string frame_name(uint32_t node, const Symbols &syms);
+    std::string stack_name(uint32_t node, const Symbols &syms);
+};
+
+#endif
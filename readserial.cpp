@@ -0,0 +1,391 @@
+/*
+ * Host side of the debug UART stream produced by dbgserial.v.
+ *
+ * Reads the serial device in large chunks and decodes all complete frames in
+ * each chunk at once. Frames are located by their sync bytes and validated by
+ * their checksum, so lost or corrupted bytes only cost the affected frames.
+ * Every frame carries one of the CPU performance counters in turn; the latest
+ * value of each is kept and printed as a CPI breakdown at the end.
+ *
+ * For testing without hardware, `readserial -g` creates a pseudo-terminal and
+ * writes synthetic frames to it (optionally corrupting some of them). Point a
+ * second `readserial` at the printed device to decode them.
+ */
+
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "cpuperf.h"
+
+#define FRAME_LEN 23
+#define FRAME_SYNC0 0xa5
+#define FRAME_SYNC1 0x5a
+
+#define READ_CHUNK (64 * 1024)
+#define GEN_BATCH 256
+
+struct dbg_frame {
+    uint8_t seq;
+    uint8_t status;
+    uint8_t opcode;
+    uint16_t pc, sp, AF, BC, DE, HL;
+    uint8_t perf_sel;
+    uint32_t perf_count;
+};
+
+struct ingest_stats {
+    unsigned long frames;
+    unsigned long bad_checksum;
+    unsigned long skipped_bytes;
+    unsigned long lost_frames;
+    uint32_t perf[PERF_NUM];        // Latest value of every counter
+};
+
+static volatile sig_atomic_t stop_requested;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static void put16(uint8_t *p, uint16_t val)
+{
+    p[0] = val >> 8;
+    p[1] = val & 0xff;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return (uint32_t)get16(p) << 16 | get16(p + 2);
+}
+
+static void put32(uint8_t *p, uint32_t val)
+{
+    put16(p, val >> 16);
+    put16(p + 2, val & 0xffff);
+}
+
+static uint8_t frame_checksum(const uint8_t *raw)
+{
+    uint8_t sum = 0;
+    for (int i = 2; i < FRAME_LEN - 1; i++)
+        sum += raw[i];
+    return -sum;
+}
+
+static void frame_encode(uint8_t *raw, const struct dbg_frame *f)
+{
+    raw[0] = FRAME_SYNC0;
+    raw[1] = FRAME_SYNC1;
+    raw[2] = f->seq;
+    raw[3] = f->status;
+    put16(&raw[4], f->pc);
+    put16(&raw[6], f->sp);
+    put16(&raw[8], f->AF);
+    put16(&raw[10], f->BC);
+    put16(&raw[12], f->DE);
+    put16(&raw[14], f->HL);
+    raw[16] = f->opcode;
+    raw[17] = f->perf_sel;
+    put32(&raw[18], f->perf_count);
+    raw[22] = frame_checksum(raw);
+}
+
+static void frame_decode(const uint8_t *raw, struct dbg_frame *f)
+{
+    f->seq = raw[2];
+    f->status = raw[3];
+    f->pc = get16(&raw[4]);
+    f->sp = get16(&raw[6]);
+    f->AF = get16(&raw[8]);
+    f->BC = get16(&raw[10]);
+    f->DE = get16(&raw[12]);
+    f->HL = get16(&raw[14]);
+    f->opcode = raw[16];
+    f->perf_sel = raw[17];
+    f->perf_count = get32(&raw[18]);
+}
+
+/*
+ * Decodes all complete frames in buf[0..len), appending their textual form to
+ * out. Returns the number of bytes consumed; the remainder is the start of a
+ * (possibly) partial frame that should be retried once more data arrives.
+ */
+static size_t decode_batch(const uint8_t *buf, size_t len, char *out,
+        size_t *out_len, struct ingest_stats *stats, int *last_seq)
+{
+    size_t pos = 0;
+
+    while (len - pos >= FRAME_LEN) {
+        const uint8_t *raw = &buf[pos];
+
+        if (raw[0] != FRAME_SYNC0 || raw[1] != FRAME_SYNC1 ||
+                raw[FRAME_LEN - 1] != frame_checksum(raw)) {
+            if (raw[0] == FRAME_SYNC0 && raw[1] == FRAME_SYNC1)
+                stats->bad_checksum++;
+            stats->skipped_bytes++;
+            pos++;
+            continue;
+        }
+
+        struct dbg_frame f;
+        frame_decode(raw, &f);
+        pos += FRAME_LEN;
+
+        if (*last_seq >= 0)
+            stats->lost_frames += (uint8_t)(f.seq - *last_seq - 1);
+        *last_seq = f.seq;
+        stats->frames++;
+        if (f.perf_sel < PERF_NUM)
+            stats->perf[f.perf_sel] = f.perf_count;
+
+        if (out)
+            *out_len += sprintf(out + *out_len,
+                    "%02x  %02d %d  %02x %04x %04x %04x %04x %04x %04x  "
+                    "%2d %08x\n",
+                    f.seq, f.status & 0x3f, f.status >> 7, f.opcode, f.pc,
+                    f.sp, f.AF, f.BC, f.DE, f.HL, f.perf_sel, f.perf_count);
+    }
+    return pos;
+}
+
+static speed_t baud_to_speed(long baud)
+{
+    switch (baud) {
+    case 9600:    return B9600;
+    case 19200:   return B19200;
+    case 38400:   return B38400;
+    case 57600:   return B57600;
+    case 115200:  return B115200;
+    case 230400:  return B230400;
+#ifdef B460800
+    case 460800:  return B460800;
+    case 921600:  return B921600;
+    case 1000000: return B1000000;
+    case 2000000: return B2000000;
+    case 3000000: return B3000000;
+#endif
+    default:
+        fprintf(stderr, "Unsupported baud rate %ld\n", baud);
+        exit(1);
+    }
+}
+
+static int set_raw(int fd, long baud)
+{
+    struct termios tio;
+
+    if (tcgetattr(fd, &tio))
+        return 1;
+    cfmakeraw(&tio);
+    if (baud) {
+        cfsetispeed(&tio, baud_to_speed(baud));
+        cfsetospeed(&tio, baud_to_speed(baud));
+    }
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    return tcsetattr(fd, TCSANOW, &tio);
+}
+
+static void print_stats(const struct ingest_stats *stats)
+{
+    fprintf(stderr, "frames: %lu  lost: %lu  bad checksum: %lu  "
+            "skipped bytes: %lu\n", stats->frames, stats->lost_frames,
+            stats->bad_checksum, stats->skipped_bytes);
+
+    for (int i = 0; i < PERF_NUM; i++) {
+        if (stats->perf[i]) {
+            perf_print(stderr, stats->perf);
+            break;
+        }
+    }
+}
+
+static int ingest(const char *path, long baud, bool quiet)
+{
+    int fd = open(path, O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    if (set_raw(fd, baud))
+        fprintf(stderr, "Warning: could not configure %s as raw tty\n", path);
+
+    /* Worst case every byte but the last partial frame decodes to a line. */
+    static uint8_t buf[READ_CHUNK + FRAME_LEN];
+    static char out[(READ_CHUNK / FRAME_LEN + 1) * 80];
+    size_t fill = 0;
+    struct ingest_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    int last_seq = -1;
+
+    if (!quiet)
+        printf("seq ST H  op  PC   SP   AF   BC   DE   HL   ctr count\n");
+
+    while (!stop_requested) {
+        ssize_t n = read(fd, buf + fill, READ_CHUNK);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        fill += n;
+
+        size_t out_len = 0;
+        size_t used = decode_batch(buf, fill, quiet ? NULL : out, &out_len,
+                &stats, &last_seq);
+        memmove(buf, buf + used, fill - used);
+        fill -= used;
+
+        if (out_len)
+            fwrite(out, 1, out_len, stdout);
+    }
+
+    fflush(stdout);
+    print_stats(&stats);
+    close(fd);
+    return 0;
+}
+
+/*
+ * Writes synthetic frames to a new pseudo-terminal. Every `corrupt_every`
+ * frames one frame is damaged (alternating a flipped and a dropped byte) to
+ * exercise resynchronization on the reader side.
+ */
+static int generate(unsigned long num_frames, unsigned long corrupt_every)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) || unlockpt(master)) {
+        fprintf(stderr, "Failed to create pseudo-terminal: %s\n",
+                strerror(errno));
+        return 1;
+    }
+
+    /* Keep the slave open ourselves so the line stays up between readers. */
+    const char *slave_path = ptsname(master);
+    int slave = open(slave_path, O_RDWR | O_NOCTTY);
+    if (slave < 0 || set_raw(slave, 0)) {
+        fprintf(stderr, "Failed to set up %s\n", slave_path);
+        return 1;
+    }
+    printf("%s\n", slave_path);
+    fflush(stdout);
+
+    static uint8_t buf[GEN_BATCH * FRAME_LEN];
+    struct dbg_frame f;
+    memset(&f, 0, sizeof(f));
+    f.sp = 0xfffe;
+    f.pc = 0x0100;
+
+    unsigned long sent = 0, corrupted = 0;
+    while (!stop_requested && (!num_frames || sent < num_frames)) {
+        size_t len = 0;
+        for (int i = 0; i < GEN_BATCH && (!num_frames || sent < num_frames);
+                i++, sent++) {
+            f.seq = sent;
+            f.status = 41; // WRITEBACK
+            f.opcode = sent * 7;
+            f.pc += 1 + (sent & 1);
+            f.AF = (sent << 8) | ((sent & 0xf) << 4);
+            f.BC = sent * 3;
+            f.DE = sent * 5;
+            f.HL = ~sent;
+            f.perf_sel = sent % PERF_NUM;
+            f.perf_count = sent * (f.perf_sel + 1);
+            frame_encode(&buf[len], &f);
+            len += FRAME_LEN;
+
+            if (corrupt_every && sent % corrupt_every == corrupt_every - 1) {
+                if (corrupted++ & 1) {
+                    len--; // Drop the checksum byte
+                } else {
+                    buf[len - 5] ^= 0x10;
+                }
+            }
+        }
+
+        for (size_t off = 0; off < len; ) {
+            ssize_t n = write(master, buf + off, len - off);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0) {
+                fprintf(stderr, "Write failed: %s\n", strerror(errno));
+                return 1;
+            }
+            off += n;
+        }
+    }
+
+    fprintf(stderr, "generated %lu frames (%lu corrupted)\n", sent, corrupted);
+
+    /* Give the reader a chance to drain the pty before it disappears. */
+    tcdrain(master);
+    sleep(1);
+    close(slave);
+    close(master);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-b baud] [-q] device\n"
+            "       %s -g [-n frames] [-e corrupt_every]\n"
+            "\n"
+            "  -b   Baud rate of the serial device (default 115200)\n"
+            "  -q   Only print statistics, not the decoded frames\n"
+            "  -g   Generate test frames on a new pseudo-terminal\n"
+            "  -n   Number of frames to generate (default: until interrupted)\n"
+            "  -e   Corrupt one of every N generated frames\n",
+            prog, prog);
+}
+
+int main(int argc, char **argv)
+{
+    long baud = 115200;
+    bool quiet = false, gen = false;
+    unsigned long num_frames = 0, corrupt_every = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:qgn:e:h")) != -1) {
+        switch (opt) {
+        case 'b': baud = strtol(optarg, NULL, 0); break;
+        case 'q': quiet = true; break;
+        case 'g': gen = true; break;
+        case 'n': num_frames = strtoul(optarg, NULL, 0); break;
+        case 'e': corrupt_every = strtoul(optarg, NULL, 0); break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    /* No SA_RESTART, so a blocking read() returns on ^C. */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if (gen)
+        return generate(num_frames, corrupt_every);
+
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    return ingest(argv[optind], baud, quiet);
+}
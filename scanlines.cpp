@@ -0,0 +1,132 @@
+/*
+ * PPU scanline timing, see scanlines.h.
+ */
+
+#include <cstring>
+
+#include "scanlines.h"
+
+/* Cycles per line after OAM search, for the hblank left to the CPU. */
+#define LINE_CYCLES_AFTER_OAM (456 - 80)
+
+#define BAR_WIDTH 40
+
+Scanlines::Scanlines()
+    : enabled(0)
+{
+    clear();
+}
+
+void Scanlines::clear()
+{
+    frames.clear();
+    memset(&cur, 0, sizeof(cur));
+    bad_lines = 0;
+}
+
+void Scanlines::frame_end(uint64_t cycle)
+{
+    /* Nothing drawn (LCD off), not a frame. */
+    if (!cur.lines)
+        return;
+    cur.cycle = cycle;
+    frames.push_back(cur);
+    memset(&cur, 0, sizeof(cur));
+}
+
+void Scanlines::add(Frame &sum, const Frame &f)
+{
+    if (!sum.lines || f.mode3_min < sum.mode3_min)
+        sum.mode3_min = f.mode3_min;
+    if (f.mode3_max > sum.mode3_max)
+        sum.mode3_max = f.mode3_max;
+    sum.lines += f.lines;
+    sum.mode3_cycles += f.mode3_cycles;
+    sum.obj_fetches += f.obj_fetches;
+    sum.obj_stall_cycles += f.obj_stall_cycles;
+    sum.fetch_restarts += f.fetch_restarts;
+    for (int i = 0; i < MODE3_BUCKETS; i++)
+        sum.mode3_hist[i] += f.mode3_hist[i];
+    for (int i = 0; i <= LINE_MAX_OBJS; i++)
+        sum.obj_hist[i] += f.obj_hist[i];
+}
+
+static void print_bar(FILE *fp, unsigned n, unsigned max)
+{
+    int len = max ? (n * BAR_WIDTH + max - 1) / max : 0;
+    fprintf(fp, "%10u  %.*s\n", n, len,
+            "########################################");
+}
+
+void Scanlines::write(FILE *fp) const
+{
+    Frame total;
+    unsigned max;
+
+    memset(&total, 0, sizeof(total));
+    for (const Frame &f : frames)
+        add(total, f);
+
+    fprintf(fp, "%zu frames, %u lines", frames.size(), total.lines);
+    if (!total.lines) {
+        fprintf(fp, "\n");
+        return;
+    }
+    fprintf(fp, "\nmode 3: %u-%u cycles, %.1f on average (hblank %.1f)\n"
+            "objects: %.2f fetches per line, stalling %.1f cycles; "
+            "%u fetcher restarts\n",
+            total.mode3_min, total.mode3_max,
+            (double)total.mode3_cycles / total.lines,
+            LINE_CYCLES_AFTER_OAM - (double)total.mode3_cycles / total.lines,
+            (double)total.obj_fetches / total.lines,
+            (double)total.obj_stall_cycles / total.lines,
+            total.fetch_restarts);
+    if (bad_lines) {
+        fprintf(fp, "%llu lines with inconsistent timing\n",
+                (unsigned long long)bad_lines);
+        fprintf(stderr, "Scanlines: %llu lines with inconsistent timing\n",
+                (unsigned long long)bad_lines);
+    }
+
+    fprintf(fp, "\nmode 3 cycles      lines\n");
+    max = 0;
+    for (int i = 0; i < MODE3_BUCKETS; i++)
+        max = total.mode3_hist[i] > max ? total.mode3_hist[i] : max;
+    for (int i = 0; i < MODE3_BUCKETS; i++) {
+        if (!total.mode3_hist[i])
+            continue;
+        if (i == MODE3_BUCKETS - 1)
+            fprintf(fp, "%3d+   ", MODE3_MIN + i * MODE3_BUCKET);
+        else
+            fprintf(fp, "%3d-%-3d", MODE3_MIN + i * MODE3_BUCKET,
+                    MODE3_MIN + (i + 1) * MODE3_BUCKET - 1);
+        print_bar(fp, total.mode3_hist[i], max);
+    }
+
+    fprintf(fp, "\nobjects            lines\n");
+    max = 0;
+    for (int i = 0; i <= LINE_MAX_OBJS; i++)
+        max = total.obj_hist[i] > max ? total.obj_hist[i] : max;
+    for (int i = 0; i <= LINE_MAX_OBJS; i++) {
+        if (!total.obj_hist[i])
+            continue;
+        fprintf(fp, "%7d", i);
+        print_bar(fp, total.obj_hist[i], max);
+    }
+
+    /* Per frame, the mode-3 histogram as bucket:lines pairs. */
+    fprintf(fp, "\nframe         cycle  lines  mode3 min    avg  max  "
+            "objs   stall  restarts  mode 3 histogram\n");
+    for (size_t n = 0; n < frames.size(); n++) {
+        const Frame &f = frames[n];
+        fprintf(fp, "%5zu  %12llu  %5u  %9u  %5.1f  %3u  %4u  %6u  %8u ",
+                n, (unsigned long long)f.cycle, f.lines, f.mode3_min,
+                (double)f.mode3_cycles / f.lines, f.mode3_max, f.obj_fetches,
+                f.obj_stall_cycles, f.fetch_restarts);
+        for (int i = 0; i < MODE3_BUCKETS; i++)
+            if (f.mode3_hist[i])
+                fprintf(fp, " %d:%u", MODE3_MIN + i * MODE3_BUCKET,
+                        f.mode3_hist[i]);
+        fprintf(fp, "\n");
+    }
+}
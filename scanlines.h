@@ -0,0 +1,90 @@
+/*
+ * PPU timing per scanline for gbsim.cpp (see gbsim_scanlines_enable): the
+ * mode-3 length, object fetches, the cycles stalled on them and background
+ * fetcher restarts of every line drawn, as reported by ppu.v, summed up into
+ * histograms per frame.
+ *
+ * Mode 3 is what is left of the 376 cycles after OAM search that the CPU
+ * does not get as hblank, so these show how objects stretch it.
+ */
+
+#ifndef SCANLINES_H
+#define SCANLINES_H
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+/* Mode-3 lengths are counted in buckets of MODE3_BUCKET cycles, from
+ * MODE3_MIN (shorter ones go in the first) up to the end of the line. */
+#define MODE3_MIN 160
+#define MODE3_BUCKET 8
+#define MODE3_BUCKETS ((456 - 80 - MODE3_MIN) / MODE3_BUCKET + 1)
+
+/* Most objects fetched per line (the size of the OAM cache of ppu.v). */
+#define LINE_MAX_OBJS 10
+
+class Scanlines
+{
+public:
+    bool enabled;
+
+    Scanlines();
+
+    void clear();
+
+    /* A line was drawn with the given timing. */
+    inline void line(unsigned mode3_cycles, unsigned obj_fetches,
+                     unsigned obj_stall_cycles, unsigned fetch_restarts)
+    {
+        unsigned bucket = mode3_cycles < MODE3_MIN ? 0 :
+                          (mode3_cycles - MODE3_MIN) / MODE3_BUCKET;
+        if (bucket >= MODE3_BUCKETS)
+            bucket = MODE3_BUCKETS - 1;
+        /* Every cycle of mode 3 either draws a pixel or stalls, and only
+         * an object fetch restarts the fetcher. */
+        if (mode3_cycles < MODE3_MIN ||
+            obj_stall_cycles > mode3_cycles - MODE3_MIN ||
+            fetch_restarts > obj_fetches)
+            bad_lines++;
+        if (obj_fetches > LINE_MAX_OBJS)
+            obj_fetches = LINE_MAX_OBJS;
+
+        if (!cur.lines || mode3_cycles < cur.mode3_min)
+            cur.mode3_min = mode3_cycles;
+        if (mode3_cycles > cur.mode3_max)
+            cur.mode3_max = mode3_cycles;
+        cur.lines++;
+        cur.mode3_cycles += mode3_cycles;
+        cur.obj_fetches += obj_fetches;
+        cur.obj_stall_cycles += obj_stall_cycles;
+        cur.fetch_restarts += fetch_restarts;
+        cur.mode3_hist[bucket]++;
+        cur.obj_hist[obj_fetches]++;
+    }
+
+    /* The LCD entered vblank at the given cycle, ending the frame. */
+    void frame_end(uint64_t cycle);
+
+    /* Totals and histograms over all frames, then a line per frame. */
+    void write(FILE *fp) const;
+
+private:
+    struct Frame {
+        uint64_t cycle;         // Start of vblank
+        unsigned lines;
+        unsigned mode3_min, mode3_max;
+        uint64_t mode3_cycles;
+        unsigned obj_fetches, obj_stall_cycles, fetch_restarts;
+        unsigned mode3_hist[MODE3_BUCKETS];
+        unsigned obj_hist[LINE_MAX_OBJS + 1];
+    };
+
+    std::vector<Frame> frames;
+    Frame cur;
+    uint64_t bad_lines;         // Inconsistent timing (see line())
+
+    static void add(Frame &sum, const Frame &f);
+};
+
+#endif
@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+"""
+Build time, startup time and simulation speed of the simulator backends
+(verilator and CXXRTL, see BACKEND in the Makefile) over the test ROMs.
+
+Every backend is built from scratch (its build directory is removed first,
+unless --no-rebuild) and timed, then runs every ROM headless for a number of
+frames. The simulator reports the time spent in the run loop and the cycles
+per second there; whatever else the process took (building the model,
+loading the ROM, exiting) counts as startup. As both backends compile the
+same RTL, they also cross-check each other: the cycles run, the hash of the
+last frame and the final registers have to be the same for all of them, and
+the script exits non-zero if they are not.
+
+Usually run by `make bench-backends`.
+"""
+
+import argparse
+import os
+import re
+import shutil
+import subprocess
+import sys
+import time
+
+RAN_RE = re.compile(r"Ran (\d+) frames, (\d+) cycles in ([\d.]+) s "
+                    r"\((\d+) cycles/s\), frame hash ([0-9a-f]+)")
+REGS_HEADER = " PC   SP   AF   BC   DE   HL  ZNHC  hlt"
+
+
+def sim_dir(builddir, backend):
+    """Build directory of a backend, as the Makefile names it."""
+    sim = os.path.join(builddir, "sim")
+    return sim if backend == "verilator" else sim + "-" + backend
+
+
+def build(builddir, backend, rebuild):
+    """Builds the simulator of a backend. Returns the time it took."""
+    if rebuild:
+        shutil.rmtree(sim_dir(builddir, backend), ignore_errors=True)
+    cmd = ["make", "sim", "BACKEND=" + backend, "BUILDDIR=" + builddir]
+    print("[BUILD] %s: %s" % (backend, " ".join(cmd)), flush=True)
+    start = time.time()
+    subprocess.check_call(cmd)
+    return time.time() - start
+
+
+def run(sim, rom, frames):
+    """Runs a ROM. Returns a dict with the wall time, the time and speed of
+    the run loop and what the backends have to agree on, or None if the
+    simulator failed."""
+    cmd = [sim, "-n", str(frames), rom]
+    start = time.time()
+    proc = subprocess.run(cmd, stdout=subprocess.PIPE,
+                          stderr=subprocess.STDOUT, universal_newlines=True)
+    wall = time.time() - start
+
+    m = RAN_RE.search(proc.stdout)
+    if proc.returncode or not m:
+        print("  %s exited with %d:\n%s" % (" ".join(cmd), proc.returncode,
+                                           proc.stdout))
+        return None
+    lines = proc.stdout.splitlines()
+    regs = ""
+    if REGS_HEADER in lines:
+        regs = lines[lines.index(REGS_HEADER) + 1].strip()
+
+    return {
+        "wall": wall,
+        "secs": float(m.group(3)),
+        "speed": int(m.group(4)),
+        "result": (int(m.group(1)), int(m.group(2)), m.group(5), regs),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Compare the simulator backends on the test ROMs.")
+    parser.add_argument("--backends", default="verilator,cxxrtl",
+                        help="comma-separated backends, the first is the "
+                             "reference for the cross-check")
+    parser.add_argument("--frames", type=int, default=300,
+                        help="frames to run per ROM")
+    parser.add_argument("--builddir", default="build",
+                        help="BUILDDIR of the Makefile")
+    parser.add_argument("--no-rebuild", action="store_true",
+                        help="keep existing builds (build time is then "
+                             "only what was out of date)")
+    parser.add_argument("roms", nargs="+", help="ROMs to run")
+    args = parser.parse_args()
+
+    backends = args.backends.split(",")
+    build_time = {}
+    for backend in backends:
+        build_time[backend] = build(args.builddir, backend,
+                                    not args.no_rebuild)
+
+    results = {}
+    for rom in args.roms:
+        for backend in backends:
+            sim = os.path.join(sim_dir(args.builddir, backend), "Vmain")
+            print("[RUN] %s: %s" % (backend, rom), flush=True)
+            results[rom, backend] = run(sim, rom, args.frames)
+
+    ref = backends[0]
+    mismatches = 0
+    print()
+    print("Build time:")
+    for backend in backends:
+        print("  %-10s %8.1f s" % (backend, build_time[backend]))
+    print()
+    print("%-24s %-10s %12s %10s  %s" % ("ROM", "backend", "cycles/s",
+                                          "startup", "vs " + ref))
+    for rom in args.roms:
+        name = os.path.basename(rom)
+        for backend in backends:
+            r = results[rom, backend]
+            if r is None:
+                print("%-24s %-10s %12s %10s  %s" % (name, backend, "-", "-",
+                                                      "failed"))
+                mismatches += 1
+                continue
+            check = ""
+            if backend != ref:
+                r_ref = results[rom, ref]
+                if r_ref is None:
+                    check = "no reference"
+                elif r["result"] == r_ref["result"]:
+                    check = "same (%.2fx)" % (r["speed"] / r_ref["speed"]
+                                              if r_ref["speed"] else 0)
+                else:
+                    check = "MISMATCH %s vs %s" % (r["result"],
+                                                   r_ref["result"])
+                    mismatches += 1
+            print("%-24s %-10s %12d %8.0fms  %s"
+                  % (name, backend, r["speed"],
+                     (r["wall"] - r["secs"]) * 1000, check))
+
+    if mismatches:
+        print("\n%d run(s) failed or did not match %s" % (mismatches, ref))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
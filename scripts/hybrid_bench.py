@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""
+Simulation speed of the hybrid builds (HYBRID=ppu and HYBRID=cpu in the
+Makefile, with C++ models in place of ppu.v or cpu.v) against the plain RTL
+build over the test ROMs, and lockstep runs of the PPU model next to ppu.v
+(HYBRID=ppu-lockstep).
+
+Builds are made as needed (not from scratch, build time is not the point
+here). Every ROM runs headless for a number of frames on each build, and the
+run loop speed of the simulator is compared to the plain build. The models
+are not cycle exact, so the hybrid runs are not cross-checked against it;
+that is what the lockstep runs are for: every ROM given with --lockstep runs
+on the lockstep build, which compares the PPU state and the pixels of every
+line and exits non-zero on mismatches. The script then exits non-zero too.
+
+Usually run by `make bench-hybrid`.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+from backend_bench import run
+
+LOCKSTEP_RE = re.compile(r"PPU lockstep: (\d+) lines compared, (\d+) "
+                         r"mismatched \((\d+) mismatches\)")
+
+
+def sim_path(builddir, hybrid):
+    """Simulator of a build, as the Makefile names its directory."""
+    sim = os.path.join(builddir, "sim")
+    return os.path.join(sim + "-" + hybrid if hybrid else sim, "Vmain")
+
+
+def build(builddir, hybrid):
+    cmd = ["make", "sim", "BUILDDIR=" + builddir]
+    if hybrid:
+        cmd.append("HYBRID=" + hybrid)
+    print("[BUILD] %s: %s" % (hybrid or "rtl", " ".join(cmd)), flush=True)
+    subprocess.check_call(cmd)
+
+
+def lockstep(sim, rom, frames):
+    """Runs a ROM on the lockstep build. Returns the lines compared and
+    mismatched, or None if the simulator failed otherwise."""
+    cmd = [sim, "-n", str(frames), rom]
+    proc = subprocess.run(cmd, stdout=subprocess.PIPE,
+                          stderr=subprocess.STDOUT, universal_newlines=True)
+    m = LOCKSTEP_RE.search(proc.stdout)
+    if not m or (proc.returncode and not int(m.group(3))):
+        print("  %s exited with %d:\n%s" % (" ".join(cmd), proc.returncode,
+                                           proc.stdout))
+        return None
+    if int(m.group(3)):
+        print(proc.stdout)
+    return int(m.group(1)), int(m.group(2))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Compare the hybrid builds with plain RTL on the test "
+                    "ROMs and run the PPU model in lockstep.")
+    parser.add_argument("--hybrids", default="ppu,cpu",
+                        help="comma-separated HYBRID builds to compare")
+    parser.add_argument("--frames", type=int, default=300,
+                        help="frames to run per ROM")
+    parser.add_argument("--builddir", default="build",
+                        help="BUILDDIR of the Makefile")
+    parser.add_argument("--lockstep", action="append", default=[],
+                        metavar="ROM",
+                        help="ROM to run with HYBRID=ppu-lockstep (repeat "
+                             "for more)")
+    parser.add_argument("roms", nargs="+", help="ROMs to compare speed on")
+    args = parser.parse_args()
+
+    compared = [""] + [h for h in args.hybrids.split(",") if h]
+    for hybrid in compared + (["ppu-lockstep"] if args.lockstep else []):
+        build(args.builddir, hybrid)
+
+    results = {}
+    for rom in args.roms:
+        for hybrid in compared:
+            print("[RUN] %s: %s" % (hybrid or "rtl", rom), flush=True)
+            results[rom, hybrid] = run(sim_path(args.builddir, hybrid), rom,
+                                       args.frames)
+    lockstep_results = {}
+    for rom in args.lockstep:
+        print("[LOCKSTEP] %s" % rom, flush=True)
+        lockstep_results[rom] = lockstep(
+            sim_path(args.builddir, "ppu-lockstep"), rom, args.frames)
+
+    failed = 0
+    print()
+    print("%-24s %-10s %12s  %s" % ("ROM", "build", "cycles/s", "vs rtl"))
+    for rom in args.roms:
+        name = os.path.basename(rom)
+        r_ref = results[rom, ""]
+        for hybrid in compared:
+            r = results[rom, hybrid]
+            if r is None:
+                print("%-24s %-10s %12s  %s" % (name, hybrid or "rtl", "-",
+                                                 "failed"))
+                failed += 1
+                continue
+            speedup = ""
+            if hybrid and r_ref is not None and r_ref["speed"]:
+                speedup = "%.2fx" % (r["speed"] / r_ref["speed"])
+            print("%-24s %-10s %12d  %s" % (name, hybrid or "rtl",
+                                             r["speed"], speedup))
+
+    if args.lockstep:
+        print()
+        print("%-24s %10s %10s" % ("ROM", "lines", "mismatched"))
+    for rom in args.lockstep:
+        name = os.path.basename(rom)
+        r = lockstep_results[rom]
+        if r is None:
+            print("%-24s %10s %10s" % (name, "-", "failed"))
+            failed += 1
+            continue
+        print("%-24s %10d %10d" % (name, r[0], r[1]))
+        if r[1]:
+            failed += 1
+
+    if failed:
+        print("\n%d run(s) failed or mismatched in lockstep" % failed)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
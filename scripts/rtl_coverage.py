@@ -0,0 +1,218 @@
+#!/usr/bin/env python3
+"""
+Line and toggle coverage of the RTL over the test ROMs and the CPU tests.
+
+Runs every ROM for a number of frames on a coverage build of the simulator
+(`make COVERAGE=1 sim`) and the CPU tests on coverage builds of their models
+(`make -C test_instructions COVERAGE=1 sim build-cov/test_alu`), each writing
+its own coverage file to the output directory. These are merged (merged.dat)
+and annotated (annotated/) with verilator_coverage, and summarized in
+summary.txt: covered points per source file, the uncovered lines and signal
+bits of the selected files, and per run the points it covers and how many of
+those no other run does. Runs that cover nothing of their own are marked, they
+can go from the set when it takes too long.
+
+Usually run by `make coverage`.
+"""
+
+import argparse
+import glob
+import os
+import re
+import shutil
+import subprocess
+import sys
+import time
+from collections import defaultdict
+
+
+def cpu_test_runs(cpu_tests, fuzz_seed):
+    """(name, command) of the CPU test runs. The cache is not used, as tests
+    that are skipped cover nothing."""
+    test = os.path.join(cpu_tests, "test")
+    return [
+        ("cpu", [test, "--cb", "--keep-going"]),
+        ("cpu-lanes", [test, "--cb", "--lanes", "--keep-going"]),
+        ("cpu-exhaustive", [test, "--exhaustive", "--keep-going"]),
+        ("cpu-fuzz", [test, "--fuzz", "--seed", str(fuzz_seed),
+                      "--keep-going"]),
+        ("alu", [os.path.join(cpu_tests, "test_alu")]),
+    ]
+
+
+def run_files(out_dir, name):
+    """Coverage files of a run: name.dat and the numbered name-N.dat."""
+    return [f for f in glob.glob(os.path.join(out_dir, name + "*.dat"))
+            if re.fullmatch(re.escape(name) + r"(-\d+)?\.dat",
+                            os.path.basename(f))]
+
+
+def run(name, cmd, out_dir, log):
+    """Runs cmd with its coverage going to out_dir/name.dat (and name-N.dat
+    for later saves). Returns the time it took."""
+    for f in run_files(out_dir, name):
+        os.remove(f)
+    env = dict(os.environ, VM_COVERAGE_FILE=os.path.join(out_dir,
+                                                         name + ".dat"))
+    print("[RUN] %s: %s" % (name, " ".join(cmd)), flush=True)
+    start = time.time()
+    ret = subprocess.call(cmd, env=env, stdout=log, stderr=subprocess.STDOUT)
+    elapsed = time.time() - start
+    if ret:
+        print("  exited with %d, see %s" % (ret, log.name))
+    return elapsed
+
+
+def parse_dat(path):
+    """Yields (fields, count) of the coverage points in a verilator coverage
+    file, where fields maps the keys of a point (f: file, l: line, page: kind
+    of point, o: comment, h: hierarchy, ...) to their values."""
+    with open(path, errors="replace") as f:
+        for line in f:
+            if not line.startswith("C '"):
+                continue
+            end = line.rindex("'")
+            fields = {}
+            for item in line[3:end].split("\x01"):
+                if "\x02" in item:
+                    key, value = item.split("\x02", 1)
+                    fields[key] = value
+            yield fields, int(line[end + 1:])
+
+
+def point_key(fields):
+    """A point of the source, whatever instance it is in: (file, line, kind,
+    comment, column)."""
+    page = fields.get("page", "")
+    kind = "toggle" if "toggle" in page else "line"
+    return (os.path.basename(fields.get("f", "")), int(fields.get("l", 0)),
+            kind, fields.get("o", ""), fields.get("n", ""))
+
+
+def load_run(out_dir, name):
+    """Points of all coverage files of a run, with their total counts."""
+    points = defaultdict(int)
+    for path in run_files(out_dir, name):
+        for fields, count in parse_dat(path):
+            points[point_key(fields)] += count
+    return points
+
+
+def percent(n, total):
+    return 100.0 * n / total if total else 0.0
+
+
+def write_summary(fp, runs, points, files, max_uncovered):
+    covered = {k for k, n in points.items() if n}
+
+    fp.write("%-14s %18s  %18s\n" % ("file", "lines", "toggles"))
+    by_file = defaultdict(lambda: defaultdict(lambda: [0, 0]))
+    for k in points:
+        c = by_file[k[0]][k[2]]
+        c[0] += k in covered
+        c[1] += 1
+    for f in sorted(by_file):
+        cols = []
+        for kind in ("line", "toggle"):
+            n, total = by_file[f][kind]
+            cols.append("%6d/%-6d %3.0f%%" % (n, total, percent(n, total)))
+        fp.write("%-14s %s  %s\n" % (f, cols[0], cols[1]))
+
+    for f in files:
+        for kind in ("line", "toggle"):
+            missing = sorted(k for k in points
+                             if k[0] == f and k[2] == kind
+                             and k not in covered)
+            if not missing:
+                continue
+            fp.write("\nUncovered %ss in %s (%d):\n" % (kind, f,
+                                                       len(missing)))
+            for k in missing[:max_uncovered]:
+                fp.write("  %s:%d  %s\n" % (f, k[1], k[3]))
+            if len(missing) > max_uncovered:
+                fp.write("  ... and %d more\n" % (len(missing) -
+                                                 max_uncovered))
+
+    # Points each run covers that no other one does
+    covered_by = defaultdict(int)
+    for _, run_points, _ in runs:
+        for k, n in run_points.items():
+            if n:
+                covered_by[k] += 1
+    fp.write("\n%-20s %8s %9s %8s\n" % ("run", "time", "covered", "unique"))
+    for name, run_points, elapsed in runs:
+        mine = [k for k, n in run_points.items() if n]
+        unique = sum(1 for k in mine if covered_by[k] == 1)
+        fp.write("%-20s %7.1fs %9d %8d%s\n" %
+                 (name, elapsed, len(mine), unique,
+                  "  (adds no coverage)" if not unique else ""))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="RTL line and toggle coverage over ROMs and CPU tests")
+    parser.add_argument("--out", required=True,
+                        help="directory for coverage files and summary")
+    parser.add_argument("--sim", help="coverage build of the simulator")
+    parser.add_argument("--frames", type=int, default=300,
+                        help="frames to run every ROM for (default 300)")
+    parser.add_argument("--cpu-tests",
+                        help="build directory of the CPU test coverage build")
+    parser.add_argument("--fuzz-seed", type=int, default=1,
+                        help="seed of the fuzz run (default 1)")
+    parser.add_argument("--files", default="cpu.v,ppu.v",
+                        help="files to list uncovered points of "
+                             "(default cpu.v,ppu.v)")
+    parser.add_argument("--max-uncovered", type=int, default=50,
+                        help="uncovered points to list per file and kind")
+    parser.add_argument("roms", nargs="*", help="ROMs to run on --sim")
+    args = parser.parse_args()
+
+    os.makedirs(args.out, exist_ok=True)
+    todo = []
+    if args.sim:
+        for rom in args.roms:
+            name = "rom-" + os.path.splitext(os.path.basename(rom))[0]
+            todo.append((name, [args.sim, "-n", str(args.frames), rom]))
+    if args.cpu_tests:
+        todo += cpu_test_runs(args.cpu_tests, args.fuzz_seed)
+    if not todo:
+        parser.error("nothing to run, give --sim and ROMs or --cpu-tests")
+
+    runs = []
+    with open(os.path.join(args.out, "runs.log"), "w") as log:
+        for name, cmd in todo:
+            elapsed = run(name, cmd, args.out, log)
+            runs.append((name, load_run(args.out, name), elapsed))
+
+    points = defaultdict(int)
+    for _, run_points, _ in runs:
+        for k, n in run_points.items():
+            points[k] += n
+    if not points:
+        print("No coverage written, are these coverage builds?")
+        return 1
+
+    dat_files = sorted(f for name, _, _ in runs
+                       for f in run_files(args.out, name))
+    if shutil.which("verilator_coverage"):
+        merged = os.path.join(args.out, "merged.dat")
+        subprocess.check_call(["verilator_coverage", "--write", merged] +
+                              dat_files)
+        subprocess.check_call(["verilator_coverage", "--annotate",
+                               os.path.join(args.out, "annotated"),
+                               "--annotate-min", "1", merged])
+    else:
+        print("verilator_coverage not found, not merging/annotating")
+
+    summary = os.path.join(args.out, "summary.txt")
+    with open(summary, "w") as fp:
+        write_summary(fp, runs, points, args.files.split(","),
+                      args.max_uncovered)
+    with open(summary) as fp:
+        sys.stdout.write(fp.read())
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,241 +1,113 @@
 #include <chrono>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
 
-#include "Vmain.h"
-#include "verilated.h"
+#include <unistd.h>
 
 extern "C" {
 #include "gui.h"
 }
+#include "gbsim.h"
 
-#define RES_X 160
-#define RES_Y 144
 #define ZOOM  4
 
-using namespace std::chrono;
-
-class MemRegion
-{
-protected:
-    uint8_t *mem;
-    uint16_t base, end;
-public:
-    MemRegion(uint16_t base, uint16_t end)
-        : base(base), end(end)
-    {
-        mem = (uint8_t *)calloc(end - base, 1);
-    }
-
-    void update(uint16_t addr, bool do_write, uint8_t val, uint8_t *rv)
-    {
-        if (addr >= base && addr < end) {
-            if (do_write)
-                mem[addr - base] = val;
-            else
-                *rv = mem[addr - base];
-        }
-    }
-};
-
-#define ROMHDR_CART_TYPE 0x0147
-#define ROMHDR_RAM_SIZE 0x0149
-
-#define CART_TYPE_ROMONLY 0x00
-#define CART_TYPE_MBC3_RAM_BAT 0x13
+/* Cycles per frame, so we still poll for input if the LCD is disabled. */
+#define CYCLES_PER_FRAME (456 * 154)
 
-#define ROMBANK_SIZE 0x4000
-#define RAMBANK_SIZE 0x2000
+using namespace std::chrono;
 
-class Cartridge
-{
-protected:
-    size_t rom_size;
-    uint8_t *rom;
-    Cartridge(size_t rom_size, uint8_t *rom_data)
-            : rom_size(rom_size), rom(rom_data)
-    {
-    }
-public:
-    virtual uint8_t read(uint16_t addr) = 0;
-    virtual void write(uint16_t addr, uint8_t data) = 0;
-
-    void update(uint16_t addr, bool do_write, uint8_t val, uint8_t *rv)
-    {
-        if (addr < 0x8000 || (addr >= 0xA000 && addr < 0xC000)) {
-            if (do_write)
-                write(addr, val);
-            else
-                *rv = read(addr);
-        }
-    }
-};
+#define BIT(val, bitpos) (((val) >> (bitpos)) & 1)
 
-class CartRomOnly : public Cartridge
+void dump_state(struct gbsim *sim)
 {
-public:
-    CartRomOnly(size_t rom_size, uint8_t *rom_data)
-        : Cartridge(rom_size, rom_data)
-    {
-    }
-
-    virtual uint8_t read(uint16_t addr)
-    {
-        if (addr >= 0x8000 || addr > rom_size)
-            return 0xaa;
-        return rom[addr];
-    }
-
-    virtual void write(uint16_t addr, uint8_t data)
-    {
-    }
-};
+    struct gbsim_regs regs;
+    gbsim_get_regs(sim, &regs);
+    printf(" PC   SP   AF   BC   DE   HL  ZNHC  hlt\n"
+            "%04x %04x %04x %04x %04x %04x %d%d%d%d   %d\n\n",
+            regs.pc, regs.sp, regs.AF, regs.BC, regs.DE, regs.HL,
+            BIT(regs.AF, 7), BIT(regs.AF, 6),
+            BIT(regs.AF, 5), BIT(regs.AF, 4),
+            regs.halted);
+}
 
-class CartMBC3 : public Cartridge
+static unsigned input_to_buttons(struct gui_input *input)
 {
-    // TODO: RTC, disabling extram
-protected:
-    uint8_t rom_bank, ram_bank;
-    size_t ram_size;
-    uint8_t *ram;
-public:
-    CartMBC3(size_t rom_size, uint8_t *rom_data)
-        : Cartridge(rom_size, rom_data),
-          rom_bank(1), ram_bank(0)
-    {
-        uint8_t cart_ram_size = rom_data[ROMHDR_RAM_SIZE];
-        switch (cart_ram_size) {
-        case 0: ram_size =   0 * 1024; break;
-        case 1: ram_size =   2 * 1024; break;
-        case 2: ram_size =   8 * 1024; break;
-        case 3: ram_size =  32 * 1024; break;
-        case 4: ram_size = 128 * 1024; break;
-        case 5: ram_size =  64 * 1024; break;
-        default:
-            fprintf(stderr, "Unsupported RAM size %#02x\n", cart_ram_size);
-            exit(1);
-        }
-
-        ram = NULL;
-        if (ram_size)
-            ram = (uint8_t *)calloc(ram_size, 1);
-    }
-
-    virtual uint8_t read(uint16_t addr)
-    {
-        if (addr < 0x4000)
-            return rom[addr];
-        else if (addr < 0x8000)
-            return rom[addr - 0x4000 + rom_bank * ROMBANK_SIZE];
-        else if (addr >= 0xA000 && addr < 0xC000)
-            return ram[addr - 0xA000 + ram_bank * RAMBANK_SIZE];
-        return 0xaa;
-    }
-
-    virtual void write(uint16_t addr, uint8_t data)
-    {
-        if (addr >= 0x2000 && addr < 0x4000) {
-            printf("rom bank %#02x\n", data);
-            rom_bank = data & 0x7f;
-            // TODO truncate
-            if (rom_bank == 0)
-                rom_bank = 1;
-        } else if (addr >= 0x4000 && addr < 0x6000) {
-            if (data <= 3)
-                ram_bank = data;
-            // TODO RTC
-        }
-    }
-};
+    return (input->button_a      ? GBSIM_BTN_A      : 0) |
+           (input->button_b      ? GBSIM_BTN_B      : 0) |
+           (input->button_select ? GBSIM_BTN_SELECT : 0) |
+           (input->button_start  ? GBSIM_BTN_START  : 0) |
+           (input->button_right  ? GBSIM_BTN_RIGHT  : 0) |
+           (input->button_left   ? GBSIM_BTN_LEFT   : 0) |
+           (input->button_up     ? GBSIM_BTN_UP     : 0) |
+           (input->button_down   ? GBSIM_BTN_DOWN   : 0);
+}
 
-int read_file(char *filename, uint8_t **buf, size_t *size)
+/* Replaces the extension of path (if it has ext) by new_ext, returns "" if it
+ * does not. */
+static std::string replace_ext(const char *path, const char *ext,
+                               const char *new_ext)
 {
-    FILE *fp;
-
-    fp = fopen(filename, "rb");
-    if (!fp) {
-        fprintf(stderr, "Failed to load file (\"%s\").\n", filename);
-        return 1;
-    }
-
-    /* Get the file size */
-    fseek(fp, 0L, SEEK_END);
-    size_t allocsize = ftell(fp) * sizeof(uint8_t);
-    rewind(fp);
-
-    *buf = (uint8_t *)malloc(allocsize);
-    if (*buf == NULL) {
-        fprintf(stderr,
-                "Error allocating mem for file (file=%s, size=%zu byte).",
-                filename, allocsize);
-        fclose(fp);
-        return 1;
-    }
-    *size = fread(*buf, sizeof(uint8_t), allocsize, fp);
-    fclose(fp);
-    return 0;
+    std::string s = path;
+    size_t len = strlen(ext);
+    if (s.size() < len || s.compare(s.size() - len, len, ext))
+        return "";
+    return s.replace(s.size() - len, len, new_ext);
 }
 
-Cartridge *load_rom(char *filename)
+/* Loads sym_file (or the .sym file of the ROM if it exists) and the .map file
+ * next to it if that exists. */
+static int load_symbols(struct gbsim *sim, const char *rom_file,
+                        const char *sym_file)
 {
-    uint8_t *rom;
-    size_t rom_size;
-    if (read_file(filename, &rom, &rom_size))
-        exit(1);
-
-    uint8_t cart_type = rom[ROMHDR_CART_TYPE];
-    switch (cart_type) {
-    case CART_TYPE_ROMONLY:
-        return new CartRomOnly(rom_size, rom);
-    case CART_TYPE_MBC3_RAM_BAT:
-        return new CartMBC3(rom_size, rom);
-    default:
-        fprintf(stderr, "Unsupported cart type %#02x\n", cart_type);
-        exit(1);
-    }
-    return NULL;
+    std::string sym = sym_file ? sym_file :
+                                 replace_ext(rom_file, ".gb", ".sym");
+    if (sym.empty() || (!sym_file && access(sym.c_str(), R_OK)))
+        return 0;
+    std::string map = replace_ext(sym.c_str(), ".sym", ".map");
+    if (!map.empty() && access(map.c_str(), R_OK))
+        map = "";
+    return gbsim_load_symbols(sim, sym.c_str(),
+                              map.empty() ? NULL : map.c_str());
 }
 
-#define BIT(val, bitpos) (((val) >> (bitpos)) & 1)
-
-void dump_state(Vmain *top)
+static void usage(const char *prog)
 {
-    printf(" PC   SP   AF   BC   DE   HL  ZNHC  hlt\n"
-            "%04x %04x %04x %04x %04x %04x %d%d%d%d   %d\n\n",
-            top->dbg_pc, top->dbg_sp, top->dbg_AF, top->dbg_BC,
-            top->dbg_DE, top->dbg_HL,
-            BIT(top->dbg_AF, 7), BIT(top->dbg_AF, 6),
-            BIT(top->dbg_AF, 5), BIT(top->dbg_AF, 4),
-            top->dbg_halted);
+    fprintf(stderr,
+            "Usage: %s [-c cycles] [-p pc] [-e categories] [-P prefix] "
+            "[-C file] [-s symfile] [-L file]\n"
+            "       [-V file] [-n frames] rom.gb\n"
+            "\n"
+            "  -c   Fast-forward the given number of cycles before starting RTL\n"
+            "  -p   Fast-forward until the given PC before starting RTL\n"
+            "  -e   Record events (GBSIM_EVCAT_* mask, e.g. 0x7f for all);\n"
+            "       printed when pausing and at exit\n"
+            "  -P   Profile the ROM, writing prefix.prof (flat profile) and\n"
+            "       prefix.folded (stacks for flame graphs) at exit\n"
+            "  -C   Write the code coverage of the ROM to file at exit\n"
+            "  -s   Symbols for the profile, coverage and -V (default: the ROM's\n"
+            "       .sym file); sections are read from the .map file next to it\n"
+            "  -L   Write PPU timing per scanline (mode 3 length, object\n"
+            "       fetches) as histograms per frame to file at exit\n"
+            "  -V   Write CPU accesses to VRAM/OAM by LCD mode and line, and\n"
+            "       those blocked by the PPU or OAM DMA, to file at exit\n"
+            "  -n   Run the given number of frames without a window and exit\n",
+            prog);
 }
 
-int main(int argc, char **argv)
+/* Runs with the GUI until it is closed or the ROM finishes. */
+static void run_gui(struct gbsim *sim, unsigned event_mask)
 {
-    Verilated::commandArgs(argc, argv);
-
-    gui_init(RES_X, RES_Y, ZOOM, "gb-fpga");
-    uint8_t *pixbuf = (uint8_t*)calloc(RES_X * RES_Y, 1);
-
-    MemRegion vram(0x8000, 0xA000);
-    MemRegion wram(0xC000, 0xE000);
-    Cartridge *cart = load_rom(argv[1]);;
-
-    Vmain *top = new Vmain;
-
-    top->reset = 1;
-    top->clk = 0;
-    top->eval();
-    top->clk = 1;
-    top->eval();
-    top->reset = 0;
-    top->clk = 0;
-    top->eval();
+    gui_init(GBSIM_LCD_WIDTH, GBSIM_LCD_HEIGHT, ZOOM, "gb-fpga");
 
     struct gui_input input_state = { 0 };
-    bool vblank_old = 0;
     bool paused = 0;
 
+    int stop_mask = GBSIM_STOP_VBLANK | GBSIM_STOP_CYCLES;
+
     steady_clock::time_point last_poll = steady_clock::now();
-    while (!Verilated::gotFinish()) {
+    while (1) {
         steady_clock::time_point now = steady_clock::now();
         auto ms_since_poll = duration_cast<milliseconds>(now - last_poll).count();
         if (ms_since_poll > 16) { // ~60 times per second
@@ -246,55 +118,136 @@ int main(int argc, char **argv)
             if (input_state.special_pause) {
                 paused = !paused;
                 printf("Paused: %d\n", paused);
+                if (paused && event_mask)
+                    gbsim_events_dump(sim, stdout);
             }
+            gbsim_set_input(sim, input_to_buttons(&input_state));
         }
 
         if (paused)
             continue;
 
-        cart->update(top->extbus_addr, top->extbus_do_write, top->extbus_data_w, &top->extbus_data_r);
-        wram.update(top->extbus_addr, top->extbus_do_write, top->extbus_data_w, &top->extbus_data_r);
-        vram.update(top->vram_addr, top->vram_do_write, top->vram_data_w, &top->vram_data_r);
+        int stop = gbsim_run_until(sim, stop_mask, CYCLES_PER_FRAME, 0);
+        if (stop & GBSIM_STOP_FINISH)
+            break;
 
-        top->joy_btn_a = input_state.button_a;
-        top->joy_btn_b = input_state.button_b;
-        top->joy_btn_start = input_state.button_start;
-        top->joy_btn_select = input_state.button_select;
-        top->joy_btn_up = input_state.button_up;
-        top->joy_btn_down = input_state.button_down;
-        top->joy_btn_left = input_state.button_left;
-        top->joy_btn_right = input_state.button_right;
+        // Redraw screen on vblank
+        if (stop & GBSIM_STOP_VBLANK)
+            gui_render_frame(gbsim_framebuffer(sim));
+    }
+}
 
-        top->clk = !top->clk;
+/* Runs the given number of frames (or until the ROM finishes) headless, e.g.
+ * for coverage runs and benchmarks (scripts/backend_bench.py). */
+static void run_frames(struct gbsim *sim, unsigned frames)
+{
+    int stop_mask = GBSIM_STOP_VBLANK | GBSIM_STOP_CYCLES;
+    uint64_t start = gbsim_cycles(sim);
+    steady_clock::time_point start_time = steady_clock::now();
+    unsigned n = 0;
+
+    while (n < frames) {
+        int stop = gbsim_run_until(sim, stop_mask, CYCLES_PER_FRAME, 0);
+        if (stop & GBSIM_STOP_FINISH)
+            break;
+        n++;
+    }
 
-        top->eval();
+    uint64_t cycles = gbsim_cycles(sim) - start;
+    double secs = duration<double>(steady_clock::now() - start_time).count();
+    printf("Ran %u frames, %llu cycles in %.3f s (%.0f cycles/s), "
+           "frame hash %016llx\n", n, (unsigned long long)cycles, secs,
+           secs > 0 ? cycles / secs : 0,
+           (unsigned long long)gbsim_frame_hash(sim));
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t ff_cycles = 0;
+    int ff_pc = -1;
+    unsigned event_mask = 0;
+    const char *profile_prefix = NULL, *coverage_file = NULL;
+    const char *sym_file = NULL, *scanlines_file = NULL;
+    const char *contention_file = NULL;
+    unsigned frames = 0;
+    int opt;
 
 #ifdef DEBUG
-        if (top->clk == 1 && top->dbg_instruction_retired)
-            dump_state(top);
+    event_mask |= GBSIM_EVCAT_TRACE;
 #endif
 
-        // Redraw screen on vblank
-        if (top->lcd_vblank && !vblank_old)
-            gui_render_frame(pixbuf);
-        vblank_old = top->lcd_vblank;
+    while ((opt = getopt(argc, argv, "c:p:e:P:C:s:L:V:n:h")) != -1) {
+        switch (opt) {
+        case 'c': ff_cycles = strtoull(optarg, NULL, 0); break;
+        case 'p': ff_pc = strtol(optarg, NULL, 16); break;
+        case 'e': event_mask = strtoul(optarg, NULL, 0); break;
+        case 'P': profile_prefix = optarg; break;
+        case 'C': coverage_file = optarg; break;
+        case 's': sym_file = optarg; break;
+        case 'L': scanlines_file = optarg; break;
+        case 'V': contention_file = optarg; break;
+        case 'n': frames = strtoul(optarg, NULL, 0); break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
 
-        if (top->clk && top->lcd_write)
-            pixbuf[top->lcd_x + top->lcd_y * RES_X] = top->lcd_col;
+    struct gbsim *sim = gbsim_create();
+    if (gbsim_load_rom(sim, argv[optind]))
+        return 1;
 
-        /*
-        if (top->dbg_instruction_retired && top->dbg_halted) {
-            printf("CPU halted, exiting\n");
-            break;
+    if (ff_cycles || ff_pc >= 0) {
+        int ff_mask = (ff_cycles ? GBSIM_STOP_CYCLES : 0) |
+                      (ff_pc >= 0 ? GBSIM_STOP_PC : 0);
+        if (gbsim_fast_forward(sim, ff_mask, ff_cycles, ff_pc) < 0) {
+            fprintf(stderr, "Fast-forward failed\n");
+            return 1;
         }
-        */
+        printf("Fast-forwarded to cycle %llu\n",
+               (unsigned long long)gbsim_cycles(sim));
+        dump_state(sim);
     }
 
-    dump_state(top);
+    gbsim_events_enable(sim, event_mask);
 
-    top->final();
+    if (profile_prefix || coverage_file || contention_file) {
+        if (load_symbols(sim, argv[optind], sym_file))
+            return 1;
+        gbsim_profile_enable(sim, !!profile_prefix);
+        gbsim_coverage_enable(sim, !!coverage_file);
+    }
+    gbsim_scanlines_enable(sim, !!scanlines_file);
+    gbsim_contention_enable(sim, !!contention_file);
+
+    if (frames)
+        run_frames(sim, frames);
+    else
+        run_gui(sim, event_mask);
+
+    if (event_mask)
+        gbsim_events_dump(sim, stdout);
+    dump_state(sim);
+    gbsim_perf_dump(sim, stdout);
+    int mismatch = gbsim_lockstep_dump(sim, stdout);
+
+    if (profile_prefix) {
+        std::string prefix = profile_prefix;
+        gbsim_profile_save(sim, (prefix + ".prof").c_str(),
+                           (prefix + ".folded").c_str());
+    }
+    if (coverage_file)
+        gbsim_coverage_save(sim, coverage_file);
+    if (scanlines_file)
+        gbsim_scanlines_save(sim, scanlines_file);
+    if (contention_file)
+        gbsim_contention_save(sim, contention_file);
 
-    delete top;
+    gbsim_destroy(sim);
 
-    return 0;
+    return mismatch;
 }
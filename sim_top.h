@@ -0,0 +1,54 @@
+/*
+ * The compiled model of main.v that gbsim.cpp drives. It comes from Verilator
+ * (Vmain) by default, or from yosys' CXXRTL backend in CXXRTL builds
+ * (BACKEND=cxxrtl, see the Makefile and cxxrtl_top.h). Both look the same to
+ * gbsim.cpp:
+ *
+ *  - SimTop has the ports of main.v as members of the same name, eval() to
+ *    settle the model after changing inputs, and final().
+ *  - MAIN(x), CPU(x) and PPU(x) are the signals and memories inside main.v,
+ *    cpu.v and ppu.v by their Verilog names, with `top` the SimTop. Signals
+ *    read and assign like integers, memories index like arrays; HRAM and the
+ *    boot ROM are MAIN(hram__DOT__mem) and MAIN(bootrom__DOT__mem).
+ *  - sim_top_finished() tells whether the model ran $finish.
+ *
+ * Hybrid builds (HYBRID=..., with C++ models behind DPI) are Verilator only,
+ * as is RTL coverage.
+ */
+
+#ifndef SIM_TOP_H
+#define SIM_TOP_H
+
+#ifdef CXXRTL
+
+#include "cxxrtl_top.h"
+
+#define MAIN(name) top->main.name
+#define CPU(name) top->cpu.name
+#define PPU(name) top->ppu.name
+
+/* CXXRTL does not stop the simulation on $finish. */
+static inline bool sim_top_finished()
+{
+    return 0;
+}
+
+#else
+
+#include "Vmain.h"
+#include "verilated.h"
+
+typedef Vmain SimTop;
+
+#define MAIN(name) top->main__DOT__ ## name
+#define CPU(name) top->main__DOT__cpu__DOT__ ## name
+#define PPU(name) top->main__DOT__ppu__DOT__ ## name
+
+static inline bool sim_top_finished()
+{
+    return Verilated::gotFinish();
+}
+
+#endif
+
+#endif
@@ -43,7 +43,7 @@ SB_SPRAM256KA spram
     .CHIPSELECT(1'b1),
     .STANDBY(1'b0),
     .SLEEP(1'b0),
-    .POWEROFF(1'b1),
+    .POWEROFF(1'b1)
 );
 
 endmodule
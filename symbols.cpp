@@ -0,0 +1,154 @@
+/*
+ * RGBDS symbol and map files, see symbols.h.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "symbols.h"
+
+/* Memory areas, labels are only looked up within the same one. */
+static const uint32_t area_ends[] = {
+    0x4000, 0x8000, 0xA000, 0xC000, 0xFE00, 0x10000
+};
+
+static int area(uint16_t addr)
+{
+    int i = 0;
+    while (addr >= area_ends[i])
+        i++;
+    return i;
+}
+
+int Symbols::load_sym(const char *filename)
+{
+    FILE *fp = fopen(filename, "r");
+    char line[512], name[512];
+    unsigned bank, addr;
+
+    if (!fp) {
+        perror(filename);
+        return 1;
+    }
+
+    symbols.clear();
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "%x:%x %511s", &bank, &addr, name) != 3)
+            continue; // Comments
+        if (strchr(name, '.'))
+            continue;
+        symbols.push_back({ loc_of(addr, bank), name });
+    }
+    fclose(fp);
+
+    std::stable_sort(symbols.begin(), symbols.end(),
+                     [](const Symbol &a, const Symbol &b) {
+                         return a.loc < b.loc;
+                     });
+    return 0;
+}
+
+/*
+ * Only the section lines are used, and the bank of the "<TYPE> bank #<n>:"
+ * line before them:
+ *
+ *   ROMX bank #1:
+ *           SECTION: $4000-$4123 ($0124 bytes) ["name"]
+ *
+ * Empty sections have no range and are skipped.
+ */
+int Symbols::load_map(const char *filename)
+{
+    FILE *fp = fopen(filename, "r");
+    char line[512];
+    unsigned bank = 0, start, end;
+
+    if (!fp) {
+        perror(filename);
+        return 1;
+    }
+
+    sections.clear();
+    while (fgets(line, sizeof(line), fp)) {
+        const char *p = line + strspn(line, " \t");
+        const char *hash = strstr(p, "ank #");
+
+        if (hash && strncmp(p, "SECTION", 7)) {
+            bank = strtoul(hash + 5, NULL, 10);
+            continue;
+        }
+        if (sscanf(p, "SECTION: $%x-$%x", &start, &end) != 2)
+            continue;
+
+        const char *name = strstr(p, "[\"");
+        std::string s = name ? name + 2 : "";
+        size_t quote = s.rfind("\"]");
+        if (quote != std::string::npos)
+            s.resize(quote);
+        sections.push_back({ loc_of(start, bank), loc_of(end, bank), s });
+    }
+    fclose(fp);
+
+    std::stable_sort(sections.begin(), sections.end(),
+                     [](const Section &a, const Section &b) {
+                         return a.start < b.start;
+                     });
+    return 0;
+}
+
+const Symbols::Symbol *Symbols::lookup(uint32_t loc) const
+{
+    auto it = std::upper_bound(symbols.begin(), symbols.end(), loc,
+                               [](uint32_t l, const Symbol &s) {
+                                   return l < s.loc;
+                               });
+    if (it == symbols.begin())
+        return NULL;
+    --it;
+    if (LOC_BANK(it->loc) != LOC_BANK(loc) ||
+            area(LOC_ADDR(it->loc)) != area(LOC_ADDR(loc)))
+        return NULL;
+    if (!sections.empty() && section(it->loc) != section(loc))
+        return NULL;
+    return &*it;
+}
+
+std::string Symbols::name(uint32_t loc, bool offset) const
+{
+    char buf[16];
+    const Symbol *sym = lookup(loc);
+
+    if (!sym)
+        return "";
+    if (!offset || sym->loc == loc)
+        return sym->name;
+    snprintf(buf, sizeof(buf), "+0x%x", loc - sym->loc);
+    return sym->name + buf;
+}
+
+uint32_t Symbols::end(const Symbol *sym) const
+{
+    uint32_t loc = sym->loc;
+    uint32_t end = LOC(LOC_BANK(loc), area_ends[area(LOC_ADDR(loc))]);
+    const Section *sec = section(loc);
+
+    if (sym + 1 < symbols.data() + symbols.size() && sym[1].loc < end)
+        end = sym[1].loc;
+    if (sec && sec->end + 1 < end)
+        end = sec->end + 1;
+    return end;
+}
+
+const Symbols::Section *Symbols::section(uint32_t loc) const
+{
+    auto it = std::upper_bound(sections.begin(), sections.end(), loc,
+                               [](uint32_t l, const Section &s) {
+                                   return l < s.start;
+                               });
+    if (it == sections.begin())
+        return NULL;
+    --it;
+    return loc <= it->end ? &*it : NULL;
+}
@@ -0,0 +1,63 @@
+/*
+ * Labels and sections of a ROM as written by rgblink (-n symbol file, -m map
+ * file), for naming guest code in the profile and coverage map.
+ *
+ * Code is identified by its location: bank << 16 | address, where the bank is
+ * only set in the switchable ROM area (0x4000-0x7fff).
+ */
+
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define LOC(bank, addr) ((uint32_t)(bank) << 16 | (addr))
+#define LOC_BANK(loc) ((loc) >> 16)
+#define LOC_ADDR(loc) ((loc) & 0xffff)
+
+/* Location of code at addr with the given ROM bank mapped. */
+static inline uint32_t loc_of(uint16_t addr, uint8_t bank)
+{
+    return addr >= 0x4000 && addr < 0x8000 ? LOC(bank, addr) : addr;
+}
+
+class Symbols
+{
+public:
+    struct Symbol {
+        uint32_t loc;
+        std::string name;
+    };
+    struct Section {
+        uint32_t start, end;    // Inclusive
+        std::string name;
+    };
+
+    std::vector<Symbol> symbols;    // Sorted by location
+    std::vector<Section> sections;  // Sorted by location
+
+    /* Replace the labels or sections with those of the given file. Return
+     * non-zero if it could not be read. */
+    int load_sym(const char *filename);
+    int load_map(const char *filename);
+
+    /* Closest label at or before loc, within the same bank and memory area
+     * (and section, if known), or NULL. Local labels (Parent.local) are left
+     * out. */
+    const Symbol *lookup(uint32_t loc) const;
+
+    /* Name of the label loc is in, with the offset into it if offset is set.
+     * Empty if there is no such label. */
+    std::string name(uint32_t loc, bool offset) const;
+
+    /* Section containing loc, or NULL. */
+    const Section *section(uint32_t loc) const;
+
+    /* End (exclusive) of the code or data of a label: the next label, the end
+     * of its section or the end of its memory area, whichever comes first. */
+    uint32_t end(const Symbol *sym) const;
+};
+
+#endif
@@ -3,17 +3,20 @@
 `include "tft.v"
 `include "cart.v"
 `include "spram.v"
+`include "dbgserial.v"
 
 module syn_top (
     input device_clk,
     output LEDR_N, LEDG_N,
+    output TX,
     output LED1, output LED2, output LED3, output LED4, output LED5,
     output P1A1, output P1A2, output P1A3, output P1A4, output P1A7, output P1A8, output P1A9, output P1A10,
-    output P1B1, output P1B2, output P1B3, output P1B4, output P1B7, output P1B8, output P1B9, output P1B10,
+    output P1B1, output P1B2, output P1B3, output P1B4, output P1B7, output P1B8, output P1B9, output P1B10
 );
 
 wire pll_locked;
-wire clk_16mhz, clk_8mhz, clk_4mhz;
+wire clk_16mhz, clk_8mhz;
+wire clk_4mhz /* verilator public_flat_rd */;
 
 wire reset;
 reg [3:0] reset_cnt;
@@ -35,10 +38,13 @@ wire cart_data_active;
 wire [7:0] wram_data_r;
 wire wram_data_active;
 
-wire lcd_hblank, lcd_vblank;
-wire lcd_write;
-wire [1:0] lcd_col;
-wire [7:0] lcd_x, lcd_y;
+/* The board simulation (board_main.cpp) follows the PPU output. */
+wire lcd_hblank;
+wire lcd_vblank /* verilator public_flat_rd */;
+wire lcd_write /* verilator public_flat_rd */;
+wire [1:0] lcd_col /* verilator public_flat_rd */;
+wire [7:0] lcd_x /* verilator public_flat_rd */;
+wire [7:0] lcd_y /* verilator public_flat_rd */;
 
 wire tft_initialized;
 wire tft_rst, tft_cs, tft_rs, tft_wr, tft_rd;
@@ -47,8 +53,15 @@ wire [7:0] tft_data;
 wire [15:0] dbg_pc, dbg_sp, dbg_AF, dbg_BC, dbg_DE, dbg_HL;
 wire [7:0] dbg_last_opcode;
 wire [5:0] dbg_stage;
-reg dbg_instruction_retired;
+wire [3:0] dbg_perf_sel;
+wire [31:0] dbg_perf_count;
+wire dbg_instruction_retired;
 wire dbg_halted;
+wire dbg_line_done;
+wire [8:0] dbg_line_mode3_cycles;
+wire [3:0] dbg_line_obj_fetches;
+wire [8:0] dbg_line_obj_stall_cycles;
+wire [3:0] dbg_line_fetch_restarts;
 
 pll pll(device_clk, clk_16mhz, pll_locked);
 
@@ -108,7 +121,16 @@ main main(
     dbg_instruction_retired,
     dbg_halted,
     dbg_last_opcode,
-    dbg_stage
+    dbg_stage,
+
+    dbg_perf_sel,
+    dbg_perf_count,
+
+    dbg_line_done,
+    dbg_line_mode3_cycles,
+    dbg_line_obj_fetches,
+    dbg_line_obj_stall_cycles,
+    dbg_line_fetch_restarts
 );
 
 localparam VRAM_BASE = 'h8000, VRAM_SIZE = 'h2000;
@@ -161,6 +183,26 @@ assign { P1B1, P1B2, P1B3, P1B4, P1B7, P1B8, P1B9, P1B10 } =
       tft_data[4], tft_data[5], tft_data[6], tft_data[7] };
 
 /* Debug output. */
+dbgserial dbgserial (
+    clk_4mhz,
+    reset,
+
+    dbg_pc,
+    dbg_sp,
+    dbg_AF,
+    dbg_BC,
+    dbg_DE,
+    dbg_HL,
+    dbg_instruction_retired,
+    dbg_halted,
+    dbg_last_opcode,
+    dbg_stage,
+    dbg_perf_sel,
+    dbg_perf_count,
+
+    TX
+);
+
 assign {LED5, LED4, LED3, LED2, LED1} = dbg_pc[4:0];
 assign LEDR_N = ~dbg_halted;
 assign LEDG_N = reset;
@@ -0,0 +1,37 @@
+`include "alu.v"
+
+/*
+ * LANES independent instances of the (combinational) ALU, for test_alu.c to
+ * evaluate a batch of inputs with a single eval(). Every lane has one 32-bit
+ * word in each port:
+ *  - operands: {in2, in1}
+ *  - controls: {20'b0, flags_in[3:0], 2'b0, is_16bit, op[4:0]}
+ *  - results:  {12'b0, flags_out[3:0], out}
+ */
+module alu_lanes #(
+    parameter LANES = 64
+) (
+    input [LANES*32-1:0] operands,
+    /* verilator lint_off UNUSED */
+    input [LANES*32-1:0] controls,
+    /* verilator lint_on UNUSED */
+    output [LANES*32-1:0] results
+);
+
+genvar i;
+generate
+    for (i = 0; i < LANES; i = i + 1) begin : lane
+        alu alu (
+            .op(controls[i*32 +: 5]),
+            .is_16bit(controls[i*32 + 5]),
+            .in1(operands[i*32 +: 16]),
+            .in2(operands[i*32 + 16 +: 16]),
+            .flags_in(controls[i*32 + 8 +: 4]),
+            .out(results[i*32 +: 16]),
+            .flags_out(results[i*32 + 16 +: 4])
+        );
+        assign results[i*32 + 20 +: 12] = 12'b0;
+    end
+endgenerate
+
+endmodule
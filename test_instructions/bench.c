@@ -0,0 +1,187 @@
+/*
+ * Benchmark of the CPU models used for testing: the verilated CPU (one CPU per
+ * vcpu model, and vlanes_num() per vlanes model) and emu_cpu.c. All of them
+ * run the same permutations from the instruction tables on a single thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+#include "vcpu.h"
+#include "vlanes.h"
+#include "emu_cpu.h"
+#include "inputstate.h"
+
+struct bench_mem {
+    u8 mem[LANE_MEM_SIZE];
+};
+
+static u8 bench_mem_read(void *ctx, u16 addr) {
+    struct bench_mem *m = ctx;
+    return addr < sizeof(m->mem) ? m->mem[addr] : 0xaa;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, u64 num_tests, double secs,
+        double base_secs) {
+    printf("  %-14s %10.0f tests/s", name, num_tests / secs);
+    if (base_secs > 0)
+        printf("  (%.2fx vcpu)", base_secs / secs);
+    printf("\n");
+}
+
+/* Times ecpu_step() for each opcode (and CB opcode) in the tests on its own,
+ * to see how the cost of an instruction depends on its opcode. */
+static void bench_ecpu_ops(struct lane_test *tests, u64 num_tests) {
+    struct lane_test *first[512] = { 0 };
+    struct bench_mem m;
+    struct ecpu *ecpu = ecpu_create();
+    double total = 0, slowest = 0;
+    int num_ops = 0, slowest_op = 0;
+
+    for (u64 i = 0; i < num_tests; i++) {
+        int key = tests[i].mem[0] == 0xcb ? 0x100 | tests[i].mem[1] :
+                  tests[i].mem[0];
+        if (!first[key])
+            first[key] = &tests[i];
+    }
+
+    ecpu_set_mmu(ecpu, &m, bench_mem_read, NULL);
+    for (int key = 0; key < 512; key++) {
+        double start, ns;
+
+        if (!first[key])
+            continue;
+        memcpy(m.mem, first[key]->mem, sizeof(m.mem));
+        start = now();
+        for (int i = 0; i < BENCH_OP_STEPS; i++) {
+            ecpu_reset(ecpu, &first[key]->in);
+            ecpu_step(ecpu);
+        }
+        ns = (now() - start) * 1e9 / BENCH_OP_STEPS;
+
+        total += ns;
+        num_ops++;
+        if (ns > slowest) {
+            slowest = ns;
+            slowest_op = key;
+        }
+    }
+    ecpu_destroy(ecpu);
+
+    if (!num_ops)
+        return;
+    printf("  emu_cpu.c per opcode: %.1f ns average, slowest %s%02x (%.1f ns)\n",
+           total / num_ops, slowest_op & 0x100 ? "CB " : "",
+           slowest_op & 0xff, slowest);
+}
+
+/* Permutations of all enabled rows, taken from every row in turn. Returns
+ * NULL if no row is enabled. */
+static struct lane_test *gen_tests(struct test_inst **insts, size_t num_insts,
+        u64 num_tests) {
+    struct lane_test *tests;
+    struct test_inst **rows = calloc(num_insts, sizeof(*rows));
+    size_t num_rows = 0;
+    struct op_state op_state;
+
+    for (size_t i = 0; i < num_insts; i++)
+        if (insts[i]->enabled)
+            rows[num_rows++] = insts[i];
+    if (!num_rows) {
+        free(rows);
+        return NULL;
+    }
+
+    tests = calloc(num_tests, sizeof(*tests));
+
+    for (u64 i = 0; i < num_tests; i++) {
+        struct test_inst *inst = rows[i % num_rows];
+        get_state(inst, 0, (i / num_rows) % num_states(inst, 0), &op_state,
+                  &tests[i].in);
+        assemble(tests[i].mem, inst, &op_state);
+    }
+
+    free(rows);
+    return tests;
+}
+
+int bench(struct test_inst **insts, size_t num_insts, u64 num_tests) {
+    struct lane_test *tests = gen_tests(insts, num_insts, num_tests);
+    struct state *vcpu_out;
+    int *vcpu_cycles;
+    struct bench_mem m;
+    struct ecpu *ecpu;
+    struct vcpu *vcpu;
+    struct vlanes *vlanes;
+    double start, vcpu_secs;
+    u64 num_differ = 0;
+
+    if (!tests) {
+        fprintf(stderr, "No enabled instructions to benchmark\n");
+        return 1;
+    }
+    vcpu_out = calloc(num_tests, sizeof(*vcpu_out));
+    vcpu_cycles = calloc(num_tests, sizeof(*vcpu_cycles));
+
+    printf("Running %llu tests per CPU model on one thread:\n",
+           (unsigned long long)num_tests);
+
+    ecpu = ecpu_create();
+    ecpu_set_mmu(ecpu, &m, bench_mem_read, NULL);
+    start = now();
+    for (u64 i = 0; i < num_tests; i++) {
+        memcpy(m.mem, tests[i].mem, sizeof(m.mem));
+        ecpu_reset(ecpu, &tests[i].in);
+        ecpu_step(ecpu);
+    }
+    report("emu_cpu.c", num_tests, now() - start, 0);
+    ecpu_destroy(ecpu);
+    bench_ecpu_ops(tests, num_tests);
+
+    vcpu = vcpu_create(m.mem, sizeof(m.mem));
+    start = now();
+    for (u64 i = 0; i < num_tests; i++) {
+        memcpy(m.mem, tests[i].mem, sizeof(m.mem));
+        vcpu_reset(vcpu, &tests[i].in);
+        vcpu_cycles[i] = vcpu_step(vcpu);
+        vcpu_get_state(vcpu, &vcpu_out[i]);
+    }
+    vcpu_secs = now() - start;
+    report("vcpu", num_tests, vcpu_secs, 0);
+    vcpu_destroy(vcpu);
+
+    vlanes = vlanes_create();
+    start = now();
+    for (u64 i = 0; i < num_tests; i += vlanes_num()) {
+        u64 num = num_tests - i < (u64)vlanes_num() ? num_tests - i :
+                  (u64)vlanes_num();
+        vlanes_run(vlanes, &tests[i], num);
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "vlanes (%d)", vlanes_num());
+    report(name, num_tests, now() - start, vcpu_secs);
+    vlanes_destroy(vlanes);
+
+    /* The lanes must behave exactly like the single CPU. */
+    for (u64 i = 0; i < num_tests; i++)
+        if (!states_eq(&tests[i].out, &vcpu_out[i]) ||
+                tests[i].cycles != vcpu_cycles[i])
+            num_differ++;
+    if (num_differ)
+        printf("%llu results of vlanes differ from vcpu!\n",
+               (unsigned long long)num_differ);
+
+    free(tests);
+    free(vcpu_out);
+    free(vcpu_cycles);
+    return num_differ != 0;
+}
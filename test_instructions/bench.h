@@ -0,0 +1,18 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+
+#include "common.h"
+
+/* Number of tests per CPU model when not given. */
+#define BENCH_NUM_TESTS 200000
+
+/* Number of times every opcode is timed on emu_cpu.c. */
+#define BENCH_OP_STEPS 20000
+
+/* Times num_tests permutations of the num_insts table rows in insts on each
+ * CPU model. Returns non-zero if the models disagree. */
+int bench(struct test_inst **insts, size_t num_insts, u64 num_tests);
+
+#endif
@@ -0,0 +1,168 @@
+/*
+ * Cache of passed test units, see cache.h.
+ *
+ * The file is text: a first line with the hash of the models, then one line
+ * per unit with its key, its number of tests, a bitmap of the opcodes it
+ * tested (in hex) and the cycles it simulated. Entries are kept in an
+ * open-addressing hash table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "inputstate.h"
+#include "rtl_hash.h"
+
+struct entry {
+    u64 key;                    // 0 for an empty slot
+    struct cache_result result;
+};
+
+static struct entry *entries;
+static size_t num_entries, table_size;
+
+static u64 fnv1a(u64 hash, const void *data, size_t len) {
+    const u8 *p = data;
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ p[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+#define HASH(hash, val) fnv1a(hash, &(val), sizeof(val))
+
+u64 cache_key(struct test_inst *inst, bool exhaustive, bool bus_timing,
+              u64 first, u64 count) {
+    u64 hash = 0xcbf29ce484222325ull;
+    int version = GENERATOR_VERSION;
+
+    hash = HASH(hash, version);
+    hash = HASH(hash, exhaustive);
+    hash = HASH(hash, bus_timing);
+    hash = HASH(hash, first);
+    hash = HASH(hash, count);
+
+    hash = fnv1a(hash, inst->mnem, strlen(inst->mnem));
+    hash = HASH(hash, inst->enabled);
+    hash = HASH(hash, inst->opcode);
+    hash = HASH(hash, inst->is_cb_prefix);
+    hash = HASH(hash, inst->imm_size);
+    hash = HASH(hash, inst->reg8_bitpos);
+    hash = HASH(hash, inst->reg8_bitpos2);
+    hash = HASH(hash, inst->reg16_bitpos);
+    hash = HASH(hash, inst->cond_bitpos);
+    hash = HASH(hash, inst->bit_bitpos);
+    hash = HASH(hash, inst->test_F);
+    hash = HASH(hash, inst->test_BC);
+    hash = HASH(hash, inst->test_DE);
+    hash = HASH(hash, inst->test_HL);
+    hash = HASH(hash, inst->test_SP);
+    hash = HASH(hash, inst->test_IME);
+    hash = HASH(hash, inst->exhaustive);
+
+    return hash ? hash : 1;
+}
+
+static struct entry *find(u64 key) {
+    size_t i = key & (table_size - 1);
+
+    while (entries[i].key && entries[i].key != key)
+        i = (i + 1) & (table_size - 1);
+    return &entries[i];
+}
+
+void cache_add(u64 key, const struct cache_result *result) {
+    struct entry *e;
+
+    if ((num_entries + 1) * 2 > table_size) {
+        struct entry *old = entries;
+        size_t old_size = table_size;
+
+        table_size = table_size ? table_size * 2 : 1024;
+        entries = calloc(table_size, sizeof(*entries));
+        num_entries = 0;
+        for (size_t i = 0; i < old_size; i++)
+            if (old[i].key)
+                cache_add(old[i].key, &old[i].result);
+        free(old);
+    }
+
+    e = find(key);
+    if (!e->key)
+        num_entries++;
+    e->key = key;
+    e->result = *result;
+}
+
+bool cache_lookup(u64 key, struct cache_result *result) {
+    struct entry *e;
+
+    if (!table_size)
+        return 0;
+    e = find(key);
+    if (!e->key)
+        return 0;
+    *result = e->result;
+    return 1;
+}
+
+void cache_load(const char *path) {
+    FILE *fp = fopen(path, "r");
+    char line[256], ops[65];
+    struct cache_result result;
+    unsigned long long key, cycles;
+
+    if (!fp)
+        return;
+
+    if (!fgets(line, sizeof(line), fp) ||
+            strcmp(line, "models " RTL_HASH "\n")) {
+        fclose(fp);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "%llx %lu %64s %llu", &key, &result.num_tests, ops,
+                   &cycles) != 4 || strlen(ops) != 64)
+            continue;
+        for (int op = 0; op < 256; op++) {
+            char digit[2] = { ops[op / 4], 0 };
+            result.tested_op[op] = (strtoul(digit, NULL, 16) >> (op % 4)) & 1;
+        }
+        result.cycles = cycles;
+        cache_add(key, &result);
+    }
+    fclose(fp);
+}
+
+int cache_save(const char *path) {
+    FILE *fp = fopen(path, "w");
+
+    if (!fp) {
+        perror(path);
+        return 1;
+    }
+
+    fprintf(fp, "models " RTL_HASH "\n");
+    for (size_t i = 0; i < table_size; i++) {
+        struct entry *e = &entries[i];
+
+        if (!e->key)
+            continue;
+        fprintf(fp, "%016llx %lu ", (unsigned long long)e->key,
+                e->result.num_tests);
+        for (int op = 0; op < 256; op += 4)
+            fprintf(fp, "%x", e->result.tested_op[op] |
+                              e->result.tested_op[op + 1] << 1 |
+                              e->result.tested_op[op + 2] << 2 |
+                              e->result.tested_op[op + 3] << 3);
+        fprintf(fp, " %llu\n", (unsigned long long)e->result.cycles);
+    }
+
+    if (fclose(fp)) {
+        perror(path);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "common.h"
+
+/*
+ * Results of earlier test runs, so unchanged tests do not need to run again.
+ * A result is kept for each unit of permutations that passed, keyed by the
+ * table row, the permutations and GENERATOR_VERSION. The cache file also
+ * holds a hash of the RTL, emu_cpu.c and known_bugs.c the test binary is built
+ * from; when that differs, all of it is discarded.
+ */
+
+struct cache_result {
+    unsigned long num_tests;
+    bool tested_op[256];
+    u64 cycles;                 // Simulated on the CPU, for reports
+};
+
+/* Key of permutations [first, first + count) of inst, tested with or without
+ * comparing bus timelines. */
+u64 cache_key(struct test_inst *inst, bool exhaustive, bool bus_timing,
+              u64 first, u64 count);
+
+/* Loads the cache from path, if it exists and matches the build. */
+void cache_load(const char *path);
+
+bool cache_lookup(u64 key, struct cache_result *result);
+void cache_add(u64 key, const struct cache_result *result);
+
+/* Writes the cache back to path, returns non-zero on error. */
+int cache_save(const char *path);
+
+#endif
@@ -7,6 +7,7 @@
 typedef uint8_t  u8;
 typedef uint16_t u16;
 typedef uint32_t u32;
+typedef uint64_t u64;
 
 typedef int8_t  s8;
 typedef int16_t s16;
@@ -28,8 +29,15 @@ struct test_inst {
 
     /* Whether to vary the specific register during tests. */
     bool test_F, test_BC, test_DE, test_HL, test_SP, test_IME;
+
+    /* Which 8-bit inputs to sweep over all values in exhaustive mode. */
+    int exhaustive;
 };
 
+#define EX_NONE 0   // Not tested in exhaustive mode
+#define EX_A_OP 1   // A, the 8-bit operand (if any) and all flags
+#define EX_OP   2   // The 8-bit operand and all flags (A is not read otherwise)
+
 
 #define MEM_ACCESS_READ 0
 #define MEM_ACCESS_WRITE 1
@@ -40,6 +48,17 @@ struct mem_access {
     u8 val;
 };
 
+/* A memory access of an instruction, at M-cycle `cycle` of it: the opcode fetch
+ * is M-cycle 0, and every later access or internal step takes one more. */
+struct bus_access {
+    int cycle;
+    int type;
+    u16 addr;
+    u8 val;
+};
+
+#define MAX_BUS_ACCESSES 16
+
 struct state {
     union {
         struct {
@@ -57,10 +76,12 @@ struct state {
 
     int num_mem_accesses;
     struct mem_access mem_accesses[16];
-};
 
+    /* All reads and writes with their timing, see --bus-timing. */
+    int num_bus_accesses;
+    struct bus_access bus_accesses[MAX_BUS_ACCESSES];
+};
 
-extern u8 instruction_mem[4];
 
 #define BIT(val, bitpos) (((val) >> (bitpos)) & 1)
 
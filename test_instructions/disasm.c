@@ -0,0 +1,186 @@
+/*
+ * Disassembles a whole ROM image, bank by bank.
+ *
+ * The file is mapped into memory and swept linearly (code and data alike), a
+ * line per instruction with its bank, address (as the CPU sees it: bank 0 at
+ * 0x0000, every other bank at 0x4000) and bytes. Instructions never cross a
+ * bank boundary; their bytes at the end of a bank are shown as DB. Lines are
+ * formatted into a large buffer without stdio in between, so this is bound by
+ * the output more than by decoding.
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "disassembler.h"
+
+#define BANK_SIZE 0x4000
+#define OUT_BUF_SIZE (1 << 20)
+
+/* Longest line: "bank:addr  3 bytes  instruction\n". */
+#define MAX_LINE (16 + DISASM_BUF_SIZE)
+
+static char out_buf[OUT_BUF_SIZE];
+static size_t out_len;
+
+static void flush_out(void) {
+    fwrite(out_buf, 1, out_len, stdout);
+    out_len = 0;
+}
+
+static char *put_hex(char *out, unsigned val, int digits) {
+    static const char hex[] = "0123456789abcdef";
+    for (int i = digits - 1; i >= 0; i--)
+        *out++ = hex[(val >> (i * 4)) & 0xf];
+    return out;
+}
+
+/* Disassembles bank (size bytes at data), returns the number of
+ * instructions. */
+static unsigned long disasm_bank(const u8 *data, size_t size, unsigned bank) {
+    u16 base = bank ? BANK_SIZE : 0;
+    unsigned long num_insts = 0;
+    size_t pc = 0;
+
+    while (pc < size) {
+        /* Room to read a full instruction even at the end of the bank. */
+        u8 inst[4] = { 0 };
+        char *line, *p;
+        int length;
+
+        memcpy(inst, data + pc, size - pc < 4 ? size - pc : 4);
+        length = disassemble_length(inst);
+        if ((size_t)length > size - pc)
+            length = 1;
+
+        if (out_len + MAX_LINE > OUT_BUF_SIZE)
+            flush_out();
+        line = p = out_buf + out_len;
+
+        p = put_hex(p, bank, bank > 0xff ? 3 : 2);
+        *p++ = ':';
+        p = put_hex(p, base + pc, 4);
+        *p++ = ' ';
+        for (int i = 0; i < 3; i++) {
+            *p++ = ' ';
+            if (i < length)
+                p = put_hex(p, inst[i], 2);
+            else {
+                *p++ = ' ';
+                *p++ = ' ';
+            }
+        }
+        *p++ = ' ';
+        *p++ = ' ';
+        if (length == 1 && disassemble_length(inst) != 1)
+            p += sprintf(p, "DB 0x%x", inst[0]);
+        else {
+            disassemble_buf(p, inst);
+            p += strlen(p);
+        }
+        *p++ = '\n';
+        out_len += p - line;
+
+        pc += length;
+        num_insts++;
+    }
+    return num_insts;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [-b bank] [-s] rom.gb\n"
+            "  -b bank  Only disassemble this (16 KiB) bank\n"
+            "  -s       Print statistics to stderr\n",
+            name);
+}
+
+int main(int argc, char **argv) {
+    const u8 *rom;
+    struct stat st;
+    unsigned num_banks, first_bank, end_bank;
+    long only_bank = -1;
+    unsigned long num_insts = 0;
+    bool stats = 0;
+    struct timespec start, stop;
+    double secs;
+    int opt, fd;
+
+    while ((opt = getopt(argc, argv, "b:s")) != -1) {
+        switch (opt) {
+        case 'b':
+            only_bank = strtol(optarg, NULL, 0);
+            break;
+        case 's':
+            stats = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    fd = open(argv[optind], O_RDONLY);
+    if (fd < 0 || fstat(fd, &st)) {
+        perror(argv[optind]);
+        return 1;
+    }
+    if (st.st_size == 0) {
+        fprintf(stderr, "%s: empty file\n", argv[optind]);
+        return 1;
+    }
+    rom = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (rom == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    madvise((void *)rom, st.st_size, MADV_SEQUENTIAL);
+
+    num_banks = (st.st_size + BANK_SIZE - 1) / BANK_SIZE;
+    if (st.st_size >= 0x150 && rom[0x148] <= 8 &&
+            (2u << rom[0x148]) != num_banks)
+        fprintf(stderr, "Warning: header says %u banks, file has %u\n",
+                2u << rom[0x148], num_banks);
+    if (only_bank >= (long)num_banks) {
+        fprintf(stderr, "Bank %ld is past the end (%u banks)\n", only_bank,
+                num_banks);
+        return 1;
+    }
+    first_bank = only_bank < 0 ? 0 : only_bank;
+    end_bank = only_bank < 0 ? num_banks : only_bank + 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned bank = first_bank; bank < end_bank; bank++) {
+        size_t offset = (size_t)bank * BANK_SIZE;
+        size_t size = st.st_size - offset < BANK_SIZE ? st.st_size - offset :
+                                                        BANK_SIZE;
+        num_insts += disasm_bank(rom + offset, size, bank);
+    }
+    flush_out();
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    if (stats) {
+        secs = (stop.tv_sec - start.tv_sec) +
+               (stop.tv_nsec - start.tv_nsec) / 1e9;
+        fprintf(stderr, "%lu instructions in %u banks in %.3f s (%.0f MB/s)\n",
+                num_insts, end_bank - first_bank, secs,
+                secs > 0 ? (end_bank - first_bank) * (double)BANK_SIZE /
+                           secs / 1e6 : 0);
+    }
+
+    munmap((void *)rom, st.st_size);
+    close(fd);
+    return 0;
+}
@@ -1,9 +1,14 @@
 /*
  * Originally adapted from VisualBoyAdvance.
+ *
+ * The mask/value lists below are expanded once into a table entry per opcode
+ * (and per CB opcode), with the operands encoded in the opcode already filled
+ * in, so disassembling an instruction is a lookup plus formatting immediates.
  */
 
 #include "disassembler.h"
 
+#include <pthread.h>
 #include <stdio.h>
 
 typedef struct {
@@ -91,7 +96,7 @@ static GBOPCODE opcodes[] = {
   { 0xff, 0xfa, "LD A, (%W)" },
   { 0xff, 0xfb, "EI" },
   { 0xff, 0xfe, "CP %B" },
-  { 0x00, 0x00, "DB %B" }
+  { 0x00, 0x00, "DB %O" }
 };
 
 static GBOPCODE cbOpcodes[] = {
@@ -106,84 +111,160 @@ static GBOPCODE cbOpcodes[] = {
   { 0xc0, 0x40, "BIT %b, %r0" },
   { 0xc0, 0x80, "RES %b, %r0" },
   { 0xc0, 0xc0, "SET %b, %r0" },
-  { 0x00, 0x00, "DB CBh, %B" }
+  { 0x00, 0x00, "DB CBh, %O" }
 };
 
 
-int disassemble(u8 *data) {
-    u16 pc = 0;
-    u8 opcode = data[pc++];
-    GBOPCODE *op = NULL;
-    const char *mnem = NULL;
+/* An opcode with everything but the immediate operands (%B, %W, %d, %n) of
+ * its mnemonic filled in. */
+struct dis_entry {
+    char fmt[24];
+    u8 length;                  // In bytes, including the CB prefix
+};
+
+static struct dis_entry table[256], cb_table[256];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void expand(struct dis_entry *e, GBOPCODE *ops, u8 opcode, int length) {
+    const char *mnem;
+    char *out = e->fmt;
+
+    while ((opcode & ops->mask) != ops->value)
+        ops++;
+
+    for (mnem = ops->mnem; *mnem; mnem++) {
+        int shift;
+
+        if (*mnem != '%') {
+            *out++ = *mnem;
+            continue;
+        }
+        switch (*++mnem) {
+        case 'B': /* Single byte */
+        case 'd': /* Signed displacement (one byte) */
+        case 'n': /* Single byte, no 0x prefix */
+            length++;
+            out += sprintf(out, "%%%c", *mnem);
+            break;
+        case 'W': /* Word (two bytes) */
+            length += 2;
+            out += sprintf(out, "%%%c", *mnem);
+            break;
+        case 'r': /* Register name */
+            shift = *++mnem - '0';
+            out += sprintf(out, "%s", registers[(opcode >> shift) & 7]);
+            break;
+        case 'R': /* 16 bit register name (double reg) */
+            shift = *++mnem - '0';
+            out += sprintf(out, "%s", registers16[(opcode >> shift) & 3]);
+            break;
+        case 't': /* 16 bit register name (double reg) for push/pop */
+            shift = *++mnem - '0';
+            out += sprintf(out, "%s", registers16[4 + ((opcode >> shift) & 3)]);
+            break;
+        case 'c': /* condition flag name */
+            shift = *++mnem - '0';
+            out += sprintf(out, "%s", conditions[(opcode >> shift) & 3]);
+            break;
+        case 'b': /* bit number of CB bit instruction */
+            out += sprintf(out, "%x", (opcode >> 3) & 7);
+            break;
+        case 'P': /* RST address */
+            out += sprintf(out, "0x%x", ((opcode >> 3) & 7) * 8);
+            break;
+        case 'O': /* The opcode itself (not an instruction) */
+            out += sprintf(out, "0x%x", opcode);
+            break;
+        default:
+            out += sprintf(out, "%%%c", *mnem);
+        }
+    }
+    *out = '\0';
+    e->length = length;
+}
 
-    if (opcode == 0xcb) {
-        /* extended instruction */
-        op = cbOpcodes;
-        opcode = data[pc++];
-    } else {
-        op = opcodes;
+static void init_tables(void) {
+    for (int op = 0; op <= 0xff; op++) {
+        expand(&table[op], opcodes, op, 1);
+        expand(&cb_table[op], cbOpcodes, op, 2);
     }
+}
 
-    while ((opcode & op->mask) != op->value)
-        op++;
-    mnem = op->mnem;
-
-    u8 temp1, temp2;
-    s8 stemp;
-
-    while (*mnem) {
-        if (*mnem == '%') {
-            mnem++;
-            switch(*mnem) {
-            case 'B': /* Single byte */
-                temp1 = data[pc++];
-                printf("0x%x", temp1);
-                break;
-            case 'W': /* Word (two bytes) */
-                temp1 = data[pc++];
-                temp2 = data[pc++];
-                printf("0x%x", temp1 | (temp2 << 8));
-                break;
-            case 'd': /* Signed displacement (one byte) */
-                stemp = data[pc++];
-                printf("%d", stemp);
-                break;
-            case 'n': /* Single byte, no 0x prefix */
-                temp1 = data[pc++];
-                printf("%02x", temp1);
-                break;
-            case 'r': /* Register name */
-                temp1 = *(++mnem) - '0';
-                printf("%s", registers[(opcode >> temp1) & 7]);
-                break;
-            case 'R': /* 16 bit register name (double reg) */
-                temp1 = *(++mnem) - '0';
-                printf("%s", registers16[(opcode >> temp1) & 3]);
-                break;
-            case 't': /* 16 bit register name (double reg) for push/pop */
-                temp1 = *(++mnem) - '0';
-                printf("%s", registers16[4 + ((opcode >> temp1) & 3)]);
-                break;
-            case 'c': /* condition flag name */
-                temp1 = *(++mnem) - '0';
-                printf("%s", conditions[(opcode >> temp1) & 3]);
-                break;
-            case 'b': /* bit number of CB bit instruction */
-                temp1 = (opcode >> 3) & 7;
-                printf("%x", temp1);
-                break;
-            case 'P': /* RST address */
-                temp1 = ((opcode >> 3) & 7) * 8;
-                printf("0x%x", temp1);
-                break;
-            default:
-                printf("%%%c", *mnem);
+static const struct dis_entry *lookup(const u8 *data) {
+    pthread_once(&tables_once, init_tables);
+    return data[0] == 0xcb ? &cb_table[data[1]] : &table[data[0]];
+}
+
+static char *put_hex(char *out, unsigned val, int min_digits) {
+    static const char digits[] = "0123456789abcdef";
+    char tmp[4];
+    int n = 0;
+
+    do {
+        tmp[n++] = digits[val & 0xf];
+        val >>= 4;
+    } while (val || n < min_digits);
+    while (n)
+        *out++ = tmp[--n];
+    return out;
+}
+
+int disassemble_length(const u8 *data) {
+    return lookup(data)->length;
+}
+
+int disassemble_buf(char *buf, const u8 *data) {
+    const struct dis_entry *e = lookup(data);
+    const u8 *imm = data + (data[0] == 0xcb ? 2 : 1);
+    char *out = buf;
+    int val;
+
+    for (const char *fmt = e->fmt; *fmt; fmt++) {
+        if (*fmt != '%') {
+            *out++ = *fmt;
+            continue;
+        }
+        switch (*++fmt) {
+        case 'B':
+            *out++ = '0';
+            *out++ = 'x';
+            out = put_hex(out, *imm++, 1);
+            break;
+        case 'W':
+            *out++ = '0';
+            *out++ = 'x';
+            out = put_hex(out, imm[0] | (imm[1] << 8), 1);
+            imm += 2;
+            break;
+        case 'd':
+            val = (s8)*imm++;
+            if (val < 0) {
+                *out++ = '-';
+                val = -val;
             }
-        } else {
-            putc(*mnem, stdout);
+            if (val >= 100)
+                *out++ = '0' + val / 100;
+            if (val >= 10)
+                *out++ = '0' + val / 10 % 10;
+            *out++ = '0' + val % 10;
+            break;
+        case 'n':
+            out = put_hex(out, *imm++, 2);
+            break;
+        default:
+            *out++ = '%';
+            *out++ = *fmt;
         }
-        mnem++;
     }
-    putc('\n', stdout);
-    return pc;
+    *out = '\0';
+    return e->length;
+}
+
+int disassemble(FILE *fp, const u8 *data) {
+    char buf[DISASM_BUF_SIZE];
+    int length = disassemble_buf(buf, data);
+
+    fputs(buf, fp);
+    putc('\n', fp);
+    return length;
 }
@@ -1,8 +1,24 @@
 #ifndef DISASSEMBLER_H
 #define DISASSEMBLER_H
 
+#include <stdio.h>
+
 #include "common.h"
 
-int disassemble(u8 *data);
+/* Longest disassembly of an instruction, including the terminating NUL. */
+#define DISASM_BUF_SIZE 32
+
+/* Disassembles the instruction at data (up to 3 bytes, plus the CB prefix)
+ * into buf, and returns its length in bytes. Opcodes that are no instruction
+ * come out as DB with a length of 1 (2 after a CB prefix). */
+int disassemble_buf(char *buf, const u8 *data);
+
+/* Length in bytes of the instruction at data (only data[0] and, after a CB
+ * prefix, data[1] are read). */
+int disassemble_length(const u8 *data);
+
+/* Prints the disassembly of the instruction at data as a line to fp, returns
+ * its length in bytes. */
+int disassemble(FILE *fp, const u8 *data);
 
 #endif
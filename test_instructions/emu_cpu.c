@@ -40,11 +40,6 @@ struct gb_state {
     int interrupts_master_enabled;
 };
 
-static struct gb_state emu_state;
-
-static int num_mem_accesses;
-static struct mem_access mem_accesses[16];
-
 #define FLAG_C 0x10
 #define FLAG_H 0x20
 #define FLAG_N 0x40
@@ -92,6 +87,10 @@ static int cycles_per_instruction_cb[] = {
      8,  8,  8,  8,  8,  8, 16,  8,  8,  8,  8,  8,  8,  8, 16,  8, /* f */
 };
 
+/* Executes an instruction, with PC just past the opcode. Returns the number of
+ * cycles taken on top of cycles_per_instruction[op], or -1 if op is invalid. */
+typedef int (*op_handler)(struct gb_state *s, u8 op);
+
 struct emu_luts {
     /* Lookup tables for the reg-index encoded in instructions to ptr to reg. */
     u8 *reg8_lut[9];
@@ -99,81 +98,143 @@ struct emu_luts {
     u16 *reg16s_lut[4];
 };
 
-static struct emu_luts luts;
-
-static void cpu_init_luts(struct gb_state *s) {
-    luts.reg8_lut[0] = &s->reg8.B;
-    luts.reg8_lut[1] = &s->reg8.C;
-    luts.reg8_lut[2] = &s->reg8.D;
-    luts.reg8_lut[3] = &s->reg8.E;
-    luts.reg8_lut[4] = &s->reg8.H;
-    luts.reg8_lut[5] = &s->reg8.L;
-    luts.reg8_lut[6] = NULL;
-    luts.reg8_lut[7] = &s->reg8.A;
-    luts.reg16_lut[0] = &s->reg16.BC;
-    luts.reg16_lut[1] = &s->reg16.DE;
-    luts.reg16_lut[2] = &s->reg16.HL;
-    luts.reg16_lut[3] = &s->sp;
-    luts.reg16s_lut[0] = &s->reg16.BC;
-    luts.reg16s_lut[1] = &s->reg16.DE;
-    luts.reg16s_lut[2] = &s->reg16.HL;
-    luts.reg16s_lut[3] = &s->reg16.AF;
+/* An emulated CPU: registers plus everything needed to run it. */
+struct ecpu {
+    struct gb_state s;
+    struct emu_luts luts;
+
+    int num_mem_accesses;
+    struct mem_access mem_accesses[16];
+
+    /* Timeline of the current instruction: every access takes an M-cycle, as
+     * do the internal steps that precede some of them (see internal_cycle). */
+    int cycle;
+    int num_bus_accesses;
+    struct bus_access bus_accesses[MAX_BUS_ACCESSES];
+
+    /* Memory behind the CPU, see ecpu_set_mmu. */
+    void *mmu_ctx;
+    u8 (*mmu_read_fn)(void *ctx, u16 addr);
+    void (*mmu_write_fn)(void *ctx, u16 addr, u8 val);
+
+    unsigned quirks;    // ECPU_QUIRK_*
+};
+
+/* The instance a gb_state belongs to (it is the first member). */
+#define CPU(s) ((struct ecpu *)(s))
+
+static void cpu_init_luts(struct emu_luts *luts, struct gb_state *s) {
+    luts->reg8_lut[0] = &s->reg8.B;
+    luts->reg8_lut[1] = &s->reg8.C;
+    luts->reg8_lut[2] = &s->reg8.D;
+    luts->reg8_lut[3] = &s->reg8.E;
+    luts->reg8_lut[4] = &s->reg8.H;
+    luts->reg8_lut[5] = &s->reg8.L;
+    luts->reg8_lut[6] = NULL;
+    luts->reg8_lut[7] = &s->reg8.A;
+    luts->reg16_lut[0] = &s->reg16.BC;
+    luts->reg16_lut[1] = &s->reg16.DE;
+    luts->reg16_lut[2] = &s->reg16.HL;
+    luts->reg16_lut[3] = &s->sp;
+    luts->reg16s_lut[0] = &s->reg16.BC;
+    luts->reg16s_lut[1] = &s->reg16.DE;
+    luts->reg16s_lut[2] = &s->reg16.HL;
+    luts->reg16s_lut[3] = &s->reg16.AF;
 }
 
 /* Resets the CPU state (registers and such) to the state at bootup. */
-void ecpu_reset(struct state *state) {
-    emu_state.halted = 0;
-    emu_state.interrupts_master_enabled = state->interrupts_master_enabled;
-    emu_state.pc = state->PC;
-    emu_state.sp = state->SP;
-    emu_state.reg16.AF = state->reg16.AF;
-    emu_state.reg16.BC = state->reg16.BC;
-    emu_state.reg16.DE = state->reg16.DE;
-    emu_state.reg16.HL = state->reg16.HL;
-
-    num_mem_accesses = 0;
-}
-
-void ecpu_get_state(struct state *state) {
-    state->PC = emu_state.pc;
-    state->SP = emu_state.sp;
-    state->reg16.AF = emu_state.reg16.AF;
-    state->reg16.BC = emu_state.reg16.BC;
-    state->reg16.DE = emu_state.reg16.DE;
-    state->reg16.HL = emu_state.reg16.HL;
-    state->halted = emu_state.halted;
-    state->interrupts_master_enabled = emu_state.interrupts_master_enabled;
-    state->num_mem_accesses = num_mem_accesses;
-    memcpy(state->mem_accesses, mem_accesses, sizeof(mem_accesses));
+void ecpu_reset(struct ecpu *cpu, struct state *state) {
+    struct gb_state *s = &cpu->s;
+    s->halted = state->halted;
+    s->interrupts_master_enabled = state->interrupts_master_enabled;
+    s->pc = state->PC;
+    s->sp = state->SP;
+    s->reg16.AF = state->reg16.AF;
+    s->reg16.BC = state->reg16.BC;
+    s->reg16.DE = state->reg16.DE;
+    s->reg16.HL = state->reg16.HL;
+
+    cpu->num_mem_accesses = 0;
+    cpu->num_bus_accesses = 0;
+}
+
+void ecpu_get_state(struct ecpu *cpu, struct state *state) {
+    struct gb_state *s = &cpu->s;
+    state->PC = s->pc;
+    state->SP = s->sp;
+    state->reg16.AF = s->reg16.AF;
+    state->reg16.BC = s->reg16.BC;
+    state->reg16.DE = s->reg16.DE;
+    state->reg16.HL = s->reg16.HL;
+    state->halted = s->halted;
+    state->interrupts_master_enabled = s->interrupts_master_enabled;
+    state->num_mem_accesses = cpu->num_mem_accesses;
+    memcpy(state->mem_accesses, cpu->mem_accesses, sizeof(cpu->mem_accesses));
+    state->num_bus_accesses = cpu->num_bus_accesses;
+    memcpy(state->bus_accesses, cpu->bus_accesses, sizeof(cpu->bus_accesses));
+}
+
+void ecpu_set_mmu(struct ecpu *cpu, void *ctx,
+        u8 (*read)(void *ctx, u16 addr),
+        void (*write)(void *ctx, u16 addr, u8 val)) {
+    cpu->mmu_ctx = ctx;
+    cpu->mmu_read_fn = read;
+    cpu->mmu_write_fn = write;
+}
+
+void ecpu_set_quirks(struct ecpu *cpu, unsigned quirks) {
+    cpu->quirks = quirks;
+}
+
+/* Starts the timeline of an instruction or interrupt dispatch. */
+static void bus_start(struct ecpu *cpu) {
+    cpu->cycle = 0;
+    cpu->num_bus_accesses = 0;
+}
+
+static void bus_record(struct ecpu *cpu, int type, u16 addr, u8 val) {
+    if (cpu->num_bus_accesses < MAX_BUS_ACCESSES) {
+        struct bus_access *access = &cpu->bus_accesses[cpu->num_bus_accesses++];
+        access->cycle = cpu->cycle;
+        access->type = type;
+        access->addr = addr;
+        access->val = val;
+    }
+    cpu->cycle++;
+}
+
+/* An M-cycle in which the SM83 does not use the bus. Only the ones before
+ * later accesses matter for the timeline. */
+static void internal_cycle(struct gb_state *s) {
+    CPU(s)->cycle++;
 }
 
 static void mmu_write(struct gb_state *s, u16 addr, u8 val) {
-    (void)s;
-    struct mem_access *access = &mem_accesses[num_mem_accesses++];
-    access->type = MEM_ACCESS_WRITE;
-    access->addr = addr;
-    access->val = val;
+    struct ecpu *cpu = CPU(s);
+    bus_record(cpu, MEM_ACCESS_WRITE, addr, val);
+    if (cpu->num_mem_accesses < (int)(sizeof(cpu->mem_accesses) /
+                                      sizeof(cpu->mem_accesses[0]))) {
+        struct mem_access *access = &cpu->mem_accesses[cpu->num_mem_accesses++];
+        access->type = MEM_ACCESS_WRITE;
+        access->addr = addr;
+        access->val = val;
+    }
+    if (cpu->mmu_write_fn)
+        cpu->mmu_write_fn(cpu->mmu_ctx, addr, val);
 }
 static u8 mmu_read(struct gb_state *s, u16 addr) {
-    (void)s;
-    //struct mem_acccess *access = &mem_accesses[num_mem_accesses++];
+    struct ecpu *cpu = CPU(s);
     u8 ret;
 
-    if (addr < 4)
-        ret = instruction_mem[addr];
-    else
-        ret = 0xaa;
-
-    /*
-    access->type = MEM_ACCESS_READ;
-    access->addr = addr;
-    access->val = ret;
-    */
+    ret = cpu->mmu_read_fn ? cpu->mmu_read_fn(cpu->mmu_ctx, addr) : 0xaa;
+    bus_record(cpu, MEM_ACCESS_READ, addr, ret);
 
     return ret;
 }
 static u16 mmu_read16(struct gb_state *s, u16 location) {
-    return mmu_read(s, location) | ((u16)mmu_read(s, location + 1) << 8);
+    /* Separate statements, as the order of the reads shows in the timeline. */
+    u8 lo = mmu_read(s, location);
+    return lo | ((u16)mmu_read(s, location + 1) << 8);
 }
 
 static void mmu_write16(struct gb_state *s, u16 location, u16 value) {
@@ -187,9 +248,16 @@ static u16 mmu_pop16(struct gb_state *s) {
     return val;
 }
 
+/* The SM83 pushes the high byte first, cpu.v the low one (a quirk). */
 void mmu_push16(struct gb_state *s, u16 value) {
-    s->sp -= 2;
-    mmu_write16(s, s->sp, value);
+    internal_cycle(s); // Decrementing SP
+    if (CPU(s)->quirks & ECPU_QUIRK_PUSH_LOW_FIRST) {
+        s->sp -= 2;
+        mmu_write16(s, s->sp, value);
+        return;
+    }
+    mmu_write(s, --s->sp, value >> 8);
+    mmu_write(s, --s->sp, value & 0xff);
 }
 
 #define CF s->flags.CF
@@ -208,501 +276,927 @@ void mmu_push16(struct gb_state *s, u16 value) {
 #define BC s->reg16.BC
 #define DE s->reg16.DE
 #define HL s->reg16.HL
-#define M(op, value, mask) (((op) & (mask)) == (value))
 #define mem(loc) (mmu_read(s, loc))
 #define IMM8  (mmu_read(s, s->pc))
-#define IMM16 (mmu_read(s, s->pc) | (mmu_read(s, s->pc + 1) << 8))
-#define REG8(bitpos) luts.reg8_lut[(op >> bitpos) & 7]
-#define REG16(bitpos) luts.reg16_lut[((op >> bitpos) & 3)]
-#define REG16S(bitpos) luts.reg16s_lut[((op >> bitpos) & 3)]
+#define IMM16 (mmu_read16(s, s->pc))
+#define REG8(bitpos) CPU(s)->luts.reg8_lut[(op >> bitpos) & 7]
+#define REG16(bitpos) CPU(s)->luts.reg16_lut[((op >> bitpos) & 3)]
+#define REG16S(bitpos) CPU(s)->luts.reg16s_lut[((op >> bitpos) & 3)]
 #define FLAG(bitpos) ((op >> bitpos) & 3)
 
-static int cpu_do_cb_instruction(struct gb_state *s) {
-    u8 op = mmu_read(s, s->pc++);
-
-    if (M(op, 0x00, 0xf8)) { /* RLC reg8 */
-        u8 *reg = REG8(0);
-        u8 val = reg ? *reg : mem(HL);
-        u8 res = (val << 1) | (val >> 7);
-        ZF = res == 0;
-        NF = 0;
-        HF = 0;
-        CF = val >> 7;
-        if (reg) *reg = res; else mmu_write(s, HL, res);
-    } else if (M(op, 0x08, 0xf8)) { /* RRC reg8 */
-        u8 *reg = REG8(0);
-        u8 val = reg ? *reg : mem(HL);
-        u8 res = (val >> 1) | ((val & 1) << 7);
-        ZF = res == 0;
-        NF = 0;
-        HF = 0;
-        CF = val & 1;
-        if (reg) *reg = res; else mmu_write(s, HL, res);
-    } else if (M(op, 0x10, 0xf8)) { /* RL reg8 */
-        u8 *reg = REG8(0);
-        u8 val = reg ? *reg : mem(HL);
-        u8 res = (val << 1) | (CF ? 1 : 0);
-        ZF = res == 0;
-        NF = 0;
-        HF = 0;
-        CF = val >> 7;
-        if (reg) *reg = res; else mmu_write(s, HL, res);
-    } else if (M(op, 0x18, 0xf8)) { /* RR reg8 */
-        u8 *reg = REG8(0);
-        u8 val = reg ? *reg : mem(HL);
-        u8 res = (val >> 1) | (CF << 7);
-        ZF = res == 0;
-        NF = 0;
-        HF = 0;
-        CF = val & 0x1;
-        if (reg) *reg = res; else mmu_write(s, HL, res);
-    } else if (M(op, 0x20, 0xf8)) { /* SLA reg8 */
-        u8 *reg = REG8(0);
-        u8 val = reg ? *reg : mem(HL);
-        CF = val >> 7;
-        val = val << 1;
-        ZF = val == 0;
-        NF = 0;
-        HF = 0;
-        if (reg) *reg = val; else mmu_write(s, HL, val);
-    } else if (M(op, 0x28, 0xf8)) { /* SRA reg8 */
-        u8 *reg = REG8(0);
-        u8 val = reg ? *reg : mem(HL);
-        CF = val & 0x1;
-        val = (val >> 1) | (val & (1<<7));
-        ZF = val == 0;
-        NF = 0;
-        HF = 0;
-        if (reg) *reg = val; else mmu_write(s, HL, val);
-    } else if (M(op, 0x30, 0xf8)) { /* SWAP reg8 */
-        u8 *reg = REG8(0);
-        u8 val = reg ? *reg : mem(HL);
-        u8 res = ((val << 4) & 0xf0) | ((val >> 4) & 0xf);
-        F = res == 0 ? FLAG_Z : 0;
-        if (reg) *reg = res; else mmu_write(s, HL, res);
-    } else if (M(op, 0x38, 0xf8)) { /* SRL reg8 */
-        u8 *reg = REG8(0);
-        u8 val = reg ? *reg : mem(HL);
-        CF = val & 0x1;
-        val = val >> 1;
-        ZF = val == 0;
-        NF = 0;
-        HF = 0;
-        if (reg) *reg = val; else mmu_write(s, HL, val);
-    } else if (M(op, 0x40, 0xc0)) { /* BIT bit, reg8 */
-        u8 bit = (op >> 3) & 7;
-        u8 *reg = REG8(0);
-        u8 val = reg ? *reg : mem(HL);
-        ZF = ((val >> bit) & 1) == 0;
-        NF = 0;
-        HF = 1;
-    } else if (M(op, 0x80, 0xc0)) { /* RES bit, reg8 */
-        u8 bit = (op >> 3) & 7;
-        u8 *reg = REG8(0);
-        u8 val = reg ? *reg : mem(HL);
-        val = val & ~(1<<bit);
-        if (reg) *reg = val; else mmu_write(s, HL, val);
-    } else if (M(op, 0xc0, 0xc0)) { /* SET bit, reg8 */
-        u8 bit = (op >> 3) & 7;
-        u8 *reg = REG8(0);
-        u8 val = reg ? *reg : mem(HL);
-        val |= (1 << bit);
-        if (reg) *reg = val; else mmu_write(s, HL, val);
-    } else {
-        s->pc -= 2;
-        printf("Unknown opcode %02x", op);
-        return -1;
-    }
+/* Opcode handlers, see op_handler and ops[]. */
+static const op_handler cb_ops[256];
+#define UNUSED __attribute__((unused))
+#define OP(name) static int name(UNUSED struct gb_state *s, UNUSED u8 op)
+
+/* RLC reg8 */
+OP(cb_rlc_reg8) {
+    u8 *reg = REG8(0);
+    u8 val = reg ? *reg : mem(HL);
+    u8 res = (val << 1) | (val >> 7);
+    ZF = res == 0;
+    NF = 0;
+    HF = 0;
+    CF = val >> 7;
+    if (reg) *reg = res; else mmu_write(s, HL, res);
+    return 0;
+}
+
+/* RRC reg8 */
+OP(cb_rrc_reg8) {
+    u8 *reg = REG8(0);
+    u8 val = reg ? *reg : mem(HL);
+    u8 res = (val >> 1) | ((val & 1) << 7);
+    ZF = res == 0;
+    NF = 0;
+    HF = 0;
+    CF = val & 1;
+    if (reg) *reg = res; else mmu_write(s, HL, res);
+    return 0;
+}
+
+/* RL reg8 */
+OP(cb_rl_reg8) {
+    u8 *reg = REG8(0);
+    u8 val = reg ? *reg : mem(HL);
+    u8 res = (val << 1) | (CF ? 1 : 0);
+    ZF = res == 0;
+    NF = 0;
+    HF = 0;
+    CF = val >> 7;
+    if (reg) *reg = res; else mmu_write(s, HL, res);
+    return 0;
+}
+
+/* RR reg8 */
+OP(cb_rr_reg8) {
+    u8 *reg = REG8(0);
+    u8 val = reg ? *reg : mem(HL);
+    u8 res = (val >> 1) | (CF << 7);
+    ZF = res == 0;
+    NF = 0;
+    HF = 0;
+    CF = val & 0x1;
+    if (reg) *reg = res; else mmu_write(s, HL, res);
+    return 0;
+}
+
+/* SLA reg8 */
+OP(cb_sla_reg8) {
+    u8 *reg = REG8(0);
+    u8 val = reg ? *reg : mem(HL);
+    CF = val >> 7;
+    val = val << 1;
+    ZF = val == 0;
+    NF = 0;
+    HF = 0;
+    if (reg) *reg = val; else mmu_write(s, HL, val);
+    return 0;
+}
+
+/* SRA reg8 */
+OP(cb_sra_reg8) {
+    u8 *reg = REG8(0);
+    u8 val = reg ? *reg : mem(HL);
+    CF = val & 0x1;
+    val = (val >> 1) | (val & (1<<7));
+    ZF = val == 0;
+    NF = 0;
+    HF = 0;
+    if (reg) *reg = val; else mmu_write(s, HL, val);
+    return 0;
+}
+
+/* SWAP reg8 */
+OP(cb_swap_reg8) {
+    u8 *reg = REG8(0);
+    u8 val = reg ? *reg : mem(HL);
+    u8 res = ((val << 4) & 0xf0) | ((val >> 4) & 0xf);
+    F = res == 0 ? FLAG_Z : 0;
+    if (reg) *reg = res; else mmu_write(s, HL, res);
+    return 0;
+}
+
+/* SRL reg8 */
+OP(cb_srl_reg8) {
+    u8 *reg = REG8(0);
+    u8 val = reg ? *reg : mem(HL);
+    CF = val & 0x1;
+    val = val >> 1;
+    ZF = val == 0;
+    NF = 0;
+    HF = 0;
+    if (reg) *reg = val; else mmu_write(s, HL, val);
+    return 0;
+}
+
+/* BIT bit, reg8 */
+OP(cb_bit_reg8) {
+    u8 bit = (op >> 3) & 7;
+    u8 *reg = REG8(0);
+    u8 val = reg ? *reg : mem(HL);
+    ZF = ((val >> bit) & 1) == 0;
+    NF = 0;
+    HF = 1;
+    return 0;
+}
+
+/* RES bit, reg8 */
+OP(cb_res_reg8) {
+    u8 bit = (op >> 3) & 7;
+    u8 *reg = REG8(0);
+    u8 val = reg ? *reg : mem(HL);
+    val = val & ~(1<<bit);
+    if (reg) *reg = val; else mmu_write(s, HL, val);
+    return 0;
+}
+
+/* SET bit, reg8 */
+OP(cb_set_reg8) {
+    u8 bit = (op >> 3) & 7;
+    u8 *reg = REG8(0);
+    u8 val = reg ? *reg : mem(HL);
+    val |= (1 << bit);
+    if (reg) *reg = val; else mmu_write(s, HL, val);
+    return 0;
+}
+
+/* NOP */
+OP(op_nop) {
+
+    return 0;
+}
+
+/* LD reg16, u16 */
+OP(op_ld_reg16_imm16) {
+    u16 *dst = REG16(4);
+    *dst = IMM16;
+    s->pc += 2;
+    return 0;
+}
+
+/* LD (BC), A */
+OP(op_ld_bc_a) {
+    mmu_write(s, BC, A);
+    return 0;
+}
+
+/* INC reg16 */
+OP(op_inc_reg16) {
+    u16 *reg = REG16(4);
+    *reg += 1;
+    return 0;
+}
+
+/* INC reg8 */
+OP(op_inc_reg8) {
+    u8* reg = REG8(3);
+    u8 val = reg ? *reg : mem(HL);
+    u8 res = val + 1;
+    ZF = res == 0;
+    NF = 0;
+    HF = (val & 0xf) == 0xf;
+    if (reg)
+        *reg = res;
+    else
+        mmu_write(s, HL, res);
+    return 0;
+}
+
+/* DEC reg8 */
+OP(op_dec_reg8) {
+    u8* reg = REG8(3);
+    u8 val = reg ? *reg : mem(HL);
+    val--;
+    NF = 1;
+    ZF = val == 0;
+    HF = (val & 0x0F) == 0x0F;
+    if (reg)
+        *reg = val;
+    else
+        mmu_write(s, HL, val);
+    return 0;
+}
+
+/* LD reg8, imm8 */
+OP(op_ld_reg8_imm8) {
+    u8* dst = REG8(3);
+    u8 src = IMM8;
+    s->pc++;
+    if (dst)
+        *dst = src;
+    else
+        mmu_write(s, HL, src);
+    return 0;
+}
+
+/* RLCA */
+OP(op_rlca) {
+    u8 res = (A << 1) | (A >> 7);
+    F = (A >> 7) ? FLAG_C : 0;
+    A = res;
+    return 0;
+}
+
+/* LD (imm16), SP */
+OP(op_ld_imm16_sp) {
+    mmu_write16(s, IMM16, s->sp);
+    s->pc += 2;
+    return 0;
+}
+
+/* ADD HL, reg16 */
+OP(op_add_hl_reg16) {
+    u16 *src = REG16(4);
+    u32 tmp = HL + *src;
+    NF = 0;
+    HF = (((HL & 0xfff) + (*src & 0xfff)) & 0x1000) ? 1 : 0;
+    CF = tmp > 0xffff;
+    HL = tmp;
+    return 0;
+}
+
+/* LD A, (BC) */
+OP(op_ld_a_bc) {
+    A = mem(BC);
+    return 0;
+}
+
+/* DEC reg16 */
+OP(op_dec_reg16) {
+    u16 *reg = REG16(4);
+    *reg -= 1;
+    return 0;
+}
+
+/* RRCA */
+OP(op_rrca) {
+    F = (A & 1) ? FLAG_C : 0;
+    A = (A >> 1) | ((A & 1) << 7);
+    return 0;
+}
+
+/* STOP */
+OP(op_stop) {
+    //s->halt_for_interrupts = 1;
+    return 0;
+}
+
+/* LD (DE), A */
+OP(op_ld_de_a) {
+    mmu_write(s, DE, A);
+    return 0;
+}
+
+/* RLA */
+OP(op_rla) {
+    u8 res = A << 1 | (CF ? 1 : 0);
+    F = (A & (1 << 7)) ? FLAG_C : 0;
+    A = res;
     return 0;
 }
 
-static int cpu_do_instruction(struct gb_state *s) {
+/* JR off8 */
+OP(op_jr_off8) {
+    s->pc += (s8)IMM8 + 1;
+    return 0;
+}
+
+/* LD A, (DE) */
+OP(op_ld_a_de) {
+    A = mem(DE);
+    return 0;
+}
+
+/* RRA */
+OP(op_rra) {
+    u8 res = (A >> 1) | (CF << 7);
+    ZF = 0;
+    NF = 0;
+    HF = 0;
+    CF = A & 0x1;
+    A = res;
+    return 0;
+}
+
+/* JR cond, off8 */
+OP(op_jr_cond_off8) {
     int extra_cycles = 0;
-    u8 op = mmu_read(s, s->pc++);
-    if (M(op, 0x00, 0xff)) { /* NOP */
-    } else if (M(op, 0x01, 0xcf)) { /* LD reg16, u16 */
-        u16 *dst = REG16(4);
-        *dst = IMM16;
-        s->pc += 2;
-    } else if (M(op, 0x02, 0xff)) { /* LD (BC), A */
-        mmu_write(s, BC, A);
-    } else if (M(op, 0x03, 0xcf)) { /* INC reg16 */
-        u16 *reg = REG16(4);
-        *reg += 1;
-    } else if (M(op, 0x04, 0xc7)) { /* INC reg8 */
-        u8* reg = REG8(3);
-        u8 val = reg ? *reg : mem(HL);
-        u8 res = val + 1;
-        ZF = res == 0;
-        NF = 0;
-        HF = (val & 0xf) == 0xf;
-        if (reg)
-            *reg = res;
-        else
-            mmu_write(s, HL, res);
-    } else if (M(op, 0x05, 0xc7)) { /* DEC reg8 */
-        u8* reg = REG8(3);
-        u8 val = reg ? *reg : mem(HL);
-        val--;
-        NF = 1;
-        ZF = val == 0;
-        HF = (val & 0x0F) == 0x0F;
-        if (reg)
-            *reg = val;
-        else
-            mmu_write(s, HL, val);
-    } else if (M(op, 0x06, 0xc7)) { /* LD reg8, imm8 */
-        u8* dst = REG8(3);
-        u8 src = IMM8;
-        s->pc++;
-        if (dst)
-            *dst = src;
-        else
-            mmu_write(s, HL, src);
-    } else if (M(op, 0x07, 0xff)) { /* RLCA */
-        u8 res = (A << 1) | (A >> 7);
-        F = (A >> 7) ? FLAG_C : 0;
-        A = res;
-
-    } else if (M(op, 0x08, 0xff)) { /* LD (imm16), SP */
-        mmu_write16(s, IMM16, s->sp);
-        s->pc += 2;
+    s8 offset = IMM8; // Read even if not taken
+    u8 flag = (op >> 3) & 3;
+    if (((F & flagmasks[flag]) ? 1 : 0) == (flag & 1)) {
+        s->pc += offset;
+        extra_cycles = 4;
+    }
+    s->pc++;
+    return extra_cycles;
+}
 
-    } else if (M(op, 0x09, 0xcf)) { /* ADD HL, reg16 */
-        u16 *src = REG16(4);
-        u32 tmp = HL + *src;
-        NF = 0;
-        HF = (((HL & 0xfff) + (*src & 0xfff)) & 0x1000) ? 1 : 0;
-        CF = tmp > 0xffff;
-        HL = tmp;
-    } else if (M(op, 0x0a, 0xff)) { /* LD A, (BC) */
-        A = mem(BC);
-    } else if (M(op, 0x0b, 0xcf)) { /* DEC reg16 */
-        u16 *reg = REG16(4);
-        *reg -= 1;
-    } else if (M(op, 0x0f, 0xff)) { /* RRCA */
-        F = (A & 1) ? FLAG_C : 0;
-        A = (A >> 1) | ((A & 1) << 7);
-    } else if (M(op, 0x10, 0xff)) { /* STOP */
-        //s->halt_for_interrupts = 1;
-    } else if (M(op, 0x12, 0xff)) { /* LD (DE), A */
-        mmu_write(s, DE, A);
-    } else if (M(op, 0x17, 0xff)) { /* RLA */
-        u8 res = A << 1 | (CF ? 1 : 0);
-        F = (A & (1 << 7)) ? FLAG_C : 0;
-        A = res;
-    } else if (M(op, 0x18, 0xff)) { /* JR off8 */
-        s->pc += (s8)IMM8 + 1;
-    } else if (M(op, 0x1a, 0xff)) { /* LD A, (DE) */
-        A = mem(DE);
-    } else if (M(op, 0x1f, 0xff)) { /* RRA */
-        u8 res = (A >> 1) | (CF << 7);
-        ZF = 0;
-        NF = 0;
-        HF = 0;
-        CF = A & 0x1;
-        A = res;
-    } else if (M(op, 0x20, 0xe7)) { /* JR cond, off8 */
-        u8 flag = (op >> 3) & 3;
-        if (((F & flagmasks[flag]) ? 1 : 0) == (flag & 1)) {
-            s->pc += (s8)IMM8;
-            extra_cycles = 4;
-        }
-        s->pc++;
-    } else if (M(op, 0x22, 0xff)) { /* LDI (HL), A */
-        mmu_write(s, HL, A);
-        HL++;
-    } else if (M(op, 0x27, 0xff)) { /* DAA */
-        /* When adding/subtracting two numbers in BCD form, this instructions
-         * brings the results back to BCD form too. In BCD form the decimals 0-9
-         * are encoded in a fixed number of bits (4). E.g., 0x93 actually means
-         * 93 decimal. Adding/subtracting such numbers takes them out of this
-         * form since they can results in values where each digit is >9.
-         * E.g., 0x9 + 0x1 = 0xA, but should be 0x10. The important thing to
-         * note here is that per 4 bits we 'skip' 6 values (0xA-0xF), and thus
-         * by adding 0x6 we get: 0xA + 0x6 = 0x10, the correct answer. The same
-         * works for the upper byte (add 0x60).
-         * So: If the lower byte is >9, we need to add 0x6.
-         * If the upper byte is >9, we need to add 0x60.
-         * Furthermore, if we carried the lower part (HF, 0x9+0x9=0x12) we
-         * should also add 0x6 (0x12+0x6=0x18).
-         * Similarly for the upper byte (CF, 0x90+0x90=0x120, +0x60=0x180).
-         *
-         * For subtractions (we know it was a subtraction by looking at the NF
-         * flag) we simiarly need to *subtract* 0x06/0x60/0x66 to again skip the
-         * unused 6 values in each byte. The GB does this by only looking at the
-         * NF and CF flags then.
-         */
-        s8 add = 0;
-        if ((!NF && (A & 0xf) > 0x9) || HF)
-            add |= 0x6;
-        if ((!NF && A > 0x99) || CF) {
-            add |= 0x60;
-            CF = 1;
-        }
-        A += NF ? -add : add;
-        ZF = A == 0;
-        HF = 0;
-    } else if (M(op, 0x2a, 0xff)) { /* LDI A, (HL) */
-        A = mmu_read(s, HL);
-        HL++;
-    } else if (M(op, 0x2f, 0xff)) { /* CPL */
-        A = ~A;
-        NF = 1;
-        HF = 1;
-    } else if (M(op, 0x32, 0xff)) { /* LDD (HL), A */
-        mmu_write(s, HL, A);
-        HL--;
-    } else if (M(op, 0x37, 0xff)) { /* SCF */
-        NF = 0;
-        HF = 0;
+/* LDI (HL), A */
+OP(op_ldi_hl_a) {
+    mmu_write(s, HL, A);
+    HL++;
+    return 0;
+}
+
+/* DAA */
+OP(op_daa) {
+    /* When adding/subtracting two numbers in BCD form, this instructions
+     * brings the results back to BCD form too. In BCD form the decimals 0-9
+     * are encoded in a fixed number of bits (4). E.g., 0x93 actually means
+     * 93 decimal. Adding/subtracting such numbers takes them out of this
+     * form since they can results in values where each digit is >9.
+     * E.g., 0x9 + 0x1 = 0xA, but should be 0x10. The important thing to
+     * note here is that per 4 bits we 'skip' 6 values (0xA-0xF), and thus
+     * by adding 0x6 we get: 0xA + 0x6 = 0x10, the correct answer. The same
+     * works for the upper byte (add 0x60).
+     * So: If the lower byte is >9, we need to add 0x6.
+     * If the upper byte is >9, we need to add 0x60.
+     * Furthermore, if we carried the lower part (HF, 0x9+0x9=0x12) we
+     * should also add 0x6 (0x12+0x6=0x18).
+     * Similarly for the upper byte (CF, 0x90+0x90=0x120, +0x60=0x180).
+     *
+     * For subtractions (we know it was a subtraction by looking at the NF
+     * flag) we simiarly need to *subtract* 0x06/0x60/0x66 to again skip the
+     * unused 6 values in each byte. The GB does this by only looking at the
+     * NF and CF flags then.
+     */
+    s8 add = 0;
+    if ((!NF && (A & 0xf) > 0x9) || HF)
+        add |= 0x6;
+    if ((!NF && A > 0x99) || CF) {
+        add |= 0x60;
         CF = 1;
-    } else if (M(op, 0x3a, 0xff)) { /* LDD A, (HL) */
-        A = mmu_read(s, HL);
-        HL--;
-    } else if (M(op, 0x3f, 0xff)) { /* CCF */
-        CF = CF ? 0 : 1;
-        NF = 0;
-        HF = 0;
-    } else if (M(op, 0x76, 0xff)) { /* HALT */
-        s->halted = 1;
-    } else if (M(op, 0x40, 0xc0)) { /* LD reg8, reg8 */
-        u8* src = REG8(0);
-        u8* dst = REG8(3);
-        u8 srcval = src ? *src : mem(HL);
-        if (dst)
-            *dst = srcval;
-        else
-            mmu_write(s, HL, srcval);
-    } else if (M(op, 0x80, 0xf8)) { /* ADD A, reg8 */
-        u8* src = REG8(0);
-        u8 srcval = src ? *src : mem(HL);
-        u16 res = A + srcval;
-        ZF = (u8)res == 0;
-        NF = 0;
-        HF = (A ^ srcval ^ res) & 0x10 ? 1 : 0;
-        CF = res & 0x100 ? 1 : 0;
-        A = (u8)res;
-    } else if (M(op, 0x88, 0xf8)) { /* ADC A, reg8 */
-        u8* src = REG8(0);
-        u8 srcval = src ? *src : mem(HL);
-        u16 res = A + srcval + CF;
-        ZF = (u8)res == 0;
-        NF = 0;
-        HF = (A ^ srcval ^ res) & 0x10 ? 1 : 0;
-        CF = res & 0x100 ? 1 : 0;
-        A = (u8)res;
-
-    } else if (M(op, 0x90, 0xf8)) { /* SUB reg8 */
-        u8 *reg = REG8(0);
-        u8 val = reg ? *reg : mem(HL);
-        u8 res = A - val;
-        ZF = res == 0;
-        NF = 1;
-        HF = ((s32)A & 0xf) - (val & 0xf) < 0;
-        CF = A < val;
-        A = res;
-    } else if (M(op, 0x98, 0xf8)) { /* SBC A, reg8 */
-        u8 *reg = REG8(0);
-        u8 regval = reg ? *reg : mem(HL);
-        u8 res = A - regval - CF;
-        ZF = res == 0;
-        NF = 1;
-        HF = ((s32)A & 0xf) - (regval & 0xf) - CF < 0;
-        CF = A < regval + CF;
-        A = res;
-    } else if (M(op, 0xa0, 0xf8)) { /* AND reg8 */
-        u8 *reg = REG8(0);
-        u8 val = reg ? *reg : mem(HL);
-        A = A & val;
-        ZF = A == 0;
-        NF = 0;
-        HF = 1;
-        CF = 0;
-    } else if (M(op, 0xa8, 0xf8)) { /* XOR reg8 */
-        u8* src = REG8(0);
-        u8 srcval = src ? *src : mem(HL);
-        A ^= srcval;
-        F = A ? 0 : FLAG_Z;
-    } else if (M(op, 0xb0, 0xf8)) { /* OR reg8 */
-        u8* src = REG8(0);
-        u8 srcval = src ? *src : mem(HL);
-        A |= srcval;
-        F = A ? 0 : FLAG_Z;
-    } else if (M(op, 0xb8, 0xf8)) { /* CP reg8 */
-        u8 *reg = REG8(0);
-        u8 regval = reg ? *reg : mem(HL);
-        ZF = A == regval;
-        NF = 1;
-        HF = (A & 0xf) < (regval & 0xf);
-        CF = A < regval;
-    } else if (M(op, 0xc0, 0xe7)) { /* RET cond */
-        u8 flag = (op >> 3) & 3;
-        if (((F & flagmasks[flag]) ? 1 : 0) == (flag & 1)) {
-            s->pc = mmu_pop16(s);
-            extra_cycles = 12;
-        }
-    } else if (M(op, 0xc1, 0xcf)) { /* POP reg16 */
-        u16 *dst = REG16S(4);
-        *dst = mmu_pop16(s);
-        F = F & 0xf0;
-    } else if (M(op, 0xc2, 0xe7)) { /* JP cond, imm16 */
-        u8 flag = (op >> 3) & 3;
-        if (((F & flagmasks[flag]) ? 1 : 0) == (flag & 1)) {
-            s->pc = IMM16;
-            extra_cycles = 4;
-        } else
-            s->pc += 2;
-    } else if (M(op, 0xc3, 0xff)) { /* JP imm16 */
-        s->pc = IMM16;
-    } else if (M(op, 0xc4, 0xe7)) { /* CALL cond, imm16 */
-        u16 dst = IMM16;
-        s->pc += 2;
-        u8 flag = (op >> 3) & 3;
-        if (((F & flagmasks[flag]) ? 1 : 0) == (flag & 1)) {
-            mmu_push16(s, s->pc);
-            s->pc = dst;
-            extra_cycles = 12;
-        }
-    } else if (M(op, 0xc5, 0xcf)) { /* PUSH reg16 */
-        u16 *src = REG16S(4);
-        mmu_push16(s,*src);
-    } else if (M(op, 0xc6, 0xff)) { /* ADD A, imm8 */
-        u16 res = A + IMM8;
-        ZF = (u8)res == 0;
-        NF = 0;
-        HF = (A ^ IMM8 ^ res) & 0x10 ? 1 : 0;
-        CF = res & 0x100 ? 1 : 0;
-        A = (u8)res;
-        s->pc++;
-    } else if (M(op, 0xc7, 0xc7)) { /* RST imm8 */
-        mmu_push16(s, s->pc);
-        s->pc = ((op >> 3) & 7) * 8;
-    } else if (M(op, 0xc9, 0xff)) { /* RET */
+    }
+    A += NF ? -add : add;
+    ZF = A == 0;
+    HF = 0;
+    return 0;
+}
+
+/* LDI A, (HL) */
+OP(op_ldi_a_hl) {
+    A = mmu_read(s, HL);
+    HL++;
+    return 0;
+}
+
+/* CPL */
+OP(op_cpl) {
+    A = ~A;
+    NF = 1;
+    HF = 1;
+    return 0;
+}
+
+/* LDD (HL), A */
+OP(op_ldd_hl_a) {
+    mmu_write(s, HL, A);
+    HL--;
+    return 0;
+}
+
+/* SCF */
+OP(op_scf) {
+    NF = 0;
+    HF = 0;
+    CF = 1;
+    return 0;
+}
+
+/* LDD A, (HL) */
+OP(op_ldd_a_hl) {
+    A = mmu_read(s, HL);
+    HL--;
+    return 0;
+}
+
+/* CCF */
+OP(op_ccf) {
+    CF = CF ? 0 : 1;
+    NF = 0;
+    HF = 0;
+    return 0;
+}
+
+/* HALT */
+OP(op_halt) {
+    s->halted = 1;
+    return 0;
+}
+
+/* LD reg8, reg8 */
+OP(op_ld_reg8_reg8) {
+    u8* src = REG8(0);
+    u8* dst = REG8(3);
+    u8 srcval = src ? *src : mem(HL);
+    if (dst)
+        *dst = srcval;
+    else
+        mmu_write(s, HL, srcval);
+    return 0;
+}
+
+/* ADD A, reg8 */
+OP(op_add_a_reg8) {
+    u8* src = REG8(0);
+    u8 srcval = src ? *src : mem(HL);
+    u16 res = A + srcval;
+    ZF = (u8)res == 0;
+    NF = 0;
+    HF = (A ^ srcval ^ res) & 0x10 ? 1 : 0;
+    CF = res & 0x100 ? 1 : 0;
+    A = (u8)res;
+    return 0;
+}
+
+/* ADC A, reg8 */
+OP(op_adc_a_reg8) {
+    u8* src = REG8(0);
+    u8 srcval = src ? *src : mem(HL);
+    u16 res = A + srcval + CF;
+    ZF = (u8)res == 0;
+    NF = 0;
+    HF = (A ^ srcval ^ res) & 0x10 ? 1 : 0;
+    CF = res & 0x100 ? 1 : 0;
+    A = (u8)res;
+    return 0;
+}
+
+/* SUB reg8 */
+OP(op_sub_reg8) {
+    u8 *reg = REG8(0);
+    u8 val = reg ? *reg : mem(HL);
+    u8 res = A - val;
+    ZF = res == 0;
+    NF = 1;
+    HF = ((s32)A & 0xf) - (val & 0xf) < 0;
+    CF = A < val;
+    A = res;
+    return 0;
+}
+
+/* SBC A, reg8 */
+OP(op_sbc_a_reg8) {
+    u8 *reg = REG8(0);
+    u8 regval = reg ? *reg : mem(HL);
+    u8 res = A - regval - CF;
+    ZF = res == 0;
+    NF = 1;
+    HF = ((s32)A & 0xf) - (regval & 0xf) - CF < 0;
+    CF = A < regval + CF;
+    A = res;
+    return 0;
+}
+
+/* AND reg8 */
+OP(op_and_reg8) {
+    u8 *reg = REG8(0);
+    u8 val = reg ? *reg : mem(HL);
+    A = A & val;
+    ZF = A == 0;
+    NF = 0;
+    HF = 1;
+    CF = 0;
+    return 0;
+}
+
+/* XOR reg8 */
+OP(op_xor_reg8) {
+    u8* src = REG8(0);
+    u8 srcval = src ? *src : mem(HL);
+    A ^= srcval;
+    F = A ? 0 : FLAG_Z;
+    return 0;
+}
+
+/* OR reg8 */
+OP(op_or_reg8) {
+    u8* src = REG8(0);
+    u8 srcval = src ? *src : mem(HL);
+    A |= srcval;
+    F = A ? 0 : FLAG_Z;
+    return 0;
+}
+
+/* CP reg8 */
+OP(op_cp_reg8) {
+    u8 *reg = REG8(0);
+    u8 regval = reg ? *reg : mem(HL);
+    ZF = A == regval;
+    NF = 1;
+    HF = (A & 0xf) < (regval & 0xf);
+    CF = A < regval;
+    return 0;
+}
+
+/* RET cond */
+OP(op_ret_cond) {
+    int extra_cycles = 0;
+    u8 flag = (op >> 3) & 3;
+    internal_cycle(s); // Checking the condition
+    if (((F & flagmasks[flag]) ? 1 : 0) == (flag & 1)) {
         s->pc = mmu_pop16(s);
-    } else if (M(op, 0xcd, 0xff)) { /* CALL imm16 */
-        u16 dst = IMM16;
-        mmu_push16(s, s->pc + 2);
+        extra_cycles = 12;
+    }
+    return extra_cycles;
+}
+
+/* POP reg16 */
+OP(op_pop_reg16) {
+    u16 *dst = REG16S(4);
+    *dst = mmu_pop16(s);
+    F = F & 0xf0;
+    return 0;
+}
+
+/* JP cond, imm16 */
+OP(op_jp_cond_imm16) {
+    int extra_cycles = 0;
+    u16 dst = IMM16; // Read even if not taken
+    u8 flag = (op >> 3) & 3;
+    if (((F & flagmasks[flag]) ? 1 : 0) == (flag & 1)) {
         s->pc = dst;
-    } else if (M(op, 0xce, 0xff)) { /* ADC imm8 */
-        u16 res = A + IMM8 + CF;
-        ZF = (u8)res == 0;
-        NF = 0;
-        HF = (A ^ IMM8 ^ res) & 0x10 ? 1 : 0;
-        CF = res & 0x100 ? 1 : 0;
-        A = (u8)res;
-        s->pc++;
-    } else if (M(op, 0xd6, 0xff)) { /* SUB imm8 */
-        u8 res = A - IMM8;
-        ZF = res == 0;
-        NF = 1;
-        HF = ((s32)A & 0xf) - (IMM8 & 0xf) < 0;
-        CF = A < IMM8;
-        A = res;
-        s->pc++;
-    } else if (M(op, 0xd9, 0xff)) { /* RETI */
-        s->pc = mmu_pop16(s);
-        s->interrupts_master_enabled = 1;
-    } else if (M(op, 0xde, 0xff)) { /* SBC imm8 */
-        u8 res = A - IMM8 - CF;
-        ZF = res == 0;
-        NF = 1;
-        HF = ((s32)A & 0xf) - (IMM8 & 0xf) - CF < 0;
-        CF = A < IMM8 + CF;
-        A = res;
-        s->pc++;
-    } else if (M(op, 0xe0, 0xff)) { /* LD (0xff00 + imm8), A */
-        mmu_write(s, 0xff00 + IMM8, A);
-        s->pc++;
-    } else if (M(op, 0xe2, 0xff)) { /* LD (0xff00 + C), A */
-        mmu_write(s, 0xff00 + C, A);
-    } else if (M(op, 0xe6, 0xff)) { /* AND imm8 */
-        A = A & IMM8;
-        s->pc++;
-        ZF = A == 0;
-        NF = 0;
-        HF = 1;
-        CF = 0;
-    } else if (M(op, 0xe8, 0xff)) { /* ADD SP, imm8s */
-        s8 off = (s8)IMM8;
-        u32 res = s->sp + off;
-        ZF = 0;
-        NF = 0;
-        HF = (s->sp & 0xf) + (IMM8 & 0xf) > 0xf;
-        CF = (s->sp & 0xff) + (IMM8 & 0xff) > 0xff;
-        s->sp = res;
-        s->pc++;
-    } else if (M(op, 0xe9, 0xff)) { /* LD PC, HL (or JP (HL) ) */
-        s->pc = HL;
-    } else if (M(op, 0xea, 0xff)) { /* LD (imm16), A */
-        mmu_write(s, IMM16, A);
+        extra_cycles = 4;
+    } else
         s->pc += 2;
-    } else if (M(op, 0xcb, 0xff)) { /* CB-prefixed extended instructions */
-        return cpu_do_cb_instruction(s);
-    } else if (M(op, 0xee, 0xff)) { /* XOR imm8 */
-        A ^= IMM8;
-        s->pc++;
-        F = A ? 0 : FLAG_Z;
-    } else if (M(op, 0xf0, 0xff)) { /* LD A, (0xff00 + imm8) */
-        A = mmu_read(s, 0xff00 + IMM8);
-        s->pc++;
-    } else if (M(op, 0xf2, 0xff)) { /* LD A, (0xff00 + C) */
-        A = mmu_read(s, 0xff00 + C);
-    } else if (M(op, 0xf3, 0xff)) { /* DI */
-        s->interrupts_master_enabled = 0;
-    } else if (M(op, 0xf6, 0xff)) { /* OR imm8 */
-        A |= IMM8;
-        F = A ? 0 : FLAG_Z;
-        s->pc++;
-    } else if (M(op, 0xf8, 0xff)) { /* LD HL, SP + imm8 */
-        u32 res = (u32)s->sp + (s8)IMM8;
-        ZF = 0;
-        NF = 0;
-        HF = (s->sp & 0xf) + (IMM8 & 0xf) > 0xf;
-        CF = (s->sp & 0xff) + (IMM8 & 0xff) > 0xff;
-        HL = (u16)res;
-        s->pc++;
-    } else if (M(op, 0xf9, 0xff)) { /* LD SP, HL */
-        s->sp = HL;
-    } else if (M(op, 0xfa, 0xff)) { /* LD A, (imm16) */
-        A = mmu_read(s, IMM16);
-        s->pc += 2;
-    } else if (M(op, 0xfb, 0xff)) { /* EI */
-        s->interrupts_master_enabled = 1;
-    } else if (M(op, 0xfe, 0xff)) { /* CP imm8 */
-        u8 n = IMM8;
-        ZF = A == n;
-        NF = 1;
-        HF = (A & 0xf) < (n & 0xf);
-        CF = A < n;
-        s->pc++;
-    } else {
-        s->pc--;
-        printf("Unknown opcode %02x", op);
-        return -1;
+    return extra_cycles;
+}
+
+/* JP imm16 */
+OP(op_jp_imm16) {
+    s->pc = IMM16;
+    return 0;
+}
+
+/* CALL cond, imm16 */
+OP(op_call_cond_imm16) {
+    int extra_cycles = 0;
+    u16 dst = IMM16;
+    s->pc += 2;
+    u8 flag = (op >> 3) & 3;
+    if (((F & flagmasks[flag]) ? 1 : 0) == (flag & 1)) {
+        mmu_push16(s, s->pc);
+        s->pc = dst;
+        extra_cycles = 12;
     }
     return extra_cycles;
 }
 
-int ecpu_step(void) {
-    struct gb_state *s = &emu_state;
+/* PUSH reg16 */
+OP(op_push_reg16) {
+    u16 *src = REG16S(4);
+    mmu_push16(s,*src);
+    return 0;
+}
+
+/* ADD A, imm8 */
+OP(op_add_a_imm8) {
+    u8 n = IMM8;
+    u16 res = A + n;
+    ZF = (u8)res == 0;
+    NF = 0;
+    HF = (A ^ n ^ res) & 0x10 ? 1 : 0;
+    CF = res & 0x100 ? 1 : 0;
+    A = (u8)res;
+    s->pc++;
+    return 0;
+}
+
+/* RST imm8 */
+OP(op_rst_imm8) {
+    mmu_push16(s, s->pc);
+    s->pc = ((op >> 3) & 7) * 8;
+    return 0;
+}
+
+/* RET */
+OP(op_ret) {
+    s->pc = mmu_pop16(s);
+    return 0;
+}
+
+/* CALL imm16 */
+OP(op_call_imm16) {
+    u16 dst = IMM16;
+    mmu_push16(s, s->pc + 2);
+    s->pc = dst;
+    return 0;
+}
+
+/* ADC imm8 */
+OP(op_adc_imm8) {
+    u8 n = IMM8;
+    u16 res = A + n + CF;
+    ZF = (u8)res == 0;
+    NF = 0;
+    HF = (A ^ n ^ res) & 0x10 ? 1 : 0;
+    CF = res & 0x100 ? 1 : 0;
+    A = (u8)res;
+    s->pc++;
+    return 0;
+}
+
+/* SUB imm8 */
+OP(op_sub_imm8) {
+    u8 n = IMM8;
+    u8 res = A - n;
+    ZF = res == 0;
+    NF = 1;
+    HF = ((s32)A & 0xf) - (n & 0xf) < 0;
+    CF = A < n;
+    A = res;
+    s->pc++;
+    return 0;
+}
+
+/* RETI */
+OP(op_reti) {
+    s->pc = mmu_pop16(s);
+    s->interrupts_master_enabled = 1;
+    return 0;
+}
+
+/* SBC imm8 */
+OP(op_sbc_imm8) {
+    u8 n = IMM8;
+    u8 res = A - n - CF;
+    ZF = res == 0;
+    NF = 1;
+    HF = ((s32)A & 0xf) - (n & 0xf) - CF < 0;
+    CF = A < n + CF;
+    A = res;
+    s->pc++;
+    return 0;
+}
+
+/* LD (0xff00 + imm8), A */
+OP(op_ldh_imm8_a) {
+    mmu_write(s, 0xff00 + IMM8, A);
+    s->pc++;
+    return 0;
+}
+
+/* LD (0xff00 + C), A */
+OP(op_ldh_c_a) {
+    mmu_write(s, 0xff00 + C, A);
+    return 0;
+}
+
+/* AND imm8 */
+OP(op_and_imm8) {
+    A = A & IMM8;
+    s->pc++;
+    ZF = A == 0;
+    NF = 0;
+    HF = 1;
+    CF = 0;
+    return 0;
+}
+
+/* ADD SP, imm8s */
+OP(op_add_sp_imm8s) {
+    u8 n = IMM8;
+    u32 res = s->sp + (s8)n;
+    ZF = 0;
+    NF = 0;
+    HF = (s->sp & 0xf) + (n & 0xf) > 0xf;
+    CF = (s->sp & 0xff) + n > 0xff;
+    s->sp = res;
+    s->pc++;
+    return 0;
+}
+
+/* LD PC, HL (or JP (HL) ) */
+OP(op_ld_pc_hl) {
+    s->pc = HL;
+    return 0;
+}
+
+/* LD (imm16), A */
+OP(op_ld_imm16_a) {
+    mmu_write(s, IMM16, A);
+    s->pc += 2;
+    return 0;
+}
+
+/* CB-prefixed extended instructions */
+OP(op_cb) {
+    u8 cb_op = mmu_read(s, s->pc++);
+    return cycles_per_instruction_cb[cb_op] +
+           cb_ops[cb_op](s, cb_op);
+}
+
+/* XOR imm8 */
+OP(op_xor_imm8) {
+    A ^= IMM8;
+    s->pc++;
+    F = A ? 0 : FLAG_Z;
+    return 0;
+}
+
+/* LD A, (0xff00 + imm8) */
+OP(op_ldh_a_imm8) {
+    A = mmu_read(s, 0xff00 + IMM8);
+    s->pc++;
+    return 0;
+}
+
+/* LD A, (0xff00 + C) */
+OP(op_ldh_a_c) {
+    A = mmu_read(s, 0xff00 + C);
+    return 0;
+}
+
+/* DI */
+OP(op_di) {
+    s->interrupts_master_enabled = 0;
+    return 0;
+}
+
+/* OR imm8 */
+OP(op_or_imm8) {
+    A |= IMM8;
+    F = A ? 0 : FLAG_Z;
+    s->pc++;
+    return 0;
+}
+
+/* LD HL, SP + imm8 */
+OP(op_ld_hl_sp_imm8) {
+    u8 n = IMM8;
+    u32 res = (u32)s->sp + (s8)n;
+    ZF = 0;
+    NF = 0;
+    HF = (s->sp & 0xf) + (n & 0xf) > 0xf;
+    CF = (s->sp & 0xff) + n > 0xff;
+    HL = (u16)res;
+    s->pc++;
+    return 0;
+}
+
+/* LD SP, HL */
+OP(op_ld_sp_hl) {
+    s->sp = HL;
+    return 0;
+}
+
+/* LD A, (imm16) */
+OP(op_ld_a_imm16) {
+    A = mmu_read(s, IMM16);
+    s->pc += 2;
+    return 0;
+}
+
+/* EI */
+OP(op_ei) {
+    s->interrupts_master_enabled = 1;
+    return 0;
+}
+
+/* CP imm8 */
+OP(op_cp_imm8) {
+    u8 n = IMM8;
+    ZF = A == n;
+    NF = 1;
+    HF = (A & 0xf) < (n & 0xf);
+    CF = A < n;
+    s->pc++;
+    return 0;
+}
+
+/* Invalid opcodes; only the -1 reports them. */
+OP(op_unknown) {
+    s->pc--;
+    return -1;
+}
+
+/* Handler of every opcode, and of every opcode after the CB prefix. */
+static const op_handler ops[256] = {
+    /* 00 */ op_nop, op_ld_reg16_imm16, op_ld_bc_a, op_inc_reg16,
+    /* 04 */ op_inc_reg8, op_dec_reg8, op_ld_reg8_imm8, op_rlca,
+    /* 08 */ op_ld_imm16_sp, op_add_hl_reg16, op_ld_a_bc, op_dec_reg16,
+    /* 0c */ op_inc_reg8, op_dec_reg8, op_ld_reg8_imm8, op_rrca,
+    /* 10 */ op_stop, op_ld_reg16_imm16, op_ld_de_a, op_inc_reg16,
+    /* 14 */ op_inc_reg8, op_dec_reg8, op_ld_reg8_imm8, op_rla,
+    /* 18 */ op_jr_off8, op_add_hl_reg16, op_ld_a_de, op_dec_reg16,
+    /* 1c */ op_inc_reg8, op_dec_reg8, op_ld_reg8_imm8, op_rra,
+    /* 20 */ op_jr_cond_off8, op_ld_reg16_imm16, op_ldi_hl_a, op_inc_reg16,
+    /* 24 */ op_inc_reg8, op_dec_reg8, op_ld_reg8_imm8, op_daa,
+    /* 28 */ op_jr_cond_off8, op_add_hl_reg16, op_ldi_a_hl, op_dec_reg16,
+    /* 2c */ op_inc_reg8, op_dec_reg8, op_ld_reg8_imm8, op_cpl,
+    /* 30 */ op_jr_cond_off8, op_ld_reg16_imm16, op_ldd_hl_a, op_inc_reg16,
+    /* 34 */ op_inc_reg8, op_dec_reg8, op_ld_reg8_imm8, op_scf,
+    /* 38 */ op_jr_cond_off8, op_add_hl_reg16, op_ldd_a_hl, op_dec_reg16,
+    /* 3c */ op_inc_reg8, op_dec_reg8, op_ld_reg8_imm8, op_ccf,
+    /* 40 */ op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8,
+    /* 44 */ op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8,
+    /* 48 */ op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8,
+    /* 4c */ op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8,
+    /* 50 */ op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8,
+    /* 54 */ op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8,
+    /* 58 */ op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8,
+    /* 5c */ op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8,
+    /* 60 */ op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8,
+    /* 64 */ op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8,
+    /* 68 */ op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8,
+    /* 6c */ op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8,
+    /* 70 */ op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8,
+    /* 74 */ op_ld_reg8_reg8, op_ld_reg8_reg8, op_halt, op_ld_reg8_reg8,
+    /* 78 */ op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8,
+    /* 7c */ op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8, op_ld_reg8_reg8,
+    /* 80 */ op_add_a_reg8, op_add_a_reg8, op_add_a_reg8, op_add_a_reg8,
+    /* 84 */ op_add_a_reg8, op_add_a_reg8, op_add_a_reg8, op_add_a_reg8,
+    /* 88 */ op_adc_a_reg8, op_adc_a_reg8, op_adc_a_reg8, op_adc_a_reg8,
+    /* 8c */ op_adc_a_reg8, op_adc_a_reg8, op_adc_a_reg8, op_adc_a_reg8,
+    /* 90 */ op_sub_reg8, op_sub_reg8, op_sub_reg8, op_sub_reg8,
+    /* 94 */ op_sub_reg8, op_sub_reg8, op_sub_reg8, op_sub_reg8,
+    /* 98 */ op_sbc_a_reg8, op_sbc_a_reg8, op_sbc_a_reg8, op_sbc_a_reg8,
+    /* 9c */ op_sbc_a_reg8, op_sbc_a_reg8, op_sbc_a_reg8, op_sbc_a_reg8,
+    /* a0 */ op_and_reg8, op_and_reg8, op_and_reg8, op_and_reg8,
+    /* a4 */ op_and_reg8, op_and_reg8, op_and_reg8, op_and_reg8,
+    /* a8 */ op_xor_reg8, op_xor_reg8, op_xor_reg8, op_xor_reg8,
+    /* ac */ op_xor_reg8, op_xor_reg8, op_xor_reg8, op_xor_reg8,
+    /* b0 */ op_or_reg8, op_or_reg8, op_or_reg8, op_or_reg8,
+    /* b4 */ op_or_reg8, op_or_reg8, op_or_reg8, op_or_reg8,
+    /* b8 */ op_cp_reg8, op_cp_reg8, op_cp_reg8, op_cp_reg8,
+    /* bc */ op_cp_reg8, op_cp_reg8, op_cp_reg8, op_cp_reg8,
+    /* c0 */ op_ret_cond, op_pop_reg16, op_jp_cond_imm16, op_jp_imm16,
+    /* c4 */ op_call_cond_imm16, op_push_reg16, op_add_a_imm8, op_rst_imm8,
+    /* c8 */ op_ret_cond, op_ret, op_jp_cond_imm16, op_cb,
+    /* cc */ op_call_cond_imm16, op_call_imm16, op_adc_imm8, op_rst_imm8,
+    /* d0 */ op_ret_cond, op_pop_reg16, op_jp_cond_imm16, op_unknown,
+    /* d4 */ op_call_cond_imm16, op_push_reg16, op_sub_imm8, op_rst_imm8,
+    /* d8 */ op_ret_cond, op_reti, op_jp_cond_imm16, op_unknown,
+    /* dc */ op_call_cond_imm16, op_unknown, op_sbc_imm8, op_rst_imm8,
+    /* e0 */ op_ldh_imm8_a, op_pop_reg16, op_ldh_c_a, op_unknown,
+    /* e4 */ op_unknown, op_push_reg16, op_and_imm8, op_rst_imm8,
+    /* e8 */ op_add_sp_imm8s, op_ld_pc_hl, op_ld_imm16_a, op_unknown,
+    /* ec */ op_unknown, op_unknown, op_xor_imm8, op_rst_imm8,
+    /* f0 */ op_ldh_a_imm8, op_pop_reg16, op_ldh_a_c, op_di,
+    /* f4 */ op_unknown, op_push_reg16, op_or_imm8, op_rst_imm8,
+    /* f8 */ op_ld_hl_sp_imm8, op_ld_sp_hl, op_ld_a_imm16, op_ei,
+    /* fc */ op_unknown, op_unknown, op_cp_imm8, op_rst_imm8,
+};
+
+static const op_handler cb_ops[256] = {
+    [0x00 ... 0x07] = cb_rlc_reg8,
+    [0x08 ... 0x0f] = cb_rrc_reg8,
+    [0x10 ... 0x17] = cb_rl_reg8,
+    [0x18 ... 0x1f] = cb_rr_reg8,
+    [0x20 ... 0x27] = cb_sla_reg8,
+    [0x28 ... 0x2f] = cb_sra_reg8,
+    [0x30 ... 0x37] = cb_swap_reg8,
+    [0x38 ... 0x3f] = cb_srl_reg8,
+    [0x40 ... 0x7f] = cb_bit_reg8,
+    [0x80 ... 0xbf] = cb_res_reg8,
+    [0xc0 ... 0xff] = cb_set_reg8,
+};
+
+int ecpu_step(struct ecpu *cpu) {
+    struct gb_state *s = &cpu->s;
     u8 op;
-    int cycles = 0, extra_cycles;
+    int extra_cycles;
 
-    op = mmu_read(s, s->pc);
-    cycles = cycles_per_instruction[op];
-    if (op == 0xcb) {
-        op = mmu_read(s, s->pc + 1);
-        cycles = cycles_per_instruction_cb[op];
-    }
+    cpu->num_mem_accesses = 0;
+    bus_start(cpu);
 
-    extra_cycles = cpu_do_instruction(s);
+    op = mmu_read(s, s->pc++);
+    extra_cycles = ops[op](s, op);
 
     if (extra_cycles < 0)
         return -1;
-    return cycles + extra_cycles;
+    return cycles_per_instruction[op] + extra_cycles;
+}
+
+int ecpu_interrupt(struct ecpu *cpu, u16 vector) {
+    struct gb_state *s = &cpu->s;
+
+    cpu->num_mem_accesses = 0;
+    bus_start(cpu);
+    s->halted = 0;
+
+    /* The timeline is that of the SM83: the opcode fetch that gets discarded,
+     * decrementing PC back, then the push. */
+    mmu_read(s, s->pc);
+    internal_cycle(s);
+    mmu_push16(s, s->pc);
+    s->pc = vector;
+    if (!(cpu->quirks & ECPU_QUIRK_IME_KEPT))
+        s->interrupts_master_enabled = 0;
+
+    /* But cpu.v takes fetch, decode, execute, two stores and writeback. */
+    return 12;
+}
+
+struct ecpu *ecpu_create(void) {
+    struct ecpu *cpu = calloc(1, sizeof(*cpu));
+    if (cpu) {
+        cpu_init_luts(&cpu->luts, &cpu->s);
+    }
+    return cpu;
 }
 
-void ecpu_init(void) {
-    cpu_init_luts(&emu_state);
+void ecpu_destroy(struct ecpu *cpu) {
+    free(cpu);
 }
@@ -3,9 +3,35 @@
 
 #include "common.h"
 
-void ecpu_init(void);
-void ecpu_reset(struct state *state);
-void ecpu_get_state(struct state *state);
-int ecpu_step(void);
+/* Instances are independent, so they can be used from different threads. */
+struct ecpu;
+
+struct ecpu *ecpu_create(void);
+void ecpu_destroy(struct ecpu *cpu);
+void ecpu_reset(struct ecpu *cpu, struct state *state);
+void ecpu_get_state(struct ecpu *cpu, struct state *state);
+int ecpu_step(struct ecpu *cpu);
+
+/* Connects the memory the CPU executes from. Without it, reads return 0xaa
+ * and writes are only recorded in the mem_accesses of the state. */
+void ecpu_set_mmu(struct ecpu *cpu, void *ctx,
+                  u8 (*read)(void *ctx, u16 addr),
+                  void (*write)(void *ctx, u16 addr, u8 val));
+
+/* Pushes PC, clears IME and jumps to vector (waking the CPU if halted), like
+ * ecpu_step() does for an instruction. Returns the number of cycles cpu.v
+ * takes to dispatch an interrupt. */
+int ecpu_interrupt(struct ecpu *cpu, u16 vector);
+
+/*
+ * Known deviations of cpu.v from the SM83. The emulated CPU follows the SM83
+ * unless told to reproduce them, which models that stand in for cpu.v do (the
+ * fast-forward of emu_sys.c and the hybrid CPU model).
+ */
+#define ECPU_QUIRK_IME_KEPT       0x01 // IME stays set on interrupt dispatch
+#define ECPU_QUIRK_PUSH_LOW_FIRST 0x02 // Pushes write the low byte first
+#define ECPU_QUIRKS_CPU_V         0x03 // All of the above
+
+void ecpu_set_quirks(struct ecpu *cpu, unsigned quirks);
 
 #endif
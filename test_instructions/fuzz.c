@@ -0,0 +1,476 @@
+/*
+ * Differential fuzzer: runs random programs on the verilated CPU and on
+ * emu_cpu.c in lockstep, comparing their state after every instruction.
+ *
+ * Unlike the table driven tests, which execute a single instruction from a
+ * clean state, this exercises dependencies between consecutive instructions,
+ * control flow, the stack, HALT and interrupts. Programs are built from the
+ * instruction tables with a PRNG seeded from the seed of the run and the
+ * number of the program, so any program can be regenerated on its own. When
+ * the CPUs diverge, the program is shrunk to a minimal one that still does.
+ *
+ * emu_cpu.c follows the SM83 here, also where cpu.v is known to deviate from
+ * it. Divergences that the known bugs (known_bugs.c) explain end the program
+ * and are counted and reported, but do not fail the run.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "fuzz.h"
+#include "disassembler.h"
+#include "vcpu.h"
+#include "emu_cpu.h"
+#include "inputstate.h"
+#include "known_bugs.h"
+
+#define MEM_SIZE 0x10000
+#define MAX_INSTS 32                // Instructions per program
+#define MAX_STEPS (4 * MAX_INSTS)   // Limit for loops
+#define INST_SIZE 4
+
+/* Throughput we aim for (of the verilated CPU, which dominates). Reported
+ * after every run, as fuzzing only finds bugs in volume. */
+#define TARGET_PROGRAMS_PER_SEC 2000
+
+/* A program is placed at address 0, one instruction after the other, in
+ * otherwise zeroed memory. */
+struct program {
+    struct state init;
+    u8 ie;
+    int irq_step;               // Step at which irq raises IF (-1 for never)
+    u8 irq;
+    int num_insts;
+    u8 len[MAX_INSTS];
+    u8 insts[MAX_INSTS][INST_SIZE];
+};
+
+struct fuzzer {
+    pthread_t thread;
+    struct vcpu *vcpu;
+    struct ecpu *ecpu;
+    u8 mem[MEM_SIZE];
+    unsigned long num_steps;
+
+    /* What the last program changed in mem, to avoid clearing all of it. */
+    u16 prog_end;
+    int num_dirty;
+    u16 dirty[MAX_STEPS * 16];
+};
+
+static struct test_inst **rows;
+static size_t num_rows;
+static bool valid_op[256], valid_op_cb[256];
+
+static u64 fuzz_seed;
+static u64 fuzz_end;
+static bool fuzz_bus_timing;
+static u64 next_program;
+static u64 first_failed_program;
+
+/* Per known bug: programs that ran into it, and the first of them. */
+static u64 known_count[NUM_KNOWN_BUGS];
+static u64 known_first[NUM_KNOWN_BUGS];
+
+
+static u64 rng_next(u64 *state) {
+    /* splitmix64 */
+    u64 z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static u8 mem_read(void *ctx, u16 addr) {
+    struct fuzzer *f = ctx;
+    return f->mem[addr];
+}
+
+/* Opcode bits that are filled in from operands by assemble(). */
+static u8 operand_mask(struct test_inst *inst) {
+    u8 mask = 0;
+    if (inst->reg8_bitpos >= 0)
+        mask |= 7 << inst->reg8_bitpos;
+    if (inst->reg8_bitpos2 >= 0)
+        mask |= 7 << inst->reg8_bitpos2;
+    if (inst->reg16_bitpos >= 0)
+        mask |= 3 << inst->reg16_bitpos;
+    if (inst->cond_bitpos >= 0)
+        mask |= 3 << inst->cond_bitpos;
+    if (inst->bit_bitpos >= 0)
+        mask |= 7 << inst->bit_bitpos;
+    return mask;
+}
+
+static void setup_rows(struct test_inst **insts, size_t num_insts) {
+    rows = calloc(num_insts, sizeof(*rows));
+    num_rows = 0;
+    for (size_t i = 0; i < num_insts; i++) {
+        struct test_inst *inst = insts[i];
+        bool *valid = inst->is_cb_prefix ? valid_op_cb : valid_op;
+
+        if (!inst->enabled)
+            continue;
+        rows[num_rows++] = inst;
+        for (int op = 0; op <= 0xff; op++)
+            if ((op & ~operand_mask(inst)) == inst->opcode)
+                valid[op] = 1;
+    }
+}
+
+static void gen_program(struct program *p, u64 num) {
+    u64 rng = fuzz_seed ^ rng_next(&num);
+
+    memset(p, 0, sizeof(*p));
+    p->init.reg16.AF = rng_next(&rng) & 0xfff0;
+    p->init.reg16.BC = rng_next(&rng);
+    p->init.reg16.DE = rng_next(&rng);
+    p->init.reg16.HL = rng_next(&rng);
+    p->init.SP = rng_next(&rng) & 1 ? 0xfffe : rng_next(&rng);
+    p->init.interrupts_master_enabled = rng_next(&rng) & 1;
+
+    p->ie = rng_next(&rng) & 0x1f;
+    p->irq_step = rng_next(&rng) & 1 ? (int)(rng_next(&rng) % MAX_STEPS) : -1;
+    p->irq = 1 << (rng_next(&rng) % 5);
+
+    p->num_insts = 1 + rng_next(&rng) % MAX_INSTS;
+    for (int i = 0; i < p->num_insts; i++) {
+        struct test_inst *inst = rows[rng_next(&rng) % num_rows];
+        struct op_state op_state;
+        struct state state;
+
+        /* Operands as the table driven tests would pick them, but with a fully
+         * random immediate half of the time. */
+        get_state(inst, 0, rng_next(&rng) % num_states(inst, 0), &op_state,
+                  &state);
+        if (rng_next(&rng) & 1)
+            op_state.imm = rng_next(&rng);
+        p->len[i] = assemble(p->insts[i], inst, &op_state);
+    }
+}
+
+/* Returns the end address of the program. */
+static u16 load_program(struct fuzzer *f, struct program *p) {
+    u16 addr = 0;
+
+    memset(f->mem, 0, f->prog_end);
+    for (int i = 0; i < f->num_dirty; i++)
+        f->mem[f->dirty[i]] = 0;
+    f->num_dirty = 0;
+
+    for (int i = 0; i < p->num_insts; i++) {
+        memcpy(&f->mem[addr], p->insts[i], p->len[i]);
+        addr += p->len[i];
+    }
+    f->prog_end = addr;
+    return addr;
+}
+
+static void dump_program(FILE *fp, struct program *p) {
+    u16 addr = 0;
+
+    fprintf(fp, " - Program -\n");
+    for (int i = 0; i < p->num_insts; i++) {
+        fprintf(fp, "%04x  ", addr);
+        for (int j = 0; j < INST_SIZE; j++)
+            if (j < p->len[i])
+                fprintf(fp, "%02x ", p->insts[i][j]);
+            else
+                fprintf(fp, "   ");
+        disassemble(fp, p->insts[i]);
+        addr += p->len[i];
+    }
+    fprintf(fp, "\nIE=%02x", p->ie);
+    if (p->irq_step >= 0)
+        fprintf(fp, ", IF |= %02x before step %d", p->irq, p->irq_step);
+    fprintf(fp, "\n\n - Input state -\n");
+    dump_state(fp, &p->init);
+}
+
+/*
+ * Runs p on both CPUs until it halts for good, jumps out of the program (into
+ * an interrupt vector, for example), runs into an opcode that is not tested,
+ * or MAX_STEPS instructions (or interrupt dispatches) have executed.
+ * Memory writes are compared as part of the state and then applied, so both
+ * CPUs always see the same memory. Returns the step at which the CPUs
+ * diverged, or -1. *known is set to the mask of the known bugs (by index) that
+ * explain the divergence, or 0. A mismatch is described in fp, if not NULL.
+ */
+static int run_program(struct fuzzer *f, struct program *p, int *known,
+                       FILE *fp) {
+    struct state cur = p->init, vcpu_state, ecpu_state;
+    int vcpu_cycles, ecpu_cycles;
+    u8 if_ = 0;
+    u16 end;
+
+    *known = 0;
+    end = load_program(f, p);
+    vcpu_reset(f->vcpu, &cur);
+    ecpu_reset(f->ecpu, &cur);
+
+    for (int step = 0; step < MAX_STEPS; step++) {
+        bool intr = 0;
+        u8 pending, op = 0;
+
+        if (step == p->irq_step)
+            if_ |= p->irq;
+        pending = p->ie & if_;
+
+        if (cur.interrupts_master_enabled && pending) {
+            int num = __builtin_ctz(pending);
+            intr = 1;
+            vcpu_set_interrupts(f->vcpu, p->ie, if_);
+            vcpu_cycles = vcpu_step(f->vcpu);
+            vcpu_set_interrupts(f->vcpu, 0, 0);
+            ecpu_cycles = ecpu_interrupt(f->ecpu, 0x40 + num * 8);
+            if_ &= ~(1 << num);
+        } else {
+            /* Without IME, cpu.v never leaves HALT. */
+            if (cur.halted || cur.PC >= end)
+                break;
+            op = f->mem[cur.PC];
+            if (op == 0xcb ? !valid_op_cb[f->mem[(u16)(cur.PC + 1)]] :
+                             !valid_op[op])
+                break;
+            vcpu_cycles = vcpu_step(f->vcpu);
+            ecpu_cycles = ecpu_step(f->ecpu);
+        }
+        f->num_steps++;
+
+        vcpu_get_state(f->vcpu, &vcpu_state);
+        ecpu_get_state(f->ecpu, &ecpu_state);
+
+        if (!states_eq(&vcpu_state, &ecpu_state) ||
+                vcpu_cycles != ecpu_cycles ||
+                (fuzz_bus_timing &&
+                 !bus_timelines_eq(&vcpu_state, &ecpu_state))) {
+            struct step s = { intr, op, &ecpu_state, ecpu_cycles,
+                              fuzz_bus_timing };
+
+            *known = known_bugs_explain(&s, &vcpu_state, vcpu_cycles);
+            if (fp) {
+                for (int i = 0; i < NUM_KNOWN_BUGS; i++)
+                    if (*known & 1 << i)
+                        fprintf(fp, "\n Known cpu.v bug: %s\n",
+                                known_bug_desc(i));
+                fprintf(fp, "\n - Diverged at step %d -\n", step);
+                dump_state(fp, &cur);
+                fprintf(fp, " - CPU output state -\n");
+                fprintf(fp, " Cycles: %d\n", vcpu_cycles);
+                dump_state(fp, &vcpu_state);
+                fprintf(fp, " - Emulated output state -\n");
+                fprintf(fp, " Cycles: %d\n", ecpu_cycles);
+                dump_state(fp, &ecpu_state);
+                if (fuzz_bus_timing) {
+                    fprintf(fp, " - CPU bus timeline -\n");
+                    dump_bus_timeline(fp, &vcpu_state);
+                    fprintf(fp, " - Emulated bus timeline -\n");
+                    dump_bus_timeline(fp, &ecpu_state);
+                }
+            }
+            return step;
+        }
+
+        for (int i = 0; i < ecpu_state.num_mem_accesses; i++) {
+            struct mem_access *access = &ecpu_state.mem_accesses[i];
+            if (access->type == MEM_ACCESS_WRITE) {
+                f->mem[access->addr] = access->val;
+                f->dirty[f->num_dirty++] = access->addr;
+            }
+        }
+        cur = ecpu_state;
+    }
+
+    return -1;
+}
+
+/* Whether p diverges other than by a known bug. */
+static bool fails(struct fuzzer *f, struct program *p) {
+    int known;
+    return run_program(f, p, &known, NULL) >= 0 && !known;
+}
+
+/* Greedily simplifies a failing program for as long as it keeps failing:
+ * removes chunks of instructions (halving the chunk size down to one) and the
+ * interrupt, and resets registers to zero. */
+static void shrink(struct fuzzer *f, struct program *p) {
+    bool progress = 1;
+
+    while (progress) {
+        struct program c;
+        progress = 0;
+
+        for (int chunk = p->num_insts; chunk >= 1; chunk /= 2) {
+            for (int i = 0; i + chunk <= p->num_insts; ) {
+                c = *p;
+                memmove(&c.len[i], &c.len[i + chunk], c.num_insts - i - chunk);
+                memmove(c.insts[i], c.insts[i + chunk],
+                        (c.num_insts - i - chunk) * INST_SIZE);
+                c.num_insts -= chunk;
+                if (fails(f, &c)) {
+                    *p = c;
+                    progress = 1;
+                } else {
+                    i += chunk;
+                }
+            }
+        }
+
+        if (p->irq_step >= 0 || p->ie) {
+            c = *p;
+            c.irq_step = -1;
+            c.ie = 0;
+            if (fails(f, &c)) {
+                *p = c;
+                progress = 1;
+            }
+        }
+
+        u16 *regs[] = { &c.init.reg16.AF, &c.init.reg16.BC, &c.init.reg16.DE,
+                        &c.init.reg16.HL };
+        for (size_t i = 0; i < sizeof(regs) / sizeof(regs[0]); i++) {
+            c = *p;
+            if (!*regs[i])
+                continue;
+            *regs[i] = 0;
+            if (fails(f, &c)) {
+                *p = c;
+                progress = 1;
+            }
+        }
+    }
+}
+
+static void *fuzz_thread(void *arg) {
+    struct fuzzer *f = arg;
+    struct program p;
+    int known;
+
+    for (;;) {
+        u64 i = __atomic_fetch_add(&next_program, 1, __ATOMIC_RELAXED);
+        if (i >= fuzz_end ||
+                i > __atomic_load_n(&first_failed_program, __ATOMIC_RELAXED))
+            break;
+
+        gen_program(&p, i);
+        if (run_program(f, &p, &known, NULL) < 0)
+            continue;
+        for (int b = 0; b < NUM_KNOWN_BUGS; b++) {
+            u64 cur = __atomic_load_n(&known_first[b], __ATOMIC_RELAXED);
+            if (!(known & 1 << b))
+                continue;
+            __atomic_fetch_add(&known_count[b], 1, __ATOMIC_RELAXED);
+            while (i < cur &&
+                   !__atomic_compare_exchange_n(&known_first[b], &cur, i,
+                       0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                ;
+        }
+        if (!known) {
+            u64 cur = __atomic_load_n(&first_failed_program, __ATOMIC_RELAXED);
+            while (i < cur &&
+                   !__atomic_compare_exchange_n(&first_failed_program, &cur, i,
+                       0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                ;
+        }
+    }
+    return NULL;
+}
+
+int fuzz(struct test_inst **insts, size_t num_insts, u64 seed, u64 first,
+         u64 end, bool bus_timing, int num_threads) {
+    struct fuzzer *fuzzers = calloc(num_threads, sizeof(*fuzzers));
+    unsigned long num_steps = 0;
+    struct timespec start, stop;
+    double secs, rate;
+    int known, ret = 0;
+
+    setup_rows(insts, num_insts);
+    fuzz_seed = seed;
+    fuzz_end = end;
+    fuzz_bus_timing = bus_timing;
+    next_program = first;
+    first_failed_program = end;
+    for (int i = 0; i < NUM_KNOWN_BUGS; i++) {
+        known_count[i] = 0;
+        known_first[i] = end;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < num_threads; i++) {
+        struct fuzzer *f = &fuzzers[i];
+        f->vcpu = vcpu_create(f->mem, sizeof(f->mem));
+        f->ecpu = ecpu_create();
+        ecpu_set_mmu(f->ecpu, f, mem_read, NULL);
+        pthread_create(&f->thread, NULL, fuzz_thread, f);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(fuzzers[i].thread, NULL);
+        num_steps += fuzzers[i].num_steps;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    if (first_failed_program < end) {
+        struct program p;
+        int orig_insts;
+
+        gen_program(&p, first_failed_program);
+        orig_insts = p.num_insts;
+        shrink(&fuzzers[0], &p);
+
+        printf("\n  === STATE MISMATCH ===\n\n");
+        printf("Program %llu of seed %llu (rerun with --fuzz --seed %llu "
+               "--range %llu:%llu), shrunk from %d to %d instructions\n\n",
+               (unsigned long long)first_failed_program,
+               (unsigned long long)seed, (unsigned long long)seed,
+               (unsigned long long)first_failed_program,
+               (unsigned long long)first_failed_program + 1,
+               orig_insts, p.num_insts);
+        dump_program(stdout, &p);
+        run_program(&fuzzers[0], &p, &known, stdout);
+        ret = 1;
+    } else {
+        secs = (stop.tv_sec - start.tv_sec) +
+               (stop.tv_nsec - start.tv_nsec) / 1e9;
+        rate = secs > 0 ? (end - first) / secs / num_threads : 0;
+        printf("Fuzzed %llu programs (%lu steps) of seed %llu in %.1f s\n",
+               (unsigned long long)(end - first), num_steps,
+               (unsigned long long)seed, secs);
+        printf("%.0f programs/s per thread (target %d)%s\n", rate,
+               TARGET_PROGRAMS_PER_SEC,
+               rate < TARGET_PROGRAMS_PER_SEC ? ", below target" : "");
+    }
+
+    for (int i = 0; i < NUM_KNOWN_BUGS; i++) {
+        if (!known_count[i])
+            continue;
+        printf("Known cpu.v bug, not counted as failure: %s\n"
+               "  %llu programs, first %llu (rerun with --fuzz --seed %llu "
+               "--range %llu:%llu)\n", known_bug_desc(i),
+               (unsigned long long)known_count[i],
+               (unsigned long long)known_first[i], (unsigned long long)seed,
+               (unsigned long long)known_first[i],
+               (unsigned long long)known_first[i] + 1);
+    }
+    /* Show the divergence when rerunning a single program for it. */
+    if (end - first == 1 && first_failed_program == end) {
+        struct program p;
+
+        gen_program(&p, first);
+        if (run_program(&fuzzers[0], &p, &known, NULL) >= 0) {
+            printf("\n");
+            dump_program(stdout, &p);
+            run_program(&fuzzers[0], &p, &known, stdout);
+        }
+    }
+
+    for (int i = 0; i < num_threads; i++) {
+        vcpu_destroy(fuzzers[i].vcpu);
+        ecpu_destroy(fuzzers[i].ecpu);
+    }
+    free(fuzzers);
+    free(rows);
+    return ret;
+}
@@ -0,0 +1,22 @@
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include <stddef.h>
+
+#include "common.h"
+
+/* Number of programs fuzzed when no range is given. */
+#define FUZZ_NUM_PROGRAMS 100000
+
+/*
+ * Runs the random programs [first, end) generated from seed on both CPUs in
+ * lockstep, on num_threads threads. Programs consist of the enabled ones of
+ * the num_insts table rows in insts. With bus_timing, the bus timelines of
+ * every step are compared as well. On a mismatch, the first failing program
+ * is shrunk and reported. Returns non-zero on mismatch; divergences explained
+ * by known cpu.v bugs (see fuzz.c) are only reported.
+ */
+int fuzz(struct test_inst **insts, size_t num_insts, u64 seed, u64 first,
+         u64 end, bool bus_timing, int num_threads);
+
+#endif
@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""
+Generates the lane-parallel test bench for vlanes.cpp:
+
+ - cpu_lanes.v: a module with N independent instances of cpu.v (lane0 ...)
+   sharing one clock, each with its own memory ports;
+ - cpu_lanes.h: NUM_LANES and FOR_EACH_LANE(X), which expands X(i) for every
+   lane, so the C++ side can name the ports and internals of each instance.
+
+Usage: gen_lanes.py N outdir
+"""
+
+import os
+import sys
+
+
+def gen_verilog(n):
+    out = ["// Generated by gen_lanes.py, do not edit.",
+           "/* verilator lint_off PINCONNECTEMPTY */",
+           "",
+           "module cpu_lanes (",
+           "    input clk,"]
+    ports = []
+    for i in range(n):
+        ports += ["    output [15:0] lane%d_mem_addr" % i,
+                  "    output [7:0] lane%d_mem_data_write" % i,
+                  "    input [7:0] lane%d_mem_data_read" % i,
+                  "    output lane%d_mem_do_write" % i]
+    out.append(",\n".join(ports))
+    out += [");", ""]
+
+    for i in range(n):
+        out += ["cpu lane%d (" % i,
+                "    .clk(clk),",
+                "    .reset(1'b0),",
+                "    .mem_addr(lane%d_mem_addr)," % i,
+                "    .mem_data_write(lane%d_mem_data_write)," % i,
+                "    .mem_data_read(lane%d_mem_data_read)," % i,
+                "    .mem_do_write(lane%d_mem_do_write)," % i,
+                "    .interrupts_enabled(5'b0),",
+                "    .interrupts_request(5'b0),",
+                "    .interrupts_ack(),",
+                "    .cpu_is_halted(),",
+                "    .dbg_pc(),",
+                "    .dbg_sp(),",
+                "    .dbg_AF(),",
+                "    .dbg_BC(),",
+                "    .dbg_DE(),",
+                "    .dbg_HL(),",
+                "    .dbg_instruction_retired(),",
+                "    .dbg_last_opcode(),",
+                "    .dbg_stage(),",
+                "    .dbg_perf_sel(4'd0),",
+                "    .dbg_perf_count()",
+                ");",
+                ""]
+
+    out.append("endmodule")
+    return "\n".join(out) + "\n"
+
+
+def gen_header(n):
+    lanes = " \\\n".join("    X(%d)" % i for i in range(n))
+    return ("/* Generated by gen_lanes.py, do not edit. */\n"
+            "#define NUM_LANES %d\n"
+            "#define FOR_EACH_LANE(X) \\\n%s\n" % (n, lanes))
+
+
+def main():
+    if len(sys.argv) != 3 or not sys.argv[1].isdigit() or int(sys.argv[1]) < 1:
+        sys.exit("Usage: %s N outdir" % sys.argv[0])
+    n = int(sys.argv[1])
+    outdir = sys.argv[2]
+
+    with open(os.path.join(outdir, "cpu_lanes.v"), "w") as f:
+        f.write(gen_verilog(n))
+    with open(os.path.join(outdir, "cpu_lanes.h"), "w") as f:
+        f.write(gen_header(n))
+
+
+if __name__ == "__main__":
+    main()
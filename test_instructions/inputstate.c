@@ -1,124 +1,272 @@
-#include <stdlib.h>
-#include <assert.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "inputstate.h"
 
-static size_t array_u8_find(u8 elem, u8 *arr, size_t size) {
-    for (size_t i = 0; i < size; i++)
-        if (arr[i] == elem)
-            return i;
-    assert(0 && "Element not found");
-    return -1;
+/*
+ * Every permutation of an instruction's operands and input state has an index:
+ * each varied operand is a digit of a mixed-radix number, least significant
+ * first in the order below. This allows jumping straight to any permutation,
+ * so a test run can be split up or resumed.
+ *
+ * Normally only a few edge values of every register and immediate are tested.
+ * In exhaustive mode, rows marked for it in the instruction table instead get
+ * all 16 flag combinations and all 256 values of A and/or their 8-bit operand.
+ * A register operand is set up by loading the same value into B, C, D, E, H and
+ * L (and A for EX_OP), so the register selected by the opcode does not matter.
+ * For (HL), HL points to the value at MEM_OPERAND_ADDR instead. An operand that
+ * is A when A is swept anyway (EX_A_OP) has nothing left to sweep, so the
+ * register digit counts the operand values along with the registers.
+ */
+
+static const u8 vals_flags_full[] = { 0x00, 0x10, 0x20, 0x40, 0x80 };
+static const u8 vals_flags_simple[] = { 0x00, 0xf0 };
+static const u8 vals8[] = { 0x00, 0x01, 0x0f, 0x10, 0xef, 0xf0, 0xff };
+static const u16 vals16[] = { 0x0000, 0x0001, 0x000f, 0x0010, 0x00ff, 0x0100,
+                              0x0fff, 0x1000, 0xffff };
+
+#define LEN(arr) (sizeof(arr) / sizeof(arr[0]))
+
+enum digit {
+    D_IME, D_F, D_A, D_BC, D_DE, D_HL, D_SP, D_IMM,
+    D_COND, D_REG16, D_REG8, D_REG8_2, D_BIT,
+    NUM_DIGITS
+};
+
+#define REG8_HL 6
+#define REG8_A  7
+
+/* Number of values of the 8-bit operand swept in exhaustive mode for register
+ * reg8. */
+static unsigned num_opvals(struct test_inst *inst, int reg8) {
+    return inst->exhaustive == EX_A_OP && reg8 == REG8_A ? 1 : 256;
+}
+
+static void get_radices(struct test_inst *inst, bool exhaustive,
+        unsigned *radix) {
+    radix[D_IME] = inst->test_IME ? 2 : 1;
+    radix[D_F] = inst->test_F ? LEN(vals_flags_full) : LEN(vals_flags_simple);
+    radix[D_A] = LEN(vals8);
+    radix[D_BC] = inst->test_BC ? LEN(vals16) : 1;
+    radix[D_DE] = inst->test_DE ? LEN(vals16) : 1;
+    radix[D_HL] = inst->test_HL ? LEN(vals16) : 1;
+    radix[D_SP] = inst->test_SP ? LEN(vals16) : 1;
+    radix[D_IMM] = inst->imm_size == 1 ? LEN(vals8) :
+                   inst->imm_size == 2 ? LEN(vals16) : 1;
+    radix[D_COND] = inst->cond_bitpos != -1 ? 4 : 1;
+    radix[D_REG16] = inst->reg16_bitpos != -1 ? 4 : 1;
+    radix[D_REG8] = inst->reg8_bitpos != -1 ? 8 : 1;
+    radix[D_REG8_2] = inst->reg8_bitpos2 != -1 ? 8 : 1;
+    radix[D_BIT] = inst->bit_bitpos != -1 ? 8 : 1;
+
+    if (exhaustive && inst->exhaustive != EX_NONE) {
+        radix[D_F] = 16;
+        radix[D_A] = inst->exhaustive == EX_A_OP ? 256 : 1;
+        radix[D_BC] = radix[D_DE] = radix[D_HL] = 1;
+        if (inst->reg8_bitpos != -1) {
+            radix[D_REG8] = 0;
+            for (int reg8 = 0; reg8 < 8; reg8++)
+                radix[D_REG8] += num_opvals(inst, reg8);
+        }
+        if (inst->imm_size == 1)
+            radix[D_IMM] = 256;
+    }
 }
 
-static size_t array_u16_find(u16 elem, u16 *arr, size_t size) {
-    for (size_t i = 0; i < size; i++)
-        if (arr[i] == elem)
-            return i;
-    assert(0 && "Element not found");
-    return -1;
+u64 num_states(struct test_inst *inst, bool exhaustive) {
+    unsigned radix[NUM_DIGITS];
+    u64 n = 1;
+
+    get_radices(inst, exhaustive, radix);
+    for (int i = 0; i < NUM_DIGITS; i++)
+        n *= radix[i];
+    return n;
 }
 
-static int next_flags(bool test_individually, u8 *val) {
-    u8 vals_full[] = { 0x00, 0x10, 0x20, 0x40, 0x80 };
-    u8 vals_simple[] = { 0x00, 0xf0 };
-    u8 *vals;
-    size_t len;
-    size_t idx;
-
-    if (test_individually) {
-        vals = vals_full;
-        len = sizeof(vals_full);
-    } else {
-        vals = vals_simple;
-        len = sizeof(vals_simple);
+void get_state(struct test_inst *inst, bool exhaustive, u64 idx,
+        struct op_state *op_state, struct state *state) {
+    unsigned radix[NUM_DIGITS], d[NUM_DIGITS];
+
+    get_radices(inst, exhaustive, radix);
+    for (int i = 0; i < NUM_DIGITS; i++) {
+        d[i] = idx % radix[i];
+        idx /= radix[i];
     }
 
-    idx = array_u8_find(*val, vals, len);
+    memset(op_state, 0, sizeof(*op_state));
+    memset(state, 0, sizeof(*state));
+
+    state->interrupts_master_enabled = d[D_IME];
+    state->SP = vals16[d[D_SP]];
+    op_state->cond = d[D_COND];
+    op_state->reg16 = d[D_REG16];
+    op_state->reg8 = d[D_REG8];
+    op_state->reg8_2 = d[D_REG8_2];
+    op_state->bit = d[D_BIT];
 
-    if (idx == len - 1)
-        *val = vals[0];
-    else
-        *val = vals[idx + 1];
+    if (exhaustive && inst->exhaustive != EX_NONE) {
+        unsigned val = 0;
 
-    return idx != len - 1;
+        /* Split the register digit into the register and operand value. */
+        if (inst->reg8_bitpos != -1) {
+            val = d[D_REG8];
+            for (op_state->reg8 = 0; val >= num_opvals(inst, op_state->reg8);
+                 op_state->reg8++)
+                val -= num_opvals(inst, op_state->reg8);
+        }
+
+        state->reg8.F = d[D_F] << 4;
+        state->reg8.A = inst->exhaustive == EX_A_OP ? d[D_A] : val;
+        state->reg8.B = state->reg8.C = val;
+        state->reg8.D = state->reg8.E = val;
+        state->reg8.H = state->reg8.L = val;
+        if (inst->reg8_bitpos != -1 && op_state->reg8 == REG8_HL) {
+            state->reg16.HL = MEM_OPERAND_ADDR;
+            op_state->mem_operand = 1;
+            op_state->mem_val = val;
+        }
+        op_state->imm = inst->imm_size == 1 ? d[D_IMM] : vals16[d[D_IMM]];
+        return;
+    }
+
+    state->reg8.F = inst->test_F ? vals_flags_full[d[D_F]] :
+                                   vals_flags_simple[d[D_F]];
+    state->reg8.A = vals8[d[D_A]];
+    state->reg16.BC = vals16[d[D_BC]];
+    state->reg16.DE = vals16[d[D_DE]];
+    state->reg16.HL = vals16[d[D_HL]];
+    op_state->imm = inst->imm_size == 1 ? vals8[d[D_IMM]] : vals16[d[D_IMM]];
 }
 
-static int next_val8(u8 *val) {
-    u8 vals[] = { 0x00, 0x01, 0x0f, 0x10, 0xef, 0xf0, 0xff };
-    size_t len = sizeof(vals);
-    size_t idx;
+int assemble(u8 *out, struct test_inst *inst, struct op_state *op_state) {
+    u8 opcode = inst->opcode;
+    int idx = 0;
 
-    idx = array_u8_find(*val, vals, len);
+    if (inst->reg8_bitpos >= 0)
+        opcode |= op_state->reg8 << inst->reg8_bitpos;
+    if (inst->reg8_bitpos2 >= 0)
+        opcode |= op_state->reg8_2 << inst->reg8_bitpos2;
+    if (inst->reg16_bitpos >= 0)
+        opcode |= op_state->reg16 << inst->reg16_bitpos;
+    if (inst->cond_bitpos >= 0)
+        opcode |= op_state->cond << inst->cond_bitpos;
+    if (inst->bit_bitpos >= 0)
+        opcode |= op_state->bit << inst->bit_bitpos;
 
-    if (idx == len - 1)
-        *val = vals[0];
-    else
-        *val = vals[idx + 1];
+    if (inst->is_cb_prefix)
+        out[idx++] = 0xcb;
 
-    return idx != len - 1;
-}
+    out[idx++] = opcode;
 
-static int next_val16(bool enabled, u16 *val) {
-    u16 vals[] = { 0x0000, 0x0001, 0x000f, 0x0010, 0x00ff, 0x0100, 0x0fff, 0x1000, 0xffff };
-    size_t len = sizeof(vals) / sizeof(vals[0]);
-    size_t idx;
+    if (inst->imm_size >= 1)
+        out[idx++] = op_state->imm & 0xff;
+    if (inst->imm_size >= 2)
+        out[idx++] = (op_state->imm >> 8) & 0xff;
 
-    if (!enabled)
-        return 0;
+    if (op_state->mem_operand)
+        out[MEM_OPERAND_ADDR] = op_state->mem_val;
 
-    idx = array_u16_find(*val, vals, len);
+    return idx;
+}
 
-    if (idx == len - 1)
-        *val = vals[0];
-    else
-        *val = vals[idx + 1];
+void dump_state(FILE *fp, struct state *state) {
+    fprintf(fp, " PC   SP   AF   BC   DE   HL  ZNHC hlt IME\n"
+            "%04x %04x %04x %04x %04x %04x %d%d%d%d  %d   %d\n",
+            state->PC, state->SP, state->reg16.AF, state->reg16.BC,
+            state->reg16.DE, state->reg16.HL,
+            BIT(state->reg16.AF, 7), BIT(state->reg16.AF, 6),
+            BIT(state->reg16.AF, 5), BIT(state->reg16.AF, 4), state->halted,
+            state->interrupts_master_enabled);
 
-    return idx != len - 1;
+    for (int i = 0; i < state->num_mem_accesses; i++)
+        fprintf(fp, "  Mem %s: addr=%04x val=%02x\n",
+                state->mem_accesses[i].type ? "write" : "read",
+                state->mem_accesses[i].addr, state->mem_accesses[i].val);
+    fprintf(fp, "\n");
 }
 
-static int next_bool(bool enabled, bool *val) {
-    if (!enabled)
-        return 0;
+void dump_op_state(FILE *fp, struct test_inst *inst,
+        struct op_state *op_state) {
+    const char *reg8_names[] = { "B", "C", "D", "E", "H", "L", "(HL)", "A" };
+    const char *reg16_names[] = { "BC", "DE", "HL", "SP/AF" };
+    const char *cond_names[] = { "NZ", "Z", "NC", "C" };
+
+    if (inst->imm_size == 1)
+        fprintf(fp, "imm: %02x\n", op_state->imm);
+    else if (inst->imm_size == 2)
+        fprintf(fp, "imm: %04x\n", op_state->imm);
+
+    if (inst->reg8_bitpos != -1)
+        fprintf(fp, "r8: %s (%d)\n", reg8_names[op_state->reg8], op_state->reg8);
+
+    if (op_state->mem_operand)
+        fprintf(fp, "(HL): %02x\n", op_state->mem_val);
+
+    if (inst->reg8_bitpos2 != -1)
+        fprintf(fp, "r8: %s (%d)\n", reg8_names[op_state->reg8_2], op_state->reg8_2);
+
+    if (inst->reg16_bitpos != -1)
+        fprintf(fp, "r16: %s (%d)\n", reg16_names[op_state->reg16], op_state->reg16);
 
-    *val = !*val;
+    if (inst->cond_bitpos != -1)
+        fprintf(fp, "cond: %s (%d)\n", cond_names[op_state->cond], op_state->cond);
 
-    return *val == 0;
+    if (inst->bit_bitpos != -1)
+        fprintf(fp, "bit: %d\n", op_state->bit);
 }
 
-static int next_oper(bool enabled, int lim, int *val) {
-    if (!enabled)
-        return 0;
+/* Whether both made the same writes, in any order: the order is part of the
+ * bus timeline (bus_timelines_eq), not of the end state. */
+static int writes_eq(struct state *s1, struct state *s2) {
+    bool matched[16] = { 0 };
 
-    if (++(*val) == lim) {
-        *val = 0;
+    if (s1->num_mem_accesses != s2->num_mem_accesses)
         return 0;
+    for (int i = 0; i < s1->num_mem_accesses; i++) {
+        struct mem_access *a1 = &s1->mem_accesses[i];
+        int j;
+        for (j = 0; j < s2->num_mem_accesses; j++) {
+            struct mem_access *a2 = &s2->mem_accesses[j];
+            if (!matched[j] && a1->type == a2->type && a1->addr == a2->addr &&
+                    a1->val == a2->val)
+                break;
+        }
+        if (j == s2->num_mem_accesses)
+            return 0;
+        matched[j] = 1;
     }
     return 1;
 }
 
-static int next_imm(int imm_size, u16 *val) {
-    if (imm_size == 0)
-        return 0;
-    else if (imm_size == 1)
-        return next_val8((u8*)val);
-    else
-        return next_val16(1, val);
+int states_eq(struct state *s1, struct state *s2) {
+    return s1->reg16.AF == s2->reg16.AF &&
+           s1->reg16.BC == s2->reg16.BC &&
+           s1->reg16.DE == s2->reg16.DE &&
+           s1->reg16.HL == s2->reg16.HL &&
+           s1->PC == s2->PC &&
+           s1->SP == s2->SP &&
+           s1->halted == s2->halted &&
+           s1->interrupts_master_enabled == s2->interrupts_master_enabled &&
+           writes_eq(s1, s2);
+}
+
+void dump_bus_timeline(FILE *fp, struct state *state) {
+    for (int i = 0; i < state->num_bus_accesses; i++) {
+        struct bus_access *access = &state->bus_accesses[i];
+        fprintf(fp, "  M%d %-5s addr=%04x val=%02x\n", access->cycle,
+                access->type ? "write" : "read", access->addr, access->val);
+    }
+    fprintf(fp, "\n");
 }
 
-int next_state(struct test_inst *inst, struct op_state *op_state,
-        struct state *state) {
-    return next_bool(inst->test_IME, &state->interrupts_master_enabled) ? 0 :
-           next_flags(inst->test_F, &state->reg8.F) ? 0 :
-           next_val8(&state->reg8.A) ? 0 :
-           next_val16(inst->test_BC, &state->reg16.BC) ? 0 :
-           next_val16(inst->test_DE, &state->reg16.DE) ? 0 :
-           next_val16(inst->test_HL, &state->reg16.HL) ? 0 :
-           next_val16(inst->test_SP, &state->SP) ? 0 :
-           next_imm(inst->imm_size, &op_state->imm) ? 0 :
-           next_oper(inst->cond_bitpos != -1, 4, &op_state->cond) ? 0 :
-           next_oper(inst->reg16_bitpos != -1, 4, &op_state->reg16) ? 0 :
-           next_oper(inst->reg8_bitpos != -1, 8, &op_state->reg8) ? 0 :
-           next_oper(inst->reg8_bitpos2 != -1, 8, &op_state->reg8_2) ? 0 :
-           next_oper(inst->bit_bitpos != -1, 8, &op_state->bit) ? 0 : 1;
+int bus_timelines_eq(struct state *s1, struct state *s2) {
+    if (s1->num_bus_accesses != s2->num_bus_accesses)
+        return 0;
+    for (int i = 0; i < s1->num_bus_accesses; i++) {
+        struct bus_access *a1 = &s1->bus_accesses[i], *a2 = &s2->bus_accesses[i];
+        if (a1->cycle != a2->cycle || a1->type != a2->type ||
+                a1->addr != a2->addr || a1->val != a2->val)
+            return 0;
+    }
+    return 1;
 }
@@ -1,16 +1,46 @@
 #ifndef INPUTSTATE_H
 #define INPUTSTATE_H
 
+#include <stdio.h>
+
 #include "common.h"
 
 /* Describes state of operands, which can be used during assembly. */
 struct op_state {
     int reg8, reg8_2, reg16, cond, bit;
     u16 imm;
+    bool mem_operand;   // mem_val goes to MEM_OPERAND_ADDR, HL points there
+    u8 mem_val;
 };
 
-int next_state(struct test_inst *inst,
-               struct op_state *op_state,
-               struct state *state);
+/* Where the (HL) operand of exhaustive mode is, after the instruction (at most
+ * 2 bytes for the instructions with one). */
+#define MEM_OPERAND_ADDR 3
+
+/* Version of the permutations get_state() generates. Bump it whenever they
+ * change, so earlier results are not reused for them (see cache.h). */
+#define GENERATOR_VERSION 2
+
+/* Number of permutations of operands and input state tested for inst, either
+ * normally or in exhaustive mode. */
+u64 num_states(struct test_inst *inst, bool exhaustive);
+
+/* Sets up permutation idx (0 <= idx < num_states(inst, exhaustive)), in O(1). */
+void get_state(struct test_inst *inst, bool exhaustive, u64 idx,
+               struct op_state *op_state, struct state *state);
+
+/* Encodes inst with the given operands into out (up to 3 bytes, plus the CB
+ * prefix), and returns its length. A memory operand is stored at
+ * out[MEM_OPERAND_ADDR], so out needs 4 bytes for those. */
+int assemble(u8 *out, struct test_inst *inst, struct op_state *op_state);
+
+void dump_state(FILE *fp, struct state *state);
+void dump_op_state(FILE *fp, struct test_inst *inst, struct op_state *op_state);
+int states_eq(struct state *s1, struct state *s2);
+
+/* Prints the bus accesses of state, one per line with their M-cycle. */
+void dump_bus_timeline(FILE *fp, struct state *state);
+/* Whether both states saw the same accesses at the same M-cycles. */
+int bus_timelines_eq(struct state *s1, struct state *s2);
 
 #endif
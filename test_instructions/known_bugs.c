@@ -0,0 +1,110 @@
+/*
+ * Known deviations of cpu.v from the SM83, see known_bugs.h.
+ *
+ * Each fix() gets the verilated CPU's output of a step and, where the
+ * deviation shows in it, changes that to what the SM83 does; it returns
+ * whether it changed anything. A divergence that is gone after all fixes is
+ * explained by the bugs that made them.
+ */
+
+#include "known_bugs.h"
+#include "inputstate.h"
+
+struct known_bug {
+    const char *desc;
+    bool (*fix)(struct step *s, struct state *vcpu);
+};
+
+static bool fix_ime_kept(struct step *s, struct state *vcpu) {
+    if (!s->intr || !vcpu->interrupts_master_enabled)
+        return 0;
+    vcpu->interrupts_master_enabled = 0;
+    return 1;
+}
+
+static bool same_access(struct bus_access *a1, struct bus_access *a2) {
+    return a1->type == a2->type && a1->addr == a2->addr && a1->val == a2->val;
+}
+
+/*
+ * PUSH, CALL, CALL cc, RST and interrupt dispatch. The SM83 writes the high
+ * byte of the pushed word, then the low one, in two adjacent M-cycles; cpu.v
+ * writes them the other way around, possibly one M-cycle earlier as it leaves
+ * out the internal one before them. Everything else on the bus has to be the
+ * same.
+ */
+static bool fix_push_order(struct step *s, struct state *vcpu) {
+    bool push = s->intr || (s->op & 0xcf) == 0xc5 || s->op == 0xcd ||
+                (s->op & 0xe7) == 0xc4 || (s->op & 0xc7) == 0xc7;
+    struct bus_access *v = vcpu->bus_accesses, *e = s->ecpu->bus_accesses;
+    int n = vcpu->num_bus_accesses, k, shift;
+
+    if (!push || !s->bus_timing || n != s->ecpu->num_bus_accesses ||
+            bus_timelines_eq(vcpu, s->ecpu))
+        return 0;
+
+    /* The first write in emu_cpu.c's timeline, and the one after it. */
+    for (k = 0; k < n && e[k].type != MEM_ACCESS_WRITE; k++)
+        ;
+    if (k + 1 >= n || e[k + 1].type != MEM_ACCESS_WRITE ||
+            e[k + 1].cycle != e[k].cycle + 1 ||
+            e[k + 1].addr != (u16)(e[k].addr - 1) ||
+            !same_access(&v[k], &e[k + 1]) || !same_access(&v[k + 1], &e[k]) ||
+            v[k + 1].cycle != v[k].cycle + 1)
+        return 0;
+    shift = e[k].cycle - v[k].cycle;
+    if (shift != 0 && shift != 1)
+        return 0;
+    for (int i = 0; i < n; i++)
+        if (i != k && i != k + 1 &&
+                (!same_access(&v[i], &e[i]) || v[i].cycle != e[i].cycle))
+            return 0;
+
+    for (int i = k; i < k + 2; i++)
+        vcpu->bus_accesses[i] = e[i];
+    return 1;
+}
+
+/* RET cc, when taken: the SM83 spends an M-cycle checking the condition after
+ * the fetch, cpu.v does not, so its pops are one M-cycle earlier. */
+static bool fix_ret_cc(struct step *s, struct state *vcpu) {
+    struct bus_access *v = vcpu->bus_accesses, *e = s->ecpu->bus_accesses;
+    int n = vcpu->num_bus_accesses;
+
+    if (s->intr || (s->op & 0xe7) != 0xc0 || !s->bus_timing ||
+            n != s->ecpu->num_bus_accesses || bus_timelines_eq(vcpu, s->ecpu))
+        return 0;
+    for (int i = 0; i < n; i++)
+        if (!same_access(&v[i], &e[i]) ||
+                v[i].cycle != e[i].cycle - (i ? 1 : 0))
+            return 0;
+
+    for (int i = 1; i < n; i++)
+        vcpu->bus_accesses[i].cycle++;
+    return 1;
+}
+
+static const struct known_bug known_bugs[NUM_KNOWN_BUGS] = {
+    { "IME stays set on interrupt dispatch", fix_ime_kept },
+    { "pushes store the low byte first, right after execute",
+      fix_push_order },
+    { "RET cc has no M-cycle for the condition check", fix_ret_cc },
+};
+
+const char *known_bug_desc(int bug) {
+    return known_bugs[bug].desc;
+}
+
+int known_bugs_explain(struct step *s, struct state *vcpu, int vcpu_cycles) {
+    struct state fixed = *vcpu;
+    int fixed_by = 0;
+
+    for (int i = 0; i < NUM_KNOWN_BUGS; i++)
+        if (known_bugs[i].fix(s, &fixed))
+            fixed_by |= 1 << i;
+    if (fixed_by && states_eq(&fixed, s->ecpu) &&
+            vcpu_cycles == s->ecpu_cycles &&
+            (!s->bus_timing || bus_timelines_eq(&fixed, s->ecpu)))
+        return fixed_by;
+    return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef KNOWN_BUGS_H
+#define KNOWN_BUGS_H
+
+#include "common.h"
+
+/*
+ * Known deviations of cpu.v from the SM83, which emu_cpu.c follows. The table
+ * driven tests and the fuzzer (fuzz.c) both check a divergence of the two
+ * CPUs against them, and count and report the ones they explain without
+ * failing. Remove an entry from known_bugs.c once cpu.v is fixed.
+ */
+
+#define NUM_KNOWN_BUGS 3
+
+/* A step as the known bugs see it: an interrupt dispatch or the instruction
+ * op, what emu_cpu.c made of it, and whether bus timelines are compared. */
+struct step {
+    bool intr;
+    u8 op;
+    struct state *ecpu;
+    int ecpu_cycles;
+    bool bus_timing;
+};
+
+/* Description of a bug, by index. */
+const char *known_bug_desc(int bug);
+
+/* Returns the mask of the known bugs (1 << index) that together explain how
+ * the verilated CPU's output vcpu and vcpu_cycles of step s diverge from
+ * emu_cpu.c's, or 0 if they do not. */
+int known_bugs_explain(struct step *s, struct state *vcpu, int vcpu_cycles);
+
+#endif
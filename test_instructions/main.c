@@ -1,207 +1,437 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
 
 #include "common.h"
 #include "disassembler.h"
 #include "vcpu.h"
+#include "vlanes.h"
+#include "bench.h"
 #include "emu_cpu.h"
 #include "inputstate.h"
+#include "fuzz.h"
+#include "cache.h"
+#include "report.h"
+#include "known_bugs.h"
 #include "instructions.h"
 
 bool output_summarize = 1;
 bool enable_cb = 0;
+bool exhaustive = 0;
+bool use_lanes = 0;
+const char *cache_path = NULL;  // Results of earlier runs, see cache.h
+bool force = 0;                 // Ignore them
+bool keep_going = 0;            // Test everything despite mismatches
+bool bus_timing = 0;            // Also compare when memory is accessed
+const char *json_path = NULL;   // Reports to write, see report.h
+const char *junit_path = NULL;
 
-u8 instruction_mem[4];
-
-unsigned long num_tests = 0;
 bool tested_op[256] = { 0 };
 bool tested_op_cb[256] = { 0 };
 
+/*
+ * All permutations of all table rows (instructions, then CB instructions) are
+ * numbered consecutively, so any part of a test run can be selected by a range
+ * of permutation indices (--range, --shard).
+ *
+ * The selected permutations are tested in parallel: they are split into units
+ * of at most UNIT_STATES permutations of one row, handed out to worker threads
+ * in order. Results are kept per unit and reported in table order afterwards,
+ * so the output does not depend on the number of threads or their scheduling.
+ */
+#define UNIT_STATES 4096
+
+struct row {
+    struct test_inst *inst;
+    u64 first_state;            // Index of its first permutation
+    size_t first_unit, num_units;
+};
+
+struct unit {
+    struct test_inst *inst;
+    u64 first_state;            // Index of first permutation of this unit
+    u64 first, count;           // Permutations of inst in this unit
+
+    unsigned long num_tests;
+    bool tested_op[256];        // Opcodes (after the CB prefix, if any)
+    u64 cycles;                 // Simulated by the verilated CPU
+    double seconds;
+    bool done;
+    bool cached;                // Passed in an earlier run
+    bool failed;
+    unsigned long num_mismatches;
+    char *report;               // Report of the first mismatch, if failed
+
+    /* Per known cpu.v bug: permutations it explains, and the first of them. */
+    unsigned long known_count[NUM_KNOWN_BUGS];
+    u64 known_first[NUM_KNOWN_BUGS];
+};
+
+struct worker {
+    pthread_t thread;
+    struct vcpu *vcpu;
+    struct vlanes *vlanes;      // Instead of vcpu, with --lanes
+    struct lane_test *lane_tests;
+    struct ecpu *ecpu;
+    u8 instruction_mem[4];
+};
+
+static struct row *rows;
+static size_t num_rows;
+static struct unit *units;
+static size_t num_units;
+static size_t next_unit;
+static size_t first_failed_unit;
+
+/* Selected permutations, and progress through them for resuming. */
+static u64 range_start, range_end;
+static size_t num_done_units;
+static time_t last_progress;
+static pthread_mutex_t progress_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
-void dump_state(struct state *state) {
-    printf(" PC   SP   AF   BC   DE   HL  ZNHC hlt IME\n"
-            "%04x %04x %04x %04x %04x %04x %d%d%d%d  %d   %d\n",
-            state->PC, state->SP, state->reg16.AF, state->reg16.BC,
-            state->reg16.DE, state->reg16.HL,
-            BIT(state->reg16.AF, 7), BIT(state->reg16.AF, 6),
-            BIT(state->reg16.AF, 5), BIT(state->reg16.AF, 4), state->halted,
-            state->interrupts_master_enabled);
-
-    for (int i = 0; i < state->num_mem_accesses; i++)
-        printf("  Mem %s: addr=%04x val=%02x\n",
-                state->mem_accesses[i].type ? "write" : "read",
-                state->mem_accesses[i].addr, state->mem_accesses[i].val);
-    printf("\n");
+static u8 test_mem_read(void *ctx, u16 addr) {
+    struct worker *w = ctx;
+    return addr < sizeof(w->instruction_mem) ? w->instruction_mem[addr] : 0xaa;
 }
 
-void dump_op_state(struct test_inst *inst, struct op_state *op_state) {
-    const char *reg8_names[] = { "B", "C", "D", "E", "H", "L", "(HL)", "A" };
-    const char *reg16_names[] = { "BC", "DE", "HL", "SP/AF" };
-    const char *cond_names[] = { "NZ", "Z", "NC", "C" };
+/* Runs the instruction in instruction_mem on the emulated CPU and compares
+ * the result to that of the verilated CPU. Mismatches that known cpu.v bugs
+ * explain are only counted in the unit. */
+static int check_state(struct worker *w, struct unit *unit, u64 idx,
+        struct state *state, struct state *vcpu_out_state, int vcpu_cycles) {
+    struct state ecpu_out_state;
+    int ecpu_cycles;
+
+    unit->cycles += vcpu_cycles;
+    ecpu_reset(w->ecpu, state);
+    ecpu_cycles = ecpu_step(w->ecpu);
+    ecpu_get_state(w->ecpu, &ecpu_out_state);
+
+    if (!states_eq(vcpu_out_state, &ecpu_out_state) ||
+            vcpu_cycles != ecpu_cycles ||
+            (bus_timing && !bus_timelines_eq(vcpu_out_state, &ecpu_out_state))) {
+        struct step s = { 0, w->instruction_mem[0], &ecpu_out_state,
+                          ecpu_cycles, bus_timing };
+        int known = known_bugs_explain(&s, vcpu_out_state, vcpu_cycles);
+        size_t len;
+        FILE *fp;
+
+        if (known) {
+            for (int i = 0; i < NUM_KNOWN_BUGS; i++)
+                if (known & 1 << i && !unit->known_count[i]++)
+                    unit->known_first[i] = idx;
+            return 0;
+        }
 
-    if (inst->imm_size == 1)
-        printf("imm: %02x\n", op_state->imm);
-    else if (inst->imm_size == 2)
-        printf("imm: %04x\n", op_state->imm);
+        if (unit->num_mismatches++)
+            return 1;
 
-    if (inst->reg8_bitpos != -1)
-        printf("r8: %s (%d)\n", reg8_names[op_state->reg8], op_state->reg8);
+        fp = open_memstream(&unit->report, &len);
+        fprintf(fp, "\n  === STATE MISMATCH ===\n");
+        fprintf(fp, "\n Permutation %llu (rerun with --range %llu:%llu)\n",
+                (unsigned long long)idx, (unsigned long long)idx,
+                (unsigned long long)idx + 1);
+        fprintf(fp, "\n - Instruction -\n");
+        disassemble(fp, w->instruction_mem);
+        fprintf(fp, "\n - Input state -\n");
+        dump_state(fp, state);
+        fprintf(fp, "\n - CPU output state -\n");
+        fprintf(fp, " Cycles: %d\n", vcpu_cycles);
+        dump_state(fp, vcpu_out_state);
+        fprintf(fp, "\n - Emulated output state -\n");
+        fprintf(fp, " Cycles: %d\n", ecpu_cycles);
+        dump_state(fp, &ecpu_out_state);
+        if (bus_timing) {
+            fprintf(fp, " - CPU bus timeline -\n");
+            dump_bus_timeline(fp, vcpu_out_state);
+            fprintf(fp, " - Emulated bus timeline -\n");
+            dump_bus_timeline(fp, &ecpu_out_state);
+        }
+        fclose(fp);
+        return 1;
+    }
 
-    if (inst->reg8_bitpos2 != -1)
-        printf("r8: %s (%d)\n", reg8_names[op_state->reg8_2], op_state->reg8_2);
+    return 0;
+}
 
-    if (inst->reg16_bitpos != -1)
-        printf("r16: %s (%d)\n", reg16_names[op_state->reg16], op_state->reg16);
+static int run_state(struct worker *w, struct unit *unit, u64 idx,
+        struct state *state) {
+    struct state vcpu_out_state;
+    int vcpu_cycles;
 
-    if (inst->cond_bitpos != -1)
-        printf("cond: %s (%d)\n", cond_names[op_state->cond], op_state->cond);
+    vcpu_reset(w->vcpu, state);
+    vcpu_cycles = vcpu_step(w->vcpu);
+    vcpu_get_state(w->vcpu, &vcpu_out_state);
 
-    if (inst->bit_bitpos != -1)
-        printf("bit: %d\n", op_state->bit);
+    return check_state(w, unit, idx, state, &vcpu_out_state, vcpu_cycles);
 }
 
-int states_eq(struct state *s1, struct state *s2) {
-    return s1->reg16.AF == s2->reg16.AF &&
-           s1->reg16.BC == s2->reg16.BC &&
-           s1->reg16.DE == s2->reg16.DE &&
-           s1->reg16.HL == s2->reg16.HL &&
-           s1->PC == s2->PC &&
-           s1->SP == s2->SP &&
-           s1->halted == s2->halted &&
-           s1->interrupts_master_enabled == s2->interrupts_master_enabled &&
-           s1->num_mem_accesses == s2->num_mem_accesses &&
-           memcmp(s1->mem_accesses, s2->mem_accesses,
-                  s1->num_mem_accesses * sizeof(struct mem_access)) == 0;
+/* Like test_instruction, but runs a batch of permutations on all lanes of the
+ * verilated CPU at once before comparing them one by one. */
+static void test_instruction_lanes(struct worker *w, struct unit *unit) {
+    struct test_inst *inst = unit->inst;
+    struct lane_test *tests = w->lane_tests;
+    u64 end = unit->first + unit->count;
+    struct op_state op_state;
+
+    for (u64 i = unit->first; i < end; i += vlanes_num()) {
+        int num = end - i < (u64)vlanes_num() ? (int)(end - i) : vlanes_num();
+
+        for (int j = 0; j < num; j++) {
+            get_state(inst, exhaustive, i + j, &op_state, &tests[j].in);
+            memset(tests[j].mem, 0, sizeof(tests[j].mem));
+            assemble(tests[j].mem, inst, &op_state);
+        }
+        vlanes_run(w->vlanes, tests, num);
+
+        for (int j = 0; j < num; j++) {
+            unit->num_tests++;
+            memcpy(w->instruction_mem, tests[j].mem, sizeof(w->instruction_mem));
+            if (check_state(w, unit, unit->first_state + (i + j - unit->first),
+                            &tests[j].in, &tests[j].out, tests[j].cycles)) {
+                unit->failed = 1;
+                if (!keep_going)
+                    return;
+                continue;
+            }
+            unit->tested_op[w->instruction_mem[inst->is_cb_prefix ? 1 : 0]] = 1;
+        }
+    }
 }
 
-static void state_reset(struct state *s) {
-    memset(s, 0, sizeof(*s));
+static void test_instruction(struct worker *w, struct unit *unit) {
+    struct test_inst *inst = unit->inst;
+    struct op_state op_state;
+    struct state state;
+
+    if (w->vlanes) {
+        test_instruction_lanes(w, unit);
+        return;
+    }
+
+    for (u64 i = unit->first; i < unit->first + unit->count; i++) {
+        get_state(inst, exhaustive, i, &op_state, &state);
+        unit->num_tests++;
+        memset(w->instruction_mem, 0, sizeof(w->instruction_mem));
+        assemble(w->instruction_mem, inst, &op_state);
+        //dump_op_state(stdout, inst, &op_state);
+        //disassemble(stdout, w->instruction_mem);
+        if (run_state(w, unit, unit->first_state + (i - unit->first), &state)) {
+            unit->failed = 1;
+            if (!keep_going)
+                return;
+            continue;
+        }
+
+        unit->tested_op[w->instruction_mem[inst->is_cb_prefix ? 1 : 0]] = 1;
+    }
 }
 
-static void op_state_reset(struct op_state *op_state) {
-    memset(op_state, 0, sizeof(*op_state));
+/* Marks a unit as done, and every now and then prints up to where all
+ * permutations have been tested, so an interrupted run can be resumed. */
+static void unit_done(struct unit *unit) {
+    pthread_mutex_lock(&progress_lock);
+    unit->done = 1;
+    if (!unit->failed || keep_going) {
+        size_t done = num_done_units;
+        while (done < num_units && units[done].done &&
+               (!units[done].failed || keep_going))
+            done++;
+        if (done != num_done_units && time(NULL) != last_progress) {
+            u64 next = done < num_units ? units[done].first_state : range_end;
+            fprintf(stderr, "Tested permutations %llu-%llu, resume with "
+                    "--range %llu:%llu\n", (unsigned long long)range_start,
+                    (unsigned long long)next, (unsigned long long)next,
+                    (unsigned long long)range_end);
+            last_progress = time(NULL);
+        }
+        num_done_units = done;
+    }
+    pthread_mutex_unlock(&progress_lock);
 }
 
+static void *worker_main(void *arg) {
+    struct worker *w = arg;
+    double start;
 
-static int run_state(struct state *state) {
-    struct state vcpu_out_state, ecpu_out_state;
-    int vcpu_cycles, ecpu_cycles;
-
-    vcpu_reset(state);
-    ecpu_reset(state);
-
-    vcpu_cycles = vcpu_step();
-    ecpu_cycles = ecpu_step();
-
-    vcpu_get_state(&vcpu_out_state);
-    ecpu_get_state(&ecpu_out_state);
-
-    if (!states_eq(&vcpu_out_state, &ecpu_out_state) ||
-            vcpu_cycles != ecpu_cycles) {
-        printf("\n  === STATE MISMATCH ===\n");
-        printf("\n - Instruction -\n");
-        disassemble(instruction_mem);
-        printf("\n - Input state -\n");
-        dump_state(state);
-        printf("\n - CPU output state -\n");
-        printf(" Cycles: %d\n", vcpu_cycles);
-        dump_state(&vcpu_out_state);
-        printf("\n - Emulated output state -\n");
-        printf(" Cycles: %d\n", ecpu_cycles);
-        dump_state(&ecpu_out_state);
-        return 1;
-    }
+    for (;;) {
+        size_t i = __atomic_fetch_add(&next_unit, 1, __ATOMIC_RELAXED);
+        if (i >= num_units)
+            break;
 
-    return 0;
+        /* A serial run would have stopped at an earlier failure. */
+        if (i > __atomic_load_n(&first_failed_unit, __ATOMIC_RELAXED))
+            continue;
+
+        if (units[i].cached)
+            continue;
+
+        start = now();
+        test_instruction(w, &units[i]);
+        units[i].seconds = now() - start;
+        unit_done(&units[i]);
+
+        if (units[i].failed && !keep_going) {
+            size_t cur = __atomic_load_n(&first_failed_unit, __ATOMIC_RELAXED);
+            while (i < cur &&
+                   !__atomic_compare_exchange_n(&first_failed_unit, &cur, i,
+                       0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                ;
+        }
+    }
+    return NULL;
 }
 
-static void assemble(u8 *out, struct test_inst *inst,
-        struct op_state *op_state) {
-    u8 opcode = inst->opcode;
-    int idx = 0;
-
-    if (inst->reg8_bitpos >= 0)
-        opcode |= op_state->reg8 << inst->reg8_bitpos;
-    if (inst->reg8_bitpos2 >= 0)
-        opcode |= op_state->reg8_2 << inst->reg8_bitpos2;
-    if (inst->reg16_bitpos >= 0)
-        opcode |= op_state->reg16 << inst->reg16_bitpos;
-    if (inst->cond_bitpos >= 0)
-        opcode |= op_state->cond << inst->cond_bitpos;
-    if (inst->bit_bitpos >= 0)
-        opcode |= op_state->bit << inst->bit_bitpos;
-
-    if (inst->is_cb_prefix)
-        out[idx++] = 0xcb;
-
-    out[idx++] = opcode;
-
-    if (inst->imm_size >= 1)
-        out[idx++] = op_state->imm & 0xff;
-    if (inst->imm_size >= 2)
-        out[idx++] = (op_state->imm >> 8) & 0xff;
+/* Runs all units on num_threads workers, each with its own pair of CPUs. */
+static void run_units(int num_threads) {
+    struct worker *workers = calloc(num_threads, sizeof(*workers));
+
+    next_unit = 0;
+    first_failed_unit = num_units;
+    num_done_units = 0;
+    last_progress = time(NULL);
+
+    for (int i = 0; i < num_threads; i++) {
+        struct worker *w = &workers[i];
+        if (use_lanes) {
+            w->vlanes = vlanes_create();
+            w->lane_tests = calloc(vlanes_num(), sizeof(*w->lane_tests));
+        } else {
+            w->vcpu = vcpu_create(w->instruction_mem,
+                                  sizeof(w->instruction_mem));
+        }
+        w->ecpu = ecpu_create();
+        ecpu_set_mmu(w->ecpu, w, test_mem_read, NULL);
+        pthread_create(&w->thread, NULL, worker_main, w);
+    }
+
+    /* All models must be idle before the first is destroyed, see
+     * vcoverage.h. */
+    for (int i = 0; i < num_threads; i++)
+        pthread_join(workers[i].thread, NULL);
+    for (int i = 0; i < num_threads; i++) {
+        if (workers[i].vlanes) {
+            vlanes_destroy(workers[i].vlanes);
+            free(workers[i].lane_tests);
+        } else {
+            vcpu_destroy(workers[i].vcpu);
+        }
+        ecpu_destroy(workers[i].ecpu);
+    }
+    free(workers);
 }
 
-static int test_instruction(struct test_inst *inst) {
-    struct op_state op_state;
-    struct state state;
+/* Sums up the units of a row into r, and adds the opcodes they tested to
+ * op_table. Without keep_going, units after the first failure are ignored as a
+ * serial run would not have run them. */
+static void collect_row(struct row *row, struct row_result *r, bool *op_table) {
+    memset(r, 0, sizeof(*r));
+    r->inst = row->inst;
+    if (!row->inst->enabled) {
+        r->status = ROW_DISABLED;
+        return;
+    }
+    r->status = row->num_units ? ROW_PASSED : ROW_NOT_RUN;
 
-    state_reset(&state);
-    op_state_reset(&op_state);
-    do {
-        num_tests++;
-        assemble(instruction_mem, inst, &op_state);
-        //dump_op_state(&op_state);
-        //disassemble(instruction_mem);
-        if (run_state(&state))
-            return 1;
+    for (size_t u = row->first_unit; u < row->first_unit + row->num_units; u++) {
+        struct unit *unit = &units[u];
 
-        if (inst->is_cb_prefix)
-            tested_op_cb[instruction_mem[1]] = 1;
-        else
-            tested_op[instruction_mem[0]] = 1;
-    } while (!next_state(inst, &op_state, &state));
+        if (!unit->done || (!keep_going && u > first_failed_unit)) {
+            if (r->status == ROW_PASSED)
+                r->status = ROW_NOT_RUN;
+            continue;
+        }
+        if (unit->failed) {
+            if (!r->mismatch)
+                r->mismatch = unit->report;
+            r->status = ROW_FAILED;
+        }
 
-    return 0;
+        for (int op = 0; op <= 0xff; op++)
+            op_table[op] |= unit->tested_op[op];
+        r->num_tests += unit->num_tests;
+        if (unit->cached)
+            r->num_cached += unit->num_tests;
+        r->num_mismatches += unit->num_mismatches;
+        r->cycles += unit->cycles;
+        r->seconds += unit->seconds;
+    }
 }
 
-static int test_instructions(size_t num_instructions,
-                             struct test_inst *insts,
-                             const char *prefix) {
-    size_t num_instructions_passed = 0;
-    for (size_t i = 0; i < num_instructions; i++) {
+/* Reports the results of rows[first..first+count) in order, as a serial run
+ * would have. Returns the number of failed rows; without keep_going, it stops
+ * at the first. */
+static size_t report_rows(struct row_result *results, size_t first,
+                          size_t count, const char *prefix) {
+    size_t num_instructions_passed = 0, num_instructions_failed = 0;
+    for (size_t i = first; i < first + count; i++) {
+        struct row_result *r = &results[i];
+
         if (!output_summarize) {
-            printf("%s   ", insts[i].mnem);
-            if (insts[i].is_cb_prefix)
+            printf("%s   ", r->inst->mnem);
+            if (r->inst->is_cb_prefix)
                 printf("(CB prefix)");
             printf("\n");
         }
 
-        if (!insts[i].enabled) {
+        switch (r->status) {
+        case ROW_DISABLED:
             if (!output_summarize)
                 printf(" Skipping\n");
             continue;
-        }
 
-        if (test_instruction(&insts[i]))
-            return 1;
+        case ROW_NOT_RUN:
+            if (!output_summarize)
+                printf(exhaustive && r->inst->exhaustive == EX_NONE ?
+                       " Not in exhaustive sweep\n" :
+                       " Not in selected range\n");
+            continue;
+
+        case ROW_FAILED:
+            fputs(r->mismatch, stdout);
+            num_instructions_failed++;
+            if (!keep_going)
+                return num_instructions_failed;
+            printf("\n %lu of %lu permutations of %s%s mismatched\n\n",
+                   r->num_mismatches, r->num_tests, prefix, r->inst->mnem);
+            continue;
+
+        case ROW_PASSED:
+            break;
+        }
 
-        if (!output_summarize)
-            printf(" Ran %lu permutations\n", num_tests);
+        if (!output_summarize) {
+            printf(" Ran %lu permutations", r->num_tests);
+            if (r->num_cached)
+                printf(" (%lu passed before)", r->num_cached);
+            printf("\n");
+        }
         num_instructions_passed++;
-        num_tests = 0;
     }
 
     if (!output_summarize)
         printf("\n");
 
     printf("Tested %zu/%zu %sinstructions\n", num_instructions_passed,
-            num_instructions, prefix);
+            count, prefix);
+    if (num_instructions_failed)
+        printf("%zu %sinstructions FAILED\n", num_instructions_failed, prefix);
     if (!output_summarize)
         printf("\n");
 
-    return 0;
+    return num_instructions_failed;
 }
 
 static bool is_valid_op(u8 op) {
@@ -250,28 +480,452 @@ static void print_coverage(bool *op_table, bool (*is_valid)(u8),
     }
 }
 
-static int test_all_instructions(void) {
+/* Number of permutations tested for a row in this run. */
+static u64 row_states(struct test_inst *inst) {
+    if (!inst->enabled || (exhaustive && inst->exhaustive == EX_NONE))
+        return 0;
+    return num_states(inst, exhaustive);
+}
+
+/* Numbers the permutations of all rows, and returns the total. */
+static u64 setup_rows(void) {
     size_t num_instructions = sizeof(instructions) / sizeof(instructions[0]);
     size_t num_cb_instructions = sizeof(cb_instructions) / sizeof(cb_instructions[0]);
+    u64 total = 0;
+
+    num_rows = num_instructions + (enable_cb ? num_cb_instructions : 0);
+    rows = calloc(num_rows, sizeof(*rows));
+    for (size_t i = 0; i < num_rows; i++) {
+        rows[i].inst = i < num_instructions ? &instructions[i] :
+                       &cb_instructions[i - num_instructions];
+        rows[i].first_state = total;
+        total += row_states(rows[i].inst);
+    }
+    return total;
+}
 
-    if (test_instructions(num_instructions, instructions, ""))
+/* Splits the permutations in [range_start, range_end) into units. */
+static void setup_units(void) {
+    size_t max_units = 0;
+
+    for (size_t i = 0; i < num_rows; i++)
+        max_units += row_states(rows[i].inst) / UNIT_STATES + 2;
+    units = calloc(max_units, sizeof(*units));
+
+    num_units = 0;
+    for (size_t i = 0; i < num_rows; i++) {
+        struct row *row = &rows[i];
+        u64 first, last;
+
+        row->first_unit = num_units;
+        first = row->first_state;
+        last = row->first_state + row_states(row->inst);
+        if (first < range_start)
+            first = range_start;
+        if (last > range_end)
+            last = range_end;
+
+        for (u64 j = first; j < last; j += UNIT_STATES) {
+            struct unit *unit = &units[num_units++];
+            unit->inst = row->inst;
+            unit->first_state = j;
+            unit->first = j - row->first_state;
+            unit->count = last - j < UNIT_STATES ? last - j : UNIT_STATES;
+            row->num_units++;
+
+            if (cache_path && !force) {
+                struct cache_result result;
+                if (cache_lookup(cache_key(unit->inst, exhaustive, bus_timing,
+                                           unit->first, unit->count),
+                                 &result)) {
+                    unit->num_tests = result.num_tests;
+                    memcpy(unit->tested_op, result.tested_op,
+                           sizeof(unit->tested_op));
+                    unit->cycles = result.cycles;
+                    unit->cached = 1;
+                    unit->done = 1;
+                }
+            }
+        }
+    }
+}
+
+/* Adds the units that passed in this run to the cache, and saves it. Returns
+ * the number of permutations whose results came from the cache. */
+static u64 update_cache(void) {
+    u64 num_cached = 0;
+
+    for (size_t i = 0; i < num_units; i++) {
+        struct unit *unit = &units[i];
+        struct cache_result result;
+
+        if (unit->cached) {
+            num_cached += unit->count;
+            continue;
+        }
+        if (!unit->done || unit->failed)
+            continue;
+
+        result.num_tests = unit->num_tests;
+        memcpy(result.tested_op, unit->tested_op, sizeof(result.tested_op));
+        result.cycles = unit->cycles;
+        cache_add(cache_key(unit->inst, exhaustive, bus_timing, unit->first,
+                            unit->count),
+                  &result);
+    }
+
+    cache_save(cache_path);
+    return num_cached;
+}
+
+static int write_reports(struct row_result *results, double seconds) {
+    struct op_coverage coverage[2];
+    bool valid[256], valid_cb[256];
+    struct run_report report = {
+        .rows = results,
+        .num_rows = num_rows,
+        .coverage = coverage,
+        .num_coverage = enable_cb ? 2 : 1,
+        .seconds = seconds,
+    };
+    int ret = 0;
+
+    for (int op = 0; op <= 0xff; op++) {
+        valid[op] = is_valid_op(op);
+        valid_cb[op] = is_valid_op_cb(op);
+    }
+    coverage[0] = (struct op_coverage){ "", tested_op, valid };
+    coverage[1] = (struct op_coverage){ "CB", tested_op_cb, valid_cb };
+
+    if (json_path)
+        ret |= write_json_report(json_path, &report);
+    if (junit_path)
+        ret |= write_junit_report(junit_path, &report);
+    return ret;
+}
+
+/* Reports the permutations of the units run that known cpu.v bugs explain. */
+static void report_known_bugs(void) {
+    for (int b = 0; b < NUM_KNOWN_BUGS; b++) {
+        unsigned long count = 0;
+        u64 first = 0;
+
+        for (size_t i = 0; i < num_units; i++) {
+            struct unit *unit = &units[i];
+            if (!unit->done || !unit->known_count[b])
+                continue;
+            if (!count)
+                first = unit->known_first[b];
+            count += unit->known_count[b];
+        }
+        if (!count)
+            continue;
+        printf("Known cpu.v bug, not counted as failure: %s\n"
+               "  %lu permutations, first %llu (rerun with --range %llu:%llu)\n",
+               known_bug_desc(b), count, (unsigned long long)first,
+               (unsigned long long)first, (unsigned long long)first + 1);
+    }
+}
+
+static int test_all_instructions(int num_threads) {
+    size_t num_instructions = sizeof(instructions) / sizeof(instructions[0]);
+    size_t num_cb_instructions = sizeof(cb_instructions) / sizeof(cb_instructions[0]);
+    struct row_result *results;
+    size_t num_failed;
+    u64 num_cached = 0;
+    double start = now(), seconds;
+    int ret = 0;
+
+    if (cache_path)
+        cache_load(cache_path);
+    setup_units();
+    run_units(num_threads);
+    seconds = now() - start;
+    if (cache_path)
+        num_cached = update_cache();
+
+    results = calloc(num_rows, sizeof(*results));
+    for (size_t i = 0; i < num_rows; i++)
+        collect_row(&rows[i], &results[i],
+                    i < num_instructions ? tested_op : tested_op_cb);
+
+    num_failed = report_rows(results, 0, num_instructions, "");
+    if (enable_cb && (!num_failed || keep_going))
+        num_failed += report_rows(results, num_instructions,
+                                  num_cb_instructions, "CB ");
+
+    if (!num_failed || keep_going) {
+        print_coverage(tested_op, is_valid_op, "");
+        if (enable_cb)
+            print_coverage(tested_op_cb, is_valid_op_cb, "CB ");
+    }
+
+    report_known_bugs();
+
+    if (num_cached)
+        printf("Reused the results of %llu permutations from %s (rerun them "
+               "with --force)\n", (unsigned long long)num_cached, cache_path);
+
+    if (write_reports(results, seconds) || num_failed)
+        ret = 1;
+
+    for (size_t i = 0; i < num_units; i++)
+        free(units[i].report);
+    free(units);
+    free(results);
+    return ret;
+}
+
+
+/* Parses "start:end", where either may be omitted to keep its default. */
+static int parse_range(const char *str, u64 *start, u64 *end) {
+    char *p = (char *)str;
+
+    if (*p != ':')
+        *start = strtoull(str, &p, 0);
+    if (*p++ != ':')
         return 1;
+    if (*p)
+        *end = strtoull(p, &p, 0);
+    return *p != '\0';
+}
 
-    if (enable_cb)
-        if (test_instructions(num_cb_instructions, cb_instructions, "CB "))
-            return 1;
+/* Disables the table rows whose opcode is not in list, a comma-separated list
+ * of hex opcodes (cbXX for CB-prefixed ones). */
+static int select_opcodes(const char *list) {
+    size_t num_instructions = sizeof(instructions) / sizeof(instructions[0]);
+    size_t num_cb_instructions = sizeof(cb_instructions) / sizeof(cb_instructions[0]);
+    bool want[256] = { 0 }, want_cb[256] = { 0 };
+    const char *p = list;
 
-    print_coverage(tested_op, is_valid_op, "");
-    if (enable_cb)
-        print_coverage(tested_op_cb, is_valid_op_cb, "CB ");
+    while (*p) {
+        bool cb = !strncmp(p, "cb", 2) && p[2] && p[2] != ',';
+        char *end;
+        unsigned long op = strtoul(p + (cb ? 2 : 0), &end, 16);
+
+        if (end == p + (cb ? 2 : 0) || op > 0xff || (*end && *end != ','))
+            return 1;
+        (cb ? want_cb : want)[op] = 1;
+        p = *end ? end + 1 : end;
+    }
 
+    for (size_t i = 0; i < num_instructions; i++)
+        if (!want[instructions[i].opcode])
+            instructions[i].enabled = 0;
+    for (size_t i = 0; i < num_cb_instructions; i++)
+        if (!want_cb[cb_instructions[i].opcode])
+            cb_instructions[i].enabled = 0;
     return 0;
 }
 
+/* The table rows selected by the options, for fuzz() and bench(). */
+static struct test_inst **row_insts(void) {
+    struct test_inst **insts = calloc(num_rows, sizeof(*insts));
+
+    for (size_t i = 0; i < num_rows; i++)
+        insts[i] = rows[i].inst;
+    return insts;
+}
+
+/* Fuzzes the programs in [range_start, range_end) from all table rows. */
+static int fuzz_rows(u64 seed, int num_threads) {
+    struct test_inst **insts = row_insts();
+    int ret;
+
+    ret = fuzz(insts, num_rows, seed, range_start, range_end, bus_timing,
+               num_threads);
+    free(insts);
+    return ret;
+}
+
+static int bench_rows(u64 num_tests) {
+    struct test_inst **insts = row_insts();
+    int ret;
+
+    ret = bench(insts, num_rows, num_tests);
+    free(insts);
+    return ret;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [-j threads] [--cb] [--exhaustive | --fuzz [--seed s]]\n"
+            "          [--lanes] [--bus-timing] [--opcodes list]\n"
+            "          [--shard i/N] [--range start:end]\n"
+            "          [--cache file [--force]] [--keep-going]\n"
+            "          [--json file] [--junit file]\n"
+            "       %s [--cb] --bench[=n]\n"
+            "  -j threads         Number of worker threads (default: all cores)\n"
+            "  --cb               Also test CB-prefixed instructions\n"
+            "  --exhaustive       Test all values of the 8-bit inputs and flags\n"
+            "                     of ALU and CB instructions (implies --cb)\n"
+            "  --fuzz             Run random instruction sequences instead, with\n"
+            "                     start:end selecting programs (default 0:%d)\n"
+            "  --seed s           Seed for --fuzz (default: random)\n"
+            "  --lanes            Run the verilated CPU in lanes of %d instances\n"
+            "  --bus-timing       Also compare the M-cycle of every memory read\n"
+            "                     and write, not only the writes and end state\n"
+            "  --opcodes list     Only test the table rows of these opcodes\n"
+            "                     (hex, comma-separated, cbXX for CB ones)\n"
+            "  --bench[=n]        Time n (default %d) tests on every CPU model\n"
+            "  --shard i/N        Only test the i-th (0-based) of N equal parts\n"
+            "                     of the selected permutations\n"
+            "  --range start:end  Only test permutations start up to (not\n"
+            "                     including) end; either may be omitted, an\n"
+            "                     omitted end is unbounded with --fuzz\n"
+            "  --cache file       Skip permutations that passed before with the\n"
+            "                     same RTL and tables, and record new passes\n"
+            "  --force            Rerun them anyway (still updating the cache)\n"
+            "  --keep-going       Test all instructions, even after mismatches\n"
+            "  --json file        Write a report with results, time and cycles\n"
+            "                     per instruction and opcode coverage\n"
+            "  --junit file       Write a JUnit XML report\n",
+            name, name, FUZZ_NUM_PROGRAMS, vlanes_num(), BENCH_NUM_TESTS);
+}
+
+int main(int argc, char **argv) {
+    static const struct option long_opts[] = {
+        { "cb", no_argument, NULL, 'c' },
+        { "exhaustive", no_argument, NULL, 'x' },
+        { "shard", required_argument, NULL, 's' },
+        { "range", required_argument, NULL, 'r' },
+        { "fuzz", no_argument, NULL, 'f' },
+        { "seed", required_argument, NULL, 'S' },
+        { "lanes", no_argument, NULL, 'l' },
+        { "bus-timing", no_argument, NULL, 'T' },
+        { "opcodes", required_argument, NULL, 'O' },
+        { "bench", optional_argument, NULL, 'b' },
+        { "cache", required_argument, NULL, 'C' },
+        { "force", no_argument, NULL, 'F' },
+        { "keep-going", no_argument, NULL, 'k' },
+        { "json", required_argument, NULL, 'J' },
+        { "junit", required_argument, NULL, 'U' },
+        { NULL, 0, NULL, 0 }
+    };
+    int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned shard = 0, num_shards = 1;
+    const char *range = NULL;
+    bool do_fuzz = 0;
+    u64 bench_tests = 0;
+    u64 seed = time(NULL) ^ getpid();
+    u64 total;
+    int opt, ret;
+
+    while ((opt = getopt_long(argc, argv, "j:", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'j':
+            num_threads = atoi(optarg);
+            break;
+        case 'c':
+            enable_cb = 1;
+            break;
+        case 'x':
+            exhaustive = 1;
+            enable_cb = 1;
+            break;
+        case 's':
+            if (sscanf(optarg, "%u/%u", &shard, &num_shards) != 2 ||
+                    shard >= num_shards) {
+                fprintf(stderr, "Invalid shard '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'r':
+            range = optarg;
+            break;
+        case 'f':
+            do_fuzz = 1;
+            break;
+        case 'S':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'l':
+            use_lanes = 1;
+            break;
+        case 'T':
+            bus_timing = 1;
+            break;
+        case 'O':
+            if (select_opcodes(optarg)) {
+                fprintf(stderr, "Invalid opcodes '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'C':
+            cache_path = optarg;
+            break;
+        case 'F':
+            force = 1;
+            break;
+        case 'k':
+            keep_going = 1;
+            break;
+        case 'J':
+            json_path = optarg;
+            break;
+        case 'U':
+            junit_path = optarg;
+            break;
+        case 'b':
+            bench_tests = optarg ? strtoull(optarg, NULL, 0) : BENCH_NUM_TESTS;
+            if (!bench_tests) {
+                fprintf(stderr, "Invalid number of tests '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (num_threads < 1)
+        num_threads = 1;
+
+    total = setup_rows();
+    if (bench_tests) {
+        ret = bench_rows(bench_tests);
+        free(rows);
+        return ret;
+    }
+    /* Fuzzing has no end of its own: a range with an open end runs until a
+     * mismatch. */
+    if (do_fuzz)
+        total = ~0ull;
+    range_start = 0;
+    range_end = do_fuzz && !range ? FUZZ_NUM_PROGRAMS : total;
+    if (range && (parse_range(range, &range_start, &range_end) ||
+                  range_start > range_end)) {
+        fprintf(stderr, "Invalid range '%s'\n", range);
+        return 1;
+    }
+    if (total > 0 && range_start >= total) {
+        fprintf(stderr, "Range '%s' starts past the last of %llu permutations\n",
+                range, (unsigned long long)total);
+        return 1;
+    }
+    if (range_end > total)
+        range_end = total;
+    if (num_shards > 1) {
+        /* Parts differ by one permutation at most, the first ones longer. */
+        u64 len = range_end - range_start;
+        u64 part = len / num_shards, rest = len % num_shards;
+        range_start += part * shard + (shard < rest ? shard : rest);
+        range_end = range_start + part + (shard < rest);
+    }
+
+    if (do_fuzz) {
+        ret = fuzz_rows(seed, num_threads);
+        free(rows);
+        return ret;
+    }
+
+    ret = test_all_instructions(num_threads);
 
-int main(void) {
-    vcpu_init();
-    ecpu_init();
+    if (range_start != 0 || range_end != total)
+        printf("Selected permutations %llu-%llu of %llu\n",
+               (unsigned long long)range_start, (unsigned long long)range_end,
+               (unsigned long long)total);
 
-    return test_all_instructions();
+    free(rows);
+    return ret;
 }
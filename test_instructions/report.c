@@ -0,0 +1,181 @@
+/*
+ * JSON and JUnit reports of a test run, see report.h.
+ */
+
+#include <stdio.h>
+
+#include "report.h"
+
+static const char *status_names[] = {
+    [ROW_PASSED]   = "passed",
+    [ROW_FAILED]   = "failed",
+    [ROW_DISABLED] = "disabled",
+    [ROW_NOT_RUN]  = "not run",
+};
+
+static void json_string(FILE *fp, const char *str) {
+    fputc('"', fp);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            fprintf(fp, "\\%c", *str);
+        else if (*str == '\n')
+            fputs("\\n", fp);
+        else if ((u8)*str < 0x20)
+            fprintf(fp, "\\u%04x", *str);
+        else
+            fputc(*str, fp);
+    }
+    fputc('"', fp);
+}
+
+static void xml_string(FILE *fp, const char *str) {
+    for (; *str; str++) {
+        switch (*str) {
+        case '&':  fputs("&amp;", fp); break;
+        case '<':  fputs("&lt;", fp); break;
+        case '>':  fputs("&gt;", fp); break;
+        case '"':  fputs("&quot;", fp); break;
+        default:   fputc(*str, fp); break;
+        }
+    }
+}
+
+static void count_rows(const struct run_report *report, size_t *num_failed,
+        size_t *num_skipped) {
+    *num_failed = *num_skipped = 0;
+    for (size_t i = 0; i < report->num_rows; i++) {
+        if (report->rows[i].status == ROW_FAILED)
+            (*num_failed)++;
+        else if (report->rows[i].status != ROW_PASSED)
+            (*num_skipped)++;
+    }
+}
+
+static int close_report(FILE *fp, const char *path) {
+    if (ferror(fp) | fclose(fp)) {
+        fprintf(stderr, "Could not write %s\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+int write_json_report(const char *path, const struct run_report *report) {
+    FILE *fp = fopen(path, "w");
+    size_t num_failed, num_skipped;
+
+    if (!fp) {
+        perror(path);
+        return 1;
+    }
+    count_rows(report, &num_failed, &num_skipped);
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"seconds\": %.3f,\n", report->seconds);
+    fprintf(fp, "  \"failed\": %zu,\n", num_failed);
+    fprintf(fp, "  \"instructions\": [\n");
+    for (size_t i = 0; i < report->num_rows; i++) {
+        const struct row_result *r = &report->rows[i];
+
+        fprintf(fp, "    { \"mnemonic\": ");
+        json_string(fp, r->inst->mnem);
+        fprintf(fp, ", \"opcode\": \"%s%02x\", \"status\": \"%s\",\n",
+                r->inst->is_cb_prefix ? "cb" : "", r->inst->opcode,
+                status_names[r->status]);
+        fprintf(fp, "      \"permutations\": %lu, \"cached\": %lu, "
+                "\"mismatches\": %lu, \"cycles\": %llu, \"seconds\": %.6f",
+                r->num_tests, r->num_cached, r->num_mismatches,
+                (unsigned long long)r->cycles, r->seconds);
+        if (r->mismatch) {
+            fprintf(fp, ",\n      \"first_mismatch\": ");
+            json_string(fp, r->mismatch);
+        }
+        fprintf(fp, " }%s\n", i + 1 < report->num_rows ? "," : "");
+    }
+    fprintf(fp, "  ],\n");
+
+    fprintf(fp, "  \"coverage\": [\n");
+    for (size_t i = 0; i < report->num_coverage; i++) {
+        const struct op_coverage *c = &report->coverage[i];
+        unsigned num_tested = 0, num_valid = 0;
+        bool first = 1;
+
+        for (int op = 0; op <= 0xff; op++) {
+            num_tested += c->tested[op];
+            num_valid += c->valid[op];
+        }
+        fprintf(fp, "    { \"prefix\": \"%s\", \"tested\": %u, \"valid\": %u, "
+                "\"untested\": [", c->prefix, num_tested, num_valid);
+        for (int op = 0; op <= 0xff; op++) {
+            if (c->tested[op] || !c->valid[op])
+                continue;
+            fprintf(fp, "%s\"%02x\"", first ? "" : ", ", op);
+            first = 0;
+        }
+        fprintf(fp, "] }%s\n", i + 1 < report->num_coverage ? "," : "");
+    }
+    fprintf(fp, "  ]\n");
+    fprintf(fp, "}\n");
+
+    return close_report(fp, path);
+}
+
+int write_junit_report(const char *path, const struct run_report *report) {
+    FILE *fp = fopen(path, "w");
+    size_t num_failed, num_skipped;
+
+    if (!fp) {
+        perror(path);
+        return 1;
+    }
+    count_rows(report, &num_failed, &num_skipped);
+
+    fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    fprintf(fp, "<testsuite name=\"test_instructions\" tests=\"%zu\" "
+            "failures=\"%zu\" skipped=\"%zu\" time=\"%.3f\">\n",
+            report->num_rows, num_failed, num_skipped, report->seconds);
+
+    fprintf(fp, "  <properties>\n");
+    for (size_t i = 0; i < report->num_coverage; i++) {
+        const struct op_coverage *c = &report->coverage[i];
+        unsigned num_tested = 0, num_valid = 0;
+
+        for (int op = 0; op <= 0xff; op++) {
+            num_tested += c->tested[op];
+            num_valid += c->valid[op];
+        }
+        fprintf(fp, "    <property name=\"%sopcodes_tested\" value=\"%u/%u\"/>\n",
+                c->prefix[0] ? "cb_" : "", num_tested, num_valid);
+    }
+    fprintf(fp, "  </properties>\n");
+
+    for (size_t i = 0; i < report->num_rows; i++) {
+        const struct row_result *r = &report->rows[i];
+
+        fprintf(fp, "  <testcase classname=\"%s\" name=\"",
+                r->inst->is_cb_prefix ? "cb_instructions" : "instructions");
+        xml_string(fp, r->inst->mnem);
+        fprintf(fp, "\" time=\"%.6f\">\n", r->seconds);
+        switch (r->status) {
+        case ROW_FAILED:
+            fprintf(fp, "    <failure message=\"%lu of %lu permutations "
+                    "mismatched\">", r->num_mismatches, r->num_tests);
+            xml_string(fp, r->mismatch ? r->mismatch : "");
+            fprintf(fp, "</failure>\n");
+            break;
+        case ROW_DISABLED:
+        case ROW_NOT_RUN:
+            fprintf(fp, "    <skipped message=\"%s\"/>\n",
+                    status_names[r->status]);
+            break;
+        case ROW_PASSED:
+            break;
+        }
+        fprintf(fp, "    <system-out>%lu permutations (%lu cached), "
+                "%llu cycles</system-out>\n", r->num_tests, r->num_cached,
+                (unsigned long long)r->cycles);
+        fprintf(fp, "  </testcase>\n");
+    }
+    fprintf(fp, "</testsuite>\n");
+
+    return close_report(fp, path);
+}
@@ -0,0 +1,50 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stddef.h>
+
+#include "common.h"
+
+/*
+ * Machine-readable reports of a test run, to track correctness and the speed
+ * of the test harness over time: JSON with all details, and JUnit XML (one
+ * test case per table row) for CI systems.
+ */
+
+enum row_status {
+    ROW_PASSED,
+    ROW_FAILED,
+    ROW_DISABLED,               // Not enabled in the table
+    ROW_NOT_RUN,                // Not selected, or stopped at earlier failure
+};
+
+struct row_result {
+    struct test_inst *inst;
+    enum row_status status;
+    unsigned long num_tests;    // Including those from the cache
+    unsigned long num_cached;
+    unsigned long num_mismatches;
+    u64 cycles;                 // Simulated cycles of the verilated CPU
+    double seconds;             // Time spent on it, summed over all threads
+    const char *mismatch;       // Report of the first mismatch, if any
+};
+
+/* Opcodes tested (after the prefix, if any), out of the valid ones. */
+struct op_coverage {
+    const char *prefix;         // "" or "CB"
+    const bool *tested, *valid; // Indexed by opcode
+};
+
+struct run_report {
+    const struct row_result *rows;
+    size_t num_rows;
+    const struct op_coverage *coverage;
+    size_t num_coverage;
+    double seconds;
+};
+
+/* Both return non-zero if the file could not be written. */
+int write_json_report(const char *path, const struct run_report *report);
+int write_junit_report(const char *path, const struct run_report *report);
+
+#endif
@@ -0,0 +1,210 @@
+/*
+ * Exhaustive test of the ALU of cpu.v (alu.v) on its own.
+ *
+ * Testing the ALU through whole instructions costs a run of the stage machine
+ * per input. Here, every operation is evaluated for all combinations of its
+ * operands and the flags it reads, a batch of lanes per eval() of the
+ * verilated ALU. Each result is compared to that of an instruction doing the
+ * same operation on emu_cpu.c, for the flags that instruction takes from the
+ * ALU.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+#include "valu.h"
+#include "emu_cpu.h"
+
+/* Mismatches printed per operation. */
+#define MAX_REPORTS 8
+
+/* Which registers the instruction of a test takes in1 and in2 from, and
+ * leaves the result in (the first one). */
+enum {
+    REGS_A_B,
+    REGS_B,
+    REGS_A,
+    REGS_HL_BC,
+};
+
+struct alu_test {
+    const char *name;
+    u8 op;
+    bool is_16bit;
+    const char *inst;           // Instruction doing op on emu_cpu.c
+    u8 code[2];
+    int regs;
+    bool reads_in2, reads_flags;
+    u8 flags_mask;              // Flags inst takes from the ALU
+};
+
+static const struct alu_test tests[] = {
+    { "ADD",   ALU_ADD,  0, "ADD A, B",   { 0x80 },       REGS_A_B,   1, 1, 0xf0 },
+    { "ADC",   ALU_ADC,  0, "ADC A, B",   { 0x88 },       REGS_A_B,   1, 1, 0xf0 },
+    { "SUB",   ALU_SUB,  0, "SUB A, B",   { 0x90 },       REGS_A_B,   1, 1, 0xf0 },
+    { "SBC",   ALU_SBC,  0, "SBC A, B",   { 0x98 },       REGS_A_B,   1, 1, 0xf0 },
+    { "AND",   ALU_AND,  0, "AND A, B",   { 0xa0 },       REGS_A_B,   1, 1, 0xf0 },
+    { "XOR",   ALU_XOR,  0, "XOR A, B",   { 0xa8 },       REGS_A_B,   1, 1, 0xf0 },
+    { "OR",    ALU_OR,   0, "OR A, B",    { 0xb0 },       REGS_A_B,   1, 1, 0xf0 },
+    { "RLC",   ALU_RLC,  0, "RLC B",      { 0xcb, 0x00 }, REGS_B,     0, 1, 0xf0 },
+    { "RRC",   ALU_RRC,  0, "RRC B",      { 0xcb, 0x08 }, REGS_B,     0, 1, 0xf0 },
+    { "RL",    ALU_RL,   0, "RL B",       { 0xcb, 0x10 }, REGS_B,     0, 1, 0xf0 },
+    { "RR",    ALU_RR,   0, "RR B",       { 0xcb, 0x18 }, REGS_B,     0, 1, 0xf0 },
+    { "SLA",   ALU_SLA,  0, "SLA B",      { 0xcb, 0x20 }, REGS_B,     0, 1, 0xf0 },
+    { "SRA",   ALU_SRA,  0, "SRA B",      { 0xcb, 0x28 }, REGS_B,     0, 1, 0xf0 },
+    { "SWAP",  ALU_SWAP, 0, "SWAP B",     { 0xcb, 0x30 }, REGS_B,     0, 1, 0xf0 },
+    { "SRL",   ALU_SRL,  0, "SRL B",      { 0xcb, 0x38 }, REGS_B,     0, 1, 0xf0 },
+    { "DAA",   ALU_DAA,  0, "DAA",        { 0x27 },       REGS_A,     0, 1, 0xb0 },
+    { "ADD16", ALU_ADD,  1, "ADD HL, BC", { 0x09 },       REGS_HL_BC, 1, 0, 0x70 },
+};
+
+static u8 test_mem[2];
+
+static u8 test_mem_read(void *ctx, u16 addr) {
+    (void)ctx;
+    return addr < sizeof(test_mem) ? test_mem[addr] : 0xaa;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Runs the instruction of t for in on emu_cpu.c. */
+static void emu_eval(struct ecpu *ecpu, const struct alu_test *t,
+        const struct alu_in *in, struct alu_out *out) {
+    struct state state;
+
+    memset(&state, 0, sizeof(state));
+    state.reg8.F = in->flags;
+    switch (t->regs) {
+    case REGS_A_B:
+        state.reg8.A = in->in1;
+        state.reg8.B = in->in2;
+        break;
+    case REGS_B:
+        state.reg8.B = in->in1;
+        break;
+    case REGS_A:
+        state.reg8.A = in->in1;
+        break;
+    case REGS_HL_BC:
+        state.reg16.HL = in->in1;
+        state.reg16.BC = in->in2;
+        break;
+    }
+
+    ecpu_reset(ecpu, &state);
+    ecpu_step(ecpu);
+    ecpu_get_state(ecpu, &state);
+
+    out->flags = state.reg8.F & t->flags_mask;
+    switch (t->regs) {
+    case REGS_B:
+        out->out = state.reg8.B;
+        break;
+    case REGS_HL_BC:
+        out->out = state.reg16.HL;
+        break;
+    default:
+        out->out = state.reg8.A;
+        break;
+    }
+}
+
+/* Value number i of the second operand of a 16-bit operation, spread over the
+ * whole range (with all low bytes) as all 2^32 pairs would take too long. */
+static u16 in2_16bit(unsigned i) {
+    return (i << 8) | (u8)(i * 167);
+}
+
+/* Tests all inputs of t, returns the number of mismatches. */
+static unsigned long test_op(struct valu *alu, struct ecpu *ecpu,
+        const struct alu_test *t, unsigned long *num_inputs) {
+    unsigned num_in1 = t->is_16bit ? 0x10000 : 0x100;
+    unsigned num_in2 = t->reads_in2 ? 0x100 : 1;
+    unsigned num_flags = t->reads_flags ? 16 : 1;
+    unsigned long total = (unsigned long)num_in1 * num_in2 * num_flags;
+    unsigned long mismatches = 0;
+    int lanes = valu_num();
+    struct alu_in *in = calloc(lanes, sizeof(*in));
+    struct alu_out *out = calloc(lanes, sizeof(*out));
+    u16 out_mask = t->is_16bit ? 0xffff : 0xff;
+
+    memcpy(test_mem, t->code, sizeof(test_mem));
+
+    for (unsigned long i = 0; i < total; i += lanes) {
+        int num = total - i < (unsigned long)lanes ? (int)(total - i) : lanes;
+
+        for (int j = 0; j < num; j++) {
+            unsigned long idx = i + j;
+            in[j].op = t->op;
+            in[j].is_16bit = t->is_16bit;
+            in[j].flags = (idx % num_flags) << 4;
+            idx /= num_flags;
+            in[j].in2 = t->is_16bit ? in2_16bit(idx % num_in2) : idx % num_in2;
+            idx /= num_in2;
+            in[j].in1 = idx;
+        }
+        valu_eval(alu, in, out, num);
+
+        for (int j = 0; j < num; j++) {
+            struct alu_out expected;
+
+            emu_eval(ecpu, t, &in[j], &expected);
+            if ((out[j].out & out_mask) == expected.out &&
+                    (out[j].flags & t->flags_mask) == expected.flags)
+                continue;
+
+            if (mismatches++ < MAX_REPORTS)
+                printf("  %s in1 %04x in2 %04x flags %x: ALU %04x flags %x, "
+                       "%s %04x flags %x\n", t->name, in[j].in1, in[j].in2,
+                       in[j].flags >> 4, out[j].out & out_mask,
+                       (out[j].flags & t->flags_mask) >> 4, t->inst,
+                       expected.out, expected.flags >> 4);
+        }
+    }
+
+    free(in);
+    free(out);
+    *num_inputs = total;
+    return mismatches;
+}
+
+int main(void) {
+    struct valu *alu = valu_create();
+    struct ecpu *ecpu = ecpu_create();
+    unsigned long total_inputs = 0;
+    int num_failed = 0;
+    double start = now();
+
+    ecpu_set_mmu(ecpu, NULL, test_mem_read, NULL);
+
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        const struct alu_test *t = &tests[i];
+        unsigned long num_inputs, mismatches;
+
+        mismatches = test_op(alu, ecpu, t, &num_inputs);
+        total_inputs += num_inputs;
+        if (mismatches) {
+            printf("ALU %-5s %lu of %lu inputs differ from %s\n", t->name,
+                   mismatches, num_inputs, t->inst);
+            num_failed++;
+        } else
+            printf("ALU %-5s %lu inputs OK\n", t->name, num_inputs);
+    }
+
+    printf("\nTested %lu inputs of %zu operations on %d lanes in %.1f s\n",
+           total_inputs, sizeof(tests) / sizeof(tests[0]), valu_num(),
+           now() - start);
+    if (num_failed)
+        printf("%d operations FAILED\n", num_failed);
+
+    ecpu_destroy(ecpu);
+    valu_destroy(alu);
+    return num_failed != 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * Verilator wrapper for the ALU test bench (alu_lanes.v). The ALU is
+ * combinational, so there is no clock: a single eval() computes all lanes.
+ */
+
+#include "verilated.h"
+#include "Valu_lanes.h"
+
+extern "C" {
+#include "common.h"
+#include "valu.h"
+}
+#include "vcoverage.h"
+
+struct valu {
+    Valu_lanes *top;
+};
+
+extern "C" {
+
+void valu_eval(struct valu *alu, const struct alu_in *in, struct alu_out *out,
+               int num) {
+    Valu_lanes *top = alu->top;
+
+    for (int i = 0; i < num; i++) {
+        top->operands[i] = in[i].in1 | ((u32)in[i].in2 << 16);
+        top->controls[i] = in[i].op | (in[i].is_16bit << 5) |
+                           ((in[i].flags >> 4) << 8);
+    }
+
+    top->eval();
+
+    for (int i = 0; i < num; i++) {
+        out[i].out = top->results[i] & 0xffff;
+        out[i].flags = ((top->results[i] >> 16) & 0xf) << 4;
+    }
+}
+
+struct valu *valu_create(void) {
+    struct valu *alu = new struct valu;
+    alu->top = new Valu_lanes;
+    vcoverage_model_created();
+    return alu;
+}
+
+void valu_destroy(struct valu *alu) {
+    vcoverage_save();
+    alu->top->final();
+    delete alu->top;
+    delete alu;
+}
+
+int valu_num(void) {
+    return ALU_LANES;
+}
+
+}
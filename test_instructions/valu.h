@@ -0,0 +1,52 @@
+#ifndef VALU_H
+#define VALU_H
+
+#include "common.h"
+
+/*
+ * Verilated alu.v, in valu_num() lanes (see alu_lanes.v) that are evaluated
+ * together.
+ */
+struct valu;
+
+/* Operations of the ALU, same as in alu.v. */
+#define ALU_NOP   0
+#define ALU_ADD   1
+#define ALU_ADC   2
+#define ALU_SUB   3
+#define ALU_SBC   4
+#define ALU_AND   5
+#define ALU_XOR   6
+#define ALU_OR    7
+#define ALU_RLC   8
+#define ALU_RRC   9
+#define ALU_RL    10
+#define ALU_RR    11
+#define ALU_SLA   12
+#define ALU_SRA   13
+#define ALU_SWAP  14
+#define ALU_SRL   15
+#define ALU_DAA   16
+
+/* Flags are in the upper nibble, like register F. */
+struct alu_in {
+    u8 op;
+    bool is_16bit;
+    u16 in1, in2;
+    u8 flags;
+};
+
+struct alu_out {
+    u16 out;
+    u8 flags;
+};
+
+struct valu *valu_create(void);
+void valu_destroy(struct valu *alu);
+int valu_num(void);
+
+/* Evaluates in[i] on lane i for the first num (<= valu_num()) lanes. */
+void valu_eval(struct valu *alu, const struct alu_in *in, struct alu_out *out,
+               int num);
+
+#endif
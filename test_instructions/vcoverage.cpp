@@ -0,0 +1,50 @@
+/*
+ * Saving the coverage of verilated models, see vcoverage.h.
+ */
+
+#include "vcoverage.h"
+
+#if VM_COVERAGE
+
+#include <cstdlib>
+#include <string>
+
+#include "verilated.h"
+#include "verilated_cov.h"
+
+static bool unsaved;
+static unsigned num_saves;
+
+void vcoverage_model_created(void) {
+    unsaved = 1;
+}
+
+void vcoverage_save(void) {
+    const char *env = getenv("VM_COVERAGE_FILE");
+    std::string path = env ? env : "coverage.dat";
+
+    if (!unsaved)
+        return;
+    if (num_saves) {
+        size_t ext = path.rfind(".dat");
+        if (ext == std::string::npos)
+            ext = path.size();
+        path.insert(ext, "-" + std::to_string(num_saves));
+    }
+    num_saves++;
+
+    VerilatedCovContext *cov = Verilated::defaultContextp()->coveragep();
+    cov->write(path.c_str());
+    cov->clear();
+    unsaved = 0;
+}
+
+#else
+
+void vcoverage_model_created(void) {
+}
+
+void vcoverage_save(void) {
+}
+
+#endif
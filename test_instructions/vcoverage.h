@@ -0,0 +1,27 @@
+#ifndef VCOVERAGE_H
+#define VCOVERAGE_H
+
+/*
+ * Line and toggle coverage of the verilated models, in builds with
+ * VM_COVERAGE=1 (COVERAGE=1 for make); no-ops otherwise.
+ *
+ * Coverage points live in the models and are dropped with them, so the counts
+ * of all models are written out when the first one is destroyed (the others
+ * must not run anymore by then). The file is $VM_COVERAGE_FILE, or
+ * coverage.dat; later saves in the same process (after creating new models)
+ * go to numbered files next to it (name-1.dat, ...), to be merged with
+ * verilator_coverage.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void vcoverage_model_created(void);
+void vcoverage_save(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
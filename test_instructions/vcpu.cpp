@@ -9,15 +9,25 @@ extern "C" {
 #include "common.h"
 #include "vcpu.h"
 }
+#include "vcoverage.h"
 
-static Vcpu *vcpu;
+struct vcpu {
+    Vcpu *top;
 
-static int num_mem_accesses;
-static struct mem_access mem_accesses[16];
+    const u8 *mem;
+    size_t mem_size;
+
+    int num_mem_accesses;
+    struct mem_access mem_accesses[16];
+
+    int num_bus_accesses;
+    struct bus_access bus_accesses[MAX_BUS_ACCESSES];
+};
 
 extern "C" {
 
-void vcpu_reset(struct state *state) {
+void vcpu_reset(struct vcpu *cpu, struct state *state) {
+    Vcpu *vcpu = cpu->top;
 #define S(name) vcpu->cpu__DOT__ ## name
     vcpu->clk = 0;
     S(halted) = 0;
@@ -40,10 +50,12 @@ void vcpu_reset(struct state *state) {
     S(stage) = 0; // RESET
     S(next_stage) = 2; // FETCH
 #undef S
-    num_mem_accesses = 0;
+    cpu->num_mem_accesses = 0;
+    cpu->num_bus_accesses = 0;
 }
 
-void vcpu_get_state(struct state *state) {
+void vcpu_get_state(struct vcpu *cpu, struct state *state) {
+    Vcpu *vcpu = cpu->top;
     state->PC = vcpu->dbg_pc;
     state->SP = vcpu->dbg_sp;
     state->reg16.AF = vcpu->dbg_AF;
@@ -52,13 +64,34 @@ void vcpu_get_state(struct state *state) {
     state->reg16.HL = vcpu->dbg_HL;
     state->halted = vcpu->cpu_is_halted;
     state->interrupts_master_enabled = vcpu->cpu__DOT__interrupts_master_enabled;
-    state->num_mem_accesses = num_mem_accesses;
-    memcpy(state->mem_accesses, mem_accesses, sizeof(mem_accesses));
+    state->num_mem_accesses = cpu->num_mem_accesses;
+    memcpy(state->mem_accesses, cpu->mem_accesses, sizeof(cpu->mem_accesses));
+    state->num_bus_accesses = cpu->num_bus_accesses;
+    memcpy(state->bus_accesses, cpu->bus_accesses, sizeof(cpu->bus_accesses));
+}
+
+/* Adds an access to the timeline of cpu; clock edge n of an instruction is in
+ * M-cycle n / 4. */
+static void bus_record(struct vcpu *cpu, int edge, int type, u16 addr, u8 val) {
+    if (cpu->num_bus_accesses < MAX_BUS_ACCESSES) {
+        struct bus_access *access = &cpu->bus_accesses[cpu->num_bus_accesses++];
+        access->cycle = edge / 4;
+        access->type = type;
+        access->addr = addr;
+        access->val = val;
+    }
 }
 
-int vcpu_step(void) {
+int vcpu_step(struct vcpu *cpu) {
+    Vcpu *vcpu = cpu->top;
     int cycles = 0;
+    u16 bus_addr = 0;
+    u8 bus_data = 0;
+
+    cpu->num_mem_accesses = 0;
+    cpu->num_bus_accesses = 0;
     do {
+        // $finish is global, so this stops all instances (in all threads).
         if (Verilated::gotFinish())
             return -1;
 
@@ -70,23 +103,52 @@ int vcpu_step(void) {
         if (vcpu->clk) {
             u16 addr = vcpu->mem_addr;
             u8 data = 0xaa;
-            if (addr < 4)
-                data = instruction_mem[addr];
+
+            // The edge that just happened latched what we drove on the last.
+            if (cpu_stage_reads_mem(vcpu->dbg_stage))
+                bus_record(cpu, cycles - 1, MEM_ACCESS_READ, bus_addr, bus_data);
+
+            if (addr < cpu->mem_size)
+                data = cpu->mem[addr];
             vcpu->mem_data_read = data;
+            bus_addr = addr;
+            bus_data = data;
 
             if (vcpu->mem_do_write) {
-                struct mem_access *access = &mem_accesses[num_mem_accesses++];
+                struct mem_access *access =
+                    &cpu->mem_accesses[cpu->num_mem_accesses++];
                 access->type = MEM_ACCESS_WRITE;
                 access->addr = vcpu->mem_addr;
                 access->val = vcpu->mem_data_write;
+                // Memory takes it on the next edge.
+                bus_record(cpu, cycles, MEM_ACCESS_WRITE, vcpu->mem_addr,
+                           vcpu->mem_data_write);
             }
         }
     } while (!vcpu->dbg_instruction_retired || vcpu->clk);
     return cycles;
 }
 
-void vcpu_init(void) {
-    vcpu = new Vcpu;
+void vcpu_set_interrupts(struct vcpu *cpu, u8 enabled, u8 request) {
+    cpu->top->interrupts_enabled = enabled & 0x1f;
+    cpu->top->interrupts_request = request & 0x1f;
+}
+
+struct vcpu *vcpu_create(const u8 *mem, size_t mem_size) {
+    struct vcpu *cpu = new struct vcpu;
+    cpu->top = new Vcpu;
+    cpu->mem = mem;
+    cpu->mem_size = mem_size;
+    cpu->num_mem_accesses = 0;
+    vcoverage_model_created();
+    return cpu;
+}
+
+void vcpu_destroy(struct vcpu *cpu) {
+    vcoverage_save();
+    cpu->top->final();
+    delete cpu->top;
+    delete cpu;
 }
 
 }
@@ -1,11 +1,32 @@
 #ifndef VCPU_H
 #define VCPU_H
 
+#include <stddef.h>
+
 #include "common.h"
 
-void vcpu_init(void);
-void vcpu_reset(struct state *state);
-void vcpu_get_state(struct state *state);
-int vcpu_step(void);
+/* Verilated cpu.v. Instances are independent, so they can be used from
+ * different threads. */
+struct vcpu;
+
+/* The CPU reads from mem[0..mem_size) (0xaa elsewhere), which the caller can
+ * change between steps. */
+struct vcpu *vcpu_create(const u8 *mem, size_t mem_size);
+void vcpu_destroy(struct vcpu *cpu);
+void vcpu_reset(struct vcpu *cpu, struct state *state);
+void vcpu_get_state(struct vcpu *cpu, struct state *state);
+int vcpu_step(struct vcpu *cpu);
+
+/* Stages of cpu.v (see there) that latch mem_data_read, i.e. end a read. */
+static inline bool cpu_stage_reads_mem(int stage) {
+    return stage == 3 ||                // DECODE
+           stage == 6 ||                // DECODE_CB3
+           stage == 10 || stage == 14 || // DECODE_IMM3, DECODE_IMM7
+           stage == 18 || stage == 22;  // LOAD_MEM3, LOAD_MEM7
+}
+
+/* Drives the IE and IF inputs of cpu.v (none by default). With IME set and an
+ * enabled interrupt requested, the next vcpu_step() dispatches it. */
+void vcpu_set_interrupts(struct vcpu *cpu, u8 enabled, u8 request);
 
 #endif
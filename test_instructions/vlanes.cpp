@@ -0,0 +1,179 @@
+/*
+ * Verilator wrapper for the lane-parallel cpu.v test bench (cpu_lanes.v, see
+ * gen_lanes.py). It is verilated with all modules inlined, so the internals of
+ * every lane are accessible on the top model just like vcpu.cpp accesses them.
+ */
+
+#include "verilated.h"
+#include "Vcpu_lanes.h"
+#include "cpu_lanes.h"
+
+extern "C" {
+#include "common.h"
+#include "vcpu.h"
+#include "vlanes.h"
+}
+#include "vcoverage.h"
+
+#define STAGE_WRITEBACK 41
+
+/* The ports and state of one cpu.v instance. */
+struct lane {
+    SData *mem_addr;
+    CData *mem_data_read, *mem_data_write, *mem_do_write;
+    SData *pc, *sp;
+    CData *reg_A, *reg_B, *reg_C, *reg_D, *reg_E, *reg_H, *reg_L;
+    CData *Z, *N, *H, *C;
+    CData *halted, *interrupts_master_enabled;
+    CData *stage, *next_stage;
+};
+
+struct vlanes {
+    Vcpu_lanes *top;
+    struct lane lanes[NUM_LANES];
+};
+
+#define S(i, name) &top->cpu_lanes__DOT__lane##i##__DOT__##name
+#define LANE(i) { \
+    &top->lane##i##_mem_addr, &top->lane##i##_mem_data_read, \
+    &top->lane##i##_mem_data_write, &top->lane##i##_mem_do_write, \
+    S(i, pc), S(i, sp), \
+    S(i, reg_A), S(i, reg_B), S(i, reg_C), S(i, reg_D), S(i, reg_E), \
+    S(i, reg_H), S(i, reg_L), \
+    S(i, Z), S(i, N), S(i, H), S(i, C), \
+    S(i, halted), S(i, interrupts_master_enabled), \
+    S(i, stage), S(i, next_stage) },
+
+static void lane_reset(struct lane *l, struct state *state) {
+    *l->halted = 0;
+    *l->interrupts_master_enabled = state->interrupts_master_enabled;
+    *l->pc = state->PC;
+    *l->sp = state->SP;
+    *l->reg_A = state->reg8.A;
+    *l->reg_B = state->reg8.B;
+    *l->reg_C = state->reg8.C;
+    *l->reg_D = state->reg8.D;
+    *l->reg_E = state->reg8.E;
+    *l->reg_H = state->reg8.H;
+    *l->reg_L = state->reg8.L;
+    *l->Z = BIT(state->reg8.F, 7);
+    *l->N = BIT(state->reg8.F, 6);
+    *l->H = BIT(state->reg8.F, 5);
+    *l->C = BIT(state->reg8.F, 4);
+
+    // Reset stage, otherwise we may add cycles coming out of halted state.
+    *l->stage = 0; // RESET
+    *l->next_stage = 2; // FETCH
+}
+
+static void lane_get_state(struct lane *l, struct state *state) {
+    state->PC = *l->pc;
+    state->SP = *l->sp;
+    state->reg8.A = *l->reg_A;
+    state->reg8.F = (*l->Z << 7) | (*l->N << 6) | (*l->H << 5) | (*l->C << 4);
+    state->reg8.B = *l->reg_B;
+    state->reg8.C = *l->reg_C;
+    state->reg8.D = *l->reg_D;
+    state->reg8.E = *l->reg_E;
+    state->reg8.H = *l->reg_H;
+    state->reg8.L = *l->reg_L;
+    state->halted = *l->halted;
+    state->interrupts_master_enabled = *l->interrupts_master_enabled;
+}
+
+extern "C" {
+
+int vlanes_run(struct vlanes *lanes, struct lane_test *tests, int num) {
+    Vcpu_lanes *top = lanes->top;
+    bool done[NUM_LANES] = { 0 };
+    u16 bus_addr[NUM_LANES] = { 0 };
+    u8 bus_data[NUM_LANES] = { 0 };
+    int remaining = num;
+
+    top->clk = 0;
+    for (int i = 0; i < num; i++) {
+        lane_reset(&lanes->lanes[i], &tests[i].in);
+        tests[i].out = tests[i].in;
+        tests[i].out.num_mem_accesses = 0;
+        tests[i].out.num_bus_accesses = 0;
+        tests[i].cycles = 0;
+    }
+
+    /* Same as vcpu_step(), for all lanes at once. Lanes that are done keep
+     * running, but are not looked at anymore. */
+    while (remaining) {
+        // $finish is global, so this stops all instances (in all threads).
+        if (Verilated::gotFinish())
+            return -1;
+
+        top->clk = !top->clk;
+        top->eval();
+
+        for (int i = 0; i < num; i++) {
+            struct lane *l = &lanes->lanes[i];
+            struct lane_test *t = &tests[i];
+
+            if (done[i])
+                continue;
+
+            if (top->clk) {
+                u16 addr = *l->mem_addr;
+                struct state *out = &t->out;
+                t->cycles++;
+
+                /* Timeline as in vcpu_step(). */
+                if (cpu_stage_reads_mem(*l->stage) &&
+                        out->num_bus_accesses < MAX_BUS_ACCESSES)
+                    out->bus_accesses[out->num_bus_accesses++] = {
+                        (t->cycles - 1) / 4, MEM_ACCESS_READ, bus_addr[i],
+                        bus_data[i] };
+
+                *l->mem_data_read = addr < LANE_MEM_SIZE ? t->mem[addr] : 0xaa;
+                bus_addr[i] = addr;
+                bus_data[i] = *l->mem_data_read;
+
+                if (*l->mem_do_write) {
+                    struct mem_access *access =
+                        &out->mem_accesses[out->num_mem_accesses++];
+                    access->type = MEM_ACCESS_WRITE;
+                    access->addr = addr;
+                    access->val = *l->mem_data_write;
+                    if (out->num_bus_accesses < MAX_BUS_ACCESSES)
+                        out->bus_accesses[out->num_bus_accesses++] = {
+                            t->cycles / 4, MEM_ACCESS_WRITE, addr,
+                            *l->mem_data_write };
+                }
+            } else if (*l->stage == STAGE_WRITEBACK) {
+                lane_get_state(l, &t->out);
+                done[i] = 1;
+                remaining--;
+            }
+        }
+    }
+    return 0;
+}
+
+struct vlanes *vlanes_create(void) {
+    struct vlanes *lanes = new struct vlanes;
+    Vcpu_lanes *top = new Vcpu_lanes;
+    struct lane init[NUM_LANES] = { FOR_EACH_LANE(LANE) };
+
+    lanes->top = top;
+    for (int i = 0; i < NUM_LANES; i++)
+        lanes->lanes[i] = init[i];
+    vcoverage_model_created();
+    return lanes;
+}
+
+void vlanes_destroy(struct vlanes *lanes) {
+    vcoverage_save();
+    lanes->top->final();
+    delete lanes->top;
+    delete lanes;
+}
+
+int vlanes_num(void) {
+    return NUM_LANES;
+}
+
+}
@@ -0,0 +1,31 @@
+#ifndef VLANES_H
+#define VLANES_H
+
+#include "common.h"
+
+/*
+ * Lane-parallel verilated cpu.v: one model with NUM_LANES independent CPUs
+ * sharing a clock (see gen_lanes.py), so the cost of every eval() is shared by
+ * that many tests. Each lane behaves like a struct vcpu running one
+ * instruction from a 4-byte memory.
+ */
+struct vlanes;
+
+#define LANE_MEM_SIZE 4
+
+struct lane_test {
+    u8 mem[LANE_MEM_SIZE];      // Reads outside of it return 0xaa
+    struct state in;
+    struct state out;           // Set by vlanes_run
+    int cycles;                 // Set by vlanes_run
+};
+
+struct vlanes *vlanes_create(void);
+void vlanes_destroy(struct vlanes *lanes);
+int vlanes_num(void);
+
+/* Runs one instruction on each of the first num (<= vlanes_num()) lanes, lane
+ * i with tests[i]. Returns -1 if the model called $finish. */
+int vlanes_run(struct vlanes *lanes, struct lane_test *tests, int num);
+
+#endif
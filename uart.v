@@ -0,0 +1,48 @@
+/*
+ * Transmit-only UART (8N1).
+ *
+ * A byte is latched when `start` is asserted while the transmitter is idle
+ * (`busy` low). The bit period is `clks_per_bit` cycles of `clk`.
+ */
+
+module uart_tx (
+    input clk,
+    input reset,
+
+    input start,
+    input [7:0] data,
+    output busy,
+
+    output tx
+);
+
+parameter clks_per_bit = 37; // 4.19 MHz / 115200 baud
+
+reg [9:0] shift;        // {stop, data[7:0], start}, shifted out LSB first
+reg [3:0] bits_left;
+reg [7:0] clk_cnt;
+
+assign busy = |bits_left;
+assign tx = busy ? shift[0] : 1'b1;
+
+always @(posedge clk) begin
+    if (reset) begin
+        shift <= 10'h3ff;
+        bits_left <= 0;
+        clk_cnt <= 0;
+    end else if (!busy) begin
+        if (start) begin
+            shift <= {1'b1, data, 1'b0};
+            bits_left <= 10;
+            clk_cnt <= clks_per_bit - 1;
+        end
+    end else if (|clk_cnt) begin
+        clk_cnt <= clk_cnt - 1;
+    end else begin
+        shift <= {1'b1, shift[9:1]};
+        bits_left <= bits_left - 1;
+        clk_cnt <= clks_per_bit - 1;
+    end
+end
+
+endmodule